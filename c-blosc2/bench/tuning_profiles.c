@@ -0,0 +1,271 @@
+/*********************************************************************
+  Benchmark for the tuning profiles in blosc2_cparams.
+
+  Shows the decompression speed and the compression ratio reached by
+  every tuning profile over the synthetic datasets used in bench.c.
+
+  Usage: tuning_profiles [compressor] [shuffle] [clevel] [nthreads] [test]
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(_WIN32)
+/* For QueryPerformanceCounter(), etc. */
+  #include <windows.h>
+#elif defined(__MACH__)
+  #include <mach/clock.h>
+  #include <mach/mach.h>
+  #include <time.h>
+  #include <sys/time.h>
+#elif defined(__unix__)
+  #include <unistd.h>
+  #if defined(__linux__)
+    #include <time.h>
+  #else
+    #include <sys/time.h>
+  #endif
+#else
+  #error Unable to detect platform.
+#endif
+
+#include "../blosc/blosc.h"
+
+#define KB  1024
+#define MB  (1024*KB)
+#define GB  (1024*MB)
+
+#define NPROFILES 3
+
+
+/* System-specific high-precision timing functions. */
+#if defined(_WIN32)
+
+/* The type of timestamp used on this system. */
+#define blosc_timestamp_t LARGE_INTEGER
+
+/* Set a timestamp value to the current time. */
+void blosc_set_timestamp(blosc_timestamp_t* timestamp) {
+  /* Ignore the return value, assume the call always succeeds. */
+  QueryPerformanceCounter(timestamp);
+}
+
+/* Given two timestamp values, return the difference in microseconds. */
+double blosc_elapsed_usecs(blosc_timestamp_t start_time, blosc_timestamp_t end_time) {
+  LARGE_INTEGER CounterFreq;
+  QueryPerformanceFrequency(&CounterFreq);
+
+  return (double)(end_time.QuadPart - start_time.QuadPart) / ((double)CounterFreq.QuadPart / 1e6);
+}
+
+#else
+
+/* The type of timestamp used on this system. */
+#define blosc_timestamp_t struct timespec
+
+/* Set a timestamp value to the current time. */
+void blosc_set_timestamp(blosc_timestamp_t* timestamp) {
+#ifdef __MACH__ // OS X does not have clock_gettime, use clock_get_time
+  clock_serv_t cclock;
+  mach_timespec_t mts;
+  host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
+  clock_get_time(cclock, &mts);
+  mach_port_deallocate(mach_task_self(), cclock);
+  timestamp->tv_sec = mts.tv_sec;
+  timestamp->tv_nsec = mts.tv_nsec;
+#else
+  clock_gettime(CLOCK_MONOTONIC, timestamp);
+#endif
+}
+
+/* Given two timestamp values, return the difference in microseconds. */
+double blosc_elapsed_usecs(blosc_timestamp_t start_time, blosc_timestamp_t end_time) {
+  return (1e6 * (end_time.tv_sec - start_time.tv_sec))
+      + (1e-3 * (end_time.tv_nsec - start_time.tv_nsec));
+}
+
+#endif
+
+
+/* Same synthetic data than in bench.c */
+int get_value(int i, int rshift) {
+  int v;
+
+  v = (i << 26) ^ (i << 18) ^ (i << 11) ^ (i << 3) ^ i;
+  if (rshift < 32) {
+    v &= (1 << rshift) - 1;
+  }
+  return v;
+}
+
+
+void init_buffer(void* src, int size, int rshift) {
+  unsigned int i;
+  int* _src = (int*)src;
+
+  for (i = 0; i < size / sizeof(int); ++i) {
+    _src[i] = get_value(i, rshift);
+  }
+}
+
+
+/* Run every profile for a dataset.  Returns 0 if all roundtrips are OK. */
+int do_bench(int compcode, int doshuffle, int clevel, int nthreads,
+             int size, int elsize, int rshift, int niter) {
+  const char* names[NPROFILES] = {"balanced", "decomp_speed", "ratio"};
+  int profiles[NPROFILES] = {BLOSC_TUNE_BALANCED, BLOSC_TUNE_DECOMP_SPEED,
+                             BLOSC_TUNE_RATIO};
+  void* src = malloc(size);
+  void* dest = malloc(size + BLOSC_MAX_OVERHEAD);
+  void* dest2 = malloc(size);
+  blosc_timestamp_t last, current;
+  int retcode = 0;
+
+  memset(src, 0, size);
+  init_buffer(src, size, rshift);
+
+  for (int p = 0; p < NPROFILES; p++) {
+    blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+    blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+    blosc2_blocksize_info info;
+    blosc2_context *cctx, *dctx;
+    double tcomp, tdecomp;
+    int cbytes = 0, nbytes = 0;
+    int flags;
+    size_t typesize;
+
+    cparams.compcode = compcode;
+    cparams.clevel = clevel;
+    cparams.typesize = (size_t)elsize;
+    cparams.nthreads = (uint32_t)nthreads;
+    cparams.filters[BLOSC_MAX_FILTERS - 1] = (uint8_t)doshuffle;
+    cparams.tuning = profiles[p];
+    cctx = blosc2_create_cctx(cparams);
+    dparams.nthreads = nthreads;
+    dctx = blosc2_create_dctx(dparams);
+
+    blosc_set_timestamp(&last);
+    for (int i = 0; i < niter; i++) {
+      cbytes = blosc2_compress_ctx(cctx, (size_t)size, src, dest,
+                                   (size_t)size + BLOSC_MAX_OVERHEAD);
+    }
+    blosc_set_timestamp(&current);
+    tcomp = blosc_elapsed_usecs(last, current) / niter;
+    blosc2_get_blocksize_info(cctx, &info);
+    blosc_cbuffer_metainfo(dest, &typesize, &flags);
+
+    blosc_set_timestamp(&last);
+    for (int i = 0; i < niter; i++) {
+      nbytes = blosc2_decompress_ctx(dctx, dest, dest2, (size_t)size);
+    }
+    blosc_set_timestamp(&current);
+    tdecomp = blosc_elapsed_usecs(last, current) / niter;
+
+    printf("%2d %8d %2d %2d  %-12s %8d %5s %7.2f %8.2f %8.2f",
+           nthreads, size, elsize, rshift, names[p], (int)info.blocksize,
+           (flags & 0x10) ? "no" : "yes", (double)size / cbytes,
+           (size * 1e6) / (tcomp * GB), (size * 1e6) / (tdecomp * GB));
+    if ((cbytes <= 0) || (nbytes != size) || memcmp(src, dest2, size) != 0) {
+      printf("  FAILED\n");
+      retcode = 1;
+    }
+    else {
+      printf("\n");
+    }
+
+    blosc2_free_ctx(cctx);
+    blosc2_free_ctx(dctx);
+  }
+
+  free(src);
+  free(dest);
+  free(dest2);
+  return retcode;
+}
+
+
+int main(int argc, char* argv[]) {
+  char* compressor = "blosclz";
+  char* shuffle = "shuffle";
+  int compcode, doshuffle;
+  int clevel = 5;
+  int nthreads = 1;
+  int test = 0;
+  int sizes[] = {256 * KB, 1 * MB, 4 * MB};
+  int elsizes[] = {1, 2, 4, 8};
+  int rshifts[] = {4, 19, 32};
+  int niter = 5;
+  int nsizes = 3;
+  int retcode = 0;
+  size_t l1, l2, l3;
+
+  if (argc >= 2) {
+    compressor = argv[1];
+  }
+  if (argc >= 3) {
+    shuffle = argv[2];
+  }
+  if (argc >= 4) {
+    clevel = atoi(argv[3]);
+  }
+  if (argc >= 5) {
+    nthreads = atoi(argv[4]);
+  }
+  if ((argc >= 6) && (strcmp(argv[5], "test") == 0)) {
+    /* Just a quick check of all the profiles */
+    test = 1;
+    niter = 1;
+    nsizes = 1;
+  }
+  if ((argc >= 7) || (clevel < 0) || (clevel > 9) || (nthreads < 1)) {
+    printf("Usage: tuning_profiles [blosclz | lz4 | lz4hc | lizard | snappy | "
+           "zlib | zstd] [noshuffle | shuffle | bitshuffle] [clevel] "
+           "[nthreads] [test]\n");
+    exit(1);
+  }
+
+  compcode = blosc_compname_to_compcode(compressor);
+  if (compcode < 0) {
+    printf("Compiled w/o support for compressor: '%s', so sorry.\n",
+           compressor);
+    exit(1);
+  }
+  if (strcmp(shuffle, "bitshuffle") == 0) {
+    doshuffle = BLOSC_BITSHUFFLE;
+  }
+  else if (strcmp(shuffle, "noshuffle") == 0) {
+    doshuffle = BLOSC_NOSHUFFLE;
+  }
+  else {
+    doshuffle = BLOSC_SHUFFLE;
+  }
+
+  blosc_init();
+
+  blosc_get_cache_sizes(&l1, &l2, &l3);
+  printf("Blosc version: %s (%s)\n", BLOSC_VERSION_STRING, BLOSC_VERSION_DATE);
+  printf("Caches: L1 %d KB, L2 %d KB, L3 %d KB\n",
+         (int)(l1 / KB), (int)(l2 / KB), (int)(l3 / KB));
+  printf("Using compressor: %s, shuffle: %s, clevel: %d\n",
+         compressor, shuffle, clevel);
+  printf("th     size es sb  profile      blocksize split   ratio"
+         "  comp GB/s decomp GB/s\n");
+
+  for (int s = 0; s < nsizes; s++) {
+    for (int e = 0; e < 4; e++) {
+      for (int r = 0; r < 3; r++) {
+        if (test && (r == 1)) {
+          continue;
+        }
+        retcode |= do_bench(compcode, doshuffle, clevel, nthreads, sizes[s],
+                            elsizes[e], rshifts[r], niter);
+      }
+    }
+  }
+
+  blosc_destroy();
+
+  return retcode;
+}
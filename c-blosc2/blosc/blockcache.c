@@ -0,0 +1,229 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "blockcache.h"
+
+/* The minimum number of hash buckets, and the bytes of budget per bucket */
+#define BLOCKCACHE_MINBUCKETS 64
+#define BLOCKCACHE_BUCKETBYTES (16 * 1024)
+
+typedef struct blockcache_entry {
+  const uint8_t* src;   /* the compressed buffer */
+  int32_t nblock;
+  uint64_t tag;         /* hash of the contents of `src` when cached */
+  size_t bsize;
+  uint8_t* block;       /* the decompressed block */
+  struct blockcache_entry* hnext;  /* next entry in the bucket */
+  struct blockcache_entry* prev;   /* LRU list, most recent first */
+  struct blockcache_entry* next;
+} blockcache_entry;
+
+struct blockcache_s {
+  size_t budget;
+  size_t nbytes;        /* bytes in the cached blocks */
+  size_t nbuckets;      /* always a power of 2 */
+  blockcache_entry** buckets;
+  blockcache_entry* head;
+  blockcache_entry* tail;
+};
+
+
+/* The bytes of the compressed block at each end that go in its tag */
+#define BLOCKCACHE_TAGBYTES 64
+
+static uint64_t fnv1a(uint64_t h, const uint8_t* p, size_t len) {
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ p[i]) * 0x100000001b3ULL;
+  }
+  return h;
+}
+
+
+/* Hash the parts of `src` that tell apart the contents of two buffers at
+   the same address: the header, the start and end of the block, and the
+   bytes at both ends of the compressed block (see README_HEADER.rst) */
+static uint64_t block_tag(const uint8_t* src, int32_t nblock) {
+  int32_t hlen = ((src[2] & 0x05) == 0x05) ? 32 : 16;
+  int32_t nbytes, blocksize, cbytes, nblocks;
+  int32_t start, end;
+  uint64_t h = 0xcbf29ce484222325ULL;
+
+  memcpy(&nbytes, src + 4, sizeof(int32_t));
+  memcpy(&blocksize, src + 8, sizeof(int32_t));
+  memcpy(&cbytes, src + 12, sizeof(int32_t));
+  nblocks = (blocksize > 0) ? (nbytes + blocksize - 1) / blocksize : 0;
+  h = fnv1a(h, src, (size_t)hlen);
+  memcpy(&start, src + hlen + nblock * sizeof(int32_t), sizeof(int32_t));
+  if (nblock + 1 < nblocks) {
+    memcpy(&end, src + hlen + (nblock + 1) * sizeof(int32_t),
+           sizeof(int32_t));
+  }
+  else {
+    end = cbytes;
+  }
+  h = fnv1a(h, (const uint8_t*)&start, sizeof(int32_t));
+  h = fnv1a(h, (const uint8_t*)&end, sizeof(int32_t));
+  if ((start < hlen) || (end > cbytes) || (start > end)) {
+    return h;
+  }
+  if (end - start <= 2 * BLOCKCACHE_TAGBYTES) {
+    return fnv1a(h, src + start, (size_t)(end - start));
+  }
+  h = fnv1a(h, src + start, BLOCKCACHE_TAGBYTES);
+  return fnv1a(h, src + end - BLOCKCACHE_TAGBYTES, BLOCKCACHE_TAGBYTES);
+}
+
+
+static size_t block_hash(const blockcache* cache, const uint8_t* src,
+                         int32_t nblock) {
+  uint64_t h = (uint64_t)(uintptr_t)src ^
+               ((uint64_t)nblock * 0x9e3779b97f4a7c15ULL);
+
+  h ^= h >> 29;
+  h *= 0xbf58476d1ce4e5b9ULL;
+  h ^= h >> 32;
+  return (size_t)h & (cache->nbuckets - 1);
+}
+
+
+blockcache* blockcache_new(size_t budget) {
+  blockcache* cache = calloc(1, sizeof(blockcache));
+
+  if (cache == NULL) {
+    return NULL;
+  }
+  cache->budget = budget;
+  cache->nbuckets = BLOCKCACHE_MINBUCKETS;
+  while (cache->nbuckets * BLOCKCACHE_BUCKETBYTES < budget) {
+    cache->nbuckets *= 2;
+  }
+  cache->buckets = calloc(cache->nbuckets, sizeof(blockcache_entry*));
+  if (cache->buckets == NULL) {
+    free(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+
+static void unlink_entry(blockcache* cache, blockcache_entry* entry) {
+  blockcache_entry** p = &cache->buckets[block_hash(cache, entry->src,
+                                                    entry->nblock)];
+
+  while (*p != entry) {
+    p = &(*p)->hnext;
+  }
+  *p = entry->hnext;
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  }
+  else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  }
+  else {
+    cache->tail = entry->prev;
+  }
+  cache->nbytes -= entry->bsize;
+  free(entry->block);
+  free(entry);
+}
+
+
+void blockcache_clear(blockcache* cache) {
+  while (cache->head != NULL) {
+    unlink_entry(cache, cache->head);
+  }
+}
+
+
+void blockcache_free(blockcache* cache) {
+  blockcache_clear(cache);
+  free(cache->buckets);
+  free(cache);
+}
+
+
+const uint8_t* blockcache_get(blockcache* cache, const uint8_t* src,
+                              int32_t nblock) {
+  blockcache_entry* entry = cache->buckets[block_hash(cache, src, nblock)];
+
+  while ((entry != NULL) && ((entry->src != src) ||
+                             (entry->nblock != nblock))) {
+    entry = entry->hnext;
+  }
+  if (entry == NULL) {
+    return NULL;
+  }
+  if (entry->tag != block_tag(src, nblock)) {
+    /* A different buffer lives at the same address now */
+    unlink_entry(cache, entry);
+    return NULL;
+  }
+
+  /* Move it to the front of the LRU list */
+  if (entry != cache->head) {
+    entry->prev->next = entry->next;
+    if (entry->next != NULL) {
+      entry->next->prev = entry->prev;
+    }
+    else {
+      cache->tail = entry->prev;
+    }
+    entry->prev = NULL;
+    entry->next = cache->head;
+    cache->head->prev = entry;
+    cache->head = entry;
+  }
+  return entry->block;
+}
+
+
+void blockcache_put(blockcache* cache, const uint8_t* src, int32_t nblock,
+                    const uint8_t* block, size_t bsize) {
+  blockcache_entry* entry;
+  size_t h;
+
+  if (bsize > cache->budget) {
+    return;
+  }
+  /* Evict the least recently used blocks */
+  while (cache->nbytes + bsize > cache->budget) {
+    unlink_entry(cache, cache->tail);
+  }
+
+  entry = malloc(sizeof(blockcache_entry));
+  if (entry == NULL) {
+    return;
+  }
+  entry->block = malloc(bsize);
+  if (entry->block == NULL) {
+    free(entry);
+    return;
+  }
+  memcpy(entry->block, block, bsize);
+  entry->src = src;
+  entry->nblock = nblock;
+  entry->tag = block_tag(src, nblock);
+  entry->bsize = bsize;
+  h = block_hash(cache, src, nblock);
+  entry->hnext = cache->buckets[h];
+  cache->buckets[h] = entry;
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = entry;
+  }
+  else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+  cache->nbytes += bsize;
+}
@@ -0,0 +1,33 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#ifndef BLOSC_BLOCKCACHE_H
+#define BLOSC_BLOCKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* A cache of decompressed blocks, keyed by the address of their buffer
+   and their number, with a memory budget and LRU eviction */
+typedef struct blockcache_s blockcache;
+
+/* NULL if the cache cannot be allocated, and then the blocks are just not
+   cached */
+blockcache* blockcache_new(size_t budget);
+
+void blockcache_free(blockcache* cache);
+
+void blockcache_clear(blockcache* cache);
+
+/* The decompressed `nblock` block of `src` (NULL if it is not cached) */
+const uint8_t* blockcache_get(blockcache* cache, const uint8_t* src,
+                              int32_t nblock);
+
+/* Keep a copy of the decompressed `nblock` block of `src` */
+void blockcache_put(blockcache* cache, const uint8_t* src, int32_t nblock,
+                    const uint8_t* block, size_t bsize);
+
+#endif  /* BLOSC_BLOCKCACHE_H */
@@ -71,11 +71,43 @@
 /* The maximum number of splits in a block for compression */
 #define MAX_SPLITS 16            /* Cannot be larger than 128 */
 
+/* Position of the chain length inside the extended header */
+#define CHAINLEN_POS (BLOSC_MIN_HEADER_LENGTH + 5)
+
+/* Separation between the two halves of the chain buffers */
+#define CHAIN_GAP 64
+
 /* Synchronization variables */
 
 /* Global context for non-contextual API */
-static blosc2_context* g_global_context;
-static pthread_mutex_t global_comp_mutex;
+/* Per-thread contexts for the non-contextual API.  The slots are owned by
+   their threads, and are linked so that blosc_destroy() can reach them. */
+struct tls_slot {
+  blosc2_context* context;
+  struct tls_slot* prev;
+  struct tls_slot* next;
+};
+static pthread_key_t g_tls_key;
+static pthread_mutex_t g_tls_mutex;  /* protects the list of slots */
+static struct tls_slot* g_tls_slots = NULL;
+static int g_tls_ready = 0;
+
+/* Snapshot of the environment variables honored by the non-contextual
+   API.  blosc_reload_env() replaces it under g_env_mutex, and the
+   compression calls copy it under the mutex too. */
+typedef struct blosc_env_s {
+  int clevel;             /* BLOSC_CLEVEL (-1 if not set) */
+  int doshuffle;          /* BLOSC_SHUFFLE (-1 if not set) */
+  int delta;              /* BLOSC_DELTA (-1 if not set) */
+  size_t typesize;        /* BLOSC_TYPESIZE (0 if not set) */
+  int compressor;         /* BLOSC_COMPRESSOR is set */
+  int compcode;           /* its code (-1 if not supported) */
+  size_t blocksize;       /* BLOSC_BLOCKSIZE (0 if not set) */
+  int nthreads;           /* BLOSC_NTHREADS (0 if not set) */
+  int nolock;             /* BLOSC_NOLOCK is set */
+} blosc_env;
+static blosc_env g_env;
+static pthread_mutex_t g_env_mutex;  /* protects g_env */
 static int g_compressor = BLOSC_BLOSCLZ;
 static int g_delta = 0;
 /* the compressor to use by default */
@@ -93,6 +125,30 @@ int blosc_release_threadpool(blosc2_context* context);
 
 /* Macros for synchronization */
 
+/* Count the thread in and wait for the last one, which releases all of
+   them.  Waiters check the generation of the meeting, so that spurious
+   wakeups and fast threads reaching the next meeting are harmless.  The
+   threads of the pool are counted by `threads_started`, as `nthreads` can
+   change while they are idle. */
+#define WAIT_COUNT(NOT_LAST, COUNT, CONTEXT_PTR) \
+  do { \
+    int gen_; \
+    pthread_mutex_lock(&(CONTEXT_PTR)->count_threads_mutex); \
+    gen_ = (CONTEXT_PTR)->count_threads_gen; \
+    if (NOT_LAST) { \
+      COUNT; \
+      while (gen_ == (CONTEXT_PTR)->count_threads_gen) { \
+        pthread_cond_wait(&(CONTEXT_PTR)->count_threads_cv, \
+                          &(CONTEXT_PTR)->count_threads_mutex); \
+      } \
+    } \
+    else { \
+      (CONTEXT_PTR)->count_threads_gen++; \
+      pthread_cond_broadcast(&(CONTEXT_PTR)->count_threads_cv); \
+    } \
+    pthread_mutex_unlock(&(CONTEXT_PTR)->count_threads_mutex); \
+  } while (0)
+
 /* Wait until all threads are initialized */
 #ifdef _POSIX_BARRIERS_MINE
 #define WAIT_INIT(RET_VAL, CONTEXT_PTR)  \
@@ -103,16 +159,8 @@ int blosc_release_threadpool(blosc2_context* context);
   }
 #else
 #define WAIT_INIT(RET_VAL, CONTEXT_PTR)   \
-  pthread_mutex_lock(&(CONTEXT_PTR)->count_threads_mutex); \
-  if ((CONTEXT_PTR)->count_threads < (CONTEXT_PTR)->nthreads) { \
-    (CONTEXT_PTR)->count_threads++;  \
-    pthread_cond_wait(&(CONTEXT_PTR)->count_threads_cv, \
-                      &(CONTEXT_PTR)->count_threads_mutex); \
-  } \
-  else { \
-    pthread_cond_broadcast(&(CONTEXT_PTR)->count_threads_cv); \
-  } \
-  pthread_mutex_unlock(&(CONTEXT_PTR)->count_threads_mutex);
+  WAIT_COUNT((CONTEXT_PTR)->count_threads < (CONTEXT_PTR)->threads_started, \
+             (CONTEXT_PTR)->count_threads++, CONTEXT_PTR)
 #endif
 
 /* Wait for all threads to finish */
@@ -125,16 +173,8 @@ int blosc_release_threadpool(blosc2_context* context);
   }
 #else
 #define WAIT_FINISH(RET_VAL, CONTEXT_PTR)                           \
-  pthread_mutex_lock(&(CONTEXT_PTR)->count_threads_mutex); \
-  if ((CONTEXT_PTR)->count_threads > 0) { \
-    (CONTEXT_PTR)->count_threads--; \
-    pthread_cond_wait(&(CONTEXT_PTR)->count_threads_cv, \
-                      &(CONTEXT_PTR)->count_threads_mutex); \
-  } \
-  else { \
-    pthread_cond_broadcast(&(CONTEXT_PTR)->count_threads_cv); \
-  } \
-  pthread_mutex_unlock(&(CONTEXT_PTR)->count_threads_mutex);
+  WAIT_COUNT((CONTEXT_PTR)->count_threads > 0, \
+             (CONTEXT_PTR)->count_threads--, CONTEXT_PTR)
 #endif
 
 
@@ -459,9 +499,11 @@ static int zlib_wrap_decompress(const char* input, size_t compressed_length,
 #endif /*  HAVE_ZLIB */
 
 #if defined(HAVE_ZSTD)
+/* `dict` is the previous block of a chain (NULL if there is none) */
 static int zstd_wrap_compress(struct thread_context* thread_context,
                               const char* input, size_t input_length,
-                              char* output, size_t maxout, int clevel) {
+                              char* output, size_t maxout, int clevel,
+                              const char* dict, size_t dictsize) {
   size_t code;
   clevel = (clevel < 9) ? clevel * 2 - 1 : ZSTD_maxCLevel();
   /* Make the level 8 close enough to maxCLevel */
@@ -470,8 +512,15 @@ static int zstd_wrap_compress(struct thread_context* thread_context,
     thread_context->zstd_cctx = ZSTD_createCCtx();
   }
 
-  code = ZSTD_compressCCtx(thread_context->zstd_cctx,
-      (void*)output, maxout, (void*)input, input_length, clevel);
+  if (dict != NULL) {
+    code = ZSTD_compress_usingDict(thread_context->zstd_cctx,
+        (void*)output, maxout, (void*)input, input_length,
+        (void*)dict, dictsize, clevel);
+  }
+  else {
+    code = ZSTD_compressCCtx(thread_context->zstd_cctx,
+        (void*)output, maxout, (void*)input, input_length, clevel);
+  }
   if (ZSTD_isError(code) != ZSTD_error_no_error) {
     return 0;
   }
@@ -480,13 +529,21 @@ static int zstd_wrap_compress(struct thread_context* thread_context,
 
 static int zstd_wrap_decompress(struct thread_context* thread_context,
                                 const char* input, size_t compressed_length,
-                                char* output, size_t maxout) {
+                                char* output, size_t maxout,
+                                const char* dict, size_t dictsize) {
   size_t code;
   if (thread_context->zstd_dctx == NULL) {
     thread_context->zstd_dctx = ZSTD_createDCtx();
   }
-  code = ZSTD_decompressDCtx(thread_context->zstd_dctx,
-      (void*)output, maxout, (void*)input, compressed_length);
+  if (dict != NULL) {
+    code = ZSTD_decompress_usingDict(thread_context->zstd_dctx,
+        (void*)output, maxout, (void*)input, compressed_length,
+        (void*)dict, dictsize);
+  }
+  else {
+    code = ZSTD_decompressDCtx(thread_context->zstd_dctx,
+        (void*)output, maxout, (void*)input, compressed_length);
+  }
   if (ZSTD_isError(code) != ZSTD_error_no_error) {
     return 0;
   }
@@ -499,6 +556,17 @@ static int get_accel(const blosc2_context* context) {
   int clevel = context->clevel;
   size_t typesize = context->typesize;
 
+  if (context->tuning != BLOSC_TUNE_BALANCED) {
+    /* Compression speed does not matter: use the densest encodings */
+    if (context->compcode == BLOSC_LZ4) {
+      return 1;
+    }
+    if (context->compcode == BLOSC_LIZARD) {
+      /* Huffman (levels 40-49) gets the ratio but slows decompression */
+      return (context->tuning == BLOSC_TUNE_RATIO) ? 49 : 29;
+    }
+  }
+
   if (context->compcode == BLOSC_BLOSCLZ) {
     /* Compute the power of 2. See:
      * http://www.exploringbinary.com/ten-ways-to-check-if-an-integer-is-a-power-of-two-in-c/
@@ -543,6 +611,132 @@ static int get_accel(const blosc2_context* context) {
 }
 
 
+/* Whether a codec can keep its history between consecutive blocks */
+static int chain_supported(int compcode) {
+  return ((compcode == BLOSC_LZ4) || (compcode == BLOSC_LZ4HC) ||
+          (compcode == BLOSC_ZSTD));
+}
+
+
+/* The start of one of the two halves of the chain buffers.  The halves are
+   not contiguous so that codecs never see them as a single prefix. */
+static uint8_t* chainbuf_half(struct thread_context* thread_context,
+                              int half) {
+  return thread_context->chainbuf +
+         half * (thread_context->chainbufsize + CHAIN_GAP);
+}
+
+
+/* Make room for keeping the current and previous blocks of a chain */
+static int ensure_chainbuf(struct thread_context* thread_context,
+                           size_t blocksize) {
+  if (thread_context->chainbufsize < blocksize) {
+    if (thread_context->chainbuf != NULL) {
+      my_free(thread_context->chainbuf);
+    }
+    thread_context->chainbuf = my_malloc(2 * (blocksize + CHAIN_GAP));
+    if (thread_context->chainbuf == NULL) {
+      thread_context->chainbufsize = 0;
+      return -1;
+    }
+    thread_context->chainbufsize = blocksize;
+    thread_context->chainnext = -1;
+  }
+  return 0;
+}
+
+
+/* Compress a block that lives in the current half of the chain buffers,
+   using the previous half as codec history unless `first` is set. */
+static int chain_compress(struct thread_context* thread_context,
+                          size_t bsize, uint8_t* dest, size_t maxout,
+                          int accel, int first) {
+  blosc2_context* context = thread_context->parent_context;
+  const char* src = (char*)chainbuf_half(thread_context,
+                                         thread_context->chaincur);
+  const char* prev = (char*)chainbuf_half(thread_context,
+                                          1 - thread_context->chaincur);
+  int prevsize = first ? 0 : (int)thread_context->chainprev;
+  int cbytes;
+
+  switch (context->compcode) {
+#if defined(HAVE_LZ4)
+    case BLOSC_LZ4:
+      if (thread_context->lz4_stream == NULL) {
+        thread_context->lz4_stream = LZ4_createStream();
+      }
+      if (first) {
+        LZ4_resetStream(thread_context->lz4_stream);
+      }
+      else if (thread_context->chainresync) {
+        LZ4_loadDict(thread_context->lz4_stream, prev, prevsize);
+      }
+      cbytes = LZ4_compress_fast_continue(thread_context->lz4_stream, src,
+                                          (char*)dest, (int)bsize,
+                                          (int)maxout, accel);
+      break;
+    case BLOSC_LZ4HC:
+      if (thread_context->lz4hc_stream == NULL) {
+        thread_context->lz4hc_stream = LZ4_createStreamHC();
+      }
+      if (first || thread_context->chainresync) {
+        LZ4_resetStreamHC(thread_context->lz4hc_stream, context->clevel);
+        if (!first) {
+          LZ4_loadDictHC(thread_context->lz4hc_stream, prev, prevsize);
+        }
+      }
+      cbytes = LZ4_compress_HC_continue(thread_context->lz4hc_stream, src,
+                                        (char*)dest, (int)bsize, (int)maxout);
+      break;
+#endif /* HAVE_LZ4 */
+#if defined(HAVE_ZSTD)
+    case BLOSC_ZSTD:
+      cbytes = zstd_wrap_compress(thread_context, src, bsize, (char*)dest,
+                                  maxout, context->clevel,
+                                  first ? NULL : prev, (size_t)prevsize);
+      break;
+#endif /* HAVE_ZSTD */
+    default:
+      return -5;    /* signals no compression support */
+  }
+
+  /* A failed codec call leaves its history in an unknown state */
+  thread_context->chainresync = (cbytes <= 0);
+  return cbytes;
+}
+
+
+/* Decompress a chained block into the current half of the chain buffers */
+static int chain_decompress(struct thread_context* thread_context,
+                            int32_t compformat, const uint8_t* src,
+                            int32_t cbytes, size_t bsize, int first) {
+  char* dest = (char*)chainbuf_half(thread_context, thread_context->chaincur);
+  const char* prev = (char*)chainbuf_half(thread_context,
+                                          1 - thread_context->chaincur);
+  int prevsize = first ? 0 : (int)thread_context->chainprev;
+  int nbytes;
+
+  switch (compformat) {
+#if defined(HAVE_LZ4)
+    case BLOSC_LZ4_FORMAT:
+      nbytes = LZ4_decompress_safe_usingDict((char*)src, dest, cbytes,
+                                             (int)bsize, prev, prevsize);
+      break;
+#endif /* HAVE_LZ4 */
+#if defined(HAVE_ZSTD)
+    case BLOSC_ZSTD_FORMAT:
+      nbytes = zstd_wrap_decompress(thread_context, (char*)src,
+                                    (size_t)cbytes, dest, bsize,
+                                    first ? NULL : prev, (size_t)prevsize);
+      break;
+#endif /* HAVE_ZSTD */
+    default:
+      return -5;    /* signals no decompression support */
+  }
+  return nbytes;
+}
+
+
 int do_nothing(int8_t filter, char cmode) {
   if (cmode == 'c') {
     return (filter == BLOSC_NOFILTER);
@@ -574,10 +768,59 @@ int last_filter(const uint8_t* filters, char cmode) {
 }
 
 
+/* Put the `bsize` bytes of the block at `offset` of the buffer being
+   compressed in `dest`, making them with the prefilter if there is one */
+static int fill_block(blosc2_context* context, int32_t tid, size_t offset,
+                      size_t bsize, uint8_t* dest) {
+  blosc2_prefilter_params params;
+
+  if (context->prefilter == NULL) {
+    memcpy(dest, context->src + offset, bsize);
+    return 0;
+  }
+  params.user_data = context->prefilter_data;
+  params.in = (context->src != NULL) ? context->src + offset : NULL;
+  params.out = dest;
+  params.out_size = (int32_t)bsize;
+  params.out_typesize = (int32_t)context->typesize;
+  params.out_offset = (int32_t)offset;
+  params.tid = tid;
+  if (context->prefilter(&params) < 0) {
+    fprintf(stderr, "The prefilter failed for the block at %d\n",
+            (int)offset);
+    return -1;
+  }
+  return 0;
+}
+
+
+/* Fill `dest` with the whole buffer being compressed */
+static int fill_blocks(blosc2_context* context, uint8_t* dest) {
+  size_t bsize;
+
+  if (context->prefilter == NULL) {
+    memcpy(dest, context->src, context->sourcesize);
+    return 0;
+  }
+  for (size_t offset = 0; offset < context->sourcesize;
+       offset += context->blocksize) {
+    bsize = context->sourcesize - offset;
+    if (bsize > (size_t)context->blocksize) {
+      bsize = context->blocksize;
+    }
+    if (fill_block(context, 0, offset, bsize, dest + offset) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
 uint8_t* pipeline_c(blosc2_context* context, const size_t bsize,
                     const uint8_t* src, const size_t offset,
-                    uint8_t* dest, uint8_t* tmp, uint8_t* tmp2) {
-  uint8_t* _src = (uint8_t*)src + offset;
+                    const uint8_t* dref, uint8_t* dest, uint8_t* tmp,
+                    uint8_t* tmp2) {
+  uint8_t* _src = (uint8_t*)src;
   uint8_t* _tmp = tmp;
   uint8_t* _dest = dest;
   size_t typesize = context->typesize;
@@ -597,7 +840,7 @@ uint8_t* pipeline_c(blosc2_context* context, const size_t bsize,
           return NULL;
         break;
       case BLOSC_DELTA:
-        delta_encoder(src, offset, bsize, typesize, _src, _dest);
+        delta_encoder(dref, offset, bsize, typesize, _src, _dest);
         break;
       case BLOSC_TRUNC_PREC:
         truncate_precision(filters_meta[i], typesize, bsize, _src, _dest);
@@ -637,19 +880,63 @@ static int blosc_c(struct thread_context* thread_context, size_t bsize,
   const uint8_t* _src;
   uint8_t *_tmp = tmp, *_tmp2 = tmp2, *_tmp3 = thread_context->tmp4;
   int last_filter_index = last_filter(context->filters, 'c');
+  int chained = (context->chain > 1);
+  int first = 1;
+  const uint8_t* block = (src != NULL) ? src + offset : NULL;
+  const uint8_t* dref = src;
+
+  if (context->prefilter != NULL) {
+    /* The block is made right here, so it is compressed while in cache */
+    if (thread_context->filterbufsize < (size_t)context->blocksize) {
+      my_free(thread_context->filterbuf);
+      thread_context->filterbuf = my_malloc(context->blocksize);
+      if (thread_context->filterbuf == NULL) {
+        thread_context->filterbufsize = 0;
+        return -1;
+      }
+      thread_context->filterbufsize = (size_t)context->blocksize;
+    }
+    block = thread_context->filterbuf;
+    if (fill_block(context, thread_context->tid, offset, bsize,
+                   thread_context->filterbuf) < 0)
+      return -9;  // signals a problem with the filter pipeline
+    dref = (offset == 0) ? block : context->filter_dref;
+  }
+
+  if (context->zonemap_type != BLOSC_ZONEMAP_NONE) {
+    /* Side pass for the zone map, while the block is still in cache */
+    zonemap_compute(context->zonemap_type, block, bsize,
+                    &context->block_zonemaps[offset / context->blocksize]);
+  }
 
   if (last_filter_index >= 0) {
     /* Apply filter pipleline */
-    _src = pipeline_c(context, bsize, src, offset, _tmp, _tmp2, _tmp3);
+    _src = pipeline_c(context, bsize, block, offset, dref, _tmp, _tmp2,
+                      _tmp3);
     if (_src == NULL)
       return -9;  // signals a problem with the filter pipeline
   } else {
-    _src = src + offset;
+    _src = block;
   }
 
   /* Calculate acceleration for different compressors */
   accel = get_accel(context);
 
+  if (chained) {
+    /* Keep the codec input around as history for the next block */
+    int32_t nblock = (int32_t)(offset / context->blocksize);
+    if (ensure_chainbuf(thread_context, context->blocksize) < 0)
+      return -1;
+    first = ((nblock % context->chain) == 0);
+    if (!first && (thread_context->chainnext != nblock))
+      return -8;  // chained blocks must be compressed in order
+    thread_context->chaincur = 1 - thread_context->chaincur;
+    memcpy(chainbuf_half(thread_context, thread_context->chaincur),
+           _src, bsize);
+    _src = chainbuf_half(thread_context, thread_context->chaincur);
+    thread_context->chainnext = nblock + 1;
+  }
+
   /* The number of splits for this block */
   if (!dont_split && !leftoverblock) {
     nsplits = typesize;
@@ -674,7 +961,11 @@ static int blosc_c(struct thread_context* thread_context, size_t bsize,
         return 0;                  /* non-compressible block */
       }
     }
-    if (context->compcode == BLOSC_BLOSCLZ) {
+    if (chained) {
+      cbytes = chain_compress(thread_context, neblock, dest, maxout, accel,
+                              first);
+    }
+    else if (context->compcode == BLOSC_BLOSCLZ) {
       cbytes = blosclz_compress(context->clevel, _src + j * neblock,
                                 (int)neblock, dest, (int)maxout, accel);
     }
@@ -710,7 +1001,8 @@ static int blosc_c(struct thread_context* thread_context, size_t bsize,
     else if (context->compcode == BLOSC_ZSTD) {
       cbytes = zstd_wrap_compress(thread_context,
                                   (char*)_src + j * neblock, (size_t)neblock,
-                                  (char*)dest, (size_t)maxout, context->clevel);
+                                  (char*)dest, (size_t)maxout, context->clevel,
+                                  NULL, 0);
     }
   #endif /* HAVE_ZSTD */
 
@@ -745,14 +1037,20 @@ static int blosc_c(struct thread_context* thread_context, size_t bsize,
     ctbytes += cbytes;
   }  /* Closes j < nsplits */
 
+  if (chained) {
+    thread_context->chainprev = bsize;
+  }
+
   return ctbytes;
 }
 
 
-/* Process the filter pipeline (decompression mode) */
+/* Process the filter pipeline (decompression mode).  If `serial`, the
+   blocks are decoded one after another by the calling thread, so the delta
+   filter does not wait for another thread to decode block 0. */
 int pipeline_d(blosc2_context* context, const size_t bsize, uint8_t* dest,
                const size_t offset, uint8_t* src, uint8_t* tmp,
-               uint8_t* tmp2, int last_filter_index) {
+               uint8_t* tmp2, int last_filter_index, int serial) {
   size_t typesize = context->typesize;
   uint8_t* filters = context->filters;
   //uint8_t* filters_meta = context->filters_meta;
@@ -778,7 +1076,13 @@ int pipeline_d(blosc2_context* context, const size_t bsize, uint8_t* dest,
           errcode = bscount;
         break;
       case BLOSC_DELTA:
-        if (context->nthreads == 1) {
+        if (context->dref != NULL) {
+          /* Block 0 has been decoded apart into dref.  When it comes here
+             again, it is only to rebuild the history of chained blocks,
+             and its output is discarded. */
+          delta_decoder(context->dref, bsize, bsize, typesize, _dest);
+        }
+        else if (serial) {
           /* Serial mode */
           delta_decoder(dest, offset, bsize, typesize, _dest);
         } else {
@@ -824,11 +1128,11 @@ int pipeline_d(blosc2_context* context, const size_t bsize, uint8_t* dest,
 }
 
 
-/* Decompress & unshuffle a single block */
+/* Decompress & unshuffle a single block (see pipeline_d() for `serial`) */
 static int blosc_d(
     struct thread_context* thread_context, size_t bsize,
-    size_t leftoverblock, const uint8_t* src, uint8_t* dest, size_t offset,
-    uint8_t* tmp, uint8_t* tmp2) {
+    size_t leftoverblock, int32_t nblock, const uint8_t* src, uint8_t* dest,
+    size_t offset, uint8_t* tmp, uint8_t* tmp2, int serial) {
   blosc2_context* context = thread_context->parent_context;
   uint8_t* filters = context->filters;
   uint8_t *tmp3 = thread_context->tmp4;
@@ -845,8 +1149,22 @@ static int blosc_d(
   size_t typesize = context->typesize;
   char* compname;
   int last_filter_index = last_filter(filters, 'd');
+  int chained = (context->chain > 1);
+  int first = 1;
 
-  if ((last_filter_index >= 0) &&
+  if (chained) {
+    /* Codec output is kept as history for the next block in the chain */
+    if (ensure_chainbuf(thread_context, bsize) < 0)
+      return -1;
+    first = ((nblock % context->chain) == 0);
+    if (!first && (thread_context->chainnext != nblock))
+      return -8;  // chained blocks must be decompressed in order
+    thread_context->chaincur = 1 - thread_context->chaincur;
+    _dest = chainbuf_half(thread_context, thread_context->chaincur);
+    tmp2 = tmp;
+    tmp = _dest;
+  }
+  else if ((last_filter_index >= 0) &&
           (next_filter(filters, BLOSC_MAX_FILTERS, 'd') != BLOSC_DELTA)) {
    // We are making use of some filter, so use a temp for destination
    _dest = tmp;
@@ -874,7 +1192,11 @@ static int blosc_d(
       nbytes = (int32_t)neblock;
     }
     else {
-      if (compformat == BLOSC_BLOSCLZ_FORMAT) {
+      if (chained) {
+        nbytes = chain_decompress(thread_context, compformat, src, cbytes,
+                                  neblock, first);
+      }
+      else if (compformat == BLOSC_BLOSCLZ_FORMAT) {
         nbytes = blosclz_decompress(src, cbytes, _dest, (int)neblock);
       }
   #if defined(HAVE_LZ4)
@@ -905,7 +1227,8 @@ static int blosc_d(
       else if (compformat == BLOSC_ZSTD_FORMAT) {
         nbytes = zstd_wrap_decompress(thread_context,
                                       (char*)src, (size_t)cbytes,
-                                      (char*)_dest, (size_t)neblock);
+                                      (char*)_dest, (size_t)neblock,
+                                      NULL, 0);
       }
   #endif /*  HAVE_ZSTD */
       else {
@@ -929,9 +1252,22 @@ static int blosc_d(
     ntbytes += nbytes;
   } /* Closes j < nsplits */
 
+  if (chained) {
+    thread_context->chainprev = bsize;
+    thread_context->chainnext = nblock + 1;
+    if (last_filter_index < 0) {
+      memcpy(dest + offset, tmp, bsize);
+    }
+    else if (next_filter(filters, BLOSC_MAX_FILTERS, 'd') == BLOSC_DELTA) {
+      /* Delta works in-place over the destination */
+      memcpy(dest + offset, tmp, bsize);
+      tmp = dest + offset;
+    }
+  }
+
   if (last_filter_index >= 0) {
     int errcode = pipeline_d(context, bsize, dest, offset, tmp, tmp2, tmp3,
-                             last_filter_index);
+                             last_filter_index, serial);
     if (errcode < 0)
       return errcode;
   }
@@ -941,6 +1277,81 @@ static int blosc_d(
 }
 
 
+/* Hand the `bsize` bytes of the decompressed block at `offset` of the
+   buffer to the postfilter */
+static int run_postfilter(blosc2_context* context, int32_t tid,
+                          const uint8_t* block, size_t offset, size_t bsize) {
+  blosc2_postfilter_params params;
+
+  params.user_data = context->postfilter_data;
+  params.in = block;
+  params.out = (context->dest != NULL) ? context->dest + offset : NULL;
+  params.size = (int32_t)bsize;
+  params.typesize = (int32_t)context->typesize;
+  params.offset = (int32_t)offset;
+  params.tid = tid;
+  if (context->postfilter(&params) < 0) {
+    fprintf(stderr, "The postfilter failed for the block at %d\n",
+            (int)offset);
+    return -1;
+  }
+  return 0;
+}
+
+
+/* Decompress a block like blosc_d(), but through the postfilter if there is
+   one.  Then the block is decoded in the buffer of the thread, and it is
+   up to the postfilter to put it in `dest`. */
+static int decompress_block(
+    struct thread_context* thread_context, size_t bsize,
+    size_t leftoverblock, int32_t nblock, const uint8_t* src, uint8_t* dest,
+    size_t offset, uint8_t* tmp, uint8_t* tmp2, int serial) {
+  blosc2_context* context = thread_context->parent_context;
+  uint8_t* block;
+  int cbytes;
+
+  if (context->postfilter == NULL) {
+    return blosc_d(thread_context, bsize, leftoverblock, nblock, src, dest,
+                   offset, tmp, tmp2, serial);
+  }
+
+  if (thread_context->filterbufsize < (size_t)context->blocksize) {
+    my_free(thread_context->filterbuf);
+    thread_context->filterbuf = my_malloc(context->blocksize);
+    if (thread_context->filterbuf == NULL) {
+      thread_context->filterbufsize = 0;
+      return -1;
+    }
+    thread_context->filterbufsize = (size_t)context->blocksize;
+  }
+  block = thread_context->filterbuf;
+  if ((nblock == 0) && (context->dref != NULL)) {
+    /* The delta reference has been decoded before */
+    if (context->chain > 1) {
+      /* Only for the history of the next chained blocks */
+      cbytes = blosc_d(thread_context, bsize, leftoverblock, 0, src, block, 0,
+                       tmp, tmp2, serial);
+      if (cbytes < 0) {
+        return cbytes;
+      }
+    }
+    memcpy(block, context->dref, bsize);
+    cbytes = (int)bsize;
+  }
+  else {
+    cbytes = blosc_d(thread_context, bsize, leftoverblock, nblock, src, block,
+                     0, tmp, tmp2, serial);
+    if (cbytes < 0) {
+      return cbytes;
+    }
+  }
+  if (run_postfilter(context, thread_context->tid, block, offset, bsize) < 0) {
+    return -9;  // signals a problem with the filter pipeline
+  }
+  return cbytes;
+}
+
+
 /* Serial version for compression/decompression */
 static int serial_blosc(struct thread_context* thread_context) {
   blosc2_context* context = thread_context->parent_context;
@@ -964,10 +1375,12 @@ static int serial_blosc(struct thread_context* thread_context) {
     if (context->do_compress) {
       if (*(context->header_flags) & BLOSC_MEMCPYED) {
         /* We want to memcpy only */
-        memcpy(context->dest + BLOSC_MAX_OVERHEAD + j * context->blocksize,
-               context->src + j * context->blocksize,
-               bsize);
         cbytes = (int32_t)bsize;
+        if (fill_block(context, thread_context->tid, j * context->blocksize,
+                       bsize, context->dest + BLOSC_MAX_OVERHEAD +
+                              j * context->blocksize) < 0) {
+          cbytes = -9;
+        }
       }
       else {
         /* Regular compression */
@@ -990,9 +1403,10 @@ static int serial_blosc(struct thread_context* thread_context) {
       }
       else {
         /* Regular decompression */
-        cbytes = blosc_d(thread_context, bsize, leftoverblock,
-                         context->src + sw32_(context->bstarts + j * 4),
-                         context->dest, j * context->blocksize, tmp, tmp2);
+        cbytes = decompress_block(
+                thread_context, bsize, leftoverblock, (int32_t)j,
+                context->src + sw32_(context->bstarts + j * 4),
+                context->dest, j * context->blocksize, tmp, tmp2, 1);
       }
     }
     if (cbytes < 0) {
@@ -1045,6 +1459,20 @@ create_thread_context(blosc2_context* context, int32_t tid) {
   thread_context->tmp3 = thread_context->tmp + context->blocksize + ebsize;
   thread_context->tmp4 = thread_context->tmp + 2 * context->blocksize + ebsize;
   thread_context->tmpblocksize = (size_t)context->blocksize;
+  thread_context->chainbuf = NULL;
+  thread_context->chainbufsize = 0;
+  thread_context->deltabuf = NULL;
+  thread_context->deltabufsize = 0;
+  thread_context->filterbuf = NULL;
+  thread_context->filterbufsize = 0;
+  thread_context->chaincur = 0;
+  thread_context->chainprev = 0;
+  thread_context->chainnext = -1;
+  thread_context->chainresync = 0;
+  #if defined(HAVE_LZ4)
+  thread_context->lz4_stream = NULL;
+  thread_context->lz4hc_stream = NULL;
+  #endif
   #if defined(HAVE_ZSTD)
   thread_context->zstd_cctx = NULL;
   thread_context->zstd_dctx = NULL;
@@ -1055,6 +1483,21 @@ create_thread_context(blosc2_context* context, int32_t tid) {
 
 void free_thread_context(struct thread_context* thread_context) {
   my_free(thread_context->tmp);
+  if (thread_context->chainbuf != NULL) {
+    my_free(thread_context->chainbuf);
+  }
+  if (thread_context->deltabuf != NULL) {
+    my_free(thread_context->deltabuf);
+  }
+  my_free(thread_context->filterbuf);
+  #if defined(HAVE_LZ4)
+  if (thread_context->lz4_stream != NULL) {
+    LZ4_freeStream(thread_context->lz4_stream);
+  }
+  if (thread_context->lz4hc_stream != NULL) {
+    LZ4_freeStreamHC(thread_context->lz4hc_stream);
+  }
+  #endif
   #if defined(HAVE_ZSTD)
   if (thread_context->zstd_cctx != NULL) {
     ZSTD_freeCCtx(thread_context->zstd_cctx);
@@ -1098,6 +1541,312 @@ static int do_job(blosc2_context* context) {
 }
 
 
+/* Decompress the part of a block that falls in the range of a getitem
+   batch.  Blocks fully in the range go straight to the destination, the
+   ones at the edges (and the ones before the range, which are only
+   decoded as the history of chained blocks) go through tmp3. */
+static int getitem_block(struct thread_context* thread_context,
+                         struct blosc2_batch_s* batch, size_t nblock,
+                         size_t bsize, size_t leftoverblock) {
+  blosc2_context* context = thread_context->parent_context;
+  size_t bstart = nblock * context->blocksize;
+  size_t bstop = bstart + bsize;
+  size_t start = (bstart > batch->start) ? bstart : batch->start;
+  size_t stop = (bstop < batch->stop) ? bstop : batch->stop;
+  uint8_t* scratch = thread_context->tmp3;
+  int full = (start == bstart) && (stop == bstop);
+  int32_t cbytes;
+
+  if ((nblock == 0) && (context->dref != NULL)) {
+    /* The delta reference has been decoded before the dispatch */
+    if (context->chain > 1) {
+      cbytes = blosc_d(thread_context, bsize, leftoverblock, 0,
+                       context->src + sw32_(context->bstarts), scratch, 0,
+                       thread_context->tmp, thread_context->tmp2, 0);
+      if (cbytes < 0) {
+        return cbytes;
+      }
+    }
+    if (start < stop) {
+      memcpy(context->dest + (start - batch->start),
+             context->dref + (start - bstart), stop - start);
+    }
+  }
+  else {
+    cbytes = blosc_d(thread_context, bsize, leftoverblock, (int32_t)nblock,
+                     context->src + sw32_(context->bstarts + nblock * 4),
+                     full ? context->dest + (bstart - batch->start) : scratch,
+                     0, thread_context->tmp, thread_context->tmp2, 0);
+    if (cbytes < 0) {
+      return cbytes;
+    }
+    if (!full && (start < stop)) {
+      memcpy(context->dest + (start - batch->start),
+             scratch + (start - bstart), stop - start);
+    }
+  }
+
+  if (start < stop) {
+    pthread_mutex_lock(&batch->mutex);
+    context->output_bytes += stop - start;
+    pthread_mutex_unlock(&batch->mutex);
+  }
+  return 1;
+}
+
+
+/* Compress or decompress a block of a batch buffer.  Returns 1 if
+   succeeds, 0 if the buffer cannot be compressed and a negative value on
+   errors. */
+static int batch_block(struct thread_context* thread_context,
+                       struct blosc2_batch_s* batch, size_t nblock) {
+  blosc2_context* context = thread_context->parent_context;
+  size_t bsize = context->blocksize;
+  size_t leftoverblock = 0;
+  size_t ebsize, ntdest;
+  int32_t cbytes;
+
+  if ((nblock == context->nblocks - 1) && (context->leftover > 0)) {
+    bsize = context->leftover;
+    leftoverblock = 1;
+  }
+
+  if (!context->do_compress && (batch->stop > 0)) {
+    return getitem_block(thread_context, batch, nblock, bsize, leftoverblock);
+  }
+  if (!context->do_compress) {
+    cbytes = decompress_block(
+            thread_context, bsize, leftoverblock, (int32_t)nblock,
+            context->src + sw32_(context->bstarts + nblock * 4),
+            context->dest, nblock * context->blocksize,
+            thread_context->tmp, thread_context->tmp2, 0);
+    if (cbytes < 0) {
+      return cbytes;
+    }
+    pthread_mutex_lock(&batch->mutex);
+    context->output_bytes += cbytes;
+    pthread_mutex_unlock(&batch->mutex);
+    return 1;
+  }
+
+  ebsize = context->blocksize + context->typesize * sizeof(int32_t);
+  cbytes = blosc_c(thread_context, bsize, leftoverblock, 0, ebsize,
+                   context->src, nblock * context->blocksize,
+                   thread_context->tmp2, thread_context->tmp,
+                   thread_context->tmp3);
+  if (cbytes < 0) {
+    return cbytes;
+  }
+  /* Reserve the room for the block in the destination */
+  pthread_mutex_lock(&batch->mutex);
+  ntdest = context->output_bytes;
+  if ((cbytes == 0) || (ntdest + cbytes > context->destsize)) {
+    pthread_mutex_unlock(&batch->mutex);
+    return 0;
+  }
+  _sw32(context->bstarts + nblock * 4, (int32_t)ntdest);
+  context->output_bytes += cbytes;
+  pthread_mutex_unlock(&batch->mutex);
+  memcpy(context->dest + ntdest, thread_context->tmp2, cbytes);
+  return 1;
+}
+
+
+/* Claim and run the units of a batch until there are no more.  This runs
+   in every thread of the pool, or in the caller for serial batches. */
+static void batch_worker(struct thread_context* thread_context,
+                         struct blosc2_batch_s* batch) {
+  blosc2_context* pool_context = thread_context->parent_context;
+  blosc2_context* context;
+  size_t blocksize = batch->blocksize;
+  size_t ebsize = blocksize + batch->typesize * sizeof(int32_t);
+  size_t nblock, lastblock, chainlen;
+  int32_t unit;
+  int lo, hi, mid;
+  int rc;
+
+  /* The temporaries must fit the blocks of any buffer */
+  if (thread_context->tmpblocksize < blocksize) {
+    my_free(thread_context->tmp);
+    thread_context->tmp = my_malloc(3 * blocksize + ebsize);
+    thread_context->tmp2 = thread_context->tmp + blocksize;
+    thread_context->tmp3 = thread_context->tmp + blocksize + ebsize;
+    thread_context->tmp4 = thread_context->tmp + 2 * blocksize + ebsize;
+    thread_context->tmpblocksize = blocksize;
+  }
+
+  while (1) {
+    pthread_mutex_lock(&batch->mutex);
+    unit = batch->next_unit++;
+    pthread_mutex_unlock(&batch->mutex);
+    if (unit >= batch->first_unit[batch->nbuffers]) {
+      break;
+    }
+
+    /* Find the buffer of this unit */
+    lo = 0;
+    hi = batch->nbuffers - 1;
+    while (lo < hi) {
+      mid = (lo + hi + 1) / 2;
+      if (batch->first_unit[mid] <= unit) {
+        lo = mid;
+      }
+      else {
+        hi = mid - 1;
+      }
+    }
+    context = &batch->shadows[lo];
+    if (context->thread_giveup_code <= 0) {
+      continue;
+    }
+
+    /* Chained blocks are always handled by the same thread */
+    chainlen = (context->chain > 1) ? (size_t)context->chain : 1;
+    nblock = (size_t)(unit - batch->first_unit[lo] + batch->skip_units) *
+             chainlen;
+    lastblock = nblock + chainlen;
+    if (lastblock > context->nblocks) {
+      lastblock = context->nblocks;
+    }
+    if ((batch->stop > 0) &&
+        (lastblock > (batch->stop - 1) / context->blocksize + 1)) {
+      /* Blocks after the range of a getitem batch */
+      lastblock = (batch->stop - 1) / context->blocksize + 1;
+    }
+    thread_context->parent_context = context;
+    for (; nblock < lastblock; nblock++) {
+      rc = batch_block(thread_context, batch, nblock);
+      if (rc <= 0) {
+        pthread_mutex_lock(&batch->mutex);
+        if (context->thread_giveup_code > 0) {
+          context->thread_giveup_code = rc;
+        }
+        pthread_mutex_unlock(&batch->mutex);
+        /* Do not leave other blocks waiting for the delta reference */
+        pthread_mutex_lock(&context->delta_mutex);
+        context->dref_not_init = 0;
+        pthread_cond_broadcast(&context->delta_cv);
+        pthread_mutex_unlock(&context->delta_mutex);
+        break;
+      }
+    }
+    thread_context->parent_context = pool_context;
+  }
+}
+
+
+/* Create a batch of `nbuffers` shadow contexts of `context` (NULL if the
+   memory cannot be allocated) */
+static struct blosc2_batch_s* batch_new(blosc2_context* context,
+                                        int nbuffers) {
+  struct blosc2_batch_s* batch;
+
+  batch = (struct blosc2_batch_s*)calloc(1, sizeof(struct blosc2_batch_s));
+  if (batch == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  batch->nbuffers = nbuffers;
+  batch->shadows = (blosc2_context*)my_malloc(
+          (nbuffers > 0 ? nbuffers : 1) * sizeof(blosc2_context));
+  batch->first_unit = (int32_t*)calloc((size_t)nbuffers + 1, sizeof(int32_t));
+  if ((batch->shadows == NULL) || (batch->first_unit == NULL)) {
+    if (batch->first_unit == NULL) {
+      fprintf(stderr, "Error allocating memory!\n");
+    }
+    my_free(batch->shadows);
+    free(batch->first_unit);
+    free(batch);
+    return NULL;
+  }
+  pthread_mutex_init(&batch->mutex, NULL);
+  for (int i = 0; i < nbuffers; i++) {
+    blosc2_context* shadow = &batch->shadows[i];
+    memcpy(shadow, context, sizeof(blosc2_context));
+    /* Shadows only borrow the threads (and temporaries) of `context` */
+    shadow->serial_context = NULL;
+    shadow->threads = NULL;
+    shadow->threads_started = 0;
+    shadow->btune = NULL;
+    shadow->batch = NULL;
+    shadow->async = NULL;
+    shadow->blockcache = NULL;
+    shadow->zonemap_type = BLOSC_ZONEMAP_NONE;
+    shadow->block_zonemaps = NULL;
+    shadow->block_zonemaps_size = 0;
+    shadow->filter_dref = NULL;
+    shadow->filter_drefsize = 0;
+    shadow->dref = NULL;
+    shadow->thread_giveup_code = 1;
+    shadow->dref_not_init = 1;
+    pthread_mutex_init(&shadow->delta_mutex, NULL);
+    pthread_cond_init(&shadow->delta_cv, NULL);
+  }
+  return batch;
+}
+
+
+/* Register the units of the next buffer in the batch (0 if it is done
+   already, e.g. for memcpy'ed buffers or errors) */
+static void batch_add_units(struct blosc2_batch_s* batch, int nbuffer,
+                            int32_t nunits) {
+  blosc2_context* shadow = &batch->shadows[nbuffer];
+  size_t size;
+
+  batch->first_unit[nbuffer + 1] = batch->first_unit[nbuffer] + nunits;
+  if (nunits > 0) {
+    size = shadow->blocksize + shadow->typesize * sizeof(int32_t);
+    if (size > batch->blocksize) {
+      batch->blocksize = size;
+    }
+    if (shadow->typesize > batch->typesize) {
+      batch->typesize = shadow->typesize;
+    }
+  }
+}
+
+
+/* Run all the units of a batch in one dispatch of the pool of `context` */
+static void batch_run(blosc2_context* context, struct blosc2_batch_s* batch) {
+  int32_t nunits = batch->first_unit[batch->nbuffers];
+
+  if (nunits == 0) {
+    return;
+  }
+  if ((context->nthreads > 1) && (nunits > 1)) {
+    if (blosc_set_nthreads_(context) < 0) {
+      return;
+    }
+    context->batch = batch;
+    parallel_blosc(context);
+    context->batch = NULL;
+  }
+  else {
+    if (context->serial_context == NULL) {
+      context->serial_context = create_thread_context(context, 0);
+    }
+    batch_worker(context->serial_context, batch);
+  }
+}
+
+
+static void batch_free(struct blosc2_batch_s* batch) {
+  for (int i = 0; i < batch->nbuffers; i++) {
+    blosc2_context* shadow = &batch->shadows[i];
+    if (shadow->serial_context != NULL) {
+      free_thread_context(shadow->serial_context);
+    }
+    my_free(shadow->filter_dref);
+    pthread_mutex_destroy(&shadow->delta_mutex);
+    pthread_cond_destroy(&shadow->delta_cv);
+  }
+  pthread_mutex_destroy(&batch->mutex);
+  my_free(batch->shadows);
+  free(batch->first_unit);
+  free(batch);
+}
+
+
 uint8_t filters_to_flags(const uint8_t* filters) {
   uint8_t flags = 0;
 
@@ -1122,6 +1871,9 @@ uint8_t filters_to_flags(const uint8_t* filters) {
 
 void flags_to_filters(const uint8_t flags, uint8_t* filters) {
 
+  /* Blosc-1 buffers have no other filters */
+  memset(filters, 0, BLOSC_MAX_FILTERS);
+
   /* Fill the end part of the filter pipeline */
   if (flags & BLOSC_DOSHUFFLE)
     filters[BLOSC_MAX_FILTERS - 1] = BLOSC_SHUFFLE;
@@ -1157,6 +1909,11 @@ static int initialize_context_compression(
   context->clevel = clevel;
   context->schunk = schunk;
 
+  if ((src == NULL) && (context->prefilter == NULL)) {
+    fprintf(stderr, "There is no source buffer nor a prefilter\n");
+    return -1;
+  }
+
   /* Check buffer size limits */
   if (sourcesize > BLOSC_MAX_BUFFERSIZE) {
     /* If buffer is too large, give up. */
@@ -1179,7 +1936,7 @@ static int initialize_context_compression(
   }
 
   /* Finally, tune some compression parameters */
-  context->blocksize = blocksize;
+  context->force_blocksize = blocksize;
   btune_cparams(context);
 
   /* Compute number of blocks in buffer */
@@ -1188,6 +1945,35 @@ static int initialize_context_compression(
   context->nblocks = (context->leftover > 0) ?
                      (context->nblocks + 1) : context->nblocks;
 
+  /* The prefilter makes block 0 beforehand when it is the reference for
+     delta */
+  if ((context->prefilter != NULL) &&
+      (context->filter_flags & BLOSC_DODELTA) && (sourcesize > 0)) {
+    if (context->filter_drefsize < (size_t)context->blocksize) {
+      my_free(context->filter_dref);
+      context->filter_dref = my_malloc(context->blocksize);
+      if (context->filter_dref == NULL) {
+        context->filter_drefsize = 0;
+        return -1;
+      }
+      context->filter_drefsize = (size_t)context->blocksize;
+    }
+    if (fill_block(context, 0, 0, (context->nblocks > 1) ?
+                   (size_t)context->blocksize : sourcesize,
+                   context->filter_dref) < 0) {
+      return -1;
+    }
+  }
+
+  /* Room for the zone maps of the blocks */
+  if ((context->zonemap_type != BLOSC_ZONEMAP_NONE) &&
+      (context->block_zonemaps_size < (int32_t)context->nblocks)) {
+    my_free(context->block_zonemaps);
+    context->block_zonemaps = (blosc2_zonemap*)my_malloc(
+            context->nblocks * sizeof(blosc2_zonemap));
+    context->block_zonemaps_size = (int32_t)context->nblocks;
+  }
+
   return 1;
 }
 
@@ -1213,6 +1999,11 @@ static uint8_t get_filter_flags(const uint8_t header_flags,
 static int initialize_context_decompression(
         blosc2_context* context, const void* src, void* dest, size_t destsize) {
 
+  if ((dest == NULL) && (context->postfilter == NULL)) {
+    fprintf(stderr, "There is no destination buffer nor a postfilter\n");
+    return -1;
+  }
+
   context->do_compress = 0;
   context->src = (const uint8_t*)src;
   context->dest = (uint8_t*)dest;
@@ -1234,12 +2025,14 @@ static int initialize_context_decompression(
       context->filters_meta[i] = filters_meta[i];
     }
     context->filter_flags = filters_to_flags(filters);
+    context->chain = context->src[CHAINLEN_POS];
     context->bstarts = (uint8_t*)(context->src + BLOSC_EXTENDED_HEADER_LENGTH);
   } else {
     /* Blosc-1 header */
     context->filter_flags = get_filter_flags(context->header_flags[0],
                                              context->typesize);
     flags_to_filters(context->header_flags[0], context->filters);
+    context->chain = 0;
     context->bstarts = (uint8_t*)(context->src + BLOSC_MIN_HEADER_LENGTH);
   }
 
@@ -1259,15 +2052,189 @@ static int initialize_context_decompression(
 }
 
 
+/* Decode block 0 apart when the postfilter takes the blocks of a delta
+   buffer, because then the other blocks cannot be decoded against the
+   destination */
+static int decode_postfilter_dref(blosc2_context* context) {
+  struct thread_context* thread_context;
+  size_t bsize = context->blocksize;
+  int delta = 0;
+  int cbytes;
+
+  for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
+    if (context->filters[i] == BLOSC_DELTA) {
+      delta = 1;
+    }
+  }
+  context->dref = NULL;
+  if ((context->postfilter == NULL) || !delta) {
+    return 0;
+  }
+
+  if (context->serial_context == NULL) {
+    context->serial_context = create_thread_context(context, 0);
+  }
+  else if (context->blocksize != context->serial_context->tmpblocksize) {
+    free_thread_context(context->serial_context);
+    context->serial_context = create_thread_context(context, 0);
+  }
+  thread_context = context->serial_context;
+  if (context->filter_drefsize < (size_t)context->blocksize) {
+    my_free(context->filter_dref);
+    context->filter_dref = my_malloc(context->blocksize);
+    if (context->filter_dref == NULL) {
+      context->filter_drefsize = 0;
+      return -1;
+    }
+    context->filter_drefsize = (size_t)context->blocksize;
+  }
+  if ((context->nblocks == 1) && (context->leftover > 0)) {
+    bsize = context->leftover;
+  }
+  /* Block 0 is its own reference, as in serial mode */
+  cbytes = blosc_d(thread_context, bsize, bsize < context->blocksize, 0,
+                   context->src + sw32_(context->bstarts),
+                   context->filter_dref, 0, thread_context->tmp,
+                   thread_context->tmp2, 1);
+  if (cbytes < 0) {
+    return cbytes;
+  }
+  context->dref = context->filter_dref;
+  return 0;
+}
+
+
+/* Hand the blocks of a memcpy'ed buffer to the postfilter */
+static int postfilter_memcpyed(blosc2_context* context) {
+  const uint8_t* src = context->src + BLOSC_MAX_OVERHEAD;
+  size_t bsize;
+
+  for (size_t offset = 0; offset < context->sourcesize;
+       offset += context->blocksize) {
+    bsize = context->sourcesize - offset;
+    if (bsize > (size_t)context->blocksize) {
+      bsize = context->blocksize;
+    }
+    if (run_postfilter(context, 0, src + offset, offset, bsize) < 0) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/* Compress a sample block both split and unsplit and return whether the
+   split gives a better ratio.  Returns a negative value on errors.
+
+   The sample is a whole block because codecs behave differently on
+   smaller inputs, and a partial block often leads to the wrong choice. */
+static int autosplit_block(blosc2_context* context) {
+  struct thread_context* thread_context;
+  uint8_t* header_flags = context->header_flags;
+  uint8_t saved_flags = *header_flags;
+  size_t sample, offset, maxbytes;
+  uint8_t* dest;
+  int32_t csize[2];
+
+  /* The block in the middle of the buffer (the first one if leftover) */
+  sample = context->blocksize;
+  offset = ((context->nblocks - 1) / 2) * sample;
+  if (offset + sample > context->sourcesize) {
+    offset = 0;
+    sample = context->sourcesize;
+  }
+
+  /* The serial context has the buffers and the codec contexts for a block */
+  if (context->serial_context == NULL) {
+    context->serial_context = create_thread_context(context, 0);
+  }
+  else if (context->blocksize != context->serial_context->tmpblocksize) {
+    free_thread_context(context->serial_context);
+    context->serial_context = create_thread_context(context, 0);
+  }
+  thread_context = context->serial_context;
+
+  maxbytes = sample + MAX_SPLITS * sizeof(int32_t);
+  dest = my_malloc(maxbytes);
+  if (dest == NULL) {
+    return -1;
+  }
+  for (int split = 0; split < 2; split++) {
+    *header_flags = (uint8_t)(saved_flags | (split ? 0 : 0x10));
+    csize[split] = blosc_c(thread_context, sample, 0, 0, maxbytes,
+                           context->src, offset, dest, thread_context->tmp,
+                           thread_context->tmp2);
+    if (csize[split] < 0) {
+      break;
+    }
+    if (csize[split] == 0) {
+      /* Non-compressible sample */
+      csize[split] = (int32_t)maxbytes;
+    }
+  }
+  *header_flags = saved_flags;
+  my_free(dest);
+
+  if ((csize[0] < 0) || (csize[1] < 0)) {
+    return (csize[0] < 0) ? csize[0] : csize[1];
+  }
+  /* Unsplit blocks decompress faster, so they win the ties */
+  return csize[1] < csize[0];
+}
+
+
 /* Conditions for splitting a block before compressing with a codec. */
-static int split_block(int compcode, size_t typesize, size_t blocksize) {
-  /* Normally all the compressors designed for speed benefit from a
-     split.  However, in conducted benchmarks LZ4 seems that it runs
-     faster if we don't split, which is quite surprising. */
-  return (((compcode == BLOSC_BLOSCLZ) ||
-           (compcode == BLOSC_SNAPPY)) &&
-          (typesize <= MAX_SPLITS) &&
-          (blocksize / typesize) >= BLOSC_MIN_BUFFERSIZE);
+static int split_block(blosc2_context* context, size_t typesize,
+                       size_t blocksize) {
+  int compcode = context->compcode;
+  int32_t key;
+  int split;
+
+  if ((typesize > MAX_SPLITS) ||
+      ((blocksize / typesize) < BLOSC_MIN_BUFFERSIZE)) {
+    return 0;
+  }
+  switch (context->splitmode) {
+    case BLOSC_ALWAYS_SPLIT:
+      return 1;
+    case BLOSC_NEVER_SPLIT:
+      return 0;
+    case BLOSC_AUTO_SPLIT:
+      if (*(context->header_flags) & BLOSC_MEMCPYED) {
+        return 0;
+      }
+      /* Super-chunks reuse the decision while the params do not change */
+      key = compcode | (context->clevel << 4) | ((int32_t)typesize << 8) |
+            (context->filter_flags << 16);
+      if ((context->schunk != NULL) && (context->autosplit >= 0) &&
+          (context->autosplit_key == key)) {
+        return context->autosplit;
+      }
+      split = autosplit_block(context);
+      if (split < 0) {
+        /* Let the actual compression report the error */
+        return 0;
+      }
+      context->autosplit = split;
+      context->autosplit_key = key;
+      return split;
+    default:
+      break;
+  }
+  switch (context->tuning) {
+    case BLOSC_TUNE_DECOMP_SPEED:
+      /* A single codec call per block is the fastest to decode */
+      return 0;
+    case BLOSC_TUNE_RATIO:
+      /* Split streams of shuffled bytes usually compress better */
+      return (typesize > 1) &&
+             (context->filter_flags & (BLOSC_DOSHUFFLE | BLOSC_DOBITSHUFFLE));
+    default:
+      /* Normally all the compressors designed for speed benefit from a
+         split.  However, in conducted benchmarks LZ4 seems that it runs
+         faster if we don't split, which is quite surprising. */
+      return ((compcode == BLOSC_BLOSCLZ) || (compcode == BLOSC_SNAPPY));
+  }
 }
 
 
@@ -1341,16 +2308,25 @@ static int write_compression_header(blosc2_context* context,
   context->dest[3] = (uint8_t)context->typesize;
   _sw32(context->dest + 4, (int32_t)context->sourcesize);
   _sw32(context->dest + 8, (int32_t)context->blocksize);
+  /* Block chains need the extended header and a codec keeping history */
+  context->chain = 0;
+  if (extended_header && (context->chainlen > 1) &&
+      chain_supported(context->compcode) && (context->nblocks > 1)) {
+    context->chain = (context->chainlen > BLOSC_MAX_CHAINLEN) ?
+                     BLOSC_MAX_CHAINLEN : context->chainlen;
+  }
   if (extended_header) {
     /* Mark that we are handling an extended header */
     *(context->header_flags) |= (BLOSC_DOSHUFFLE | BLOSC_DOBITSHUFFLE);
     /* Store filter pipeline info at the end of the header */
     uint8_t *filters = context->dest + BLOSC_MIN_HEADER_LENGTH;
     uint8_t *filters_meta = filters + 8;
+    memset(filters, 0, BLOSC_EXTENDED_HEADER_LENGTH - BLOSC_MIN_HEADER_LENGTH);
     for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
       filters[i] = context->filters[i];
       filters_meta[i] = context->filters_meta[i];
     }
+    context->dest[CHAINLEN_POS] = (uint8_t)context->chain;
     context->bstarts = context->dest + BLOSC_EXTENDED_HEADER_LENGTH;
     context->output_bytes = BLOSC_EXTENDED_HEADER_LENGTH +
             sizeof(int32_t) * context->nblocks;
@@ -1386,8 +2362,14 @@ static int write_compression_header(blosc2_context* context,
     *(context->header_flags) |= BLOSC_DODELTA;
   }
 
-  dont_split = !split_block(context->compcode, context->typesize,
-                            context->blocksize);
+  if (context->chain > 1) {
+    /* Chained blocks are compressed as a single stream each */
+    dont_split = 1;
+  }
+  else {
+    dont_split = !split_block(context, context->typesize,
+                              context->blocksize);
+  }
   *(context->header_flags) |= dont_split << 4;  /* dont_split is in bit 4 */
   *(context->header_flags) |= compformat << 5;  /* codec starts at bit 5 */
 
@@ -1426,8 +2408,9 @@ int blosc_compress_context(blosc2_context* context) {
       }
     }
     else if (context->sourcesize + BLOSC_MAX_OVERHEAD <= context->destsize) {
-      memcpy(context->dest + BLOSC_MAX_OVERHEAD, context->src,
-             context->sourcesize);
+      if (fill_blocks(context, context->dest + BLOSC_MAX_OVERHEAD) < 0) {
+        return -1;
+      }
       ntbytes = (int)context->sourcesize + BLOSC_MAX_OVERHEAD;
     }
   }
@@ -1453,7 +2436,7 @@ int blosc2_compress_ctx(blosc2_context* context, size_t nbytes,
   error = initialize_context_compression(
     context, nbytes, src, dest, destsize,
     context->clevel, context->filters, context->filters_meta,
-    context->typesize, context->compcode, context->blocksize,
+    context->typesize, context->compcode, context->force_blocksize,
     context->nthreads, context->schunk);
   if (error < 0) { return error; }
 
@@ -1463,6 +2446,21 @@ int blosc2_compress_ctx(blosc2_context* context, size_t nbytes,
 
   result = blosc_compress_context(context);
 
+  if ((result > 0) && (context->zonemap_type != BLOSC_ZONEMAP_NONE) &&
+      (*(context->header_flags) & BLOSC_MEMCPYED)) {
+    /* The blocks have not gone through blosc_c() */
+    for (size_t j = 0; j < context->nblocks; j++) {
+      size_t bsize = context->blocksize;
+      if ((j == context->nblocks - 1) && (context->leftover > 0)) {
+        bsize = context->leftover;
+      }
+      zonemap_compute(context->zonemap_type,
+                      context->dest + BLOSC_MAX_OVERHEAD +
+                      j * context->blocksize, bsize,
+                      &context->block_zonemaps[j]);
+    }
+  }
+
   return result;
 }
 
@@ -1480,104 +2478,221 @@ void build_filters(const int doshuffle, const int delta,
 }
 
 
-/* The public routine for compression.  See blosc.h for docstrings. */
-int blosc_compress(int clevel, int doshuffle, size_t typesize, size_t nbytes,
-                   const void* src, void* dest, size_t destsize) {
-  int error;
-  int result;
+/* Parse the environment variables into `env` */
+static void load_env(blosc_env* env) {
   char* envvar;
+  long value;
 
-  /* Check whether the library should be initialized */
-  if (!g_initlib) blosc_init();
+  memset(env, 0, sizeof(blosc_env));
+  env->clevel = -1;
+  env->doshuffle = -1;
+  env->delta = -1;
 
-  /* Check for a BLOSC_CLEVEL environment variable */
   envvar = getenv("BLOSC_CLEVEL");
   if (envvar != NULL) {
-    long value;
     value = strtol(envvar, NULL, 10);
     if ((value != EINVAL) && (value >= 0)) {
-      clevel = (int)value;
+      env->clevel = (int)value;
     }
   }
 
-  /* Check for a BLOSC_SHUFFLE environment variable */
   envvar = getenv("BLOSC_SHUFFLE");
   if (envvar != NULL) {
     if (strcmp(envvar, "NOSHUFFLE") == 0) {
-      doshuffle = BLOSC_NOSHUFFLE;
+      env->doshuffle = BLOSC_NOSHUFFLE;
     }
     if (strcmp(envvar, "SHUFFLE") == 0) {
-      doshuffle = BLOSC_SHUFFLE;
+      env->doshuffle = BLOSC_SHUFFLE;
     }
     if (strcmp(envvar, "BITSHUFFLE") == 0) {
-      doshuffle = BLOSC_BITSHUFFLE;
+      env->doshuffle = BLOSC_BITSHUFFLE;
     }
   }
 
-  /* Check for a BLOSC_DELTA environment variable */
   envvar = getenv("BLOSC_DELTA");
   if (envvar != NULL) {
-    if (strcmp(envvar, "1") == 0) {
-      blosc_set_delta(1);
-    } else {
-      blosc_set_delta(0);
-    }
+    env->delta = (strcmp(envvar, "1") == 0) ? 1 : 0;
   }
 
-  /* Check for a BLOSC_TYPESIZE environment variable */
   envvar = getenv("BLOSC_TYPESIZE");
   if (envvar != NULL) {
-    long value;
     value = strtol(envvar, NULL, 10);
     if ((value != EINVAL) && (value > 0)) {
-      typesize = (size_t)value;
+      env->typesize = (size_t)value;
     }
   }
 
-  /* Check for a BLOSC_COMPRESSOR environment variable */
   envvar = getenv("BLOSC_COMPRESSOR");
   if (envvar != NULL) {
-    result = blosc_set_compressor(envvar);
-    if (result < 0) { return result; }
+    env->compressor = 1;
+    env->compcode = blosc_compname_to_compcode(envvar);
   }
 
-  /* Check for a BLOSC_COMPRESSOR environment variable */
   envvar = getenv("BLOSC_BLOCKSIZE");
   if (envvar != NULL) {
-    long blocksize;
-    blocksize = strtol(envvar, NULL, 10);
-    if ((blocksize != EINVAL) && (blocksize > 0)) {
-      blosc_set_blocksize((size_t)blocksize);
+    value = strtol(envvar, NULL, 10);
+    if ((value != EINVAL) && (value > 0)) {
+      env->blocksize = (size_t)value;
     }
   }
 
-  /* Check for a BLOSC_NTHREADS environment variable */
   envvar = getenv("BLOSC_NTHREADS");
   if (envvar != NULL) {
-    long nthreads;
-    nthreads = strtol(envvar, NULL, 10);
-    if ((nthreads != EINVAL) && (nthreads > 0)) {
-      result = blosc_set_nthreads((int)nthreads);
-      if (result < 0) { return result; }
+    value = strtol(envvar, NULL, 10);
+    if ((value != EINVAL) && (value > 0)) {
+      env->nthreads = (int)value;
     }
   }
 
-  /* Check for a BLOSC_NOLOCK environment variable.  It is important
-     that this should be the last env var so that it can take the
-     previous ones into account */
-  envvar = getenv("BLOSC_NOLOCK");
-  if (envvar != NULL) {
-    char *compname;
+  env->nolock = (getenv("BLOSC_NOLOCK") != NULL);
+}
+
+
+void blosc_reload_env(void) {
+  blosc_env env;
+
+  /* Check whether the library should be initialized (this loads it too) */
+  if (!g_initlib) {
+    blosc_init();
+    return;
+  }
+
+  load_env(&env);
+  pthread_mutex_lock(&g_env_mutex);
+  g_env = env;
+  pthread_mutex_unlock(&g_env_mutex);
+}
+
+
+/* Copy the snapshot of the environment variables into `env` */
+static void get_env(blosc_env* env) {
+  pthread_mutex_lock(&g_env_mutex);
+  *env = g_env;
+  pthread_mutex_unlock(&g_env_mutex);
+}
+
+
+/* Release a per-thread context and its slot (called at thread exit) */
+static void tls_slot_free(void* ptr) {
+  struct tls_slot* slot = (struct tls_slot*)ptr;
+
+  pthread_mutex_lock(&g_tls_mutex);
+  if (slot->prev != NULL) {
+    slot->prev->next = slot->next;
+  }
+  else {
+    g_tls_slots = slot->next;
+  }
+  if (slot->next != NULL) {
+    slot->next->prev = slot->prev;
+  }
+  pthread_mutex_unlock(&g_tls_mutex);
+
+  if (slot->context != NULL) {
+    blosc2_free_ctx(slot->context);
+  }
+  free(slot);
+}
+
+
+/* Get the context of the calling thread for the non-contextual API,
+   creating it on the first call.  Contexts keep their pool of threads and
+   temporaries between calls, and no lock is taken once they exist. */
+static blosc2_context* tls_context(void) {
+  struct tls_slot* slot;
+  blosc2_context* context;
+
+  slot = (struct tls_slot*)pthread_getspecific(g_tls_key);
+  if (slot != NULL && slot->context != NULL) {
+    return slot->context;
+  }
+
+  if (slot == NULL) {
+    slot = (struct tls_slot*)calloc(1, sizeof(struct tls_slot));
+    if (slot == NULL || pthread_setspecific(g_tls_key, slot) != 0) {
+      fprintf(stderr, "Cannot create the context for this thread\n");
+      free(slot);
+      return NULL;
+    }
+    pthread_mutex_lock(&g_tls_mutex);
+    slot->next = g_tls_slots;
+    if (g_tls_slots != NULL) {
+      g_tls_slots->prev = slot;
+    }
+    g_tls_slots = slot;
+    pthread_mutex_unlock(&g_tls_mutex);
+  }
+
+  context = (blosc2_context*)my_malloc(sizeof(blosc2_context));
+  if (context == NULL) {
+    /* Do not leave an empty slot behind */
+    pthread_setspecific(g_tls_key, NULL);
+    tls_slot_free(slot);
+    return NULL;
+  }
+  memset(context, 0, sizeof(blosc2_context));
+  context->nthreads = g_nthreads;
+  context->autosplit = -1;
+  pthread_mutex_lock(&g_tls_mutex);
+  slot->context = context;
+  pthread_mutex_unlock(&g_tls_mutex);
+
+  return context;
+}
+
+
+/* The public routine for compression.  See blosc.h for docstrings. */
+int blosc_compress(int clevel, int doshuffle, size_t typesize, size_t nbytes,
+                   const void* src, void* dest, size_t destsize) {
+  int error;
+  int result;
+  blosc_env env;
+  blosc2_context* context;
+
+  /* Check whether the library should be initialized */
+  if (!g_initlib) blosc_init();
+
+  /* Apply the environment variables (see blosc_reload_env()).  Like
+     before, the ones for global settings act as calls to the setters. */
+  get_env(&env);
+  if (env.clevel >= 0) {
+    clevel = env.clevel;
+  }
+  if (env.doshuffle >= 0) {
+    doshuffle = env.doshuffle;
+  }
+  if ((env.delta >= 0) && (env.delta != g_delta)) {
+    g_delta = env.delta;
+  }
+  if (env.typesize > 0) {
+    typesize = env.typesize;
+  }
+  if (env.compressor) {
+    if (env.compcode < 0) { return env.compcode; }
+    if (env.compcode != g_compressor) {
+      g_compressor = env.compcode;
+    }
+  }
+  if ((env.blocksize > 0) && (env.blocksize != g_force_blocksize)) {
+    g_force_blocksize = env.blocksize;
+  }
+  if ((env.nthreads > 0) && (env.nthreads != g_nthreads)) {
+    result = blosc_set_nthreads(env.nthreads);
+    if (result < 0) { return result; }
+  }
+
+  /* BLOSC_NOLOCK compresses with a context of its own */
+  if (env.nolock) {
     blosc2_context *cctx;
     blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
 
-    blosc_compcode_to_compname(g_compressor, &compname);
     /* Create a context for compression */
     build_filters(doshuffle, g_delta, typesize, cparams.filters);
     cparams.typesize = (uint8_t)typesize;
     cparams.compcode = (uint8_t)g_compressor;
     cparams.clevel = (uint8_t)clevel;
     cparams.nthreads = (uint8_t)g_nthreads;
+    cparams.blocksize = g_force_blocksize;
     cctx = blosc2_create_cctx(cparams);
     /* Do the actual compression */
     result = blosc2_compress_ctx(cctx, nbytes, src, dest, destsize);
@@ -1586,29 +2701,27 @@ int blosc_compress(int clevel, int doshuffle, size_t typesize, size_t nbytes,
     return result;
   }
 
-  pthread_mutex_lock(&global_comp_mutex);
-
   /* Initialize a context compression */
-  uint8_t* filters = calloc(1, BLOSC_MAX_FILTERS);
-  uint8_t* filters_meta = calloc(1, BLOSC_MAX_FILTERS);
+  context = tls_context();
+  if (context == NULL) {
+    return -1;
+  }
+  uint8_t filters[BLOSC_MAX_FILTERS] = {0};
+  uint8_t filters_meta[BLOSC_MAX_FILTERS] = {0};
   build_filters(doshuffle, g_delta, typesize, filters);
   error = initialize_context_compression(
-    g_global_context, nbytes, src, dest, destsize, clevel, filters,
+    context, nbytes, src, dest, destsize, clevel, filters,
     filters_meta, typesize, g_compressor, g_force_blocksize, g_nthreads,
     g_schunk);
-  free(filters);
-  free(filters_meta);
   if (error < 0)
     return error;
 
   /* Write chunk header without extended header (Blosc1 compatibility mode) */
-  error = write_compression_header(g_global_context, 0);
+  error = write_compression_header(context, 0);
   if (error < 0)
     return error;
 
-  result = blosc_compress_context(g_global_context);
-
-  pthread_mutex_unlock(&global_comp_mutex);
+  result = blosc_compress_context(context);
 
   return result;
 }
@@ -1624,12 +2737,25 @@ int blosc_run_decompression_with_context(
 
   /* Check whether this buffer is memcpy'ed */
   if (*(context->header_flags) & BLOSC_MEMCPYED) {
-    memcpy(dest, (uint8_t*)src + BLOSC_MAX_OVERHEAD, context->sourcesize);
+    if (context->postfilter != NULL) {
+      if (postfilter_memcpyed(context) < 0) {
+        return -1;
+      }
+    }
+    else {
+      memcpy(dest, (uint8_t*)src + BLOSC_MAX_OVERHEAD, context->sourcesize);
+    }
     ntbytes = (int32_t)context->sourcesize;
   }
   else {
+    error = decode_postfilter_dref(context);
+    if (error < 0) {
+      return error;
+    }
     /* Do the actual decompression */
     ntbytes = do_job(context);
+    /* The reference is only valid for this buffer */
+    context->dref = NULL;
     if (ntbytes < 0) {
       return -1;
     }
@@ -1656,32 +2782,656 @@ int blosc2_decompress_ctx(
 }
 
 
+/* The layout of a scattered buffer */
+struct scatter_layout {
+  uint8_t* dest;             /* for strides */
+  int64_t stride;
+  const blosc2_iovec* iov;   /* for iovecs */
+  int iovcnt;
+  size_t* iovstarts;         /* the offset of every iovec in the buffer */
+};
+
+
+/* Copy the `size` bytes at `offset` of the buffer in the iovecs of `layout`
+   to `block` (gather) or the other way around */
+static void iov_copy(struct scatter_layout* layout, size_t offset,
+                     size_t size, uint8_t* block, int gather) {
+  size_t end = offset + size;
+  size_t start, n;
+  uint8_t* base;
+  int lo = 0;
+  int hi = layout->iovcnt - 1;
+  int mid;
+
+  /* Look for the last iovec starting at or before `offset` */
+  while (lo < hi) {
+    mid = (lo + hi + 1) / 2;
+    if (layout->iovstarts[mid] <= offset) {
+      lo = mid;
+    }
+    else {
+      hi = mid - 1;
+    }
+  }
+  for (int i = lo; (i < layout->iovcnt) && (offset < end); i++) {
+    start = layout->iovstarts[i];
+    if (offset >= start + layout->iov[i].len) {
+      continue;  /* empty iovecs */
+    }
+    n = start + layout->iov[i].len - offset;
+    n = (n < end - offset) ? n : end - offset;
+    base = (uint8_t*)layout->iov[i].base + (offset - start);
+    if (gather) {
+      memcpy(block, base, n);
+    }
+    else {
+      memcpy(base, block, n);
+    }
+    block += n;
+    offset += n;
+  }
+}
+
+
+/* Set up the offsets of the iovecs of `layout` and put their size in
+   `total`.  Returns 0 if succeeds, or -1 if the offsets cannot be kept. */
+static int iov_init(struct scatter_layout* layout, const blosc2_iovec* iov,
+                    int iovcnt, size_t* total) {
+  layout->iov = iov;
+  layout->iovcnt = iovcnt;
+  layout->iovstarts = malloc(iovcnt * sizeof(size_t));
+  if (layout->iovstarts == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return -1;
+  }
+  *total = 0;
+  for (int i = 0; i < iovcnt; i++) {
+    layout->iovstarts[i] = *total;
+    *total += iov[i].len;
+  }
+  return 0;
+}
+
+
+/* The postfilter scattering the items of every block */
+static int scatter_block(blosc2_postfilter_params* params) {
+  struct scatter_layout* layout = (struct scatter_layout*)params->user_data;
+  const uint8_t* in = params->in;
+  int32_t typesize = params->typesize;
+  int32_t nitems = params->size / typesize;
+  int64_t stride = layout->stride;
+  uint8_t* out;
+
+  if (layout->iov != NULL) {
+    iov_copy(layout, (size_t)params->offset, (size_t)params->size,
+             (uint8_t*)in, 0);
+    return 0;
+  }
+
+  out = layout->dest + (params->offset / typesize) * stride;
+  /* Constant sizes let the compiler turn the copies into moves */
+  switch (typesize) {
+    case 1:
+      for (int32_t i = 0; i < nitems; i++, in += 1, out += stride)
+        memcpy(out, in, 1);
+      break;
+    case 2:
+      for (int32_t i = 0; i < nitems; i++, in += 2, out += stride)
+        memcpy(out, in, 2);
+      break;
+    case 4:
+      for (int32_t i = 0; i < nitems; i++, in += 4, out += stride)
+        memcpy(out, in, 4);
+      break;
+    case 8:
+      for (int32_t i = 0; i < nitems; i++, in += 8, out += stride)
+        memcpy(out, in, 8);
+      break;
+    default:
+      for (int32_t i = 0; i < nitems; i++, in += typesize, out += stride)
+        memcpy(out, in, (size_t)typesize);
+  }
+  return 0;
+}
+
+
+/* The prefilter gathering every block from the iovecs */
+static int gather_block(blosc2_prefilter_params* params) {
+  struct scatter_layout* layout = (struct scatter_layout*)params->user_data;
+
+  iov_copy(layout, (size_t)params->out_offset, (size_t)params->out_size,
+           params->out, 1);
+  return 0;
+}
+
+
+/* Decompress `src` through the scatter postfilter */
+static int decompress_scattered(blosc2_context* context, const void* src,
+                                struct scatter_layout* layout) {
+  blosc2_postfilter_fn postfilter = context->postfilter;
+  void* postfilter_data = context->postfilter_data;
+  int32_t nbytes = sw32_((const uint8_t*)src + 4);
+  int result;
+
+  if (context->do_compress != 0) {
+    fprintf(stderr, "Context is not meant for decompression.  Giving up.\n");
+    return -10;
+  }
+  if (postfilter != NULL) {
+    fprintf(stderr, "Scattered destinations cannot be used with a "
+                    "postfilter\n");
+    return -1;
+  }
+
+  context->postfilter = scatter_block;
+  context->postfilter_data = layout;
+  result = blosc_run_decompression_with_context(context, src, NULL,
+                                                (size_t)nbytes);
+  context->postfilter = postfilter;
+  context->postfilter_data = postfilter_data;
+
+  return result;
+}
+
+
+/* Decompression into strided items.  See blosc.h for docstrings. */
+int blosc2_decompress_strided_ctx(blosc2_context* context, const void* src,
+                                  void* dest, int64_t stride) {
+  struct scatter_layout layout = {0};
+  const uint8_t* _src = (const uint8_t*)src;
+  int32_t typesize = _src[3];
+  int32_t nbytes = sw32_(_src + 4);
+  int32_t blocksize = sw32_(_src + 8);
+
+  if ((typesize == 0) || (nbytes % typesize != 0) ||
+      (blocksize % typesize != 0)) {
+    fprintf(stderr, "The buffer cannot be scattered by items of typesize "
+                    "('%d') bytes\n", typesize);
+    return -1;
+  }
+  if ((stride < typesize) && (stride > -typesize)) {
+    fprintf(stderr, "The stride ('%lld') is smaller than the typesize "
+                    "('%d')\n", (long long)stride, typesize);
+    return -1;
+  }
+
+  layout.dest = (uint8_t*)dest;
+  layout.stride = stride;
+  return decompress_scattered(context, src, &layout);
+}
+
+
+/* Decompression into iovecs.  See blosc.h for docstrings. */
+int blosc2_decompress_iov_ctx(blosc2_context* context, const void* src,
+                              const blosc2_iovec* iov, int iovcnt) {
+  struct scatter_layout layout = {0};
+  int32_t nbytes = sw32_((const uint8_t*)src + 4);
+  size_t total;
+  int result;
+
+  if (iovcnt <= 0) {
+    fprintf(stderr, "There are no iovecs for the destination\n");
+    return -1;
+  }
+  if (iov_init(&layout, iov, iovcnt, &total) < 0) {
+    return -1;
+  }
+  if (total < (size_t)nbytes) {
+    fprintf(stderr, "The iovecs are smaller than the buffer\n");
+    free(layout.iovstarts);
+    return -1;
+  }
+
+  result = decompress_scattered(context, src, &layout);
+  free(layout.iovstarts);
+  return result;
+}
+
+
+/* Compression from iovecs.  See blosc.h for docstrings. */
+int blosc2_compress_iov_ctx(blosc2_context* context, const blosc2_iovec* iov,
+                            int iovcnt, void* dest, size_t destsize) {
+  struct scatter_layout layout = {0};
+  blosc2_prefilter_fn prefilter = context->prefilter;
+  void* prefilter_data = context->prefilter_data;
+  size_t nbytes;
+  int result;
+
+  if (context->do_compress != 1) {
+    fprintf(stderr, "Context is not meant for compression.  Giving up.\n");
+    return -10;
+  }
+  if (prefilter != NULL) {
+    fprintf(stderr, "Gathered sources cannot be used with a prefilter\n");
+    return -1;
+  }
+  if (iovcnt <= 0) {
+    fprintf(stderr, "There are no iovecs for the source\n");
+    return -1;
+  }
+
+  if (iov_init(&layout, iov, iovcnt, &nbytes) < 0) {
+    return -1;
+  }
+  context->prefilter = gather_block;
+  context->prefilter_data = &layout;
+  result = blosc2_compress_ctx(context, nbytes, NULL, dest, destsize);
+  context->prefilter = prefilter;
+  context->prefilter_data = prefilter_data;
+  free(layout.iovstarts);
+
+  return result;
+}
+
+
+/* Compression of several buffers at once.  See blosc.h for docstrings. */
+int blosc2_compress_batch(blosc2_context* context, blosc2_batch_item* items,
+                          int nitems) {
+  struct blosc2_batch_s* batch;
+  blosc2_context* shadow;
+  size_t chainlen;
+  int32_t ntbytes;
+  int rc = 0;
+  int error;
+
+  if (context->do_compress != 1) {
+    fprintf(stderr, "Context is not meant for compression.  Giving up.\n");
+    return -10;
+  }
+  if (nitems < 0) {
+    fprintf(stderr, "The number of items ('%d') cannot be negative\n", nitems);
+    return -10;
+  }
+
+  /* Set up the params and the header of every buffer */
+  batch = batch_new(context, nitems);
+  if (batch == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < nitems; i++) {
+    shadow = &batch->shadows[i];
+    items[i].result = 0;
+    error = initialize_context_compression(
+      shadow, items[i].nbytes, items[i].src, items[i].dest,
+      items[i].destsize, context->clevel, context->filters,
+      context->filters_meta, context->typesize, context->compcode,
+      context->force_blocksize, context->nthreads, context->schunk);
+    if (error >= 0) {
+      error = write_compression_header(shadow, 1);
+    }
+    if (error < 0) {
+      items[i].result = error;
+      shadow->thread_giveup_code = error;
+      batch_add_units(batch, i, 0);
+      continue;
+    }
+    if (*(shadow->header_flags) & BLOSC_MEMCPYED) {
+      batch_add_units(batch, i, 0);
+      continue;
+    }
+    chainlen = (shadow->chain > 1) ? (size_t)shadow->chain : 1;
+    batch_add_units(batch, i,
+                    (int32_t)((shadow->nblocks + chainlen - 1) / chainlen));
+  }
+
+  batch_run(context, batch);
+
+  /* Finish the buffers, memcpy'ing the ones that cannot be compressed */
+  for (int i = 0; i < nitems; i++) {
+    shadow = &batch->shadows[i];
+    if (items[i].result < 0) {
+      rc = (rc < 0) ? rc : items[i].result;
+      continue;
+    }
+    if (shadow->thread_giveup_code < 0) {
+      items[i].result = -1;
+      rc = (rc < 0) ? rc : -1;
+      continue;
+    }
+    if (shadow->thread_giveup_code == 0) {
+      *(shadow->header_flags) |= BLOSC_MEMCPYED;
+    }
+    if (*(shadow->header_flags) & BLOSC_MEMCPYED) {
+      if (shadow->sourcesize + BLOSC_MAX_OVERHEAD > shadow->destsize) {
+        ntbytes = 0;
+      }
+      else if (fill_blocks(shadow, shadow->dest + BLOSC_MAX_OVERHEAD) < 0) {
+        items[i].result = -1;
+        rc = (rc < 0) ? rc : -1;
+        continue;
+      }
+      else {
+        ntbytes = (int32_t)shadow->sourcesize + BLOSC_MAX_OVERHEAD;
+      }
+    }
+    else {
+      ntbytes = (int32_t)shadow->output_bytes;
+    }
+    _sw32(shadow->dest + 12, ntbytes);
+    items[i].result = ntbytes;
+  }
+
+  batch_free(batch);
+  return rc;
+}
+
+
+/* Decompression of several buffers at once.  See blosc.h for docstrings. */
+int blosc2_decompress_batch(blosc2_context* context, blosc2_batch_item* items,
+                            int nitems) {
+  struct blosc2_batch_s* batch;
+  blosc2_context* shadow;
+  size_t chainlen;
+  int rc = 0;
+  int error;
+
+  if (context->do_compress != 0) {
+    fprintf(stderr, "Context is not meant for decompression.  Giving up.\n");
+    return -10;
+  }
+  if (nitems < 0) {
+    fprintf(stderr, "The number of items ('%d') cannot be negative\n", nitems);
+    return -10;
+  }
+
+  /* Read the header of every buffer */
+  batch = batch_new(context, nitems);
+  if (batch == NULL) {
+    return -1;
+  }
+  for (int i = 0; i < nitems; i++) {
+    shadow = &batch->shadows[i];
+    items[i].result = 0;
+    error = initialize_context_decompression(shadow, items[i].src,
+                                             items[i].dest, items[i].destsize);
+    if ((error >= 0) && (*(shadow->header_flags) & BLOSC_MEMCPYED)) {
+      if (shadow->postfilter != NULL) {
+        error = postfilter_memcpyed(shadow);
+      }
+      else {
+        memcpy(shadow->dest, shadow->src + BLOSC_MAX_OVERHEAD,
+               shadow->sourcesize);
+      }
+      if (error >= 0) {
+        shadow->output_bytes = shadow->sourcesize;
+        batch_add_units(batch, i, 0);
+        continue;
+      }
+    }
+    else if (error >= 0) {
+      error = decode_postfilter_dref(shadow);
+    }
+    if (error < 0) {
+      items[i].result = error;
+      shadow->thread_giveup_code = error;
+      batch_add_units(batch, i, 0);
+      continue;
+    }
+    chainlen = (shadow->chain > 1) ? (size_t)shadow->chain : 1;
+    batch_add_units(batch, i,
+                    (int32_t)((shadow->nblocks + chainlen - 1) / chainlen));
+  }
+
+  batch_run(context, batch);
+
+  for (int i = 0; i < nitems; i++) {
+    shadow = &batch->shadows[i];
+    if (items[i].result < 0) {
+      rc = (rc < 0) ? rc : items[i].result;
+      continue;
+    }
+    if (shadow->thread_giveup_code < 0) {
+      items[i].result = -1;
+      rc = (rc < 0) ? rc : -1;
+      continue;
+    }
+    items[i].result = (int)shadow->output_bytes;
+  }
+
+  batch_free(batch);
+  return rc;
+}
+
+
+/* The thread running the asynchronous requests of a context */
+static void* async_thread(void* arg) {
+  blosc2_context* context = (blosc2_context*)arg;
+  struct blosc2_async_s* async = context->async;
+  blosc2_request* request;
+  int result;
+
+  pthread_mutex_lock(&async->mutex);
+  while (1) {
+    while ((async->head == NULL) && !async->stop) {
+      pthread_cond_wait(&async->cond, &async->mutex);
+    }
+    if (async->head == NULL) {
+      break;
+    }
+    request = async->head;
+    async->head = request->next;
+    if (async->head == NULL) {
+      async->tail = NULL;
+    }
+    request->state = BLOSC2_REQUEST_RUNNING;
+    pthread_mutex_unlock(&async->mutex);
+
+    if (request->do_compress) {
+      result = blosc2_compress_ctx(context, request->nbytes, request->src,
+                                   request->dest, request->destsize);
+    }
+    else {
+      result = blosc2_decompress_ctx(context, request->src, request->dest,
+                                     request->destsize);
+    }
+    /* The request is not done (nor released) until the callback returns */
+    if (request->callback != NULL) {
+      request->callback(request, result, request->callback_data);
+    }
+
+    pthread_mutex_lock(&async->mutex);
+    request->result = result;
+    request->state = BLOSC2_REQUEST_DONE;
+    pthread_cond_broadcast(&async->cond);
+  }
+  pthread_mutex_unlock(&async->mutex);
+
+  return NULL;
+}
+
+
+/* Queue an asynchronous request in the context */
+static blosc2_request* submit_request(blosc2_context* context,
+                                      blosc2_request* request) {
+  struct blosc2_async_s* async = context->async;
+
+  if (async == NULL) {
+    async = (struct blosc2_async_s*)calloc(1, sizeof(struct blosc2_async_s));
+    if (async == NULL) {
+      fprintf(stderr, "Error allocating memory!\n");
+      free(request);
+      return NULL;
+    }
+    pthread_mutex_init(&async->mutex, NULL);
+    pthread_cond_init(&async->cond, NULL);
+    context->async = async;
+    if (pthread_create(&async->thread, NULL, async_thread, context) != 0) {
+      fprintf(stderr, "ERROR; could not create the thread for asynchronous "
+                      "requests\n");
+      pthread_mutex_destroy(&async->mutex);
+      pthread_cond_destroy(&async->cond);
+      free(async);
+      context->async = NULL;
+      free(request);
+      return NULL;
+    }
+  }
+
+  request->context = context;
+  request->state = BLOSC2_REQUEST_PENDING;
+  request->next = NULL;
+  pthread_mutex_lock(&async->mutex);
+  if (async->tail == NULL) {
+    async->head = request;
+  }
+  else {
+    async->tail->next = request;
+  }
+  async->tail = request;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->mutex);
+
+  return request;
+}
+
+
+blosc2_request* blosc2_compress_ctx_async(
+        blosc2_context* context, size_t nbytes, const void* src, void* dest,
+        size_t destsize, blosc2_callback callback, void* data) {
+  blosc2_request* request;
+
+  if (context->do_compress != 1) {
+    fprintf(stderr, "Context is not meant for compression.  Giving up.\n");
+    return NULL;
+  }
+
+  request = (blosc2_request*)calloc(1, sizeof(blosc2_request));
+  if (request == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  request->do_compress = 1;
+  request->nbytes = nbytes;
+  request->src = src;
+  request->dest = dest;
+  request->destsize = destsize;
+  request->callback = callback;
+  request->callback_data = data;
+  return submit_request(context, request);
+}
+
+
+blosc2_request* blosc2_decompress_ctx_async(
+        blosc2_context* context, const void* src, void* dest, size_t destsize,
+        blosc2_callback callback, void* data) {
+  blosc2_request* request;
+
+  if (context->do_compress != 0) {
+    fprintf(stderr, "Context is not meant for decompression.  Giving up.\n");
+    return NULL;
+  }
+
+  request = (blosc2_request*)calloc(1, sizeof(blosc2_request));
+  if (request == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  request->do_compress = 0;
+  request->src = src;
+  request->dest = dest;
+  request->destsize = destsize;
+  request->callback = callback;
+  request->callback_data = data;
+  return submit_request(context, request);
+}
+
+
+int blosc2_request_poll(blosc2_request* request) {
+  struct blosc2_async_s* async = request->context->async;
+  int done;
+
+  pthread_mutex_lock(&async->mutex);
+  done = (request->state == BLOSC2_REQUEST_DONE) ||
+         (request->state == BLOSC2_REQUEST_CANCELLED);
+  pthread_mutex_unlock(&async->mutex);
+  return done;
+}
+
+
+int blosc2_request_wait(blosc2_request* request) {
+  struct blosc2_async_s* async = request->context->async;
+  int result;
+
+  pthread_mutex_lock(&async->mutex);
+  while ((request->state != BLOSC2_REQUEST_DONE) &&
+         (request->state != BLOSC2_REQUEST_CANCELLED)) {
+    pthread_cond_wait(&async->cond, &async->mutex);
+  }
+  result = request->result;
+  pthread_mutex_unlock(&async->mutex);
+
+  free(request);
+  return result;
+}
+
+
+int blosc2_request_cancel(blosc2_request* request) {
+  struct blosc2_async_s* async = request->context->async;
+  blosc2_request* prev = NULL;
+  blosc2_request* r;
+  int cancelled = 0;
+
+  pthread_mutex_lock(&async->mutex);
+  if (request->state == BLOSC2_REQUEST_PENDING) {
+    /* Unlink it from the queue */
+    for (r = async->head; r != request; r = r->next) {
+      prev = r;
+    }
+    if (prev == NULL) {
+      async->head = request->next;
+    }
+    else {
+      prev->next = request->next;
+    }
+    if (async->tail == request) {
+      async->tail = prev;
+    }
+    request->state = BLOSC2_REQUEST_CANCELLED;
+    request->result = BLOSC2_REQUEST_CANCELLED_RESULT;
+    cancelled = 1;
+  }
+  pthread_mutex_unlock(&async->mutex);
+
+  return cancelled;
+}
+
+
+/* Run the pending requests and stop the thread of the requests */
+static void free_async(blosc2_context* context) {
+  struct blosc2_async_s* async = context->async;
+
+  pthread_mutex_lock(&async->mutex);
+  async->stop = 1;
+  pthread_cond_broadcast(&async->cond);
+  pthread_mutex_unlock(&async->mutex);
+  pthread_join(async->thread, NULL);
+
+  pthread_mutex_destroy(&async->mutex);
+  pthread_cond_destroy(&async->cond);
+  free(async);
+  context->async = NULL;
+}
+
+
 /* The public routine for decompression.  See blosc.h for docstrings. */
 int blosc_decompress(const void* src, void* dest, size_t destsize) {
   int result;
-  char* envvar;
-  long nthreads;
-  blosc2_context *dctx;
+  blosc_env env;
+  blosc2_context *dctx, *context;
   blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
 
   /* Check whether the library should be initialized */
   if (!g_initlib) blosc_init();
 
-  /* Check for a BLOSC_NTHREADS environment variable */
-  envvar = getenv("BLOSC_NTHREADS");
-  if (envvar != NULL) {
-    nthreads = strtol(envvar, NULL, 10);
-    if ((nthreads != EINVAL) && (nthreads > 0)) {
-      result = blosc_set_nthreads((int)nthreads);
-      if (result < 0) { return result; }
-    }
+  /* Apply the environment variables (see blosc_reload_env()) */
+  get_env(&env);
+  if ((env.nthreads > 0) && (env.nthreads != g_nthreads)) {
+    result = blosc_set_nthreads(env.nthreads);
+    if (result < 0) { return result; }
   }
 
-  /* Check for a BLOSC_NOLOCK environment variable.  It is important
-     that this should be the last env var so that it can take the
-     previous ones into account */
-  envvar = getenv("BLOSC_NOLOCK");
-  if (envvar != NULL) {
+  /* BLOSC_NOLOCK decompresses with a context of its own */
+  if (env.nolock) {
     dparams.nthreads = g_nthreads;
     dctx = blosc2_create_dctx(dparams);
     result = blosc2_decompress_ctx(dctx, src, dest, destsize);
@@ -1689,12 +3439,13 @@ int blosc_decompress(const void* src, void* dest, size_t destsize) {
     return result;
   }
 
-  pthread_mutex_lock(&global_comp_mutex);
-
-  result = blosc_run_decompression_with_context(
-          g_global_context, src, dest, destsize);
-
-  pthread_mutex_unlock(&global_comp_mutex);
+  context = tls_context();
+  if (context == NULL) {
+    return -1;
+  }
+  context->nthreads = g_nthreads;
+  context->schunk = g_schunk;
+  result = blosc_run_decompression_with_context(context, src, dest, destsize);
 
   return result;
 }
@@ -1716,6 +3467,12 @@ int _blosc_getitem(blosc2_context* context, const void* src, int start,
   int startb, stopb;
   int cbytes;
   int stop = start + nitems;
+  int chain = 0;
+  int lastj = -1;                   /* last block decoded in this call */
+  int delta = 0;
+  uint8_t* deltabuf = NULL;         /* decoded block 0, then block j */
+  blockcache* cache = context->blockcache;
+  const uint8_t* cached;
   size_t ebsize;
 
   _src = (uint8_t*)(src);
@@ -1737,12 +3494,14 @@ int _blosc_getitem(blosc2_context* context, const void* src, int start,
       context->filters[i] = filters[i];
       context->filters_meta[i] = filters_meta[i];
     }
+    chain = _src[CHAINLEN_POS];
     _src += BLOSC_EXTENDED_HEADER_LENGTH;
   } else {
     /* Minimal header */
     flags_to_filters(flags, context->filters);
     _src += BLOSC_MIN_HEADER_LENGTH;
   }
+  context->chain = chain;
   bstarts = _src;
   /* Compute some params */
   /* Total blocks */
@@ -1761,6 +3520,12 @@ int _blosc_getitem(blosc2_context* context, const void* src, int start,
     return -1;
   }
 
+  for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
+    if (context->filters[i] == BLOSC_DELTA) {
+      delta = 1;
+    }
+  }
+
   for (j = 0; j < nblocks; j++) {
     bsize = blocksize;
     leftoverblock = 0;
@@ -1804,16 +3569,96 @@ int _blosc_getitem(blosc2_context* context, const void* src, int start,
         scontext->tmpblocksize = blocksize;
       }
 
-      /* Regular decompression.  Put results in tmp2. */
-      cbytes = blosc_d(context->serial_context, bsize, leftoverblock,
+      /* Blocks decompressed by previous calls */
+      if (cache != NULL) {
+        cached = blockcache_get(cache, (uint8_t*)src, j);
+        if (cached != NULL) {
+          memcpy((uint8_t*)dest + ntbytes, cached + startb, bsize2);
+          ntbytes += (int)bsize2;
+          continue;
+        }
+      }
+
+      /* Delta blocks are decoded against block 0, which is kept at the
+         start of `deltabuf` (the block itself goes right after it) */
+      if (delta && (deltabuf == NULL)) {
+        size_t bsize0 = (nblocks == 1) ? bsize : blocksize;
+        if (scontext->deltabufsize < blocksize) {
+          if (scontext->deltabuf != NULL) {
+            my_free(scontext->deltabuf);
+          }
+          scontext->deltabuf = my_malloc(2 * blocksize);
+          if (scontext->deltabuf == NULL) {
+            scontext->deltabufsize = 0;
+            ntbytes = -1;
+            break;
+          }
+          scontext->deltabufsize = blocksize;
+        }
+        deltabuf = scontext->deltabuf;
+        cached = (cache != NULL) ? blockcache_get(cache, (uint8_t*)src, 0) :
+                 NULL;
+        if (cached != NULL) {
+          memcpy(deltabuf, cached, bsize0);
+        }
+        else {
+          cbytes = blosc_d(context->serial_context, bsize0,
+                           (nblocks == 1) ? leftoverblock : 0, 0,
+                           (uint8_t*)src + sw32_(bstarts), deltabuf, 0,
+                           scontext->tmp, scontext->tmp3, 1);
+          if (cbytes < 0) {
+            ntbytes = cbytes;
+            break;
+          }
+          lastj = 0;
+          if (cache != NULL) {
+            blockcache_put(cache, (uint8_t*)src, 0, deltabuf, bsize0);
+          }
+        }
+      }
+      if (delta && (j == 0)) {
+        memcpy((uint8_t*)dest + ntbytes, deltabuf + startb, bsize2);
+        ntbytes += (int)bsize2;
+        continue;
+      }
+
+      /* Chained blocks need all their predecessors in the chain */
+      if ((chain > 1) && (j % chain != 0) && (j != lastj + 1)) {
+        int k;
+        for (k = j - j % chain; k < j; k++) {
+          cbytes = blosc_d(context->serial_context, blocksize, 0, k,
+                           (uint8_t*)src + sw32_(bstarts + k * 4),
+                           scontext->tmp2, 0, scontext->tmp, scontext->tmp3,
+                           1);
+          if (cbytes < 0) {
+            break;
+          }
+        }
+        if (cbytes < 0) {
+          ntbytes = cbytes;
+          break;
+        }
+      }
+
+      /* Regular decompression.  Put results in tmp2 (or after the delta
+         reference). */
+      cbytes = blosc_d(context->serial_context, bsize, leftoverblock, j,
                        (uint8_t*)src + sw32_(bstarts + j * 4),
-                       scontext->tmp2, 0, scontext->tmp, scontext->tmp3);
+                       delta ? deltabuf : scontext->tmp2,
+                       delta ? blocksize : 0, scontext->tmp, scontext->tmp3,
+                       1);
       if (cbytes < 0) {
         ntbytes = cbytes;
         break;
       }
+      lastj = j;
+      if (cache != NULL) {
+        blockcache_put(cache, (uint8_t*)src, j,
+                       delta ? deltabuf + blocksize : scontext->tmp2, bsize);
+      }
       /* Copy to destination */
-      memcpy((uint8_t*)dest + ntbytes, scontext->tmp2 + startb, bsize2);
+      memcpy((uint8_t*)dest + ntbytes,
+             (delta ? deltabuf + blocksize : scontext->tmp2) + startb, bsize2);
       cbytes = (int)bsize2;
     }
     ntbytes += cbytes;
@@ -1831,7 +3676,9 @@ int blosc_getitem(const void* src, int start, int nitems, void* dest) {
   int result;
 
   /* Minimally populate the context */
+  memset(&context, 0, sizeof(blosc2_context));
   context.typesize = (uint8_t)_src[3];
+  context.nthreads = 1;
   context.blocksize = (size_t)sw32_(_src + 8);
   context.header_flags = _src + 2;
   context.filter_flags = get_filter_flags(*(_src + 2), context.typesize);
@@ -1846,10 +3693,97 @@ int blosc_getitem(const void* src, int start, int nitems, void* dest) {
   return result;
 }
 
+/* Decompress a large range of items with the threads of `context`.  The
+   blocks of the range are handed to the threads as a batch of a single
+   buffer, and the delta reference (if any) is decoded first. */
+static int parallel_getitem(blosc2_context* context, const void* src,
+                            size_t start, size_t stop, void* dest) {
+  struct thread_context* scontext = context->serial_context;
+  struct blosc2_batch_s* batch;
+  blosc2_context* shadow;
+  size_t blocksize, chainlen, ebsize, firstunit, lastunit;
+  int delta = 0;
+  int result;
+
+  batch = batch_new(context, 1);
+  if (batch == NULL) {
+    return -1;
+  }
+  shadow = &batch->shadows[0];
+  /* The destination only has room for the range */
+  initialize_context_decompression(shadow, src, dest,
+                                   (size_t)sw32_((uint8_t*)src + 4));
+  blocksize = shadow->blocksize;
+  chainlen = (shadow->chain > 1) ? (size_t)shadow->chain : 1;
+  firstunit = start / blocksize / chainlen;
+  lastunit = (stop - 1) / blocksize / chainlen;
+  batch->start = start;
+  batch->stop = stop;
+  batch->skip_units = (int32_t)firstunit;
+  batch_add_units(batch, 0, (int32_t)(lastunit - firstunit + 1));
+
+  for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
+    if (shadow->filters[i] == BLOSC_DELTA) {
+      delta = 1;
+    }
+  }
+  if (delta) {
+    /* The range spans several blocks, so block 0 is never a leftover */
+    ebsize = blocksize + shadow->typesize * sizeof(int32_t);
+    if (scontext->tmpblocksize < blocksize) {
+      my_free(scontext->tmp);
+      scontext->tmp = my_malloc(3 * blocksize + ebsize);
+      scontext->tmp2 = scontext->tmp + blocksize;
+      scontext->tmp3 = scontext->tmp + blocksize + ebsize;
+      scontext->tmp4 = scontext->tmp + 2 * blocksize + ebsize;
+      scontext->tmpblocksize = blocksize;
+    }
+    if (scontext->deltabufsize < blocksize) {
+      if (scontext->deltabuf != NULL) {
+        my_free(scontext->deltabuf);
+      }
+      scontext->deltabuf = my_malloc(2 * blocksize);
+      if (scontext->deltabuf == NULL) {
+        scontext->deltabufsize = 0;
+        batch_free(batch);
+        return -1;
+      }
+      scontext->deltabufsize = blocksize;
+    }
+    scontext->parent_context = shadow;
+    result = blosc_d(scontext, blocksize, 0, 0,
+                     shadow->src + sw32_(shadow->bstarts), scontext->deltabuf,
+                     0, scontext->tmp, scontext->tmp2, 1);
+    scontext->parent_context = context;
+    if (result < 0) {
+      batch_free(batch);
+      return result;
+    }
+    shadow->dref = scontext->deltabuf;
+  }
+
+  batch_run(context, batch);
+  if (shadow->thread_giveup_code <= 0) {
+    result = shadow->thread_giveup_code;
+  }
+  else {
+    result = (int)shadow->output_bytes;
+  }
+  batch_free(batch);
+  return result;
+}
+
+
+void blosc2_clear_blockcache(blosc2_context* context) {
+  if (context->blockcache != NULL) {
+    blockcache_clear(context->blockcache);
+  }
+}
+
+
 int blosc2_getitem_ctx(blosc2_context* context, const void* src, int start,
     int nitems, void* dest) {
   uint8_t* _src = (uint8_t*)(src);
-  int result;
 
   /* Minimally populate the context */
   context->typesize = (uint8_t)_src[3];
@@ -1859,11 +3793,24 @@ int blosc2_getitem_ctx(blosc2_context* context, const void* src, int start,
   if (context->serial_context == NULL) {
     context->serial_context = create_thread_context(context, 0);
   }
+  if ((context->blockcache_size > 0) && (context->blockcache == NULL)) {
+    context->blockcache = blockcache_new(context->blockcache_size);
+  }
 
-  /* Call the actual getitem function */
-  result = _blosc_getitem(context, src, start, nitems, dest);
+  /* Large ranges are decompressed by the threads of the context */
+  if ((context->nthreads > 1) && (nitems > 0) && (start >= 0) &&
+      !(_src[2] & BLOSC_MEMCPYED)) {
+    size_t bstart = (size_t)start * context->typesize;
+    size_t bstop = ((size_t)start + (size_t)nitems) * context->typesize;
+    if ((bstop <= (size_t)sw32_(_src + 4)) &&
+        ((bstop - 1) / context->blocksize - bstart / context->blocksize + 1 >=
+         GETITEM_PARALLEL_BLOCKS)) {
+      return parallel_getitem(context, src, bstart, bstop, dest);
+    }
+  }
 
-  return result;
+  /* Call the actual getitem function */
+  return _blosc_getitem(context, src, start, nitems, dest);
 }
 
 
@@ -1886,6 +3833,7 @@ static void* t_blosc(void* ctxt) {
   size_t nblocks;
   size_t leftover;
   size_t leftover2;
+  size_t chainlen;
   uint8_t* bstarts;
   const uint8_t* src;
   uint8_t* dest;
@@ -1902,6 +3850,13 @@ static void* t_blosc(void* ctxt) {
       break;
     }
 
+    if (context->parent_context->batch != NULL) {
+      /* The buffers of a batch (see blosc2_compress_batch()) */
+      batch_worker(context, context->parent_context->batch);
+      WAIT_FINISH(NULL, context->parent_context);
+      continue;
+    }
+
     /* Get parameters for this thread before entering the main loop */
     blocksize = context->parent_context->blocksize;
     ebsize = blocksize + context->parent_context->typesize * sizeof(int32_t);
@@ -1913,6 +3868,9 @@ static void* t_blosc(void* ctxt) {
     bstarts = context->parent_context->bstarts;
     src = context->parent_context->src;
     dest = context->parent_context->dest;
+    /* Chained blocks are always handled by the same thread */
+    chainlen = (context->parent_context->chain > 1) ?
+               (size_t)context->parent_context->chain : 1;
 
     /* Resize the temporaries if needed */
     if (blocksize != context->tmpblocksize) {
@@ -1933,8 +3891,8 @@ static void* t_blosc(void* ctxt) {
     if (compress && !(flags & BLOSC_MEMCPYED)) {
       /* Compression always has to follow the block order */
       pthread_mutex_lock(&context->parent_context->count_mutex);
-      context->parent_context->thread_nblock++;
-      nblock_ = (size_t)context->parent_context->thread_nblock;
+      nblock_ = (size_t)(context->parent_context->thread_nblock + 1);
+      context->parent_context->thread_nblock += (int)chainlen;
       pthread_mutex_unlock(&context->parent_context->count_mutex);
       tblock = nblocks;
     }
@@ -1946,6 +3904,8 @@ static void* t_blosc(void* ctxt) {
       tblocks = nblocks / context->parent_context->nthreads;
       leftover2 = nblocks % context->parent_context->nthreads;
       tblocks = (leftover2 > 0) ? tblocks + 1 : tblocks;
+      /* Do not split a chain among threads */
+      tblocks = ((tblocks + chainlen - 1) / chainlen) * chainlen;
 
       nblock_ = context->tid * tblocks;
       tblock = nblock_ + tblocks;
@@ -1966,9 +3926,12 @@ static void* t_blosc(void* ctxt) {
       if (compress) {
         if (flags & BLOSC_MEMCPYED) {
           /* We want to memcpy only */
-          memcpy(dest + BLOSC_MAX_OVERHEAD + nblock_ * blocksize,
-                 src + nblock_ * blocksize, bsize);
           cbytes = (int32_t)bsize;
+          if (fill_block(context->parent_context, context->tid,
+                         nblock_ * blocksize, bsize,
+                         dest + BLOSC_MAX_OVERHEAD + nblock_ * blocksize) < 0) {
+            cbytes = -9;
+          }
         }
         else {
           /* Regular compression */
@@ -1984,9 +3947,11 @@ static void* t_blosc(void* ctxt) {
           cbytes = (int32_t)bsize;
         }
         else {
-          cbytes = blosc_d(context, bsize, leftoverblock,
-                           src + sw32_(bstarts + nblock_ * 4),
-                           dest, nblock_ * blocksize, tmp, tmp2);
+          cbytes = decompress_block(context, bsize, leftoverblock,
+                                    (int32_t)nblock_,
+                                    src + sw32_(bstarts + nblock_ * 4),
+                                    dest, nblock_ * blocksize, tmp, tmp2,
+                                    0);
         }
       }
 
@@ -2015,8 +3980,14 @@ static void* t_blosc(void* ctxt) {
           pthread_mutex_unlock(&context->parent_context->count_mutex);
           break;
         }
-        context->parent_context->thread_nblock++;
-        nblock_ = (size_t)context->parent_context->thread_nblock;
+        if ((nblock_ + 1) % chainlen != 0) {
+          /* Keep going with the next block in the chain */
+          nblock_++;
+        }
+        else {
+          nblock_ = (size_t)(context->parent_context->thread_nblock + 1);
+          context->parent_context->thread_nblock += (int)chainlen;
+        }
         context->parent_context->output_bytes += cbytes;
         pthread_mutex_unlock(&context->parent_context->count_mutex);
         /* End of critical section */
@@ -2074,6 +4045,7 @@ static int init_threads(blosc2_context* context) {
   pthread_mutex_init(&context->count_threads_mutex, NULL);
   pthread_cond_init(&context->count_threads_cv, NULL);
   context->count_threads = 0;      /* Reset threads counter */
+  context->count_threads_gen = 0;
 #endif
 
 #if !defined(_WIN32)
@@ -2085,6 +4057,8 @@ static int init_threads(blosc2_context* context) {
   /* Make space for thread handlers */
   context->threads = (pthread_t*)my_malloc(
           context->nthreads * sizeof(pthread_t));
+  /* The threads count themselves in the barriers with this */
+  context->threads_started = context->nthreads;
   /* Finally, create the threads */
   for (tid = 0; tid < context->nthreads; tid++) {
     /* Create a thread context (will destroy when finished) */
@@ -2114,16 +4088,18 @@ int blosc_get_nthreads(void)
 
 int blosc_set_nthreads(int nthreads_new) {
   int ret = g_nthreads;          /* the previous number of threads */
+  struct tls_slot* slot;
 
   /* Check whether the library should be initialized */
   if (!g_initlib) blosc_init();
 
  if (nthreads_new != ret) {
-    /* Re-initialize Blosc */
-    blosc_destroy();
-    blosc_init();
     g_nthreads = nthreads_new;
-    g_global_context->nthreads = nthreads_new;
+    /* End the pool of this thread; the other ones are resized lazily */
+    slot = (struct tls_slot*)pthread_getspecific(g_tls_key);
+    if ((slot != NULL) && (slot->context != NULL)) {
+      blosc_release_threadpool(slot->context);
+    }
   }
 
   return ret;
@@ -2136,14 +4112,13 @@ int blosc_set_nthreads_(blosc2_context* context) {
   }
 
   /* Launch a new pool of threads */
-  if (context->nthreads > 1 && context->nthreads != context->threads_started) {
+  if (context->nthreads != context->threads_started) {
     blosc_release_threadpool(context);
-    init_threads(context);
+    if (context->nthreads > 1) {
+      init_threads(context);
+    }
   }
 
-  /* We have now started the threads */
-  context->threads_started = context->nthreads;
-
   return context->nthreads;
 }
 
@@ -2343,7 +4318,6 @@ void blosc_set_blocksize(size_t size) {
    reachable (the default). */
 void blosc_set_schunk(blosc2_schunk* schunk) {
   g_schunk = schunk;
-  g_global_context->schunk = schunk;
 }
 
 
@@ -2351,28 +4325,37 @@ void blosc_init(void) {
   /* Return if we are already initialized */
   if (g_initlib) return;
 
-  pthread_mutex_init(&global_comp_mutex, NULL);
-  /* Create a global context */
-  g_global_context = (blosc2_context*)my_malloc(sizeof(blosc2_context));
-  /* Initialize some struct components */
-  g_global_context->serial_context = NULL;
-  g_global_context->threads = NULL;
-  g_global_context->threads_started = 0;
+  /* The key for the per-thread contexts outlives blosc_destroy() */
+  if (!g_tls_ready) {
+    pthread_mutex_init(&g_tls_mutex, NULL);
+    pthread_mutex_init(&g_env_mutex, NULL);
+    pthread_key_create(&g_tls_key, tls_slot_free);
+    g_tls_ready = 1;
+  }
+  /* Environment variables are read once, here and in blosc_reload_env() */
+  load_env(&g_env);
+  /* Cache sizes drive the automatic blocksizes */
+  btune_detect_caches();
   g_initlib = 1;
 }
 
 
 void blosc_destroy(void) {
+  struct tls_slot* slot;
+
   /* Return if Blosc is not initialized */
   if (!g_initlib) return;
 
   g_initlib = 0;
-  blosc_release_threadpool(g_global_context);
-  if (g_global_context->serial_context != NULL) {
-    free_thread_context(g_global_context->serial_context);
+  /* The slots stay with their threads, but without contexts */
+  pthread_mutex_lock(&g_tls_mutex);
+  for (slot = g_tls_slots; slot != NULL; slot = slot->next) {
+    if (slot->context != NULL) {
+      blosc2_free_ctx(slot->context);
+      slot->context = NULL;
+    }
   }
-  my_free(g_global_context);
-  pthread_mutex_destroy(&global_comp_mutex);
+  pthread_mutex_unlock(&g_tls_mutex);
 }
 
 
@@ -2426,10 +4409,24 @@ int blosc_release_threadpool(blosc2_context* context) {
 }
 
 int blosc_free_resources(void) {
+  struct tls_slot* slot;
+  int rc = 0;
+
   /* Return if Blosc is not initialized */
   if (!g_initlib) return -1;
 
-  return blosc_release_threadpool(g_global_context);
+  pthread_mutex_lock(&g_tls_mutex);
+  for (slot = g_tls_slots; slot != NULL; slot = slot->next) {
+    if (slot->context != NULL) {
+      rc = blosc_release_threadpool(slot->context);
+      if (rc < 0) {
+        break;
+      }
+    }
+  }
+  pthread_mutex_unlock(&g_tls_mutex);
+
+  return rc;
 }
 
 
@@ -2439,6 +4436,9 @@ int blosc_free_resources(void) {
 blosc2_context* blosc2_create_cctx(blosc2_cparams cparams) {
 
   blosc2_context* context = (blosc2_context*)my_malloc(sizeof(blosc2_context));
+  if (context == NULL) {
+    return NULL;
+  }
   memset(context, 0, sizeof(blosc2_context));
 
   context->do_compress = 1;   /* meant for compression */
@@ -2451,8 +4451,14 @@ blosc2_context* blosc2_create_cctx(blosc2_cparams cparams) {
     context->filters_meta[i] = cparams.filters_meta[i];
   }
   context->nthreads = cparams.nthreads;
-  context->blocksize = cparams.blocksize;
+  context->force_blocksize = cparams.blocksize;
+  context->chainlen = cparams.chainlen;
+  context->tuning = cparams.tuning;
+  context->splitmode = cparams.splitmode;
+  context->autosplit = -1;
   context->schunk = cparams.schunk;
+  context->prefilter = cparams.prefilter;
+  context->prefilter_data = cparams.prefilter_data;
 
   return context;
 }
@@ -2462,19 +4468,34 @@ blosc2_context* blosc2_create_cctx(blosc2_cparams cparams) {
 blosc2_context* blosc2_create_dctx(blosc2_dparams dparams) {
 
   blosc2_context* context = (blosc2_context*)my_malloc(sizeof(blosc2_context));
+  if (context == NULL) {
+    return NULL;
+  }
   memset(context, 0, sizeof(blosc2_context));
 
   context->do_compress = 0;   /* Meant for decompression */
   /* Populate the context, using default values for zeroed values */
   context->nthreads = dparams.nthreads;
   context->schunk = dparams.schunk;
+  context->blockcache_size = dparams.blockcache;
+  context->postfilter = dparams.postfilter;
+  context->postfilter_data = dparams.postfilter_data;
 
   return context;
 }
 
 
 void blosc2_free_ctx(blosc2_context* context) {
+  if (context->async != NULL) {
+    free_async(context);
+  }
+  if (context->blockcache != NULL) {
+    blockcache_free(context->blockcache);
+  }
+  my_free(context->block_zonemaps);
+  my_free(context->filter_dref);
   blosc_release_threadpool(context);
+  btune_free(context);
   if (context->serial_context != NULL) {
     free_thread_context(context->serial_context);
   }
@@ -79,6 +79,28 @@ enum {
   /* Maximum number of filters in the filter pipeline */
 };
 
+enum {
+  BLOSC_MAX_CHAINLEN = 255,
+  /* Maximum number of blocks sharing codec history (see `chainlen` in
+     blosc2_cparams).  Only LZ4, LZ4HC and Zstd support block chains. */
+};
+
+/* Tuning profiles for the automatic compression params (see `tuning` in
+   blosc2_cparams) */
+enum {
+  BLOSC_TUNE_BALANCED = 0,      /* balance speed and compression ratio */
+  BLOSC_TUNE_DECOMP_SPEED = 1,  /* maximize the decompression speed */
+  BLOSC_TUNE_RATIO = 2,         /* maximize the compression ratio */
+};
+
+/* Split modes for the blocks (see `splitmode` in blosc2_cparams) */
+enum {
+  BLOSC_ALWAYS_SPLIT = 1,          /* split blocks into typesize streams */
+  BLOSC_NEVER_SPLIT = 2,           /* compress blocks as a single stream */
+  BLOSC_AUTO_SPLIT = 3,            /* decide by a trial on a sample block */
+  BLOSC_FORWARD_COMPAT_SPLIT = 4,  /* per codec and tuning profile */
+};
+
 /* Codes for internal flags (see blosc_cbuffer_metainfo) */
 enum {
   BLOSC_DOSHUFFLE = 0x1,     /* byte-wise shuffle */
@@ -161,6 +183,11 @@ enum {
   Blosc to be used simultaneously in a multi-threaded environment, in
   which case you can use the
   blosc2_compress_ctx()/blosc2_decompress_ctx() pair (see below).
+
+  blosc_compress() and blosc_decompress() can be called from several
+  threads at once too: every calling thread gets a context of its own
+  (with its own pool of internal threads), which is kept between calls
+  and released when the thread exits or in blosc_destroy().
 */
 BLOSC_EXPORT void blosc_init(void);
 
@@ -175,6 +202,19 @@ BLOSC_EXPORT void blosc_init(void);
 BLOSC_EXPORT void blosc_destroy(void);
 
 
+/**
+  Read again the environment variables honored by blosc_compress() and
+  blosc_decompress() (see below).
+
+  These variables are read once in blosc_init(), so that compression
+  calls do not have to scan the environment, and changes made afterwards
+  (e.g. with setenv()) are only seen after calling this function.  It
+  can be called while other threads are compressing; they will use the
+  new values in their next calls.
+*/
+BLOSC_EXPORT void blosc_reload_env(void);
+
+
 /**
   Compress a block of data in the `src` buffer and returns the size of
   compressed block.  The size of `src` buffer is specified by
@@ -216,7 +256,8 @@ BLOSC_EXPORT void blosc_destroy(void);
 
   blosc_compress() honors different environment variables to control
   internal parameters without the need of doing that programatically.
-  Here are the ones supported:
+  They are read in blosc_init() and blosc_reload_env().  Here are the
+  ones supported:
 
   BLOSC_CLEVEL=(INTEGER): This will overwrite the `clevel` parameter
   before the compression process starts.
@@ -249,7 +290,9 @@ BLOSC_EXPORT void blosc_destroy(void);
   `numinternalthreads` parameters set to the same as the last calls to
   blosc_set_compressor(), blosc_set_blocksize() and
   blosc_set_nthreads().  BLOSC_CLEVEL, BLOSC_SHUFFLE, BLOSC_DELTA and
-  BLOSC_TYPESIZE environment vars will also be honored.
+  BLOSC_TYPESIZE environment vars will also be honored.  *NOTE:* This
+  creates and frees a context per call, and it is not needed anymore
+  for concurrent calls, as they use per-thread contexts.
 */
 BLOSC_EXPORT int blosc_compress(int clevel, int doshuffle, size_t typesize,
                                 size_t nbytes, const void* src, void* dest,
@@ -274,7 +317,8 @@ BLOSC_EXPORT int blosc_compress(int clevel, int doshuffle, size_t typesize,
 
   blosc_decompress() honors different environment variables to control
   internal parameters without the need of doing that programatically.
-  Here are the ones supported:
+  They are read in blosc_init() and blosc_reload_env().  Here are the
+  ones supported:
 
   BLOSC_NTHREADS=(INTEGER): This will call
   blosc_set_nthreads(BLOSC_NTHREADS) before the proper decompression
@@ -311,6 +355,10 @@ BLOSC_EXPORT int blosc_get_nthreads(void);
   previous existing pool is ended.  If this is not called, `nthreads`
   is set to 1 internally.
 
+  The pool of the calling thread is ended right away, and the ones of
+  other threads calling blosc_compress()/blosc_decompress() are resized
+  on their next call.
+
   Returns the previous number of threads.
   */
 BLOSC_EXPORT int blosc_set_nthreads(int nthreads);
@@ -474,6 +522,38 @@ BLOSC_EXPORT char* blosc_cbuffer_complib(const void* cbuffer);
 
 typedef struct blosc2_context_s blosc2_context;   /* uncomplete type */
 
+/**
+  The parameters of a call to a prefilter (see blosc2_cparams).
+*/
+typedef struct {
+  void* user_data;
+  /* the `prefilter_data` of the compression params */
+  const uint8_t* in;
+  /* the block in the source buffer (NULL if there is no source buffer) */
+  uint8_t* out;
+  /* where the block to be compressed has to be put */
+  int32_t out_size;
+  /* the size of the block in bytes */
+  int32_t out_typesize;
+  /* the typesize of the items in the block */
+  int32_t out_offset;
+  /* the offset of the block from the start of the buffer */
+  int32_t tid;
+  /* the id of the thread running the prefilter */
+} blosc2_prefilter_params;
+
+/**
+  A prefilter makes the blocks to be compressed, right before they go
+  through the filters and the codec.
+
+  It is called from the threads of the context for every block, not
+  necessarily in order and maybe more than once for the same block, and it
+  must fill the `out_size` bytes of `out`.
+  It returns 0 if it succeeds, or a negative value for stopping the
+  compression.
+*/
+typedef int (*blosc2_prefilter_fn)(blosc2_prefilter_params* params);
+
 /**
   The parameters for creating a context for compression purposes.
 
@@ -497,12 +577,67 @@ typedef struct {
   /* the (sequence of) filters */
   uint8_t filters_meta[BLOSC_MAX_FILTERS];
   /* metadata for filters */
+  int32_t chainlen;
+  /* the number of consecutive blocks compressed as a single dependent
+     stream (0; meaning independent blocks).  See BLOSC_MAX_CHAINLEN. */
+  int32_t tuning;
+  /* the profile for choosing blocksizes, block splits and codec
+     acceleration (BLOSC_TUNE_BALANCED).  Profiles other than the default
+     one choose the acceleration of LZ4 and the level of Lizard by
+     themselves, so `clevel` only tells these codecs whether to compress
+     at all (0) or not. */
+  int32_t splitmode;
+  /* whether blocks are split into typesize streams before the codec
+     (BLOSC_FORWARD_COMPAT_SPLIT).  With BLOSC_AUTO_SPLIT the decision is
+     taken per chunk, and cached for the rest of a super-chunk. */
+  blosc2_prefilter_fn prefilter;
+  /* the function making the blocks to compress (NULL; meaning that they
+     are read from the source buffer).  With a prefilter, the source
+     buffer can be NULL. */
+  void* prefilter_data;
+  /* the user data for the prefilter (NULL) */
 } blosc2_cparams;
 
 /* Default struct for compression params meant for user initialization */
 static const blosc2_cparams BLOSC_CPARAMS_DEFAULTS = {
         BLOSC_BLOSCLZ, 5, 8, 1, 0, NULL,
-        {0, 0, 0, 0, BLOSC_SHUFFLE}, {0, 0, 0, 0, 0} };
+        {0, 0, 0, 0, BLOSC_SHUFFLE}, {0, 0, 0, 0, 0}, 0,
+        BLOSC_TUNE_BALANCED, BLOSC_FORWARD_COMPAT_SPLIT, NULL, NULL };
+
+/**
+  The parameters of a call to a postfilter (see blosc2_dparams).
+*/
+typedef struct {
+  void* user_data;
+  /* the `postfilter_data` of the decompression params */
+  const uint8_t* in;
+  /* the decompressed block */
+  uint8_t* out;
+  /* where the block goes in the destination (NULL if there is no
+     destination buffer) */
+  int32_t size;
+  /* the size of the block in bytes */
+  int32_t typesize;
+  /* the typesize of the items in the block */
+  int32_t offset;
+  /* the offset of the block from the start of the buffer */
+  int32_t tid;
+  /* the id of the thread running the postfilter */
+} blosc2_postfilter_params;
+
+/**
+  A postfilter takes the blocks right after they are decompressed, while
+  they are still in the cache of the thread that made them.
+
+  It is called from the threads of the context for every block, not
+  necessarily in order, and the decompressed block only gets to the
+  destination if the postfilter puts it (or a transformation of it) in
+  `out`.  Postfilters that just consume the blocks (e.g. reductions) can be
+  used without a destination buffer.
+  It returns 0 if it succeeds, or a negative value for stopping the
+  decompression.
+*/
+typedef int (*blosc2_postfilter_fn)(blosc2_postfilter_params* params);
 
 /**
   The parameters for creating a context for decompression purposes.
@@ -515,10 +650,19 @@ typedef struct {
   /* the number of threads to use internally (1) */
   void* schunk;
   /* the associated schunk, if any (NULL) */
+  size_t blockcache;
+  /* memory budget in bytes for caching the blocks decompressed by
+     blosc2_getitem_ctx() (0; meaning no cache) */
+  blosc2_postfilter_fn postfilter;
+  /* the function taking the decompressed blocks (NULL; meaning that they
+     go straight to the destination).  With a postfilter, the destination
+     buffer can be NULL.  It is not used by blosc2_getitem_ctx(). */
+  void* postfilter_data;
+  /* the user data for the postfilter (NULL) */
 } blosc2_dparams;
 
 /* Default struct for compression params meant for user initialization */
-static const blosc2_dparams BLOSC_DPARAMS_DEFAULTS = { 1, NULL };
+static const blosc2_dparams BLOSC_DPARAMS_DEFAULTS = { 1, NULL, 0, NULL, NULL };
 
 /**
   Create a context for *_ctx() compression functions.
@@ -582,18 +726,274 @@ BLOSC_EXPORT int blosc2_compress_ctx(
 BLOSC_EXPORT int blosc2_decompress_ctx(blosc2_context* context, const void* src,
                                        void* dest, size_t destsize);
 
+/**
+  A piece of a buffer made of several ones (like `struct iovec`).
+*/
+typedef struct {
+  void* base;
+  /* the start of the piece */
+  size_t len;
+  /* the size of the piece in bytes */
+} blosc2_iovec;
+
+/**
+  Decompress like blosc2_decompress_ctx(), but with the items going to
+  `stride` bytes from one another in `dest` (e.g. a column of a 2-D array).
+  Negative strides are valid, and then `dest` is where the first item goes.
+
+  Every block is scattered by the thread decompressing it while the block
+  is still in its cache, so there is no contiguous temporary to copy from.
+  The context cannot have a postfilter, and the typesize of `src` must
+  divide both its nbytes and its blocksize.
+
+  Returns the number of bytes decompressed or a negative value if some
+  error happens (e.g. `stride` is smaller than the typesize).
+*/
+BLOSC_EXPORT int blosc2_decompress_strided_ctx(blosc2_context* context,
+                                               const void* src, void* dest,
+                                               int64_t stride);
+
+/**
+  Decompress like blosc2_decompress_ctx(), but into the `iovcnt` pieces in
+  `iov`, which are filled in order.  Pieces are written by the threads of
+  the context as the blocks are decompressed, like with
+  blosc2_decompress_strided_ctx().
+
+  Returns the number of bytes decompressed or a negative value if some
+  error happens (e.g. the pieces are smaller than the buffer).
+*/
+BLOSC_EXPORT int blosc2_decompress_iov_ctx(blosc2_context* context,
+                                           const void* src,
+                                           const blosc2_iovec* iov,
+                                           int iovcnt);
+
+/**
+  Compress like blosc2_compress_ctx(), but with the data coming from the
+  `iovcnt` pieces in `iov`, one after the other.  Every block is gathered
+  by the thread compressing it, right in its own buffer, so the pieces are
+  never copied into a contiguous source first.  The context cannot have a
+  prefilter.
+
+  Returns the size of the compressed buffer like blosc2_compress_ctx().
+*/
+BLOSC_EXPORT int blosc2_compress_iov_ctx(blosc2_context* context,
+                                         const blosc2_iovec* iov, int iovcnt,
+                                         void* dest, size_t destsize);
+
 /**
   Context interface counterpart for blosc_getitem().
 
   It uses similar parameters than the blosc_getitem() function plus a
   `context` parameter.
 
+  Ranges spanning more than a few blocks are decompressed by the threads
+  of `context` (if it has more than one), with the blocks fully inside the
+  range going straight to `dest`.  These ranges bypass the block cache.
+
   Returns the number of bytes copied to `dest` or a negative value if
   some error happens.
 */
 BLOSC_EXPORT int blosc2_getitem_ctx(blosc2_context* context, const void* src,
                                     int start, int nitems, void* dest);
 
+/**
+  Drop the blocks cached by blosc2_getitem_ctx() (see `blockcache` in
+  blosc2_dparams).
+
+  Blocks are cached by the address of their buffer, and checked against a
+  hash of its header and of the ends of the compressed block.  This tells
+  apart most buffers that take the place of another one, but not all of
+  them, so this must be called after a buffer that has been read is freed,
+  reused or modified in place.
+*/
+BLOSC_EXPORT void blosc2_clear_blockcache(blosc2_context* context);
+
+/**
+  An iterator over the decompressed contents of a buffer, for reading it
+  piece by piece (see blosc2_diter_new()).
+*/
+typedef struct blosc2_diter_s blosc2_diter;   /* uncomplete type */
+
+/**
+  Create an iterator over the decompressed contents of the compressed
+  buffer in `src`, which must outlive it.
+
+  A background thread decompresses the buffer ahead of the reads, in
+  windows of two blocks per thread in `dparams` (one block with a single
+  thread, and four blocks at least with several threads, so that the
+  threads take part in every window), and keeps two windows at most.  So the memory needed is a few
+  blocks per thread instead of the whole decompressed buffer.
+
+  NULL is returned if this fails.
+*/
+BLOSC_EXPORT blosc2_diter* blosc2_diter_new(blosc2_dparams dparams,
+                                            const void* src);
+
+/**
+  Copy the next `maxbytes` bytes (or less, at the end) of the decompressed
+  buffer into `dest`.
+
+  Returns the number of bytes copied (0 at the end of the buffer), or a
+  negative value if some error happens.
+*/
+BLOSC_EXPORT int blosc2_diter_next(blosc2_diter* iter, void* dest,
+                                   int32_t maxbytes);
+
+/**
+  Free an iterator, stopping its background thread.
+*/
+BLOSC_EXPORT void blosc2_diter_free(blosc2_diter* iter);
+
+
+/**
+  A buffer in a batch (see blosc2_compress_batch()).
+*/
+typedef struct {
+  const void* src;
+  /* the source buffer */
+  size_t nbytes;
+  /* the size of the source buffer (ignored for decompression) */
+  void* dest;
+  /* the destination buffer */
+  size_t destsize;
+  /* the size of the destination buffer */
+  int result;
+  /* output: the value that blosc2_compress_ctx() or
+     blosc2_decompress_ctx() would return for this buffer */
+} blosc2_batch_item;
+
+/**
+  Compress the `nitems` buffers in `items` with the params of `context`.
+
+  The blocks of all the buffers are distributed among the threads of the
+  context in a single dispatch, so that many small buffers (that would
+  leave most of the threads idle one at a time) keep all of them busy.
+  The compressed buffers are the same than the ones produced by
+  blosc2_compress_ctx().
+
+  Returns 0 if all the buffers succeeded, or the first negative `result`
+  otherwise.  -10 means that `context` is not meant for compression or
+  that `nitems` is negative, and -1 that the batch cannot be allocated.
+*/
+BLOSC_EXPORT int blosc2_compress_batch(blosc2_context* context,
+                                       blosc2_batch_item* items, int nitems);
+
+/**
+  Decompress the `nitems` buffers in `items` with the threads of `context`
+  in a single dispatch (see blosc2_compress_batch()).
+
+  Returns 0 if all the buffers succeeded, or the first negative `result`
+  otherwise.  -10 means that `context` is not meant for decompression or
+  that `nitems` is negative, and -1 that the batch cannot be allocated.
+*/
+BLOSC_EXPORT int blosc2_decompress_batch(blosc2_context* context,
+                                         blosc2_batch_item* items, int nitems);
+
+
+/**
+  An asynchronous compression or decompression (see
+  blosc2_compress_ctx_async()).
+*/
+typedef struct blosc2_request_s blosc2_request;   /* uncomplete type */
+
+enum {
+  BLOSC2_REQUEST_CANCELLED_RESULT = -12,
+  /* The result of the requests cancelled with blosc2_request_cancel() */
+};
+
+/**
+  The function called when an asynchronous request completes.  `result`
+  is the value that the synchronous call would have returned.
+*/
+typedef void (*blosc2_callback)(blosc2_request* request, int result,
+                                void* data);
+
+/**
+  Compress like blosc2_compress_ctx(), but without waiting.
+
+  The request is queued in `context` and run by a thread owned by the
+  context, on top of the threads of the context.  Requests on the same
+  context are run one after another, in submission order; use several
+  contexts for running them concurrently.  The context must not be used
+  for synchronous calls while it has requests that are not done.
+
+  `src` and `dest` must stay valid and untouched until the request is
+  done, i.e. until blosc2_request_poll() returns 1, blosc2_request_wait()
+  returns or `callback` is called.
+
+  If `callback` is not NULL, it is called with `data` from the thread of
+  the context when the request completes.  It must not wait for requests
+  of the same context.
+
+  Returns the request, which must always be released with
+  blosc2_request_wait() (before freeing the context), or NULL if
+  `context` is not meant for compression or the request cannot be
+  allocated or queued.
+*/
+BLOSC_EXPORT blosc2_request* blosc2_compress_ctx_async(
+        blosc2_context* context, size_t nbytes, const void* src, void* dest,
+        size_t destsize, blosc2_callback callback, void* data);
+
+/**
+  Decompress like blosc2_decompress_ctx(), but without waiting (see
+  blosc2_compress_ctx_async()).  The chunks of a super-chunk can be
+  decompressed with its `dctx` this way.
+*/
+BLOSC_EXPORT blosc2_request* blosc2_decompress_ctx_async(
+        blosc2_context* context, const void* src, void* dest, size_t destsize,
+        blosc2_callback callback, void* data);
+
+/**
+  Returns 1 if `request` is done (or cancelled), 0 otherwise.
+*/
+BLOSC_EXPORT int blosc2_request_poll(blosc2_request* request);
+
+/**
+  Wait for `request` to be done and release it.
+
+  Returns the value that the synchronous call would have returned, or
+  BLOSC2_REQUEST_CANCELLED_RESULT if the request was cancelled.
+*/
+BLOSC_EXPORT int blosc2_request_wait(blosc2_request* request);
+
+/**
+  Cancel `request` if it has not started yet.  Its callback is not
+  called, and it still must be released with blosc2_request_wait().
+
+  Returns 1 if the request has been cancelled, 0 if it already started.
+*/
+BLOSC_EXPORT int blosc2_request_cancel(blosc2_request* request);
+
+
+/**
+  The cache sizes and the blocksize decisions taken for the last buffer
+  compressed with a context.
+*/
+typedef struct {
+  size_t l1;
+  /* the size of the L1 data cache */
+  size_t l2;
+  /* the size of the L2 cache */
+  size_t l3;
+  /* the size of the L3 cache (0 if there is none) */
+  size_t blocksize;
+  /* the blocksize used */
+  size_t blocksize_limit;
+  /* the largest automatic blocksize whose working set fits in cache */
+  int forced;
+  /* whether the blocksize was forced by the user */
+} blosc2_blocksize_info;
+
+/**
+  Fill `info` with the blocksize decisions for the last buffer compressed
+  with `context`.
+
+  Returns 0 if succeeds, or a negative value if `context` is not meant for
+  compression.
+*/
+BLOSC_EXPORT int blosc2_get_blocksize_info(blosc2_context* context,
+                                           blosc2_blocksize_info* info);
+
 
 /*********************************************************************
 
@@ -601,6 +1001,8 @@ BLOSC_EXPORT int blosc2_getitem_ctx(blosc2_context* context, const void* src,
 
 *********************************************************************/
 
+typedef struct blosc2_schunk_priv_s blosc2_schunk_priv;  /* uncomplete type */
+
 typedef struct {
   uint8_t version;
   uint8_t flags1;
@@ -641,8 +1043,9 @@ typedef struct {
   blosc2_context* cctx;
   blosc2_context* dctx;
   /* Contexts for compression and decompression */
-  uint8_t* reserved;
-  /* Reserved for the future. */
+  blosc2_schunk_priv* priv;
+  /* State private to the library (asynchronous appends, caches and zone
+     maps) */
 } blosc2_schunk;
 
 
@@ -664,9 +1067,166 @@ BLOSC_EXPORT int blosc2_destroy_schunk(blosc2_schunk* sheader);
 BLOSC_EXPORT size_t blosc2_append_buffer(blosc2_schunk* sheader,
                                          size_t nbytes, void* src);
 
+/* Append a `src` data buffer to a super-chunk asynchronously.
+
+ `src` is copied into a bounded queue, so it can be reused as soon as
+ this returns.  A background thread compresses the queued buffers with
+ the threads of the compression context (several buffers at once, see
+ blosc2_compress_batch()) while the caller keeps appending, and then
+ appends the chunks in order.  When the queue is full, this waits for the
+ background thread to make room.
+
+ This returns the number of chunks that the super-chunk will have once
+ the pending buffers are appended.  A negative value is returned if
+ some problem is detected, including errors compressing buffers queued
+ in previous calls.
+
+ blosc2_schunk_flush() must be called before accessing the chunks.
+ blosc2_append_buffer(), blosc2_schunk_decompress_range(),
+ blosc2_schunk_get_slice() and blosc2_destroy_schunk() do it automatically.
+ */
+BLOSC_EXPORT int64_t blosc2_append_buffer_async(blosc2_schunk* sheader,
+                                                size_t nbytes, void* src);
+
+/* Wait until all the buffers appended with blosc2_append_buffer_async()
+ are in the super-chunk.
+
+ This returns 0 if all of them have been appended, or a negative code if
+ some of them could not be compressed (the chunks after the first error
+ are discarded).
+ */
+BLOSC_EXPORT int blosc2_schunk_flush(blosc2_schunk* sheader);
+
+/* A stream of data compressed into chunks while it is being written */
+typedef struct blosc2_cstream_s blosc2_cstream;   /* uncomplete type */
+
+/* Take a chunk made by a stream.  `chunk` is only valid during the call.
+ Returns 0 if succeeds, or a negative value for stopping the stream. */
+typedef int (*blosc2_cstream_fn)(const void* chunk, int32_t cbytes,
+     void* user_data);
+
+/* Create a stream compressing the data written to it into chunks of
+ `chunksize` bytes, with `cparams` (which cannot have a prefilter).
+
+ The chunks are handed to `emit` with `emit_data` in order, from a
+ background thread.  If `emit` is NULL, they are appended to the
+ super-chunk in `cparams.schunk` instead, which should not be used until
+ the stream is flushed.
+
+ NULL is returned if this fails.
+ */
+BLOSC_EXPORT blosc2_cstream* blosc2_cstream_new(blosc2_cparams cparams,
+     size_t chunksize, blosc2_cstream_fn emit, void* emit_data);
+
+/* Write the `nbytes` bytes in `src` to a stream.
+
+ The threads of the compression context start compressing every block as
+ soon as it is complete, so the data does not wait for its chunk to be
+ full.  Writes wait when there are two chunks pending.
+
+ This returns 0 if succeeds, or a negative code if the stream is flushed
+ already or some chunk could not be compressed or emitted.
+ */
+BLOSC_EXPORT int blosc2_cstream_write(blosc2_cstream* stream,
+     const void* src, size_t nbytes);
+
+/* Finish a stream, emitting the last (partial) chunk and waiting for all
+ of them.  Nothing can be written to the stream afterwards.
+
+ This returns 0 if all the chunks have been emitted, or a negative code
+ if some of them could not be compressed or emitted (the chunks after the
+ first error are discarded).
+ */
+BLOSC_EXPORT int blosc2_cstream_flush(blosc2_cstream* stream);
+
+/* Free a stream, flushing it first */
+BLOSC_EXPORT void blosc2_cstream_free(blosc2_cstream* stream);
+
+/* Replace the `nchunk` chunk of a super-chunk with `chunk`.
+
+ `chunk` must be a Blosc buffer.  If `copy` is 0, the super-chunk takes
+ the ownership of `chunk`, which must have been allocated with malloc()
+ (only when this succeeds); otherwise a copy of it is made.  The previous
+ chunk is released.
+
+ This returns the number of chunks in the super-chunk.  If some problem is
+ detected, this number will be negative.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_update_chunk(blosc2_schunk* sheader,
+     int64_t nchunk, void* chunk, int copy);
+
+/* Insert `chunk` at the `nchunk` position of a super-chunk, moving the
+ chunks from `nchunk` on one position forward.  `nchunk` can be the number
+ of chunks, for appending it.
+
+ `chunk` and `copy` are like in blosc2_schunk_update_chunk().
+
+ This returns the number of chunks in the super-chunk.  If some problem is
+ detected, this number will be negative.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_insert_chunk(blosc2_schunk* sheader,
+     int64_t nchunk, void* chunk, int copy);
+
+/* Delete the `nchunk` chunk of a super-chunk, moving the chunks after it
+ one position backward.
+
+ This returns the number of chunks in the super-chunk.  If some problem is
+ detected, this number will be negative.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_delete_chunk(blosc2_schunk* sheader,
+     int64_t nchunk);
+
+/* Compress the `src` data buffer of `nbytes` bytes with the compression
+ context of a super-chunk and replace the `nchunk` chunk with it (see
+ blosc2_schunk_update_chunk()).
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_update_buffer(blosc2_schunk* sheader,
+     int64_t nchunk, size_t nbytes, void* src);
+
+/* Compress the `src` data buffer of `nbytes` bytes with the compression
+ context of a super-chunk and insert it at the `nchunk` position (see
+ blosc2_schunk_insert_chunk()).
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_insert_buffer(blosc2_schunk* sheader,
+     int64_t nchunk, size_t nbytes, void* src);
+
 BLOSC_EXPORT void* blosc2_packed_append_buffer(void* packed, size_t typesize,
                                                size_t nbytes, void* src);
 
+/* Replace the `nchunk` chunk of a *packed* super-chunk with a copy of
+ `chunk`, which must be a Blosc buffer.
+
+ Like the other functions changing packed super-chunks, this can move the
+ packed super-chunk, and returns its new address.  The new chunk is put
+ after the last one, and the bytes of the replaced one are left dead until
+ blosc2_packed_compact().  The zone maps kept in the packed super-chunk
+ are updated too (see blosc2_schunk_set_zonemaps()).  If some problem is
+ detected, NULL is returned and the packed super-chunk is left as is.
+ */
+BLOSC_EXPORT void* blosc2_packed_update_chunk(void* packed, int64_t nchunk,
+                                              void* chunk);
+
+/* Insert a copy of `chunk` at the `nchunk` position of a *packed*
+ super-chunk, moving the chunks from `nchunk` on one position forward (see
+ blosc2_packed_update_chunk()).
+ */
+BLOSC_EXPORT void* blosc2_packed_insert_chunk(void* packed, int64_t nchunk,
+                                              void* chunk);
+
+/* Delete the `nchunk` chunk of a *packed* super-chunk, moving the chunks
+ after it one position backward (see blosc2_packed_update_chunk()).
+ */
+BLOSC_EXPORT void* blosc2_packed_delete_chunk(void* packed, int64_t nchunk);
+
+/* Drop the dead bytes that changing the chunks of a *packed* super-chunk
+ leaves in it, by copying the rest into a new packed super-chunk.
+
+ The old packed super-chunk is freed, and the new one is returned (or the
+ old one if it has no dead bytes).  If some problem is detected, NULL is
+ returned and the packed super-chunk is left as is.
+ */
+BLOSC_EXPORT void* blosc2_packed_compact(void* packed);
+
 /* Decompress and return the `nchunk` chunk of a super-chunk.
 
  If the chunk is uncompressed successfully, it is put in the `*dest`
@@ -680,16 +1240,265 @@ BLOSC_EXPORT void* blosc2_packed_append_buffer(void* packed, size_t typesize,
 BLOSC_EXPORT int blosc2_decompress_chunk(blosc2_schunk* sheader,
      size_t nchunk, void* dest, size_t nbytes);
 
+/* Decompress the chunks from `first` to `last` (not included) of a
+ super-chunk into the contiguous `dest` area of `nbytes` bytes.
+
+ The blocks of all the chunks are decompressed concurrently by the
+ threads of the decompression context of the super-chunk, so that
+ ranges of small chunks are read in parallel too.
+
+ The size of the decompressed range is returned.  If some problem is
+ detected, a negative code is returned instead.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_decompress_range(blosc2_schunk* sheader,
+     size_t first, size_t last, void* dest, size_t nbytes);
+
+/* Get the items from `start` to `stop` (not included) of a super-chunk,
+ counting from the start of its first chunk, into `dest`.
+
+ Items are `typesize` bytes long and the slice can span several chunks.
+ Only the blocks intersecting the slice are decompressed for the chunks
+ at its edges, while the chunks fully inside are decompressed
+ concurrently (see blosc2_schunk_decompress_range()).  `dest` must have
+ room for (`stop` - `start`) * `typesize` bytes.
+
+ The number of bytes copied into `dest` is returned.  If some problem is
+ detected, a negative code is returned instead.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_get_slice(blosc2_schunk* sheader,
+     int64_t start, int64_t stop, void* dest);
+
+/* Set up a partial result of blosc2_schunk_reduce() */
+typedef void (*blosc2_reduce_init_fn)(void* partial, void* user_data);
+
+/* Fold the decompressed `block` of `size` bytes, found at `offset` bytes
+   from the start of the super-chunk, into a partial result.  Returns 0 if
+   succeeds, or a negative value for stopping the reduction. */
+typedef int (*blosc2_reduce_block_fn)(void* partial, const uint8_t* block,
+     int32_t size, int32_t typesize, int64_t offset, void* user_data);
+
+/* Fold a partial result into the final `result` */
+typedef void (*blosc2_reduce_combine_fn)(void* result, const void* partial,
+     void* user_data);
+
+/* Reduce the contents of a super-chunk with the threads of its
+ decompression context.
+
+ Every thread gets a partial result of `partial_size` bytes, set up with
+ `init`, and folds into it the blocks that it decompresses with `block`,
+ while they are still in its cache (see blosc2_postfilter_fn).  The blocks
+ come in no particular order.  Then `result` is set up with `init` too and
+ every partial result is folded into it with `combine`.  `user_data` is
+ passed to all of them.
+
+ The number of bytes reduced is returned.  If some problem is detected, a
+ negative code is returned instead.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_reduce(blosc2_schunk* sheader,
+     size_t partial_size, blosc2_reduce_init_fn init,
+     blosc2_reduce_block_fn block, blosc2_reduce_combine_fn combine,
+     void* user_data, void* result);
+
+/* An element-wise expression over super-chunks */
+typedef struct blosc2_expr_s blosc2_expr;   /* uncomplete type */
+
+/* Compile an element-wise `expression` over the `noperands` super-chunks
+ in `operands`.
+
+ The operands are named from `a` to `z` in the expression, in the order
+ of `operands`, and their items are doubles.  Expressions are made of
+ operands, numbers, parentheses and the `+`, `-`, `*` and `/` operators.
+
+ The operands are not copied, so they must outlive the expression.  NULL
+ is returned if the expression is not valid or too deeply nested, or if
+ memory cannot be allocated.
+ */
+BLOSC_EXPORT blosc2_expr* blosc2_expr_new(const char* expression,
+     blosc2_schunk** operands, int noperands);
+
+/* Evaluate an expression and append the result to `out`, a chunk for
+ every chunk of the operands (which must have chunks of the same sizes).
+
+ The result is made block by block by the threads of the compression
+ context of `out` (see blosc2_prefilter_fn), every thread decompressing
+ just the matching blocks of the operands.  So neither the operands nor
+ the result are ever decompressed as a whole.
+
+ The number of bytes appended is returned.  If some problem is detected,
+ a negative code is returned instead.
+ */
+BLOSC_EXPORT int64_t blosc2_expr_eval(blosc2_expr* expr, blosc2_schunk* out);
+
+/* Free an expression */
+BLOSC_EXPORT void blosc2_expr_free(blosc2_expr* expr);
+
+/* Statistics of the cache of decompressed chunks of a super-chunk */
+typedef struct {
+  size_t budget;
+  /* the memory budget in bytes */
+  size_t nbytes;
+  /* the bytes in the cached chunks */
+  int64_t nchunks;
+  /* the number of cached chunks */
+  int64_t hits;
+  /* the lookups served from the cache */
+  int64_t misses;
+  /* the lookups that had to decompress the chunk */
+  int64_t evictions;
+  /* the chunks dropped for making room to others */
+} blosc2_chunkcache_stats;
+
+/* Attach a cache of decompressed chunks to a super-chunk.
+
+ From now on, blosc2_decompress_chunk() keeps a copy of the chunks that it
+ decompresses, up to `budget` bytes, evicting the least recently used
+ ones, and serves repeated requests of the same chunks from the cache.
+ Lookups are safe from several threads at once (the ones missing the cache
+ decompress one at a time, as they share the decompression context of the
+ super-chunk).  A `budget` of 0 drops the cache.  Attaching a new cache
+ drops the chunks and counters of the previous one.
+
+ Returns 0 if succeeds, or a negative value if some error happens.
+ */
+BLOSC_EXPORT int blosc2_schunk_set_chunkcache(blosc2_schunk* sheader,
+     size_t budget);
+
+/* Fill `stats` with the counters of the cache of decompressed chunks of a
+ super-chunk.
+
+ Returns 0 if succeeds, or a negative value if there is no cache.
+ */
+BLOSC_EXPORT int blosc2_schunk_get_chunkcache_stats(blosc2_schunk* sheader,
+     blosc2_chunkcache_stats* stats);
+
+/* The types of the items that zone maps can be computed for */
+enum {
+  BLOSC_ZONEMAP_NONE = 0,
+  BLOSC_ZONEMAP_INT8 = 1,
+  BLOSC_ZONEMAP_INT16 = 2,
+  BLOSC_ZONEMAP_INT32 = 3,
+  BLOSC_ZONEMAP_INT64 = 4,
+  BLOSC_ZONEMAP_UINT8 = 5,
+  BLOSC_ZONEMAP_UINT16 = 6,
+  BLOSC_ZONEMAP_UINT32 = 7,
+  BLOSC_ZONEMAP_UINT64 = 8,
+  BLOSC_ZONEMAP_FLOAT32 = 9,
+  BLOSC_ZONEMAP_FLOAT64 = 10,
+};
+
+/* Statistics of the items of a chunk, or of one of its blocks.
+
+ Values are converted to double, which keeps their order.  NaN values are
+ counted as nulls and do not take part in `min` and `max`, so `min` is
+ +inf and `max` is -inf when there are no other values.
+ */
+typedef struct {
+  double min;
+  /* the smallest value */
+  double max;
+  /* the largest value */
+  int64_t nnulls;
+  /* the number of NaN values */
+} blosc2_zonemap;
+
+/* Keep the zone maps (min, max and null count) of the chunks of a
+ super-chunk, and of their blocks, with items of `type`.
+
+ The size of `type` must be the typesize of the super-chunk.  The zone
+ maps of the chunks already in the super-chunk are computed right away;
+ the ones of new chunks are computed while compressing them, block by
+ block, and they follow updates, inserts and deletes.  They are stored in
+ the metadata chunk when the super-chunk is packed.  BLOSC_ZONEMAP_NONE
+ drops the zone maps.
+
+ Returns 0 if succeeds, or a negative value if some error happens.
+ */
+BLOSC_EXPORT int blosc2_schunk_set_zonemaps(blosc2_schunk* sheader,
+     int type);
+
+/* Fill `zonemap` with the zone map of the `nchunk` chunk of a super-chunk.
+
+ Returns 0 if succeeds, or a negative value if the super-chunk has no
+ zone maps or there is no such chunk.
+ */
+BLOSC_EXPORT int blosc2_schunk_get_zonemap(blosc2_schunk* sheader,
+     int64_t nchunk, blosc2_zonemap* zonemap);
+
+/* Fill `zonemaps` with the zone maps of the blocks of the `nchunk` chunk
+ of a super-chunk, up to `maxblocks` of them.
+
+ Returns the number of blocks of the chunk, or a negative value if the
+ super-chunk has no zone maps or there is no such chunk.
+ */
+BLOSC_EXPORT int blosc2_schunk_get_block_zonemaps(blosc2_schunk* sheader,
+     int64_t nchunk, blosc2_zonemap* zonemaps, int32_t maxblocks);
+
+/* Find the chunks of a super-chunk that can hold values in [`low`, `high`].
+
+ Only the zone maps are looked up, so the chunks found may still have no
+ such values, but the chunks left out have none for sure.  Their ids are
+ put in `chunks`, in order and up to `maxchunks` of them.
+
+ Returns the number of chunks found, or a negative value if the
+ super-chunk has no zone maps.
+ */
+BLOSC_EXPORT int64_t blosc2_schunk_zonemap_query(blosc2_schunk* sheader,
+     double low, double high, int64_t* chunks, int64_t maxchunks);
+
 BLOSC_EXPORT int blosc2_packed_decompress_chunk(void* packed, size_t nchunk,
       void** dest);
 
 /* Pack a super-chunk by using the header. */
 BLOSC_EXPORT void* blosc2_pack_schunk(blosc2_schunk* sheader);
 
-/* Unpack a packed super-chunk */
+/* Unpack a packed super-chunk (NULL if it has an unsupported version, see
+ README_PACKED_HEADER.rst) */
 BLOSC_EXPORT blosc2_schunk* blosc2_unpack_schunk(void* packed);
 
 
+/* Objectives for BTune, the automatic tuner for super-chunks */
+enum {
+  BLOSC_BTUNE_RATIO = 0,   /* maximize the compression ratio */
+  BLOSC_BTUNE_CSPEED = 1,  /* maximize the compression speed */
+  BLOSC_BTUNE_DSPEED = 2,  /* maximize the decompression speed */
+};
+
+/**
+  The parameters for BTune.
+
+  In parenthesis it is shown the default value used internally when a 0
+  (zero) in the fields of the struct is passed to a function.
+*/
+typedef struct {
+  int objective;
+  /* the figure to maximize (BLOSC_BTUNE_RATIO) */
+  double min_cspeed;
+  /* the minimum compression speed in GB/s (0; meaning no limit) */
+  double min_dspeed;
+  /* the minimum decompression speed in GB/s (0; meaning no limit) */
+  int period;
+  /* the number of chunks between checks for data drift (32) */
+} blosc2_btune;
+
+/* Default struct for BTune params meant for user initialization */
+static const blosc2_btune BLOSC_BTUNE_DEFAULTS = {BLOSC_BTUNE_RATIO, 0, 0, 0};
+
+/**
+  Attach BTune to a super-chunk.
+
+  From now on, the chunks appended to `schunk` are used for measuring
+  the compression ratio and speed of different codecs, compression
+  levels, shuffles and blocksizes.  After a few chunks, the tuner
+  converges to the parameters that best fit the `btune` objective and
+  constraints, and stores them in the super-chunk header (`compcode`,
+  `clevel`, `filters` and `blocksize`).  The parameters are explored
+  again whenever the compression ratio of new chunks drifts away.
+
+  Returns 0 if succeeds, or a negative value if some error happens.
+*/
+BLOSC_EXPORT int blosc2_set_btune(blosc2_schunk* schunk, blosc2_btune btune);
+
+
 /*********************************************************************
 
   Low-level functions follows.  Use them only if you are an expert!
@@ -706,6 +1515,14 @@ BLOSC_EXPORT int blosc_get_blocksize(void);
 */
 BLOSC_EXPORT void blosc_set_blocksize(size_t blocksize);
 
+/**
+  Get the sizes (in bytes) of the L1 data, L2 and L3 caches of the CPU,
+  as detected at runtime.  These are used for computing automatic
+  blocksizes.  Sizes that cannot be detected are reported as the usual
+  defaults (32 KB for L1, 256 KB for L2 and 0 for L3).
+*/
+BLOSC_EXPORT void blosc_get_cache_sizes(size_t* l1, size_t* l2, size_t* l3);
+
 /**
   Set pointer to super-chunk.  If NULL, no super-chunk will be
   available (the default).
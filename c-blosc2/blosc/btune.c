@@ -8,8 +8,113 @@
 **********************************************************************/
 
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+  #include <windows.h>
+#elif defined(__MACH__)
+  #include <mach/clock.h>
+  #include <mach/mach.h>
+  #include <time.h>
+  #include <sys/sysctl.h>
+#else
+  #include <time.h>
+#endif
 #include "btune.h"
 
+#if defined(_MSC_VER) && (defined(_M_IX86) || defined(_M_X64))
+  #include <intrin.h>
+  #define cpuid(leaf, subleaf, regs) __cpuidex((int*)(regs), leaf, subleaf)
+#elif defined(__i386__) || defined(__x86_64__)
+  #include <cpuid.h>
+  #define cpuid(leaf, subleaf, regs) \
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3])
+#endif
+
+
+/* Phases of the BTune exploration, in order */
+enum {
+  BTUNE_CODEC,      /* codecs and shuffles */
+  BTUNE_CLEVEL,     /* compression levels */
+  BTUNE_BLOCKSIZE,  /* blocksizes */
+  BTUNE_STEADY,     /* use the best parameters found */
+};
+
+#define BTUNE_MAX_CANDIDATES 16
+#define BTUNE_PERIOD 32
+#define BTUNE_GB (1024. * 1024. * 1024.)
+/* Relative change in the compression ratio considered as a data drift */
+#define BTUNE_DRIFT 0.25
+
+/* The parameters that BTune explores */
+typedef struct {
+  int compcode;
+  int clevel;
+  uint8_t shuffle;      /* the filter in the last slot of the pipeline */
+  int32_t blocksize;    /* 0 means automatic */
+} btune_params;
+
+/* The measurements for a set of parameters */
+typedef struct {
+  btune_params params;
+  double ratio;
+  double cspeed;        /* GB/s */
+  double dspeed;        /* GB/s (0 if not measured) */
+} btune_trial;
+
+#if defined(_WIN32)
+typedef LARGE_INTEGER btune_timestamp;
+#else
+typedef struct timespec btune_timestamp;
+#endif
+
+typedef struct {
+  blosc2_btune config;
+  blosc2_schunk* schunk;
+  int phase;
+  btune_params candidates[BTUNE_MAX_CANDIDATES];
+  int ncandidates;
+  int current;          /* candidate used for the next chunk */
+  btune_trial best;
+  int has_best;
+  size_t chunksize;     /* size of the last chunk */
+  double drift_ratio;   /* sum of ratios since the last drift check */
+  int drift_count;
+  uint8_t* dbuf;        /* scratch for measuring decompression */
+  size_t dbufsize;
+  btune_timestamp start;
+} btune_state;
+
+
+static void btune_set_timestamp(btune_timestamp* timestamp) {
+#if defined(_WIN32)
+  QueryPerformanceCounter(timestamp);
+#elif defined(__MACH__)
+  clock_serv_t cclock;
+  mach_timespec_t mts;
+  host_get_clock_service(mach_host_self(), CALENDAR_CLOCK, &cclock);
+  clock_get_time(cclock, &mts);
+  mach_port_deallocate(mach_task_self(), cclock);
+  timestamp->tv_sec = mts.tv_sec;
+  timestamp->tv_nsec = mts.tv_nsec;
+#else
+  clock_gettime(CLOCK_MONOTONIC, timestamp);
+#endif
+}
+
+
+/* Elapsed seconds between two timestamps */
+static double btune_elapsed(btune_timestamp start, btune_timestamp end) {
+#if defined(_WIN32)
+  LARGE_INTEGER freq;
+  QueryPerformanceFrequency(&freq);
+  return (double)(end.QuadPart - start.QuadPart) / (double)freq.QuadPart;
+#else
+  return (double)(end.tv_sec - start.tv_sec) +
+         1e-9 * (double)(end.tv_nsec - start.tv_nsec);
+#endif
+}
+
 
 /* Whether a codec is meant for High Compression Ratios */
 /* Includes LZ4 + BITSHUFFLE here, but not BloscLZ + BITSHUFFLE because,
@@ -36,13 +141,210 @@ int HCR(blosc2_context *context) {
 }
 
 
+/* Cache sizes in bytes (L1 data, L2 and L3), detected at runtime */
+static size_t cache_sizes[3] = {0, 0, 0};
+static pthread_once_t cache_once = PTHREAD_ONCE_INIT;
+
+
+/* Parse sizes like "48K" or "32M" from sysfs */
+#if defined(__linux__)
+static size_t parse_cache_size(const char* str) {
+  char* end;
+  size_t size = (size_t)strtoul(str, &end, 10);
+  if (*end == 'K') {
+    size *= 1024;
+  }
+  else if (*end == 'M') {
+    size *= 1024 * 1024;
+  }
+  return size;
+}
+
+
+/* Read the first line of a small sysfs file */
+static int read_sysfs(const char* path, char* buf, int len) {
+  FILE* f = fopen(path, "r");
+  if (f == NULL) {
+    return -1;
+  }
+  if (fgets(buf, len, f) == NULL) {
+    fclose(f);
+    return -1;
+  }
+  fclose(f);
+  return 0;
+}
+#endif  /* __linux__ */
+
+
+/* Get the cache sizes of the first CPU from the OS */
+static void detect_cache_sizes_os(size_t* sizes) {
+#if defined(__linux__)
+  char path[128];
+  char buf[32];
+  for (int i = 0; i < 16; i++) {
+    int level;
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/level", i);
+    if (read_sysfs(path, buf, sizeof(buf)) < 0) {
+      break;
+    }
+    level = atoi(buf);
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/type", i);
+    if ((read_sysfs(path, buf, sizeof(buf)) < 0) ||
+        (strncmp(buf, "Instruction", 11) == 0)) {
+      continue;
+    }
+    snprintf(path, sizeof(path),
+             "/sys/devices/system/cpu/cpu0/cache/index%d/size", i);
+    if ((level >= 1) && (level <= 3) &&
+        (read_sysfs(path, buf, sizeof(buf)) == 0)) {
+      sizes[level - 1] = parse_cache_size(buf);
+    }
+  }
+#elif defined(__APPLE__)
+  const char* names[3] = {"hw.l1dcachesize", "hw.l2cachesize",
+                          "hw.l3cachesize"};
+  for (int i = 0; i < 3; i++) {
+    int64_t size = 0;
+    size_t len = sizeof(size);
+    if (sysctlbyname(names[i], &size, &len, NULL, 0) == 0) {
+      sizes[i] = (size_t)size;
+    }
+  }
+#elif defined(_WIN32)
+  SYSTEM_LOGICAL_PROCESSOR_INFORMATION* info = NULL;
+  DWORD len = 0;
+  GetLogicalProcessorInformation(NULL, &len);
+  info = malloc(len);
+  if ((info != NULL) && GetLogicalProcessorInformation(info, &len)) {
+    for (DWORD i = 0; i < len / sizeof(*info); i++) {
+      CACHE_DESCRIPTOR* cache = &info[i].Cache;
+      if ((info[i].Relationship == RelationCache) &&
+          (cache->Level >= 1) && (cache->Level <= 3) &&
+          (cache->Type != CacheInstruction) &&
+          (sizes[cache->Level - 1] == 0)) {
+        sizes[cache->Level - 1] = cache->Size;
+      }
+    }
+  }
+  free(info);
+#else
+  (void)sizes;
+#endif
+}
+
+
+/* Get the cache sizes with the x86 cpuid instruction */
+static void detect_cache_sizes_cpuid(size_t* sizes) {
+#if defined(__i386__) || defined(__x86_64__) || \
+    defined(_M_IX86) || defined(_M_X64)
+  /* Intel uses leaf 4, AMD leaf 0x8000001D with the same layout */
+  uint32_t leaves[2] = {4, 0x8000001D};
+  uint32_t regs[4];
+  for (int l = 0; l < 2; l++) {
+    cpuid(leaves[l] & 0x80000000, 0, regs);
+    if (regs[0] < leaves[l]) {
+      continue;
+    }
+    for (uint32_t i = 0; i < 16; i++) {
+      uint32_t type, level;
+      cpuid(leaves[l], i, regs);
+      type = regs[0] & 0x1f;
+      level = (regs[0] >> 5) & 0x7;
+      if (type == 0) {
+        break;
+      }
+      if ((type != 2) && (level >= 1) && (level <= 3)) {
+        /* ways * partitions * line size * sets */
+        sizes[level - 1] = (size_t)(((regs[1] >> 22) & 0x3ff) + 1) *
+                           (((regs[1] >> 12) & 0x3ff) + 1) *
+                           ((regs[1] & 0xfff) + 1) * (regs[2] + 1);
+      }
+    }
+    if (sizes[0] != 0) {
+      break;
+    }
+  }
+#else
+  (void)sizes;
+#endif
+}
+
+
+/* Detect the cache sizes (just once) */
+static void detect_caches(void) {
+  size_t sizes[3] = {0, 0, 0};
+
+  detect_cache_sizes_os(sizes);
+  if (sizes[0] == 0) {
+    detect_cache_sizes_cpuid(sizes);
+  }
+  /* Sanity checks, falling back to the usual sizes */
+  if ((sizes[0] < 8 * 1024) || (sizes[0] > 1024 * 1024)) {
+    sizes[0] = L1;
+  }
+  if ((sizes[1] < sizes[0]) || (sizes[1] > 64 * 1024 * 1024)) {
+    sizes[1] = L2;
+  }
+  if (sizes[2] < sizes[1]) {
+    sizes[2] = 0;
+  }
+  cache_sizes[0] = sizes[0];
+  cache_sizes[1] = sizes[1];
+  cache_sizes[2] = sizes[2];
+}
+
+
+/* Contexts can be created from several threads at once */
+void btune_detect_caches(void) {
+  pthread_once(&cache_once, detect_caches);
+}
+
+
+void blosc_get_cache_sizes(size_t* l1, size_t* l2, size_t* l3) {
+  btune_detect_caches();
+  *l1 = cache_sizes[0];
+  *l2 = cache_sizes[1];
+  *l3 = cache_sizes[2];
+}
+
+
+/* The largest automatic blocksize whose per-thread working set (the source
+   block plus the temporaries) fits in the cache that suits the tuning
+   profile and `clevel` */
+static size_t blocksize_limit(blosc2_context* context) {
+  size_t cache = cache_sizes[1];
+  size_t nthreads = (context->nthreads > 0) ? (size_t)context->nthreads : 1;
+  size_t limit;
+  int use_l3 = (context->tuning == BLOSC_TUNE_RATIO) ||
+               ((context->tuning == BLOSC_TUNE_BALANCED) &&
+                (context->clevel >= 7));
+
+  if (use_l3 && (cache_sizes[2] / nthreads > cache)) {
+    /* Trade speed for ratio: use the share of L3 for this thread */
+    cache = cache_sizes[2] / nthreads;
+  }
+  limit = (cache - context->typesize * sizeof(int32_t)) / BLOSC_WORKINGSET;
+  if (limit < cache_sizes[0]) {
+    limit = cache_sizes[0];
+  }
+  return limit;
+}
+
+
 /* Tune some compression parameters based in the context */
 void btune_cparams(blosc2_context* context) {
   int32_t clevel = context->clevel;
   size_t typesize = context->typesize;
   size_t nbytes = context->sourcesize;
-  size_t user_blocksize = context->blocksize;
+  size_t user_blocksize = context->force_blocksize;
   size_t blocksize = nbytes;
+  size_t nthreads = (context->nthreads > 0) ? (size_t)context->nthreads : 1;
+
+  btune_detect_caches();
+  context->blocksize_limit = blocksize_limit(context);
 
   /* Protection against very small buffers */
   if (nbytes < typesize) {
@@ -57,8 +359,18 @@ void btune_cparams(blosc2_context* context) {
       blocksize = BLOSC_MIN_BUFFERSIZE;
     }
   }
-  else if (nbytes >= L1) {
-    blocksize = L1;
+  else if ((nbytes >= cache_sizes[0]) &&
+           (context->tuning == BLOSC_TUNE_DECOMP_SPEED)) {
+    /* The largest blocks whose decompression happens in L2 */
+    blocksize = context->blocksize_limit;
+  }
+  else if ((nbytes >= cache_sizes[0]) &&
+           (context->tuning == BLOSC_TUNE_RATIO)) {
+    /* The largest blocks used for the highest compression levels */
+    blocksize = cache_sizes[0] * 32;
+  }
+  else if (nbytes >= cache_sizes[0]) {
+    blocksize = cache_sizes[0];
 
     /* For HCR codecs, increase the block sizes by a factor of 2 because they
        are meant for compressing large blocks (i.e. they show a big overhead
@@ -99,6 +411,20 @@ void btune_cparams(blosc2_context* context) {
       default:
         break;
     }
+
+  }
+
+  if (!user_blocksize && (nbytes >= cache_sizes[0])) {
+    /* Keep the working set of every thread in cache */
+    if (blocksize > context->blocksize_limit) {
+      blocksize = context->blocksize_limit;
+    }
+
+    /* Give every thread at least a block, as long as blocks fill L1 */
+    if ((nbytes / blocksize < nthreads) &&
+        (nbytes / nthreads >= cache_sizes[0])) {
+      blocksize = nbytes / nthreads;
+    }
   }
 
   /* Check that blocksize is not too large */
@@ -113,3 +439,293 @@ void btune_cparams(blosc2_context* context) {
 
   context->blocksize = blocksize;
 }
+
+
+int blosc2_get_blocksize_info(blosc2_context* context,
+                              blosc2_blocksize_info* info) {
+  if (context->do_compress != 1) {
+    fprintf(stderr, "Context is not meant for compression.  Giving up.\n");
+    return -10;
+  }
+  blosc_get_cache_sizes(&info->l1, &info->l2, &info->l3);
+  info->blocksize = context->blocksize;
+  info->blocksize_limit = context->blocksize_limit;
+  info->forced = (context->force_blocksize != 0);
+  return 0;
+}
+
+
+/* Whether the last slot of the filter pipeline can be tuned */
+static int shuffle_tunable(blosc2_context* context) {
+  uint8_t filter = context->filters[BLOSC_MAX_FILTERS - 1];
+  return ((filter == BLOSC_NOSHUFFLE) || (filter == BLOSC_SHUFFLE) ||
+          (filter == BLOSC_BITSHUFFLE));
+}
+
+
+/* How far a trial is from fulfilling the speed constraints (0 if it does) */
+static double violation(btune_state* state, btune_trial* trial) {
+  double v = 0;
+  if ((state->config.min_cspeed > 0) &&
+      (trial->cspeed < state->config.min_cspeed)) {
+    v = 1 - trial->cspeed / state->config.min_cspeed;
+  }
+  if ((state->config.min_dspeed > 0) &&
+      (trial->dspeed < state->config.min_dspeed) &&
+      (1 - trial->dspeed / state->config.min_dspeed > v)) {
+    v = 1 - trial->dspeed / state->config.min_dspeed;
+  }
+  return v;
+}
+
+
+/* Whether trial `a` is better than trial `b` for the objective */
+static int better_trial(btune_state* state, btune_trial* a, btune_trial* b) {
+  double va = violation(state, a);
+  double vb = violation(state, b);
+
+  if ((va > 0) || (vb > 0)) {
+    return va < vb;
+  }
+  switch (state->config.objective) {
+    case BLOSC_BTUNE_CSPEED:
+      return a->cspeed > b->cspeed;
+    case BLOSC_BTUNE_DSPEED:
+      return a->dspeed > b->dspeed;
+    default:
+      return a->ratio > b->ratio;
+  }
+}
+
+
+/* Fill the candidates for the current phase, around the best params */
+static void build_candidates(btune_state* state, blosc2_context* context) {
+  static const int compcodes[] = {BLOSC_BLOSCLZ, BLOSC_LZ4, BLOSC_LZ4HC,
+                                  BLOSC_ZLIB, BLOSC_ZSTD, BLOSC_LIZARD};
+  static const int clevels[] = {1, 3, 5, 7, 9};
+  static const int32_t blocksizes[] = {0, 16 * 1024, 32 * 1024, 64 * 1024,
+                                       128 * 1024, 256 * 1024, 512 * 1024};
+  btune_params base = state->best.params;
+  btune_params* c = state->candidates;
+  char* compname;
+  int n = 0;
+  int i, j;
+
+  switch (state->phase) {
+    case BTUNE_CODEC:
+      for (i = 0; i < (int)(sizeof(compcodes) / sizeof(int)); i++) {
+        if (blosc_compcode_to_compname(compcodes[i], &compname) < 0) {
+          continue;   /* codec not compiled in */
+        }
+        for (j = 0; j < 2; j++) {
+          c[n] = base;
+          c[n].compcode = compcodes[i];
+          if (shuffle_tunable(context)) {
+            /* Shuffle does nothing for 1-byte items */
+            c[n].shuffle = (uint8_t)((j == 1) ? BLOSC_BITSHUFFLE :
+                            (context->typesize > 1) ? BLOSC_SHUFFLE :
+                                                      BLOSC_NOSHUFFLE);
+          }
+          else if (j == 1) {
+            break;
+          }
+          n++;
+        }
+      }
+      break;
+    case BTUNE_CLEVEL:
+      for (i = 0; i < (int)(sizeof(clevels) / sizeof(int)); i++) {
+        if (clevels[i] != base.clevel) {
+          c[n] = base;
+          c[n].clevel = clevels[i];
+          n++;
+        }
+      }
+      break;
+    case BTUNE_BLOCKSIZE:
+      for (i = 0; i < (int)(sizeof(blocksizes) / sizeof(int32_t)); i++) {
+        if ((blocksizes[i] != base.blocksize) &&
+            ((size_t)blocksizes[i] < state->chunksize)) {
+          c[n] = base;
+          c[n].blocksize = blocksizes[i];
+          n++;
+        }
+      }
+      break;
+    default:
+      break;
+  }
+  state->ncandidates = n;
+  state->current = 0;
+}
+
+
+/* Store the best params in the super-chunk header, so that they persist */
+static void persist_params(btune_state* state) {
+  blosc2_schunk* schunk = state->schunk;
+  btune_params* params = &state->best.params;
+
+  schunk->compcode = (uint8_t)params->compcode;
+  schunk->clevel = (uint8_t)params->clevel;
+  schunk->filters[BLOSC_MAX_FILTERS - 1] = params->shuffle;
+  schunk->blocksize = params->blocksize;
+}
+
+
+/* Move to the next phase having candidates to explore */
+static void next_phase(btune_state* state, blosc2_context* context) {
+  persist_params(state);
+  do {
+    state->phase++;
+    build_candidates(state, context);
+  } while ((state->phase < BTUNE_STEADY) && (state->ncandidates == 0));
+  state->drift_ratio = 0;
+  state->drift_count = 0;
+}
+
+
+/* Start exploring from the codec phase, using current params as a base */
+static void restart_exploration(btune_state* state, blosc2_context* context) {
+  state->phase = BTUNE_CODEC;
+  state->has_best = 0;
+  build_candidates(state, context);
+}
+
+
+int blosc2_set_btune(blosc2_schunk* schunk, blosc2_btune btune) {
+  blosc2_context* context = schunk->cctx;
+  btune_state* state;
+
+  if ((btune.objective < BLOSC_BTUNE_RATIO) ||
+      (btune.objective > BLOSC_BTUNE_DSPEED)) {
+    fprintf(stderr, "BTune objective %d not supported\n", btune.objective);
+    return -1;
+  }
+  if ((btune.min_cspeed < 0) || (btune.min_dspeed < 0)) {
+    fprintf(stderr, "BTune speed constraints cannot be negative\n");
+    return -1;
+  }
+
+  btune_free(context);
+  state = calloc(1, sizeof(btune_state));
+  if (state == NULL) {
+    return -1;
+  }
+  state->config = btune;
+  if (state->config.period <= 0) {
+    state->config.period = BTUNE_PERIOD;
+  }
+  state->schunk = schunk;
+
+  /* The current super-chunk params are the starting point */
+  state->best.params.compcode = schunk->compcode;
+  state->best.params.clevel = (schunk->clevel > 0) ? schunk->clevel : 5;
+  state->best.params.shuffle = schunk->filters[BLOSC_MAX_FILTERS - 1];
+  state->best.params.blocksize = schunk->blocksize;
+  context->btune = state;
+  restart_exploration(state, context);
+
+  return 0;
+}
+
+
+/* Set the compression params for the next chunk */
+void btune_next_cparams(blosc2_context* context) {
+  btune_state* state = (btune_state*)context->btune;
+  btune_params* params;
+
+  if (state == NULL) {
+    return;
+  }
+  if (state->phase == BTUNE_STEADY) {
+    params = &state->best.params;
+  }
+  else {
+    params = &state->candidates[state->current];
+  }
+
+  context->compcode = params->compcode;
+  context->clevel = params->clevel;
+  if (shuffle_tunable(context)) {
+    context->filters[BLOSC_MAX_FILTERS - 1] = params->shuffle;
+  }
+  context->force_blocksize = (size_t)params->blocksize;
+
+  btune_set_timestamp(&state->start);
+}
+
+
+/* Feed BTune with the results of compressing a chunk */
+void btune_update(blosc2_context* context, size_t nbytes, int cbytes,
+                  const void* chunk) {
+  btune_state* state = (btune_state*)context->btune;
+  btune_timestamp end;
+  btune_trial trial;
+  double elapsed;
+
+  if ((state == NULL) || (cbytes <= 0) || (nbytes == 0)) {
+    return;
+  }
+  btune_set_timestamp(&end);
+  elapsed = btune_elapsed(state->start, end);
+  state->chunksize = nbytes;
+
+  if (state->phase == BTUNE_STEADY) {
+    /* Check for data drifting away from the one used for tuning */
+    state->drift_ratio += (double)nbytes / cbytes;
+    state->drift_count++;
+    if (state->drift_count >= state->config.period) {
+      double ratio = state->drift_ratio / state->drift_count;
+      state->drift_ratio = 0;
+      state->drift_count = 0;
+      if ((ratio > state->best.ratio * (1 + BTUNE_DRIFT)) ||
+          (ratio < state->best.ratio * (1 - BTUNE_DRIFT))) {
+        restart_exploration(state, context);
+      }
+    }
+    return;
+  }
+
+  trial.params = state->candidates[state->current];
+  trial.ratio = (double)nbytes / cbytes;
+  trial.cspeed = (double)nbytes / (elapsed > 0 ? elapsed : 1e-9) / BTUNE_GB;
+  trial.dspeed = 0;
+  if ((state->config.objective == BLOSC_BTUNE_DSPEED) ||
+      (state->config.min_dspeed > 0)) {
+    int dbytes;
+    if (state->dbufsize < nbytes) {
+      free(state->dbuf);
+      state->dbuf = malloc(nbytes);
+      state->dbufsize = (state->dbuf != NULL) ? nbytes : 0;
+    }
+    btune_set_timestamp(&state->start);
+    dbytes = blosc2_decompress_ctx(state->schunk->dctx, chunk, state->dbuf,
+                                   state->dbufsize);
+    btune_set_timestamp(&end);
+    if (dbytes > 0) {
+      elapsed = btune_elapsed(state->start, end);
+      trial.dspeed = (double)dbytes / (elapsed > 0 ? elapsed : 1e-9) / BTUNE_GB;
+    }
+  }
+
+  if (!state->has_best || better_trial(state, &trial, &state->best)) {
+    state->best = trial;
+    state->has_best = 1;
+  }
+  state->current++;
+  if (state->current >= state->ncandidates) {
+    next_phase(state, context);
+  }
+}
+
+
+/* Release the BTune state attached to a context */
+void btune_free(blosc2_context* context) {
+  btune_state* state = (btune_state*)context->btune;
+
+  if (state != NULL) {
+    free(state->dbuf);
+    free(state);
+    context->btune = NULL;
+  }
+}
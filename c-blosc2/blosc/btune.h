@@ -12,11 +12,27 @@
 
 #include "context.h"
 
-/* The size of L1 cache.  32 KB is quite common nowadays. */
+/* The size of L1 cache.  32 KB is quite common nowadays.  Only used when
+   the actual size cannot be detected at runtime. */
 #define L1 (32 * 1024)
+/* Same for the size of the L2 cache */
+#define L2 (256 * 1024)
 
+/* The size of the working set of a thread in blocks: the source block plus
+   the temporaries */
+#define BLOSC_WORKINGSET 4
+
+
+void btune_detect_caches(void);
 
 void btune_cparams(blosc2_context* context);
 
+void btune_next_cparams(blosc2_context* context);
+
+void btune_update(blosc2_context* context, size_t nbytes, int cbytes,
+                  const void* chunk);
+
+void btune_free(blosc2_context* context);
+
 
 #endif  /* BTUNE_H */
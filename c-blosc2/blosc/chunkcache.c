@@ -0,0 +1,234 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include "chunkcache.h"
+
+#if defined(_WIN32) && !defined(__GNUC__)
+  #include "win32/pthread.h"
+#else
+  #include <pthread.h>
+#endif
+
+/* The minimum number of hash buckets, and the bytes of budget per bucket */
+#define CHUNKCACHE_MINBUCKETS 16
+#define CHUNKCACHE_BUCKETBYTES (256 * 1024)
+
+typedef struct chunkcache_entry {
+  int64_t nchunk;
+  const void* chunk;    /* the compressed chunk when cached */
+  size_t nbytes;
+  uint8_t* data;        /* the decompressed chunk */
+  struct chunkcache_entry* hnext;  /* next entry in the bucket */
+  struct chunkcache_entry* prev;   /* LRU list, most recent first */
+  struct chunkcache_entry* next;
+} chunkcache_entry;
+
+struct chunkcache_s {
+  size_t budget;
+  size_t nbytes;        /* bytes in the cached chunks */
+  int64_t nchunks;      /* number of cached chunks */
+  int64_t hits;
+  int64_t misses;
+  int64_t evictions;
+  size_t nbuckets;      /* always a power of 2 */
+  chunkcache_entry** buckets;
+  chunkcache_entry* head;
+  chunkcache_entry* tail;
+  pthread_mutex_t mutex;
+};
+
+
+static size_t chunk_hash(const chunkcache* cache, int64_t nchunk) {
+  uint64_t h = (uint64_t)nchunk * 0x9e3779b97f4a7c15ULL;
+
+  h ^= h >> 32;
+  return (size_t)h & (cache->nbuckets - 1);
+}
+
+
+chunkcache* chunkcache_new(size_t budget) {
+  chunkcache* cache = calloc(1, sizeof(chunkcache));
+
+  cache->budget = budget;
+  cache->nbuckets = CHUNKCACHE_MINBUCKETS;
+  while (cache->nbuckets * CHUNKCACHE_BUCKETBYTES < budget) {
+    cache->nbuckets *= 2;
+  }
+  cache->buckets = calloc(cache->nbuckets, sizeof(chunkcache_entry*));
+  pthread_mutex_init(&cache->mutex, NULL);
+  return cache;
+}
+
+
+static chunkcache_entry* find_entry(chunkcache* cache, int64_t nchunk) {
+  chunkcache_entry* entry = cache->buckets[chunk_hash(cache, nchunk)];
+
+  while ((entry != NULL) && (entry->nchunk != nchunk)) {
+    entry = entry->hnext;
+  }
+  return entry;
+}
+
+
+static void unlink_entry(chunkcache* cache, chunkcache_entry* entry) {
+  chunkcache_entry** p = &cache->buckets[chunk_hash(cache, entry->nchunk)];
+
+  while (*p != entry) {
+    p = &(*p)->hnext;
+  }
+  *p = entry->hnext;
+  if (entry->prev != NULL) {
+    entry->prev->next = entry->next;
+  }
+  else {
+    cache->head = entry->next;
+  }
+  if (entry->next != NULL) {
+    entry->next->prev = entry->prev;
+  }
+  else {
+    cache->tail = entry->prev;
+  }
+  cache->nbytes -= entry->nbytes;
+  cache->nchunks--;
+  free(entry->data);
+  free(entry);
+}
+
+
+void chunkcache_clear(chunkcache* cache) {
+  pthread_mutex_lock(&cache->mutex);
+  while (cache->head != NULL) {
+    unlink_entry(cache, cache->head);
+  }
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void chunkcache_free(chunkcache* cache) {
+  chunkcache_clear(cache);
+  pthread_mutex_destroy(&cache->mutex);
+  free(cache->buckets);
+  free(cache);
+}
+
+
+void chunkcache_invalidate(chunkcache* cache, int64_t nchunk) {
+  chunkcache_entry* entry;
+
+  pthread_mutex_lock(&cache->mutex);
+  entry = find_entry(cache, nchunk);
+  if (entry != NULL) {
+    unlink_entry(cache, entry);
+  }
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+int chunkcache_get(chunkcache* cache, int64_t nchunk, const void* chunk,
+                   void* dest, size_t nbytes) {
+  chunkcache_entry* entry;
+  int result = -1;
+
+  pthread_mutex_lock(&cache->mutex);
+  entry = find_entry(cache, nchunk);
+  if ((entry != NULL) && (entry->chunk != chunk)) {
+    /* The chunk has been replaced behind our back */
+    unlink_entry(cache, entry);
+    entry = NULL;
+  }
+  if ((entry != NULL) && (entry->nbytes <= nbytes)) {
+    /* Move it to the front of the LRU list */
+    if (entry != cache->head) {
+      entry->prev->next = entry->next;
+      if (entry->next != NULL) {
+        entry->next->prev = entry->prev;
+      }
+      else {
+        cache->tail = entry->prev;
+      }
+      entry->prev = NULL;
+      entry->next = cache->head;
+      cache->head->prev = entry;
+      cache->head = entry;
+    }
+    memcpy(dest, entry->data, entry->nbytes);
+    result = (int)entry->nbytes;
+    cache->hits++;
+  }
+  else {
+    cache->misses++;
+  }
+  pthread_mutex_unlock(&cache->mutex);
+  return result;
+}
+
+
+void chunkcache_put(chunkcache* cache, int64_t nchunk, const void* chunk,
+                    const void* data, size_t nbytes) {
+  chunkcache_entry* entry;
+  chunkcache_entry* old;
+  size_t h;
+
+  if (nbytes > cache->budget) {
+    return;
+  }
+  entry = malloc(sizeof(chunkcache_entry));
+  if (entry == NULL) {
+    return;
+  }
+  entry->data = malloc(nbytes);
+  if (entry->data == NULL) {
+    free(entry);
+    return;
+  }
+  /* Copy outside the lock, so that readers are not kept waiting */
+  memcpy(entry->data, data, nbytes);
+  entry->nchunk = nchunk;
+  entry->chunk = chunk;
+  entry->nbytes = nbytes;
+
+  pthread_mutex_lock(&cache->mutex);
+  old = find_entry(cache, nchunk);
+  if (old != NULL) {
+    /* Another thread was faster */
+    unlink_entry(cache, old);
+  }
+  /* Evict the least recently used chunks */
+  while (cache->nbytes + nbytes > cache->budget) {
+    unlink_entry(cache, cache->tail);
+    cache->evictions++;
+  }
+  h = chunk_hash(cache, nchunk);
+  entry->hnext = cache->buckets[h];
+  cache->buckets[h] = entry;
+  entry->prev = NULL;
+  entry->next = cache->head;
+  if (cache->head != NULL) {
+    cache->head->prev = entry;
+  }
+  else {
+    cache->tail = entry;
+  }
+  cache->head = entry;
+  cache->nbytes += nbytes;
+  cache->nchunks++;
+  pthread_mutex_unlock(&cache->mutex);
+}
+
+
+void chunkcache_stats(chunkcache* cache, blosc2_chunkcache_stats* stats) {
+  pthread_mutex_lock(&cache->mutex);
+  stats->budget = cache->budget;
+  stats->nbytes = cache->nbytes;
+  stats->nchunks = cache->nchunks;
+  stats->hits = cache->hits;
+  stats->misses = cache->misses;
+  stats->evictions = cache->evictions;
+  pthread_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,40 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#ifndef BLOSC_CHUNKCACHE_H
+#define BLOSC_CHUNKCACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "blosc.h"
+
+/* A cache of the decompressed chunks of a super-chunk, keyed by their
+   number, with a memory budget and LRU eviction.  All the functions are
+   safe to call from several threads at once. */
+typedef struct chunkcache_s chunkcache;
+
+chunkcache* chunkcache_new(size_t budget);
+
+void chunkcache_free(chunkcache* cache);
+
+/* Drop all the chunks (but keep the counters) */
+void chunkcache_clear(chunkcache* cache);
+
+/* Drop the `nchunk` chunk, e.g. because it has been replaced */
+void chunkcache_invalidate(chunkcache* cache, int64_t nchunk);
+
+/* Copy the decompressed `nchunk` chunk into `dest` if it is cached and
+   was decompressed from `chunk`.  Returns its size, or -1 on misses. */
+int chunkcache_get(chunkcache* cache, int64_t nchunk, const void* chunk,
+                   void* dest, size_t nbytes);
+
+/* Keep a copy of the decompressed `nchunk` chunk */
+void chunkcache_put(chunkcache* cache, int64_t nchunk, const void* chunk,
+                    const void* data, size_t nbytes);
+
+void chunkcache_stats(chunkcache* cache, blosc2_chunkcache_stats* stats);
+
+#endif  /* BLOSC_CHUNKCACHE_H */
@@ -10,7 +10,13 @@
 #ifndef CONTEXT_H
 #define CONTEXT_H
 
+#if defined(USING_CMAKE)
+  #include "config.h"
+#endif /*  USING_CMAKE */
+
 #include "blosc.h"
+#include "blockcache.h"
+#include "zonemap.h"
 
 #if defined(_WIN32) && !defined(__GNUC__)
   #include "win32/pthread.h"
@@ -18,11 +24,85 @@
   #include <pthread.h>
 #endif
 
+#if defined(HAVE_LZ4)
+  #include "lz4.h"
+  #include "lz4hc.h"
+#endif /*  HAVE_LZ4 */
 #if defined(HAVE_ZSTD)
   #include "zstd.h"
 #endif /*  HAVE_ZSTD */
 
 
+/* Ranges of getitem spanning at least this many blocks use the threads */
+#define GETITEM_PARALLEL_BLOCKS 4
+
+/* States of an asynchronous request */
+enum {
+  BLOSC2_REQUEST_PENDING = 0,
+  BLOSC2_REQUEST_RUNNING = 1,
+  BLOSC2_REQUEST_DONE = 2,
+  BLOSC2_REQUEST_CANCELLED = 3,
+};
+
+struct blosc2_request_s {
+  blosc2_context* context;
+  /* The context running the request */
+  int do_compress;
+  /* 1 for compression, 0 for decompression */
+  size_t nbytes;
+  const void* src;
+  void* dest;
+  size_t destsize;
+  /* The params of blosc2_compress_ctx() or blosc2_decompress_ctx() */
+  blosc2_callback callback;
+  void* callback_data;
+  /* The function called on completion (NULL if none) */
+  int state;
+  /* One of the BLOSC2_REQUEST_* states */
+  int result;
+  /* The return value of the request (when done) */
+  struct blosc2_request_s* next;
+  /* The next request in the queue */
+};
+
+struct blosc2_async_s {
+  struct blosc2_request_s* head;
+  struct blosc2_request_s* tail;
+  /* The queue of pending requests */
+  int stop;
+  /* The thread has to exit once the queue is empty */
+  pthread_t thread;
+  /* The thread running the requests on the pool of the context */
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  /* Protects the queue and the states of the requests */
+};
+
+/* The buffers of a batch dispatch.  Every buffer gets a shadow context with
+   its own params and header, and the work units (a block, or a chain of
+   blocks) of all the buffers are claimed in order by the workers. */
+struct blosc2_batch_s {
+  int nbuffers;
+  /* Number of buffers in the batch */
+  blosc2_context* shadows;
+  /* The contexts of the buffers */
+  int32_t* first_unit;
+  /* The first unit of every buffer, plus the total number of units */
+  int32_t next_unit;
+  /* The next unit to be claimed */
+  size_t blocksize;
+  /* The size needed for the temporaries of the workers */
+  size_t typesize;
+  /* The largest typesize in the batch */
+  size_t start;
+  size_t stop;
+  /* The byte range of a getitem batch (stop is 0 for whole buffers) */
+  int32_t skip_units;
+  /* The units before the range of a getitem batch */
+  pthread_mutex_t mutex;
+  /* Protects the unit counter and the output of the buffers */
+};
+
 struct blosc2_context_s {
   const uint8_t* src;
   /* The source buffer */
@@ -38,6 +118,10 @@ struct blosc2_context_s {
   /* Extra bytes at end of buffer */
   size_t blocksize;
   /* Length of the block in bytes */
+  size_t force_blocksize;
+  /* Blocksize requested by the user (0 means automatic) */
+  size_t blocksize_limit;
+  /* Largest automatic blocksize whose working set fits in cache */
   size_t output_bytes;
   /* Counter for the number of output bytes */
   size_t destsize;
@@ -56,6 +140,18 @@ struct blosc2_context_s {
   /* the (sequence of) filters */
   uint8_t filters_meta[BLOSC_MAX_FILTERS];
   /* metadata for filters */
+  int chainlen;
+  /* Requested number of blocks sharing codec history (compression) */
+  int chain;
+  /* Actual number of blocks sharing codec history in current buffer */
+  int tuning;
+  /* Profile for blocksizes, splits and codec acceleration */
+  int splitmode;
+  /* How blocks are split into streams (see BLOSC_AUTO_SPLIT) */
+  int autosplit;
+  /* Cached split decision of BLOSC_AUTO_SPLIT (-1 if none) */
+  int32_t autosplit_key;
+  /* Codec, clevel, typesize and filters of the cached decision */
   blosc2_schunk* schunk;
   /* Associated super-chunk (if available) */
   struct thread_context* serial_context;
@@ -63,7 +159,33 @@ struct blosc2_context_s {
   int do_compress;
   /* 1 if we are compressing, 0 if decompressing */
   void *btune;
-  /* Entry point for BTune persistence between runs */
+  /* BTune state for the chunks of a super-chunk (NULL if not tuning) */
+  struct blosc2_batch_s* batch;
+  /* The batch being run by the pool of threads (NULL if none) */
+  struct blosc2_async_s* async;
+  /* The asynchronous requests of the context (NULL if none yet) */
+  size_t blockcache_size;
+  /* Memory budget for the cache of blocks decompressed by getitem */
+  blockcache* blockcache;
+  /* The cache of blocks decompressed by getitem (NULL if none yet) */
+  int zonemap_type;
+  /* The type of the items for the zone maps of blocks (0 if none) */
+  blosc2_zonemap* block_zonemaps;
+  /* The zone maps of the blocks of the last compressed buffer */
+  int32_t block_zonemaps_size;
+  /* The number of blocks that `block_zonemaps` has room for */
+  blosc2_prefilter_fn prefilter;
+  /* The function making the blocks to compress (NULL if none) */
+  void* prefilter_data;
+  /* The user data for the prefilter */
+  blosc2_postfilter_fn postfilter;
+  /* The function taking the decompressed blocks (NULL if none) */
+  void* postfilter_data;
+  /* The user data for the postfilter */
+  uint8_t* filter_dref;
+  /* Block 0 made by the prefilter (or decoded for the postfilter), as the
+     reference for delta */
+  size_t filter_drefsize;
 
   /* Threading */
   int nthreads;
@@ -76,6 +198,7 @@ struct blosc2_context_s {
   pthread_barrier_t barr_finish;
 #else
   int count_threads;
+  int count_threads_gen;   /* bumped every time the threads meet */
   pthread_mutex_t count_threads_mutex;
   pthread_cond_t count_threads_cv;
 #endif
@@ -86,6 +209,7 @@ struct blosc2_context_s {
   /* error code when give up */
   int thread_nblock;       /* block counter */
   int dref_not_init;       /* data ref in delta not initialized */
+  const uint8_t* dref;     /* block 0, when decoded apart from dest */
   pthread_mutex_t delta_mutex;
   pthread_cond_t delta_cv;
 };
@@ -98,6 +222,21 @@ struct thread_context {
   uint8_t* tmp3;
   uint8_t* tmp4;
   size_t tmpblocksize; /* keep track of how big the temporary buffers are */
+  uint8_t* chainbuf;   /* ping-pong buffers keeping the previous chained block */
+  size_t chainbufsize;
+  int chaincur;        /* which half of chainbuf holds the current block */
+  size_t chainprev;    /* size of the previous block in the chain */
+  int32_t chainnext;   /* the block that can continue the current chain */
+  int chainresync;     /* codec history must be reloaded from chainbuf */
+  uint8_t* deltabuf;   /* the delta reference block plus a block for getitem */
+  size_t deltabufsize;
+  uint8_t* filterbuf;  /* the block for the prefilter or the postfilter */
+  size_t filterbufsize;
+#if defined(HAVE_LZ4)
+  /* The streams for chained LZ4 and LZ4HC */
+  LZ4_stream_t* lz4_stream;
+  LZ4_streamHC_t* lz4hc_stream;
+#endif /* HAVE_LZ4 */
 #if defined(HAVE_ZSTD)
   /* The contexts for ZSTD */
   ZSTD_CCtx* zstd_cctx;
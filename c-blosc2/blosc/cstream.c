@@ -0,0 +1,267 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blosc.h"
+#include "context.h"
+
+/* A stream of data compressed into chunks while it is being written.
+
+   Chunks are written one after the other into two staging buffers.  The
+   background thread starts compressing a chunk as soon as its first bytes
+   are written, and the prefilter of the compression context waits for
+   every block to be complete, so the threads of the context compress the
+   blocks as they fill.  Compressing a chunk is assumed to go on until it is
+   full; when the stream ends in the middle of it, the chunk is made again
+   with the bytes that there are. */
+struct blosc2_cstream_s {
+  blosc2_context* cctx;
+  blosc2_schunk* schunk;     /* where the chunks go if there is no emit */
+  blosc2_cstream_fn emit;
+  void* emit_data;
+  size_t chunksize;
+  uint8_t* stage[2];         /* the chunks being written and compressed */
+  int64_t written;           /* the bytes written so far */
+  int64_t nchunk;            /* the chunk being compressed */
+  int closing;
+  int joined;
+  int error;                 /* first error compressing or emitting */
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+
+/* The prefilter of the stream, which waits for the blocks to be written */
+static int cstream_block(blosc2_prefilter_params* params) {
+  blosc2_cstream* stream = (blosc2_cstream*)params->user_data;
+  uint8_t* stage = stream->stage[stream->nchunk % 2];
+  int64_t start = stream->nchunk * (int64_t)stream->chunksize;
+  int64_t end = start + params->out_offset + params->out_size;
+  int64_t avail;
+
+  pthread_mutex_lock(&stream->mutex);
+  while ((stream->written < end) && !stream->closing) {
+    pthread_cond_wait(&stream->cond, &stream->mutex);
+  }
+  avail = stream->written - start - params->out_offset;
+  pthread_mutex_unlock(&stream->mutex);
+
+  if (avail >= params->out_size) {
+    memcpy(params->out, stage + params->out_offset, params->out_size);
+  }
+  else {
+    /* The stream ended before the block, so the chunk is made again */
+    avail = (avail > 0) ? avail : 0;
+    memcpy(params->out, stage + params->out_offset, (size_t)avail);
+    memset(params->out + avail, 0, (size_t)(params->out_size - avail));
+  }
+  return 0;
+}
+
+
+/* Compress the current chunk and emit it */
+static int compress_chunk(blosc2_cstream* stream) {
+  int64_t start = stream->nchunk * (int64_t)stream->chunksize;
+  size_t destsize = stream->chunksize + BLOSC_MAX_OVERHEAD;
+  int64_t nbytes = (int64_t)stream->chunksize;
+  int64_t avail;
+  void* chunk;
+  int cbytes;
+  int rc;
+
+  pthread_mutex_lock(&stream->mutex);
+  if (stream->closing && (stream->written - start < nbytes)) {
+    nbytes = stream->written - start;
+  }
+  pthread_mutex_unlock(&stream->mutex);
+
+  chunk = malloc(destsize);
+  if (chunk == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return -1;
+  }
+  cbytes = blosc2_compress_ctx(stream->cctx, (size_t)nbytes, NULL, chunk,
+                               destsize);
+  pthread_mutex_lock(&stream->mutex);
+  avail = stream->written - start;
+  pthread_mutex_unlock(&stream->mutex);
+  if ((cbytes >= 0) && (avail < nbytes)) {
+    /* The stream has ended in the middle of the chunk */
+    cbytes = blosc2_compress_ctx(stream->cctx, (size_t)avail, NULL, chunk,
+                                 destsize);
+  }
+  if (cbytes < 0) {
+    free(chunk);
+    return cbytes;
+  }
+
+  if (stream->emit != NULL) {
+    rc = stream->emit(chunk, cbytes, stream->emit_data);
+    free(chunk);
+  }
+  else {
+    rc = (int)blosc2_schunk_insert_chunk(stream->schunk,
+                                         stream->schunk->nchunks, chunk, 0);
+    if (rc < 0) {
+      free(chunk);
+    }
+  }
+  return (rc < 0) ? rc : 0;
+}
+
+
+/* The background thread compressing the chunks */
+static void* cstream_thread(void* arg) {
+  blosc2_cstream* stream = (blosc2_cstream*)arg;
+  int64_t start;
+  int rc;
+
+  pthread_mutex_lock(&stream->mutex);
+  while (1) {
+    start = stream->nchunk * (int64_t)stream->chunksize;
+    while ((stream->written <= start) && !stream->closing) {
+      pthread_cond_wait(&stream->cond, &stream->mutex);
+    }
+    if (stream->written <= start) {
+      break;
+    }
+    pthread_mutex_unlock(&stream->mutex);
+
+    rc = compress_chunk(stream);
+
+    pthread_mutex_lock(&stream->mutex);
+    if (rc < 0) {
+      stream->error = rc;
+      pthread_cond_broadcast(&stream->cond);
+      break;
+    }
+    /* Room for writing the chunk after the next one */
+    stream->nchunk++;
+    pthread_cond_broadcast(&stream->cond);
+  }
+  pthread_mutex_unlock(&stream->mutex);
+
+  return NULL;
+}
+
+
+blosc2_cstream* blosc2_cstream_new(blosc2_cparams cparams, size_t chunksize,
+                                   blosc2_cstream_fn emit, void* emit_data) {
+  blosc2_cstream* stream;
+
+  if ((emit == NULL) && (cparams.schunk == NULL)) {
+    fprintf(stderr, "The stream has no emit function nor super-chunk\n");
+    return NULL;
+  }
+  if ((chunksize == 0) || (chunksize > BLOSC_MAX_BUFFERSIZE)) {
+    fprintf(stderr, "The chunksize of the stream is not valid\n");
+    return NULL;
+  }
+  if (cparams.prefilter != NULL) {
+    fprintf(stderr, "Streams cannot be used with a prefilter\n");
+    return NULL;
+  }
+
+  stream = calloc(1, sizeof(blosc2_cstream));
+  if (stream == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  stream->schunk = (blosc2_schunk*)cparams.schunk;
+  stream->emit = emit;
+  stream->emit_data = emit_data;
+  stream->chunksize = chunksize;
+  stream->stage[0] = malloc(chunksize);
+  stream->stage[1] = malloc(chunksize);
+  cparams.prefilter = cstream_block;
+  cparams.prefilter_data = stream;
+  stream->cctx = blosc2_create_cctx(cparams);
+  if ((stream->stage[0] == NULL) || (stream->stage[1] == NULL) ||
+      (stream->cctx == NULL)) {
+    fprintf(stderr, "Error allocating memory!\n");
+    if (stream->cctx != NULL) {
+      blosc2_free_ctx(stream->cctx);
+    }
+    free(stream->stage[0]);
+    free(stream->stage[1]);
+    free(stream);
+    return NULL;
+  }
+  pthread_mutex_init(&stream->mutex, NULL);
+  pthread_cond_init(&stream->cond, NULL);
+  if (pthread_create(&stream->thread, NULL, cstream_thread, stream) != 0) {
+    fprintf(stderr, "ERROR; could not create the thread for the stream\n");
+    stream->joined = 1;
+    blosc2_cstream_free(stream);
+    return NULL;
+  }
+
+  return stream;
+}
+
+
+int blosc2_cstream_write(blosc2_cstream* stream, const void* src,
+                         size_t nbytes) {
+  const uint8_t* _src = (const uint8_t*)src;
+  int64_t nchunk;
+  size_t offset, n;
+  int rc;
+
+  while (nbytes > 0) {
+    pthread_mutex_lock(&stream->mutex);
+    nchunk = stream->written / (int64_t)stream->chunksize;
+    /* Back-pressure: the chunk two positions back must be compressed */
+    while ((stream->nchunk < nchunk - 1) && (stream->error == 0)) {
+      pthread_cond_wait(&stream->cond, &stream->mutex);
+    }
+    rc = (stream->error < 0) ? stream->error : (stream->closing ? -1 : 0);
+    pthread_mutex_unlock(&stream->mutex);
+    if (rc < 0) {
+      return rc;
+    }
+
+    offset = (size_t)(stream->written % (int64_t)stream->chunksize);
+    n = stream->chunksize - offset;
+    n = (n < nbytes) ? n : nbytes;
+    memcpy(stream->stage[nchunk % 2] + offset, _src, n);
+    pthread_mutex_lock(&stream->mutex);
+    stream->written += n;
+    pthread_cond_broadcast(&stream->cond);
+    pthread_mutex_unlock(&stream->mutex);
+    _src += n;
+    nbytes -= n;
+  }
+
+  return 0;
+}
+
+
+int blosc2_cstream_flush(blosc2_cstream* stream) {
+  pthread_mutex_lock(&stream->mutex);
+  stream->closing = 1;
+  pthread_cond_broadcast(&stream->cond);
+  pthread_mutex_unlock(&stream->mutex);
+  if (!stream->joined) {
+    pthread_join(stream->thread, NULL);
+    stream->joined = 1;
+  }
+
+  return stream->error;
+}
+
+
+void blosc2_cstream_free(blosc2_cstream* stream) {
+  blosc2_cstream_flush(stream);
+  pthread_mutex_destroy(&stream->mutex);
+  pthread_cond_destroy(&stream->cond);
+  blosc2_free_ctx(stream->cctx);
+  free(stream->stage[0]);
+  free(stream->stage[1]);
+  free(stream);
+}
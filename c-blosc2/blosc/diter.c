@@ -0,0 +1,207 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blosc.h"
+#include "context.h"
+
+/* An iterator over a decompressed buffer.
+
+   The buffer is read in windows of two blocks per thread (and at least
+   GETITEM_PARALLEL_BLOCKS with several threads), which the background
+   thread decompresses with blosc2_getitem_ctx() (and so with the threads
+   of the context) into two buffers in turn: the next window is
+   decompressed while the caller reads the current one. */
+struct blosc2_diter_s {
+  blosc2_context* dctx;
+  const uint8_t* src;
+  int32_t nbytes;
+  int32_t typesize;
+  int32_t window;            /* the bytes in every window */
+  int32_t nwindows;
+  uint8_t* buffers[2];
+  int32_t ndone;             /* the windows decompressed so far */
+  int32_t nread;             /* the windows read (and free) so far */
+  int32_t pos;               /* the offset of the next byte to read */
+  int error;                 /* the error decompressing a window */
+  int stop;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+
+/* The background thread decompressing the windows */
+static void* diter_thread(void* arg) {
+  blosc2_diter* iter = (blosc2_diter*)arg;
+  int32_t start, nbytes;
+  int stop;
+  int rc;
+
+  for (int32_t w = 0; w < iter->nwindows; w++) {
+    pthread_mutex_lock(&iter->mutex);
+    /* Wait for the window two positions back to be read */
+    while ((w - iter->nread >= 2) && !iter->stop) {
+      pthread_cond_wait(&iter->cond, &iter->mutex);
+    }
+    stop = iter->stop;
+    pthread_mutex_unlock(&iter->mutex);
+    if (stop) {
+      break;
+    }
+
+    start = w * iter->window;
+    nbytes = iter->nbytes - start;
+    nbytes = (nbytes < iter->window) ? nbytes : iter->window;
+    rc = blosc2_getitem_ctx(iter->dctx, iter->src, start / iter->typesize,
+                            nbytes / iter->typesize, iter->buffers[w % 2]);
+
+    pthread_mutex_lock(&iter->mutex);
+    if (rc < 0) {
+      iter->error = rc;
+    }
+    else {
+      iter->ndone = w + 1;
+    }
+    pthread_cond_broadcast(&iter->cond);
+    pthread_mutex_unlock(&iter->mutex);
+    if (rc < 0) {
+      break;
+    }
+  }
+
+  return NULL;
+}
+
+
+blosc2_diter* blosc2_diter_new(blosc2_dparams dparams, const void* src) {
+  blosc2_diter* iter;
+  size_t nbytes, cbytes, blocksize, typesize;
+  int flags;
+  int nthreads = (dparams.nthreads > 1) ? dparams.nthreads : 1;
+  size_t nblocks = 1;
+
+  blosc_cbuffer_sizes(src, &nbytes, &cbytes, &blocksize);
+  blosc_cbuffer_metainfo(src, &typesize, &flags);
+  if ((typesize == 0) || (nbytes % typesize != 0) ||
+      (blocksize % typesize != 0)) {
+    fprintf(stderr, "The buffer cannot be read by items of typesize ('%d') "
+                    "bytes\n", (int)typesize);
+    return NULL;
+  }
+
+  iter = calloc(1, sizeof(blosc2_diter));
+  if (iter == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  iter->src = (const uint8_t*)src;
+  iter->nbytes = (int32_t)nbytes;
+  iter->typesize = (int32_t)typesize;
+  /* Two blocks per thread even out the blocks that are slower to decode,
+     and blosc2_getitem_ctx() only uses the threads for large ranges */
+  if (nthreads > 1) {
+    nblocks = 2 * nthreads;
+    if (nblocks < GETITEM_PARALLEL_BLOCKS) {
+      nblocks = GETITEM_PARALLEL_BLOCKS;
+    }
+  }
+  iter->window = (int32_t)(blocksize * nblocks);
+  if ((iter->window > iter->nbytes) || (iter->window <= 0)) {
+    iter->window = iter->nbytes;
+  }
+  if (iter->window > 0) {
+    iter->nwindows = (iter->nbytes + iter->window - 1) / iter->window;
+  }
+  iter->buffers[0] = malloc(iter->window > 0 ? (size_t)iter->window : 1);
+  iter->buffers[1] = malloc(iter->window > 0 ? (size_t)iter->window : 1);
+  /* The windows are read whole, so there is nothing to cache */
+  dparams.blockcache = 0;
+  dparams.postfilter = NULL;
+  iter->dctx = blosc2_create_dctx(dparams);
+  if ((iter->buffers[0] == NULL) || (iter->buffers[1] == NULL) ||
+      (iter->dctx == NULL)) {
+    fprintf(stderr, "Error allocating memory!\n");
+    if (iter->dctx != NULL) {
+      blosc2_free_ctx(iter->dctx);
+    }
+    free(iter->buffers[0]);
+    free(iter->buffers[1]);
+    free(iter);
+    return NULL;
+  }
+  pthread_mutex_init(&iter->mutex, NULL);
+  pthread_cond_init(&iter->cond, NULL);
+  if (pthread_create(&iter->thread, NULL, diter_thread, iter) != 0) {
+    fprintf(stderr, "ERROR; could not create the thread for the iterator\n");
+    pthread_mutex_destroy(&iter->mutex);
+    pthread_cond_destroy(&iter->cond);
+    blosc2_free_ctx(iter->dctx);
+    free(iter->buffers[0]);
+    free(iter->buffers[1]);
+    free(iter);
+    return NULL;
+  }
+
+  return iter;
+}
+
+
+int blosc2_diter_next(blosc2_diter* iter, void* dest, int32_t maxbytes) {
+  uint8_t* _dest = (uint8_t*)dest;
+  int32_t ncopied = 0;
+  int32_t w, offset, n;
+  int rc = 0;
+
+  while ((ncopied < maxbytes) && (iter->pos < iter->nbytes)) {
+    w = iter->pos / iter->window;
+    pthread_mutex_lock(&iter->mutex);
+    while ((iter->ndone <= w) && (iter->error == 0)) {
+      pthread_cond_wait(&iter->cond, &iter->mutex);
+    }
+    rc = iter->error;
+    pthread_mutex_unlock(&iter->mutex);
+    if (rc < 0) {
+      return rc;
+    }
+
+    offset = iter->pos - w * iter->window;
+    n = iter->window - offset;
+    n = (n < iter->nbytes - iter->pos) ? n : iter->nbytes - iter->pos;
+    n = (n < maxbytes - ncopied) ? n : maxbytes - ncopied;
+    memcpy(_dest + ncopied, iter->buffers[w % 2] + offset, (size_t)n);
+    ncopied += n;
+    iter->pos += n;
+    if ((iter->pos - w * iter->window == iter->window) ||
+        (iter->pos == iter->nbytes)) {
+      /* The buffer of the window is free for the next but one */
+      pthread_mutex_lock(&iter->mutex);
+      iter->nread = w + 1;
+      pthread_cond_broadcast(&iter->cond);
+      pthread_mutex_unlock(&iter->mutex);
+    }
+  }
+
+  return ncopied;
+}
+
+
+void blosc2_diter_free(blosc2_diter* iter) {
+  pthread_mutex_lock(&iter->mutex);
+  iter->stop = 1;
+  pthread_cond_broadcast(&iter->cond);
+  pthread_mutex_unlock(&iter->mutex);
+  pthread_join(iter->thread, NULL);
+
+  pthread_mutex_destroy(&iter->mutex);
+  pthread_cond_destroy(&iter->cond);
+  blosc2_free_ctx(iter->dctx);
+  free(iter->buffers[0]);
+  free(iter->buffers[1]);
+  free(iter);
+}
@@ -0,0 +1,538 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "blosc.h"
+#include "context.h"
+
+/* The items are evaluated in strips of this length, which keeps the
+   registers in the L1 cache and lets the compiler vectorize the loops */
+#define EXPR_STRIP 256
+#define EXPR_MAX_DEPTH 16
+/* The parser recurses on parentheses and unary minus signs */
+#define EXPR_MAX_NESTING 64
+#define EXPR_MAX_OPERANDS 26
+
+enum {
+  EXPR_OPERAND,
+  EXPR_CONST,
+  EXPR_ADD,
+  EXPR_SUB,
+  EXPR_MUL,
+  EXPR_DIV,
+  EXPR_NEG,
+};
+
+typedef struct {
+  int op;
+  int operand;     /* for EXPR_OPERAND */
+  double value;    /* for EXPR_CONST */
+} expr_instr;
+
+/* What a thread needs for evaluating blocks */
+typedef struct {
+  blosc2_context** dctxs;   /* for reading the blocks of every operand */
+  double* operands;         /* the blocks of the operands */
+  size_t operands_size;     /* the items that `operands` has room for */
+  double* regs;             /* EXPR_MAX_DEPTH strips for the results */
+} expr_thread;
+
+struct blosc2_expr_s {
+  expr_instr* program;      /* in reverse polish notation */
+  int ninstrs;
+  int depth;                /* the depth of the stack for running it */
+  blosc2_schunk** operands;
+  int noperands;
+  /* The state of the evaluation */
+  int64_t nchunk;
+  expr_thread* threads;
+  int nthreads;
+};
+
+/* The state of the parser */
+typedef struct {
+  const char* p;
+  blosc2_expr* expr;
+  int depth;
+  int nesting;     /* the parentheses and minus signs being parsed */
+  int error;
+} expr_parser;
+
+
+/* Copy 4 bytes from `*pa` to int32_t, changing endianness if necessary. */
+static int32_t sw32_(const uint8_t* pa) {
+  int32_t idest;
+  uint8_t* dest = (uint8_t*)&idest;
+  int i = 1;                    /* for big/little endian detection */
+  char* p = (char*)&i;
+
+  if (p[0] != 1) {
+    /* big endian */
+    dest[0] = pa[3];
+    dest[1] = pa[2];
+    dest[2] = pa[1];
+    dest[3] = pa[0];
+  }
+  else {
+    /* little endian */
+    dest[0] = pa[0];
+    dest[1] = pa[1];
+    dest[2] = pa[2];
+    dest[3] = pa[3];
+  }
+  return idest;
+}
+
+
+static void emit(expr_parser* parser, int op, int operand, double value) {
+  blosc2_expr* expr = parser->expr;
+  expr_instr* program;
+
+  if ((op == EXPR_OPERAND) || (op == EXPR_CONST)) {
+    parser->depth++;
+    if (parser->depth > expr->depth) {
+      expr->depth = parser->depth;
+    }
+  }
+  else if (op != EXPR_NEG) {
+    parser->depth--;
+  }
+  program = realloc(expr->program, (expr->ninstrs + 1) * sizeof(expr_instr));
+  if (program == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    parser->error = 1;
+    return;
+  }
+  expr->program = program;
+  expr->program[expr->ninstrs].op = op;
+  expr->program[expr->ninstrs].operand = operand;
+  expr->program[expr->ninstrs].value = value;
+  expr->ninstrs++;
+}
+
+
+static void skip_spaces(expr_parser* parser) {
+  while (isspace((unsigned char)*parser->p)) {
+    parser->p++;
+  }
+}
+
+
+static void syntax_error(expr_parser* parser, const char* what) {
+  if (!parser->error) {
+    fprintf(stderr, "%s in expression at '%s'\n", what, parser->p);
+    parser->error = 1;
+  }
+}
+
+
+static void parse_sum(expr_parser* parser);
+
+/* Enter a nested part of the expression (0 if too deep) */
+static int enter(expr_parser* parser) {
+  if (parser->nesting >= EXPR_MAX_NESTING) {
+    syntax_error(parser, "Too deeply nested");
+    return 0;
+  }
+  parser->nesting++;
+  return 1;
+}
+
+static void parse_primary(expr_parser* parser) {
+  char* end;
+  double value;
+  int operand;
+
+  skip_spaces(parser);
+  if (*parser->p == '(') {
+    if (!enter(parser)) {
+      return;
+    }
+    parser->p++;
+    parse_sum(parser);
+    parser->nesting--;
+    skip_spaces(parser);
+    if (*parser->p != ')') {
+      syntax_error(parser, "Missing ')'");
+      return;
+    }
+    parser->p++;
+  }
+  else if (islower((unsigned char)*parser->p) &&
+           !isalnum((unsigned char)parser->p[1])) {
+    operand = *parser->p - 'a';
+    if (operand >= parser->expr->noperands) {
+      syntax_error(parser, "Unknown operand");
+      return;
+    }
+    parser->p++;
+    emit(parser, EXPR_OPERAND, operand, 0);
+  }
+  else if (isdigit((unsigned char)*parser->p) || (*parser->p == '.')) {
+    value = strtod(parser->p, &end);
+    if (end == parser->p) {
+      syntax_error(parser, "Bad number");
+      return;
+    }
+    parser->p = end;
+    emit(parser, EXPR_CONST, 0, value);
+  }
+  else {
+    syntax_error(parser, "Syntax error");
+  }
+}
+
+
+static void parse_unary(expr_parser* parser) {
+  skip_spaces(parser);
+  if (*parser->p == '-') {
+    if (!enter(parser)) {
+      return;
+    }
+    parser->p++;
+    parse_unary(parser);
+    parser->nesting--;
+    emit(parser, EXPR_NEG, 0, 0);
+  }
+  else {
+    parse_primary(parser);
+  }
+}
+
+
+static void parse_product(expr_parser* parser) {
+  char op;
+
+  parse_unary(parser);
+  skip_spaces(parser);
+  while (!parser->error && ((*parser->p == '*') || (*parser->p == '/'))) {
+    op = *parser->p++;
+    parse_unary(parser);
+    emit(parser, (op == '*') ? EXPR_MUL : EXPR_DIV, 0, 0);
+    skip_spaces(parser);
+  }
+}
+
+
+static void parse_sum(expr_parser* parser) {
+  char op;
+
+  parse_product(parser);
+  skip_spaces(parser);
+  while (!parser->error && ((*parser->p == '+') || (*parser->p == '-'))) {
+    op = *parser->p++;
+    parse_product(parser);
+    emit(parser, (op == '+') ? EXPR_ADD : EXPR_SUB, 0, 0);
+    skip_spaces(parser);
+  }
+}
+
+
+blosc2_expr* blosc2_expr_new(const char* expression,
+                             blosc2_schunk** operands, int noperands) {
+  blosc2_expr* expr;
+  expr_parser parser;
+
+  if ((noperands < 1) || (noperands > EXPR_MAX_OPERANDS)) {
+    fprintf(stderr, "Expressions take from 1 to %d operands\n",
+            EXPR_MAX_OPERANDS);
+    return NULL;
+  }
+  for (int i = 0; i < noperands; i++) {
+    if (operands[i]->typesize != sizeof(double)) {
+      fprintf(stderr, "The items of the operands must be doubles\n");
+      return NULL;
+    }
+  }
+
+  expr = calloc(1, sizeof(blosc2_expr));
+  if (expr == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  expr->noperands = noperands;
+  expr->operands = malloc(noperands * sizeof(blosc2_schunk*));
+  if (expr->operands == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    free(expr);
+    return NULL;
+  }
+  memcpy(expr->operands, operands, noperands * sizeof(blosc2_schunk*));
+
+  parser.p = expression;
+  parser.expr = expr;
+  parser.depth = 0;
+  parser.nesting = 0;
+  parser.error = 0;
+  parse_sum(&parser);
+  if (!parser.error && (*parser.p != '\0')) {
+    syntax_error(&parser, "Syntax error");
+  }
+  if (!parser.error && (expr->depth > EXPR_MAX_DEPTH)) {
+    fprintf(stderr, "The expression is too deeply nested\n");
+    parser.error = 1;
+  }
+  if (parser.error) {
+    blosc2_expr_free(expr);
+    return NULL;
+  }
+
+  return expr;
+}
+
+
+void blosc2_expr_free(blosc2_expr* expr) {
+  free(expr->program);
+  free(expr->operands);
+  free(expr);
+}
+
+
+/* Run the program over `n` items, starting at the `first` one of the
+   blocks of the operands */
+static void run_strip(blosc2_expr* expr, expr_thread* thread,
+                      size_t blockitems, size_t first, size_t n,
+                      double* out) {
+  const double* stack[EXPR_MAX_DEPTH];
+  const double* a;
+  const double* b;
+  double* r;
+  int sp = 0;
+
+  for (int i = 0; i < expr->ninstrs; i++) {
+    expr_instr* instr = &expr->program[i];
+    switch (instr->op) {
+      case EXPR_OPERAND:
+        stack[sp++] = thread->operands + instr->operand * blockitems + first;
+        continue;
+      case EXPR_CONST:
+        r = thread->regs + sp * EXPR_STRIP;
+        for (size_t j = 0; j < n; j++) {
+          r[j] = instr->value;
+        }
+        stack[sp++] = r;
+        continue;
+      case EXPR_NEG:
+        a = stack[sp - 1];
+        r = thread->regs + (sp - 1) * EXPR_STRIP;
+        for (size_t j = 0; j < n; j++) {
+          r[j] = -a[j];
+        }
+        stack[sp - 1] = r;
+        continue;
+      default:
+        break;
+    }
+    /* Binary operators leave the result in the register of the first
+       argument */
+    a = stack[sp - 2];
+    b = stack[sp - 1];
+    r = thread->regs + (sp - 2) * EXPR_STRIP;
+    switch (instr->op) {
+      case EXPR_ADD:
+        for (size_t j = 0; j < n; j++) {
+          r[j] = a[j] + b[j];
+        }
+        break;
+      case EXPR_SUB:
+        for (size_t j = 0; j < n; j++) {
+          r[j] = a[j] - b[j];
+        }
+        break;
+      case EXPR_MUL:
+        for (size_t j = 0; j < n; j++) {
+          r[j] = a[j] * b[j];
+        }
+        break;
+      case EXPR_DIV:
+        for (size_t j = 0; j < n; j++) {
+          r[j] = a[j] / b[j];
+        }
+        break;
+      default:
+        break;
+    }
+    stack[sp - 2] = r;
+    sp--;
+  }
+  memcpy(out, stack[0], n * sizeof(double));
+}
+
+
+/* The prefilter making the blocks of the result */
+static int expr_block(blosc2_prefilter_params* params) {
+  blosc2_expr* expr = (blosc2_expr*)params->user_data;
+  expr_thread* thread = &expr->threads[params->tid];
+  size_t nitems = (size_t)params->out_size / sizeof(double);
+  int start = params->out_offset / (int)sizeof(double);
+  double* out = (double*)params->out;
+  size_t n;
+
+  if (thread->operands_size < nitems) {
+    free(thread->operands);
+    thread->operands = malloc(expr->noperands * nitems * sizeof(double));
+    if (thread->operands == NULL) {
+      fprintf(stderr, "Error allocating memory!\n");
+      thread->operands_size = 0;
+      return -1;
+    }
+    thread->operands_size = nitems;
+  }
+  /* Only the matching blocks of the operands are decompressed */
+  for (int i = 0; i < expr->noperands; i++) {
+    if (blosc2_getitem_ctx(thread->dctxs[i],
+                           expr->operands[i]->data[expr->nchunk], start,
+                           (int)nitems, thread->operands + i * nitems) < 0) {
+      return -1;
+    }
+  }
+  for (size_t first = 0; first < nitems; first += EXPR_STRIP) {
+    n = (nitems - first < EXPR_STRIP) ? nitems - first : EXPR_STRIP;
+    run_strip(expr, thread, nitems, first, n, out + first);
+  }
+  return 0;
+}
+
+
+/* The largest block of the chunks of an operand */
+static size_t max_blocksize(blosc2_schunk* operand) {
+  size_t blocksize = 0;
+
+  for (int64_t nchunk = 0; nchunk < operand->nchunks; nchunk++) {
+    int32_t bsize = sw32_(operand->data[nchunk] + 8);
+    if ((size_t)bsize > blocksize) {
+      blocksize = (size_t)bsize;
+    }
+  }
+  return blocksize;
+}
+
+
+/* Check that the chunks of the operands are all alike */
+static int check_operands(blosc2_expr* expr) {
+  blosc2_schunk* first = expr->operands[0];
+
+  for (int i = 0; i < expr->noperands; i++) {
+    blosc2_schunk* operand = expr->operands[i];
+    if (blosc2_schunk_flush(operand) < 0) {
+      return -1;
+    }
+    if (operand->nchunks != first->nchunks) {
+      fprintf(stderr, "The operands do not have the same number of chunks\n");
+      return -1;
+    }
+    for (int64_t nchunk = 0; nchunk < operand->nchunks; nchunk++) {
+      if (sw32_(operand->data[nchunk] + 4) !=
+          sw32_(first->data[nchunk] + 4)) {
+        fprintf(stderr, "The chunks '%ld' of the operands are not alike\n",
+                (long)nchunk);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+/* Release the state of the threads (which may be partially set up) */
+static void free_threads(blosc2_expr* expr) {
+  for (int t = 0; t < expr->nthreads; t++) {
+    expr_thread* thread = &expr->threads[t];
+    if (thread->dctxs != NULL) {
+      for (int i = 0; i < expr->noperands; i++) {
+        if (thread->dctxs[i] != NULL) {
+          blosc2_free_ctx(thread->dctxs[i]);
+        }
+      }
+    }
+    free(thread->dctxs);
+    free(thread->operands);
+    free(thread->regs);
+  }
+  free(expr->threads);
+  expr->threads = NULL;
+}
+
+
+/* Set up the state of the threads (-1 if memory cannot be allocated) */
+static int new_threads(blosc2_expr* expr, int nthreads) {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+
+  expr->threads = calloc((size_t)nthreads, sizeof(expr_thread));
+  if (expr->threads == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return -1;
+  }
+  expr->nthreads = nthreads;
+  for (int t = 0; t < nthreads; t++) {
+    expr_thread* thread = &expr->threads[t];
+    thread->dctxs = calloc((size_t)expr->noperands, sizeof(blosc2_context*));
+    thread->regs = malloc(EXPR_MAX_DEPTH * EXPR_STRIP * sizeof(double));
+    if ((thread->dctxs == NULL) || (thread->regs == NULL)) {
+      fprintf(stderr, "Error allocating memory!\n");
+      free_threads(expr);
+      return -1;
+    }
+    for (int i = 0; i < expr->noperands; i++) {
+      dparams.blockcache = 2 * max_blocksize(expr->operands[i]);
+      thread->dctxs[i] = blosc2_create_dctx(dparams);
+      if (thread->dctxs[i] == NULL) {
+        free_threads(expr);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
+
+
+int64_t blosc2_expr_eval(blosc2_expr* expr, blosc2_schunk* out) {
+  blosc2_context* cctx = out->cctx;
+  blosc2_prefilter_fn prefilter = cctx->prefilter;
+  void* prefilter_data = cctx->prefilter_data;
+  int64_t ntbytes = 0;
+  int64_t rc = 0;
+
+  if (out->typesize != sizeof(double)) {
+    fprintf(stderr, "The items of the result must be doubles\n");
+    return -1;
+  }
+  if (check_operands(expr) < 0) {
+    return -1;
+  }
+
+  /* Every thread of the compression context reads the operands apart.
+     The blocks of the result and of the operands do not need to match, so
+     the last block read of every operand is cached for the next blocks of
+     the result (with room for block 0 too, which the delta filter needs). */
+  if (new_threads(expr, (cctx->nthreads > 1) ? cctx->nthreads : 1) < 0) {
+    return -1;
+  }
+
+  cctx->prefilter = expr_block;
+  cctx->prefilter_data = expr;
+  for (expr->nchunk = 0; expr->nchunk < expr->operands[0]->nchunks;
+       expr->nchunk++) {
+    int32_t nbytes = sw32_(expr->operands[0]->data[expr->nchunk] + 4);
+    rc = (int64_t)blosc2_append_buffer(out, (size_t)nbytes, NULL);
+    if (rc < 0) {
+      break;
+    }
+    ntbytes += nbytes;
+  }
+  cctx->prefilter = prefilter;
+  cctx->prefilter_data = prefilter_data;
+
+  free_threads(expr);
+  if (rc < 0) {
+    return rc;
+  }
+
+  return ntbytes;
+}
@@ -8,11 +8,15 @@
 **********************************************************************/
 
 
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
 #include "blosc.h"
+#include "btune.h"
+#include "chunkcache.h"
+#include "zonemap.h"
 
 
 #if defined(_WIN32) && !defined(__MINGW32__)
@@ -34,11 +38,26 @@
 #endif
 
 
+/* The queue of the asynchronous appends (see below) */
+typedef struct append_queue_s append_queue;
+
+/* The state of a super-chunk that is private to the library */
+struct blosc2_schunk_priv_s {
+  append_queue* append_queue;  /* see blosc2_append_buffer_async() */
+  chunkcache* chunk_cache;     /* see blosc2_schunk_set_chunkcache() */
+  zonemaps* zonemaps;          /* see blosc2_schunk_set_zonemaps() */
+  pthread_mutex_t dctx_mutex;  /* for the readers that miss chunk_cache */
+};
+
+
 /* Create a new super-chunk */
 blosc2_schunk* blosc2_new_schunk(blosc2_cparams cparams,
                                  blosc2_dparams dparams) {
   blosc2_schunk* schunk = calloc(1, sizeof(blosc2_schunk));
 
+  schunk->priv = calloc(1, sizeof(blosc2_schunk_priv));
+  pthread_mutex_init(&schunk->priv->dctx_mutex, NULL);
+
   schunk->version = 0;     /* pre-first version */
   for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
     schunk->filters[i] = cparams.filters[i];
@@ -83,20 +102,604 @@ size_t append_chunk(blosc2_schunk* schunk, void* chunk) {
 }
 
 
+/* Compute the zone maps of the blocks of `chunk`, of `type` items, from
+   `src` if not NULL or else from decompressing it with `dctx`.  Returns a
+   new array of `*nblocks` zone maps, or NULL if it cannot be allocated. */
+static blosc2_zonemap* compute_zonemaps(blosc2_context* dctx, int type,
+                                        const uint8_t* chunk, const void* src,
+                                        int32_t* nblocks) {
+  int32_t nbytes = *(int32_t*)(chunk + 4);
+  int32_t blocksize = *(int32_t*)(chunk + 8);
+  blosc2_zonemap* blocks;
+  uint8_t* buffer = NULL;
+  int32_t bsize;
+
+  *nblocks = 0;
+  if (blocksize > 0) {
+    *nblocks = (nbytes + blocksize - 1) / blocksize;
+  }
+  blocks = malloc((*nblocks > 0 ? *nblocks : 1) * sizeof(blosc2_zonemap));
+  if (blocks == NULL) {
+    return NULL;
+  }
+
+  if (src == NULL) {
+    buffer = malloc(nbytes > 0 ? (size_t)nbytes : 1);
+    if ((buffer != NULL) &&
+        (blosc2_decompress_ctx(dctx, chunk, buffer, (size_t)nbytes) ==
+         nbytes)) {
+      src = buffer;
+    }
+  }
+  if (src != NULL) {
+    for (int32_t i = 0; i < *nblocks; i++) {
+      bsize = (i < *nblocks - 1) ? blocksize : nbytes - i * blocksize;
+      zonemap_compute(type, (const uint8_t*)src + (size_t)i * blocksize,
+                      (size_t)bsize, &blocks[i]);
+    }
+  }
+  else {
+    /* Nothing is known about the contents, so the chunk always matches */
+    for (int32_t i = 0; i < *nblocks; i++) {
+      blocks[i].min = -HUGE_VAL;
+      blocks[i].max = HUGE_VAL;
+      blocks[i].nnulls = 0;
+    }
+  }
+  free(buffer);
+  return blocks;
+}
+
+
+/* Forget the zone maps of a super-chunk that cannot be kept up to date */
+static void drop_zonemaps(blosc2_schunk* schunk) {
+  fprintf(stderr, "Error allocating memory for the zone maps!\n");
+  zonemaps_free(schunk->priv->zonemaps);
+  schunk->priv->zonemaps = NULL;
+  schunk->cctx->zonemap_type = BLOSC_ZONEMAP_NONE;
+}
+
+
+/* Record the zone maps of the `nchunk` chunk, that has just been put in
+   the super-chunk, replacing the previous ones if `replace`.  The zone maps
+   of its blocks come from the compression context if `compressed` and the
+   chunk is still the last buffer compressed with it, or else from
+   compute_zonemaps(). */
+static void keep_zonemaps(blosc2_schunk* schunk, int64_t nchunk,
+                          const void* src, int compressed, int replace) {
+  zonemaps* zmaps = schunk->priv->zonemaps;
+  blosc2_context* cctx = schunk->cctx;
+  uint8_t* chunk = schunk->data[nchunk];
+  int32_t nbytes = *(int32_t*)(chunk + 4);
+  int32_t blocksize = *(int32_t*)(chunk + 8);
+  int32_t nblocks = 0;
+  blosc2_zonemap* blocks;
+  int type;
+
+  if (zmaps == NULL) {
+    return;
+  }
+  type = zonemaps_type(zmaps);
+  if (blocksize > 0) {
+    nblocks = (nbytes + blocksize - 1) / blocksize;
+  }
+  if (compressed && (cctx->dest == chunk) && (cctx->zonemap_type == type) &&
+      (cctx->block_zonemaps_size >= nblocks)) {
+    /* Computed while compressing, and not overwritten by another chunk */
+    blocks = malloc((nblocks > 0 ? nblocks : 1) * sizeof(blosc2_zonemap));
+    if (blocks != NULL) {
+      memcpy(blocks, cctx->block_zonemaps, nblocks * sizeof(blosc2_zonemap));
+    }
+  }
+  else {
+    blocks = compute_zonemaps(schunk->dctx, type, chunk, src, &nblocks);
+  }
+  if (blocks == NULL) {
+    drop_zonemaps(schunk);
+    return;
+  }
+
+  if (replace) {
+    zonemaps_update(zmaps, nchunk, blocks, nblocks);
+  }
+  else if (zonemaps_insert(zmaps, nchunk, blocks, nblocks) < 0) {
+    drop_zonemaps(schunk);
+  }
+}
+
+
 /* Append a data buffer to a super-chunk. */
 size_t blosc2_append_buffer(blosc2_schunk* schunk, size_t nbytes, void* src) {
   int cbytes;
-  void* chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
+  void* chunk;
+
+  /* Keep the order of the asynchronous appends */
+  cbytes = blosc2_schunk_flush(schunk);
+  if (cbytes < 0) {
+    return (size_t)cbytes;
+  }
+
+  chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
 
   /* Compress the src buffer using super-chunk context */
+  btune_next_cparams(schunk->cctx);
   cbytes = blosc2_compress_ctx(schunk->cctx, nbytes, src, chunk,
                                nbytes + BLOSC_MAX_OVERHEAD);
   if (cbytes < 0) {
     free(chunk);
     return (size_t)cbytes;
   }
+  btune_update(schunk->cctx, nbytes, cbytes, chunk);
+
+  append_chunk(schunk, chunk);
+  keep_zonemaps(schunk, schunk->nchunks - 1, src, 1, 0);
+
+  return (size_t)schunk->nchunks;
+}
+
+
+/* Check that `chunk` looks like a Blosc buffer */
+static int check_chunk(void* chunk) {
+  if ((chunk == NULL) ||
+      (*(int32_t*)((uint8_t*)chunk + 12) < BLOSC_MIN_HEADER_LENGTH)) {
+    fprintf(stderr, "The chunk is not a Blosc buffer\n");
+    return -1;
+  }
+  return 0;
+}
+
+
+/* Copy `chunk` if requested, as super-chunks own their chunks */
+static void* own_chunk(void* chunk, int copy) {
+  int32_t cbytes = *(int32_t*)((uint8_t*)chunk + 12);
+  void* chunk_;
+
+  if (!copy) {
+    return chunk;
+  }
+  chunk_ = malloc((size_t)cbytes);
+  memcpy(chunk_, chunk, (size_t)cbytes);
+  return chunk_;
+}
+
+
+/* The decompressed chunks that are cached for `nchunk` and the next ones
+   (all of them if `nchunk` is negative) are not valid anymore */
+static void forget_chunks(blosc2_schunk* schunk, int64_t nchunk) {
+  if (schunk->priv->chunk_cache != NULL) {
+    if (nchunk >= 0) {
+      chunkcache_invalidate(schunk->priv->chunk_cache, nchunk);
+    }
+    else {
+      chunkcache_clear(schunk->priv->chunk_cache);
+    }
+  }
+  /* Blocks are cached by the address of their chunk, that may be reused */
+  blosc2_clear_blockcache(schunk->dctx);
+}
+
+
+/* Replace the `nchunk` chunk of a super-chunk (`src` and `compressed` are
+   like in keep_zonemaps()). */
+static int64_t update_chunk(blosc2_schunk* schunk, int64_t nchunk,
+                            void* chunk, int copy, const void* src,
+                            int compressed) {
+  void* old;
+  int rc;
+
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  if ((nchunk < 0) || (nchunk >= schunk->nchunks)) {
+    fprintf(stderr, "specified nchunk ('%ld') exceeds the number of chunks "
+                    "('%ld') in super-chunk\n",
+            (long)nchunk, (long)schunk->nchunks);
+    return -10;
+  }
+  if (check_chunk(chunk) < 0) {
+    return -1;
+  }
+
+  old = schunk->data[nchunk];
+  schunk->data[nchunk] = own_chunk(chunk, copy);
+  /* Update counters */
+  schunk->nbytes += *(int32_t*)((uint8_t*)chunk + 4) -
+                    *(int32_t*)((uint8_t*)old + 4);
+  schunk->cbytes += *(int32_t*)((uint8_t*)chunk + 12) -
+                    *(int32_t*)((uint8_t*)old + 12);
+  forget_chunks(schunk, nchunk);
+  free(old);
+  keep_zonemaps(schunk, nchunk, src, compressed, 1);
+
+  return schunk->nchunks;
+}
+
+
+/* Replace the `nchunk` chunk of a super-chunk. */
+int64_t blosc2_schunk_update_chunk(blosc2_schunk* schunk, int64_t nchunk,
+                                   void* chunk, int copy) {
+  return update_chunk(schunk, nchunk, chunk, copy, NULL, 0);
+}
+
+
+/* Insert a chunk at the `nchunk` position of a super-chunk (`src` and
+   `compressed` are like in keep_zonemaps()). */
+static int64_t insert_chunk(blosc2_schunk* schunk, int64_t nchunk,
+                            void* chunk, int copy, const void* src,
+                            int compressed) {
+  int64_t nchunks;
+  int rc;
+
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  nchunks = schunk->nchunks;
+  if ((nchunk < 0) || (nchunk > nchunks)) {
+    fprintf(stderr, "specified nchunk ('%ld') exceeds the number of chunks "
+                    "('%ld') in super-chunk\n", (long)nchunk, (long)nchunks);
+    return -10;
+  }
+  if (check_chunk(chunk) < 0) {
+    return -1;
+  }
+
+  chunk = own_chunk(chunk, copy);
+  if (nchunk == nchunks) {
+    append_chunk(schunk, chunk);
+    keep_zonemaps(schunk, nchunk, src, compressed, 0);
+    return schunk->nchunks;
+  }
+  schunk->data = realloc(schunk->data, (nchunks + 1) * sizeof(void*));
+  memmove(schunk->data + nchunk + 1, schunk->data + nchunk,
+          (size_t)(nchunks - nchunk) * sizeof(void*));
+  schunk->data[nchunk] = chunk;
+  /* Update counters */
+  schunk->nchunks = nchunks + 1;
+  schunk->nbytes += *(int32_t*)((uint8_t*)chunk + 4);
+  schunk->cbytes += *(int32_t*)((uint8_t*)chunk + 12) + sizeof(void*);
+  forget_chunks(schunk, -1);
+  keep_zonemaps(schunk, nchunk, src, compressed, 0);
+
+  return schunk->nchunks;
+}
+
+
+/* Insert a chunk at the `nchunk` position of a super-chunk. */
+int64_t blosc2_schunk_insert_chunk(blosc2_schunk* schunk, int64_t nchunk,
+                                   void* chunk, int copy) {
+  return insert_chunk(schunk, nchunk, chunk, copy, NULL, 0);
+}
+
+
+/* Delete the `nchunk` chunk of a super-chunk. */
+int64_t blosc2_schunk_delete_chunk(blosc2_schunk* schunk, int64_t nchunk) {
+  int64_t nchunks;
+  void* old;
+  int rc;
+
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  nchunks = schunk->nchunks;
+  if ((nchunk < 0) || (nchunk >= nchunks)) {
+    fprintf(stderr, "specified nchunk ('%ld') exceeds the number of chunks "
+                    "('%ld') in super-chunk\n", (long)nchunk, (long)nchunks);
+    return -10;
+  }
+
+  old = schunk->data[nchunk];
+  memmove(schunk->data + nchunk, schunk->data + nchunk + 1,
+          (size_t)(nchunks - nchunk - 1) * sizeof(void*));
+  /* Update counters */
+  schunk->nchunks = nchunks - 1;
+  schunk->nbytes -= *(int32_t*)((uint8_t*)old + 4);
+  schunk->cbytes -= *(int32_t*)((uint8_t*)old + 12) + sizeof(void*);
+  forget_chunks(schunk, (nchunk == nchunks - 1) ? nchunk : -1);
+  free(old);
+  if (schunk->priv->zonemaps != NULL) {
+    zonemaps_delete(schunk->priv->zonemaps, nchunk);
+  }
+
+  return schunk->nchunks;
+}
+
+
+/* Compress a data buffer with the params of a super-chunk, like in
+   blosc2_append_buffer() */
+static void* compress_buffer(blosc2_schunk* schunk, size_t nbytes,
+                             void* src, int* cbytes) {
+  void* chunk;
+
+  /* The context is shared with the asynchronous appends */
+  *cbytes = blosc2_schunk_flush(schunk);
+  if (*cbytes < 0) {
+    return NULL;
+  }
 
-  return append_chunk(schunk, chunk);
+  chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
+  btune_next_cparams(schunk->cctx);
+  *cbytes = blosc2_compress_ctx(schunk->cctx, nbytes, src, chunk,
+                                nbytes + BLOSC_MAX_OVERHEAD);
+  if (*cbytes < 0) {
+    free(chunk);
+    return NULL;
+  }
+  btune_update(schunk->cctx, nbytes, *cbytes, chunk);
+  return chunk;
+}
+
+
+/* Replace the `nchunk` chunk of a super-chunk with a data buffer. */
+int64_t blosc2_schunk_update_buffer(blosc2_schunk* schunk, int64_t nchunk,
+                                    size_t nbytes, void* src) {
+  int64_t nchunks;
+  void* chunk;
+  int cbytes;
+
+  chunk = compress_buffer(schunk, nbytes, src, &cbytes);
+  if (chunk == NULL) {
+    return cbytes;
+  }
+  nchunks = update_chunk(schunk, nchunk, chunk, 0, src, 1);
+  if (nchunks < 0) {
+    free(chunk);
+  }
+  return nchunks;
+}
+
+
+/* Insert a data buffer at the `nchunk` position of a super-chunk. */
+int64_t blosc2_schunk_insert_buffer(blosc2_schunk* schunk, int64_t nchunk,
+                                    size_t nbytes, void* src) {
+  int64_t nchunks;
+  void* chunk;
+  int cbytes;
+
+  chunk = compress_buffer(schunk, nbytes, src, &cbytes);
+  if (chunk == NULL) {
+    return cbytes;
+  }
+  nchunks = insert_chunk(schunk, nchunk, chunk, 0, src, 1);
+  if (nchunks < 0) {
+    free(chunk);
+  }
+  return nchunks;
+}
+
+
+/* Minimum number of buffers in the queue of asynchronous appends */
+#define APPEND_QUEUE_MIN 4
+
+/* The queue of asynchronous appends.  The caller fills `srcs` while the
+   background thread compresses the previous buffers in `batch`. */
+struct append_queue_s {
+  int depth;           /* the maximum number of buffers in the queue */
+  void** srcs;         /* copies of the buffers waiting in the queue */
+  size_t* nbytes;
+  int nqueued;
+  blosc2_batch_item* batch;  /* the buffers being compressed */
+  void** bsrcs;
+  int nbatch;
+  int64_t nchunks;     /* the chunks there will be after the queued ones */
+  int error;           /* first error compressing a buffer */
+  int stop;
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+};
+
+
+/* Compress a batch of queued buffers and append them in order */
+static void append_batch(blosc2_schunk* schunk, append_queue* queue) {
+  blosc2_batch_item* items = queue->batch;
+  int nitems = queue->nbatch;
+  int error = 0;
+  int failed;
+
+  pthread_mutex_lock(&queue->mutex);
+  failed = queue->error < 0;
+  pthread_mutex_unlock(&queue->mutex);
+
+  for (int i = 0; i < nitems; i++) {
+    items[i].dest = failed ? NULL : malloc(items[i].nbytes +
+                                           BLOSC_MAX_OVERHEAD);
+    items[i].destsize = items[i].nbytes + BLOSC_MAX_OVERHEAD;
+    items[i].result = 0;
+  }
+
+  if (!failed) {
+    if (schunk->cctx->btune != NULL) {
+      /* BTune measures the chunks one by one */
+      for (int i = 0; i < nitems; i++) {
+        btune_next_cparams(schunk->cctx);
+        items[i].result = blosc2_compress_ctx(
+          schunk->cctx, items[i].nbytes, items[i].src, items[i].dest,
+          items[i].destsize);
+        btune_update(schunk->cctx, items[i].nbytes, items[i].result,
+                     items[i].dest);
+      }
+    }
+    else {
+      blosc2_compress_batch(schunk->cctx, items, nitems);
+    }
+  }
+
+  /* The caller waits for the batch before touching the super-chunk, so
+     the chunks are appended without holding the lock */
+  for (int i = 0; i < nitems; i++) {
+    if (!failed && (items[i].result < 0)) {
+      error = items[i].result;
+      failed = 1;
+    }
+    if (failed) {
+      free(items[i].dest);
+    }
+    else {
+      append_chunk(schunk, items[i].dest);
+      /* Compressed in a batch, so the blocks are looked at again */
+      keep_zonemaps(schunk, schunk->nchunks - 1, items[i].src, 0, 0);
+    }
+    free(queue->bsrcs[i]);
+  }
+
+  pthread_mutex_lock(&queue->mutex);
+  if ((queue->error == 0) && (error < 0)) {
+    queue->error = error;
+  }
+  queue->nbatch = 0;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+}
+
+
+/* The background thread of the asynchronous appends */
+static void* append_thread(void* arg) {
+  blosc2_schunk* schunk = (blosc2_schunk*)arg;
+  append_queue* queue = schunk->priv->append_queue;
+  void** srcs;
+
+  pthread_mutex_lock(&queue->mutex);
+  while (1) {
+    while ((queue->nqueued == 0) && !queue->stop) {
+      pthread_cond_wait(&queue->cond, &queue->mutex);
+    }
+    if (queue->nqueued == 0) {
+      break;
+    }
+    /* Take all the queued buffers, making room for new ones */
+    for (int i = 0; i < queue->nqueued; i++) {
+      queue->batch[i].src = queue->srcs[i];
+      queue->batch[i].nbytes = queue->nbytes[i];
+    }
+    srcs = queue->bsrcs;
+    queue->bsrcs = queue->srcs;
+    queue->srcs = srcs;
+    queue->nbatch = queue->nqueued;
+    queue->nqueued = 0;
+    pthread_cond_broadcast(&queue->cond);
+    pthread_mutex_unlock(&queue->mutex);
+
+    append_batch(schunk, queue);
+
+    pthread_mutex_lock(&queue->mutex);
+  }
+  pthread_mutex_unlock(&queue->mutex);
+
+  return NULL;
+}
+
+
+/* Append a data buffer to a super-chunk in the background. */
+int64_t blosc2_append_buffer_async(blosc2_schunk* schunk, size_t nbytes,
+                                   void* src) {
+  append_queue* queue = schunk->priv->append_queue;
+  int64_t nchunks;
+  void* copy;
+  int error;
+
+  if (queue == NULL) {
+    queue = calloc(1, sizeof(append_queue));
+    queue->depth = 2 * schunk->cctx->nthreads;
+    if (queue->depth < APPEND_QUEUE_MIN) {
+      queue->depth = APPEND_QUEUE_MIN;
+    }
+    queue->srcs = malloc(queue->depth * sizeof(void*));
+    queue->nbytes = malloc(queue->depth * sizeof(size_t));
+    queue->batch = malloc(queue->depth * sizeof(blosc2_batch_item));
+    queue->bsrcs = malloc(queue->depth * sizeof(void*));
+    pthread_mutex_init(&queue->mutex, NULL);
+    pthread_cond_init(&queue->cond, NULL);
+    schunk->priv->append_queue = queue;
+    if (pthread_create(&queue->thread, NULL, append_thread, schunk) != 0) {
+      fprintf(stderr, "ERROR; could not create the thread for appending "
+                      "buffers\n");
+      pthread_mutex_destroy(&queue->mutex);
+      pthread_cond_destroy(&queue->cond);
+      free(queue->srcs);
+      free(queue->nbytes);
+      free(queue->batch);
+      free(queue->bsrcs);
+      free(queue);
+      schunk->priv->append_queue = NULL;
+      return -1;
+    }
+  }
+
+  copy = malloc(nbytes > 0 ? nbytes : 1);
+  if (copy == NULL) {
+    return -1;
+  }
+  memcpy(copy, src, nbytes);
+
+  pthread_mutex_lock(&queue->mutex);
+  /* Back-pressure: wait for the background thread to make room */
+  while ((queue->nqueued == queue->depth) && (queue->error == 0)) {
+    pthread_cond_wait(&queue->cond, &queue->mutex);
+  }
+  error = queue->error;
+  if (error < 0) {
+    pthread_mutex_unlock(&queue->mutex);
+    free(copy);
+    return error;
+  }
+  if ((queue->nqueued == 0) && (queue->nbatch == 0)) {
+    /* The background thread is not appending, so the count is settled */
+    queue->nchunks = schunk->nchunks;
+  }
+  queue->srcs[queue->nqueued] = copy;
+  queue->nbytes[queue->nqueued] = nbytes;
+  queue->nqueued++;
+  nchunks = ++queue->nchunks;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+
+  return nchunks;
+}
+
+
+/* Wait for the asynchronous appends to a super-chunk. */
+int blosc2_schunk_flush(blosc2_schunk* schunk) {
+  append_queue* queue = schunk->priv->append_queue;
+  int error;
+
+  if (queue == NULL) {
+    return 0;
+  }
+  pthread_mutex_lock(&queue->mutex);
+  while ((queue->nqueued > 0) || (queue->nbatch > 0)) {
+    pthread_cond_wait(&queue->cond, &queue->mutex);
+  }
+  /* The super-chunk can be appended again after reporting the error */
+  error = queue->error;
+  queue->error = 0;
+  pthread_mutex_unlock(&queue->mutex);
+
+  return error;
+}
+
+
+/* Stop the background thread of the asynchronous appends */
+static void free_append_queue(blosc2_schunk* schunk) {
+  append_queue* queue = schunk->priv->append_queue;
+
+  blosc2_schunk_flush(schunk);
+  pthread_mutex_lock(&queue->mutex);
+  queue->stop = 1;
+  pthread_cond_broadcast(&queue->cond);
+  pthread_mutex_unlock(&queue->mutex);
+  pthread_join(queue->thread, NULL);
+
+  pthread_mutex_destroy(&queue->mutex);
+  pthread_cond_destroy(&queue->cond);
+  free(queue->srcs);
+  free(queue->nbytes);
+  free(queue->batch);
+  free(queue->bsrcs);
+  free(queue);
+  schunk->priv->append_queue = NULL;
 }
 
 
@@ -107,6 +710,7 @@ int blosc2_decompress_chunk(blosc2_schunk* schunk, size_t nchunk,
   void* src;
   int chunksize;
   int nbytes_;
+  int cached;
 
   if (nchunk >= nchunks) {
     printf("specified nchunk ('%ld') exceeds the number of chunks "
@@ -123,15 +727,426 @@ int blosc2_decompress_chunk(blosc2_schunk* schunk, size_t nchunk,
     return -11;
   }
 
+  /* The postfilter has to see every block, so its output is not cached */
+  cached = (schunk->priv->chunk_cache != NULL) &&
+           (schunk->dctx->postfilter == NULL);
+  if (!cached) {
+    return blosc2_decompress_ctx(schunk->dctx, src, dest, nbytes);
+  }
+
+  chunksize = chunkcache_get(schunk->priv->chunk_cache, (int64_t)nchunk, src,
+                             dest, nbytes);
+  if (chunksize >= 0) {
+    return chunksize;
+  }
+  /* Readers missing the cache share the decompression context */
+  pthread_mutex_lock(&schunk->priv->dctx_mutex);
   chunksize = blosc2_decompress_ctx(schunk->dctx, src, dest, nbytes);
+  pthread_mutex_unlock(&schunk->priv->dctx_mutex);
+  if (chunksize >= 0) {
+    chunkcache_put(schunk->priv->chunk_cache, (int64_t)nchunk, src, dest,
+                   (size_t)chunksize);
+  }
 
   return chunksize;
 }
 
 
+/* Attach a cache of decompressed chunks to a super-chunk */
+int blosc2_schunk_set_chunkcache(blosc2_schunk* schunk, size_t budget) {
+  if (schunk->priv->chunk_cache != NULL) {
+    chunkcache_free(schunk->priv->chunk_cache);
+    schunk->priv->chunk_cache = NULL;
+  }
+  if (budget > 0) {
+    schunk->priv->chunk_cache = chunkcache_new(budget);
+  }
+  return 0;
+}
+
+
+int blosc2_schunk_get_chunkcache_stats(blosc2_schunk* schunk,
+                                       blosc2_chunkcache_stats* stats) {
+  if (schunk->priv->chunk_cache == NULL) {
+    return -1;
+  }
+  chunkcache_stats(schunk->priv->chunk_cache, stats);
+  return 0;
+}
+
+
+/* Keep the zone maps of the chunks of a super-chunk */
+int blosc2_schunk_set_zonemaps(blosc2_schunk* schunk, int type) {
+  int rc;
+
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  if ((type != BLOSC_ZONEMAP_NONE) &&
+      (zonemap_typesize(type) != (int)schunk->typesize)) {
+    fprintf(stderr, "The items of the zone map type ('%d') are not "
+                    "typesize ('%d') bytes long\n",
+            type, (int)schunk->typesize);
+    return -1;
+  }
+  if (schunk->priv->zonemaps != NULL) {
+    zonemaps_free(schunk->priv->zonemaps);
+    schunk->priv->zonemaps = NULL;
+  }
+  schunk->cctx->zonemap_type = type;
+  if (type == BLOSC_ZONEMAP_NONE) {
+    return 0;
+  }
+
+  schunk->priv->zonemaps = zonemaps_new(type);
+  if (schunk->priv->zonemaps == NULL) {
+    fprintf(stderr, "Error allocating memory for the zone maps!\n");
+    schunk->cctx->zonemap_type = BLOSC_ZONEMAP_NONE;
+    return -1;
+  }
+  for (int64_t nchunk = 0; nchunk < schunk->nchunks; nchunk++) {
+    keep_zonemaps(schunk, nchunk, NULL, 0, 0);
+    if (schunk->priv->zonemaps == NULL) {
+      return -1;
+    }
+  }
+  return 0;
+}
+
+
+/* Check that the zone maps of the `nchunk` chunk can be looked up */
+static int check_zonemaps(blosc2_schunk* schunk, int64_t nchunk) {
+  if (blosc2_schunk_flush(schunk) < 0) {
+    return -1;
+  }
+  if (schunk->priv->zonemaps == NULL) {
+    fprintf(stderr, "The super-chunk has no zone maps\n");
+    return -1;
+  }
+  if ((nchunk < 0) || (nchunk >= schunk->nchunks)) {
+    fprintf(stderr, "specified nchunk ('%ld') exceeds the number of chunks "
+                    "('%ld') in super-chunk\n",
+            (long)nchunk, (long)schunk->nchunks);
+    return -10;
+  }
+  return 0;
+}
+
+
+int blosc2_schunk_get_zonemap(blosc2_schunk* schunk, int64_t nchunk,
+                              blosc2_zonemap* zonemap) {
+  int rc = check_zonemaps(schunk, nchunk);
+
+  if (rc < 0) {
+    return rc;
+  }
+  *zonemap = *zonemaps_chunk(schunk->priv->zonemaps, nchunk);
+  return 0;
+}
+
+
+int blosc2_schunk_get_block_zonemaps(blosc2_schunk* schunk, int64_t nchunk,
+                                     blosc2_zonemap* zonemaps_,
+                                     int32_t maxblocks) {
+  const blosc2_zonemap* blocks;
+  int32_t nblocks;
+  int rc = check_zonemaps(schunk, nchunk);
+
+  if (rc < 0) {
+    return rc;
+  }
+  blocks = zonemaps_blocks(schunk->priv->zonemaps, nchunk, &nblocks);
+  if (maxblocks > nblocks) {
+    maxblocks = nblocks;
+  }
+  if (maxblocks > 0) {
+    memcpy(zonemaps_, blocks, (size_t)maxblocks * sizeof(blosc2_zonemap));
+  }
+  return nblocks;
+}
+
+
+/* Find the chunks of a super-chunk that can hold values in [low, high] */
+int64_t blosc2_schunk_zonemap_query(blosc2_schunk* schunk, double low,
+                                    double high, int64_t* chunks,
+                                    int64_t maxchunks) {
+  if (blosc2_schunk_flush(schunk) < 0) {
+    return -1;
+  }
+  if (schunk->priv->zonemaps == NULL) {
+    fprintf(stderr, "The super-chunk has no zone maps\n");
+    return -1;
+  }
+  return zonemaps_query(schunk->priv->zonemaps, low, high, chunks,
+                        maxchunks);
+}
+
+
+/* Decompress the chunks in [first, last) of a super-chunk concurrently. */
+int64_t blosc2_schunk_decompress_range(blosc2_schunk* schunk, size_t first,
+                                       size_t last, void* dest,
+                                       size_t nbytes) {
+  int64_t nchunks;
+  blosc2_batch_item* items;
+  uint8_t* _dest = (uint8_t*)dest;
+  size_t ntbytes = 0;
+  int32_t nbytes_;
+  int nitems;
+  int rc;
+
+  /* Include the pending asynchronous appends */
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  nchunks = schunk->nchunks;
+  if ((first > last) || ((int64_t)last > nchunks)) {
+    fprintf(stderr, "specified range of chunks ('%ld' to '%ld') exceeds "
+                    "the number of chunks ('%ld') in super-chunk\n",
+            (long)first, (long)last, (long)nchunks);
+    return -10;
+  }
+
+  nitems = (int)(last - first);
+  items = malloc((nitems > 0 ? nitems : 1) * sizeof(blosc2_batch_item));
+  if (items == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return -1;
+  }
+  for (int i = 0; i < nitems; i++) {
+    void* src = schunk->data[first + i];
+    nbytes_ = *(int32_t*)((uint8_t*)src + 4);
+    if (ntbytes + nbytes_ > nbytes) {
+      fprintf(stderr, "Buffer size is too small for the decompressed range "
+                      "('%ld' bytes, but more are needed)\n", (long)nbytes);
+      free(items);
+      return -11;
+    }
+    items[i].src = src;
+    items[i].nbytes = 0;
+    items[i].dest = _dest + ntbytes;
+    items[i].destsize = (size_t)nbytes_;
+    ntbytes += nbytes_;
+  }
+
+  /* The blocks of all the chunks are spread over the threads at once */
+  rc = blosc2_decompress_batch(schunk->dctx, items, nitems);
+  free(items);
+  if (rc < 0) {
+    return rc;
+  }
+
+  return (int64_t)ntbytes;
+}
+
+
+/* Get the items in [start, stop) of a super-chunk. */
+int64_t blosc2_schunk_get_slice(blosc2_schunk* schunk, int64_t start,
+                                int64_t stop, void* dest) {
+  int64_t nchunks;
+  int32_t typesize = (int32_t)schunk->typesize;
+  blosc2_batch_item* items;
+  uint8_t* _dest = (uint8_t*)dest;
+  int64_t first = 0;             /* the first item of the current chunk */
+  int64_t ntbytes = 0;
+  int32_t nitems, startc, stopc;
+  int nfull = 0;
+  int rc = 0;
+
+  if ((start < 0) || (start > stop)) {
+    fprintf(stderr, "specified slice ('%ld' to '%ld') is not valid\n",
+            (long)start, (long)stop);
+    return -10;
+  }
+
+  /* Include the pending asynchronous appends */
+  rc = blosc2_schunk_flush(schunk);
+  if (rc < 0) {
+    return rc;
+  }
+  nchunks = schunk->nchunks;
+  items = malloc((nchunks > 0 ? nchunks : 1) * sizeof(blosc2_batch_item));
+  if (items == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return -1;
+  }
+  for (int64_t nchunk = 0; (nchunk < nchunks) && (first < stop); nchunk++) {
+    uint8_t* chunk = schunk->data[nchunk];
+    nitems = *(int32_t*)(chunk + 4) / typesize;
+    if (first + nitems > start) {
+      startc = (start > first) ? (int32_t)(start - first) : 0;
+      stopc = (stop < first + nitems) ? (int32_t)(stop - first) : nitems;
+      if ((startc == 0) && (stopc == nitems)) {
+        /* Whole chunks are decompressed concurrently below */
+        items[nfull].src = chunk;
+        items[nfull].nbytes = 0;
+        items[nfull].dest = _dest + ntbytes;
+        items[nfull].destsize = (size_t)nitems * typesize;
+        nfull++;
+      }
+      else {
+        /* Only the blocks intersecting the slice */
+        rc = blosc2_getitem_ctx(schunk->dctx, chunk, startc, stopc - startc,
+                                _dest + ntbytes);
+        if (rc < 0) {
+          break;
+        }
+      }
+      ntbytes += (int64_t)(stopc - startc) * typesize;
+    }
+    first += nitems;
+  }
+
+  if ((rc >= 0) && (first < stop)) {
+    fprintf(stderr, "specified slice ('%ld' to '%ld') exceeds the number of "
+                    "items ('%ld') in super-chunk\n",
+            (long)start, (long)stop, (long)first);
+    rc = -10;
+  }
+  if ((rc >= 0) && (nfull > 0)) {
+    rc = blosc2_decompress_batch(schunk->dctx, items, nfull);
+  }
+  free(items);
+  if (rc < 0) {
+    return rc;
+  }
+
+  return ntbytes;
+}
+
+
+/* Partial results are put this far apart, so that the threads do not share
+   cache lines */
+#define REDUCE_ALIGN 64
+
+/* The state of a blosc2_schunk_reduce() */
+typedef struct {
+  uint8_t* partials;   /* the partial result of every thread */
+  size_t stride;       /* the distance between partial results */
+  int64_t offset;      /* the offset of the chunk being decompressed */
+  blosc2_reduce_block_fn block;
+  void* user_data;
+} reduce_state;
+
+
+/* Allocate the partial results aligned to REDUCE_ALIGN (like my_malloc()
+   in blosc.c), as their stride alone does not keep them in separate cache
+   lines */
+static uint8_t* reduce_malloc(size_t size) {
+  void* block = NULL;
+  int res = 0;
+
+#if defined(_WIN32)
+  block = (void *)_aligned_malloc(size, REDUCE_ALIGN);
+#elif _POSIX_C_SOURCE >= 200112L || _XOPEN_SOURCE >= 600
+  res = posix_memalign(&block, REDUCE_ALIGN, size);
+#else
+  block = malloc(size);
+#endif  /* _WIN32 */
+
+  if (block == NULL || res != 0) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  return (uint8_t*)block;
+}
+
+
+static void reduce_free(void* block) {
+#if defined(_WIN32)
+  _aligned_free(block);
+#else
+  free(block);
+#endif  /* _WIN32 */
+}
+
+
+/* The postfilter folding the blocks into the partial result of the thread */
+static int reduce_block(blosc2_postfilter_params* params) {
+  reduce_state* state = (reduce_state*)params->user_data;
+
+  return state->block(state->partials + params->tid * state->stride,
+                      params->in, params->size, params->typesize,
+                      state->offset + params->offset, state->user_data);
+}
+
+
+/* Reduce the contents of a super-chunk in the threads of its dctx. */
+int64_t blosc2_schunk_reduce(blosc2_schunk* schunk, size_t partial_size,
+                             blosc2_reduce_init_fn init,
+                             blosc2_reduce_block_fn block,
+                             blosc2_reduce_combine_fn combine,
+                             void* user_data, void* result) {
+  blosc2_context* dctx = schunk->dctx;
+  blosc2_postfilter_fn postfilter = dctx->postfilter;
+  void* postfilter_data = dctx->postfilter_data;
+  reduce_state state;
+  int npartials = (dctx->nthreads > 1) ? dctx->nthreads : 1;
+  int rc = 0;
+
+  if ((init == NULL) || (block == NULL) || (combine == NULL)) {
+    fprintf(stderr, "The reduction needs init, block and combine functions\n");
+    return -1;
+  }
+  if (blosc2_schunk_flush(schunk) < 0) {
+    return -1;
+  }
+
+  state.stride = (partial_size + REDUCE_ALIGN - 1) / REDUCE_ALIGN *
+                 REDUCE_ALIGN;
+  state.partials = reduce_malloc((state.stride > 0 ? state.stride : 1) *
+                                 npartials);
+  if (state.partials == NULL) {
+    return -1;
+  }
+  state.offset = 0;
+  state.block = block;
+  state.user_data = user_data;
+  for (int i = 0; i < npartials; i++) {
+    init(state.partials + i * state.stride, user_data);
+  }
+
+  /* The chunks go one after the other, and their blocks in parallel */
+  dctx->postfilter = reduce_block;
+  dctx->postfilter_data = &state;
+  for (int64_t nchunk = 0; nchunk < schunk->nchunks; nchunk++) {
+    uint8_t* chunk = schunk->data[nchunk];
+    rc = blosc2_decompress_ctx(dctx, chunk, NULL,
+                               (size_t)*(int32_t*)(chunk + 4));
+    if (rc < 0) {
+      break;
+    }
+    state.offset += rc;
+  }
+  dctx->postfilter = postfilter;
+  dctx->postfilter_data = postfilter_data;
+
+  init(result, user_data);
+  for (int i = 0; i < npartials; i++) {
+    combine(result, state.partials + i * state.stride, user_data);
+  }
+  reduce_free(state.partials);
+  if (rc < 0) {
+    return rc;
+  }
+
+  return state.offset;
+}
+
+
 /* Free all memory from a super-chunk. */
 int blosc2_destroy_schunk(blosc2_schunk* schunk) {
 
+  if (schunk->priv->append_queue != NULL)
+    free_append_queue(schunk);
+  if (schunk->priv->chunk_cache != NULL)
+    chunkcache_free(schunk->priv->chunk_cache);
+  if (schunk->priv->zonemaps != NULL)
+    zonemaps_free(schunk->priv->zonemaps);
+  pthread_mutex_destroy(&schunk->priv->dctx_mutex);
+  free(schunk->priv);
+
   if (schunk->filters_chunk != NULL)
     free(schunk->filters_chunk);
   if (schunk->codec_chunk != NULL)
@@ -154,17 +1169,55 @@ int blosc2_destroy_schunk(blosc2_schunk* schunk) {
 }
 
 
+/* The offsets of the fields of the header of packed super-chunks (see
+   README_PACKED_HEADER.rst) */
+#define PACKED_HEADER_LENGTH 112
+#define PACKED_CNAME 4
+#define PACKED_CLEVEL 6
+#define PACKED_FILTERS 8
+#define PACKED_CHUNKSIZE 12
+#define PACKED_NCHUNKS 16
+#define PACKED_NBYTES 24
+#define PACKED_CBYTES 32
+#define PACKED_FILTERS_CHUNK 40
+#define PACKED_CODEC_CHUNK 48
+#define PACKED_METADATA_CHUNK 56
+#define PACKED_USERDATA_CHUNK 64
+#define PACKED_DATA_OFFSETS 72
+#define PACKED_TYPESIZE 80
+#define PACKED_BLOCKSIZE 84
+#define PACKED_FILTERS_META 88
+#define PACKED_DEAD_BYTES 96
+
+/* The version of the layout above, in the first byte of the header.  The
+   packed super-chunks made before it have a 0 there, and a different
+   layout. */
+#define PACKED_VERSION 1
+
+
+/* Check that `packed` follows the layout above */
+static int check_packed(const uint8_t* packed) {
+  if (packed[0] != PACKED_VERSION) {
+    fprintf(stderr, "Unsupported version ('%d') of packed super-chunk\n",
+            packed[0]);
+    return -1;
+  }
+  return 0;
+}
+
+
 /* Compute the final length of a packed super-chunk */
-int64_t blosc2_get_packed_length(blosc2_schunk* schunk) {
+static int64_t get_packed_length(blosc2_schunk* schunk,
+                                 uint8_t* metadata_chunk) {
   int i;
-  int64_t length = sizeof(blosc2_schunk);
+  int64_t length = PACKED_HEADER_LENGTH;
 
   if (schunk->filters_chunk != NULL)
     length += *(int32_t*)(schunk->filters_chunk + 12);
   if (schunk->codec_chunk != NULL)
     length += *(int32_t*)(schunk->codec_chunk + 12);
-  if (schunk->metadata_chunk != NULL)
-    length += *(int32_t*)(schunk->metadata_chunk + 12);
+  if (metadata_chunk != NULL)
+    length += *(int32_t*)(metadata_chunk + 12);
   if (schunk->userdata_chunk != NULL)
     length += *(int32_t*)(schunk->userdata_chunk + 12);
   if (schunk->data != NULL) {
@@ -197,35 +1250,112 @@ void pack_copy_chunk(void* chunk, void* packed, int offset, int64_t* cbytes,
 }
 
 
+/* Compress serialized zone maps into a new chunk (NULL if that fails) */
+static uint8_t* compress_zonemaps(const zonemaps* zmaps) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  uint8_t* buffer;
+  uint8_t* chunk;
+  size_t nbytes;
+  int cbytes = -1;
+
+  buffer = zonemaps_serialize(zmaps, &nbytes);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
+  /* Zone maps are mostly doubles */
+  cparams.typesize = sizeof(double);
+  cctx = blosc2_create_cctx(cparams);
+  if (cctx != NULL) {
+    if (chunk != NULL) {
+      cbytes = blosc2_compress_ctx(cctx, nbytes, buffer, chunk,
+                                   nbytes + BLOSC_MAX_OVERHEAD);
+    }
+    blosc2_free_ctx(cctx);
+  }
+  free(buffer);
+  if (cbytes <= 0) {
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
+}
+
+
+/* The metadata chunk of a packed super-chunk, which keeps the zone maps */
+static uint8_t* pack_metadata(blosc2_schunk* schunk) {
+  uint8_t* chunk;
+
+  if (schunk->priv->zonemaps == NULL) {
+    return schunk->metadata_chunk;
+  }
+  chunk = compress_zonemaps(schunk->priv->zonemaps);
+  if (chunk == NULL) {
+    return schunk->metadata_chunk;
+  }
+  return chunk;
+}
+
+
 /* Create a packed super-chunk */
 void* blosc2_pack_schunk(blosc2_schunk* schunk) {
-  int64_t cbytes = sizeof(blosc2_schunk);
-  int64_t nbytes = sizeof(blosc2_schunk);
-  int64_t nchunks = schunk->nchunks;
-  void* packed;
+  int64_t cbytes = PACKED_HEADER_LENGTH;
+  int64_t nbytes = PACKED_HEADER_LENGTH;
+  int64_t nchunks;
+  uint8_t* packed;
+  uint8_t* metadata_chunk;
   void* data_chunk;
   int64_t* data_pointers;
   uint64_t data_offsets_len;
   int32_t chunk_cbytes, chunk_nbytes;
   int64_t packed_len;
+  uint16_t filters = 0;
   int i;
 
-  packed_len = blosc2_get_packed_length(schunk);
+  if (blosc2_schunk_flush(schunk) < 0) {
+    return NULL;
+  }
+  nchunks = schunk->nchunks;
+  metadata_chunk = pack_metadata(schunk);
+  packed_len = get_packed_length(schunk, metadata_chunk);
   packed = malloc((size_t)packed_len);
 
   /* Fill the header */
-  memcpy(packed, schunk, 40);    /* copy until cbytes */
+  memset(packed, 0, PACKED_HEADER_LENGTH);
+  packed[0] = PACKED_VERSION;
+  packed[1] = schunk->flags1;
+  packed[2] = schunk->flags2;
+  packed[3] = schunk->flags3;
+  *(uint16_t*)(packed + PACKED_CNAME) = schunk->compcode;
+  *(uint16_t*)(packed + PACKED_CLEVEL) = schunk->clevel;
+  for (i = 0; i < BLOSC_MAX_FILTERS; i++) {
+    filters |= (uint16_t)((schunk->filters[i] & 0x7) << (3 * i));
+  }
+  *(uint16_t*)(packed + PACKED_FILTERS) = filters;
+  *(uint32_t*)(packed + PACKED_CHUNKSIZE) = schunk->chunksize;
+  *(int32_t*)(packed + PACKED_TYPESIZE) = (int32_t)schunk->typesize;
+  *(int32_t*)(packed + PACKED_BLOCKSIZE) = schunk->blocksize;
+  memcpy(packed + PACKED_FILTERS_META, schunk->filters_meta,
+         BLOSC_MAX_FILTERS);
 
   /* Fill the ancillary chunks info */
-  pack_copy_chunk(schunk->filters_chunk,  packed, 40, &cbytes, &nbytes);
-  pack_copy_chunk(schunk->codec_chunk,    packed, 48, &cbytes, &nbytes);
-  pack_copy_chunk(schunk->metadata_chunk, packed, 56, &cbytes, &nbytes);
-  pack_copy_chunk(schunk->userdata_chunk, packed, 64, &cbytes, &nbytes);
+  pack_copy_chunk(schunk->filters_chunk, packed, PACKED_FILTERS_CHUNK,
+                  &cbytes, &nbytes);
+  pack_copy_chunk(schunk->codec_chunk, packed, PACKED_CODEC_CHUNK,
+                  &cbytes, &nbytes);
+  pack_copy_chunk(metadata_chunk, packed, PACKED_METADATA_CHUNK,
+                  &cbytes, &nbytes);
+  pack_copy_chunk(schunk->userdata_chunk, packed, PACKED_USERDATA_CHUNK,
+                  &cbytes, &nbytes);
+  if (metadata_chunk != schunk->metadata_chunk) {
+    free(metadata_chunk);
+  }
 
   /* Finally, setup the data pointers section */
   data_offsets_len = nchunks * sizeof(int64_t);
-  data_pointers = (int64_t*)((uint8_t*)packed + packed_len - data_offsets_len);
-  *(uint64_t*)((uint8_t*)packed + 72) = packed_len - data_offsets_len;
+  data_pointers = (int64_t*)(packed + packed_len - data_offsets_len);
+  *(uint64_t*)(packed + PACKED_DATA_OFFSETS) = packed_len - data_offsets_len;
 
   /* And fill the actual data chunks */
   if (schunk->data != NULL) {
@@ -233,7 +1363,7 @@ void* blosc2_pack_schunk(blosc2_schunk* schunk) {
       data_chunk = schunk->data[i];
       chunk_nbytes = *(int32_t*)((uint8_t*)data_chunk + 4);
       chunk_cbytes = *(int32_t*)((uint8_t*)data_chunk + 12);
-      memcpy((uint8_t*)packed + cbytes, data_chunk, (size_t)chunk_cbytes);
+      memcpy(packed + cbytes, data_chunk, (size_t)chunk_cbytes);
       data_pointers[i] = cbytes;
       cbytes += chunk_cbytes;
       nbytes += chunk_nbytes;
@@ -244,42 +1374,87 @@ void* blosc2_pack_schunk(blosc2_schunk* schunk) {
   cbytes += data_offsets_len;
   nbytes += data_offsets_len;
   assert (cbytes == packed_len);
-  *(int64_t*)((uint8_t*)packed + 16) = nchunks;
-  *(int64_t*)((uint8_t*)packed + 24) = nbytes;
-  *(int64_t*)((uint8_t*)packed + 32) = cbytes;
+  *(int64_t*)(packed + PACKED_NCHUNKS) = nchunks;
+  *(int64_t*)(packed + PACKED_NBYTES) = nbytes;
+  *(int64_t*)(packed + PACKED_CBYTES) = cbytes;
 
   return packed;
 }
 
 
-/* Copy a chunk into a packed super-chunk */
-void* unpack_copy_chunk(uint8_t* packed, int offset,
-    blosc2_schunk* schunk, int64_t *nbytes, int64_t *cbytes) {
-  int32_t nbytes_, cbytes_;
-  uint8_t *chunk, *dst_chunk = NULL;
+/* The compression params in the header of a packed super-chunk */
+static blosc2_cparams packed_cparams(const uint8_t* packed) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  uint16_t filters = *(uint16_t*)(packed + PACKED_FILTERS);
+
+  cparams.compcode = *(uint16_t*)(packed + PACKED_CNAME);
+  cparams.clevel = *(uint16_t*)(packed + PACKED_CLEVEL);
+  cparams.typesize = (size_t)*(int32_t*)(packed + PACKED_TYPESIZE);
+  cparams.blocksize = (size_t)*(int32_t*)(packed + PACKED_BLOCKSIZE);
+  for (int i = 0; i < BLOSC_MAX_FILTERS; i++) {
+    cparams.filters[i] = (uint8_t)((filters >> (3 * i)) & 0x7);
+    cparams.filters_meta[i] = packed[PACKED_FILTERS_META + i];
+  }
+  return cparams;
+}
+
+
+/* Copy a chunk out of a packed super-chunk (NULL if there is none) */
+static uint8_t* unpack_copy_chunk(const uint8_t* packed, int offset) {
+  const uint8_t* chunk;
+  uint8_t* dst_chunk = NULL;
+  int32_t cbytes_;
 
   if (*(int64_t*)(packed + offset) != 0) {
     chunk = packed + *(int64_t*)(packed + offset);
-    nbytes_ = *(int32_t*)(chunk + 4);
     cbytes_ = *(int32_t*)(chunk + 12);
-    /* Create a copy of the chunk */
     dst_chunk = malloc((size_t)cbytes_);
     memcpy(dst_chunk, chunk, (size_t)cbytes_);
-    /* Update counters */
-    schunk->nbytes += nbytes_;
-    schunk->cbytes += cbytes_;
-    *cbytes += cbytes_;
-    *nbytes += nbytes_;
   }
   return dst_chunk;
 }
 
 
+/* Restore the zone maps kept in the metadata chunk of a packed super-chunk,
+   which is kept as is if it does not hold them */
+static void unpack_metadata(blosc2_schunk* schunk, uint8_t* chunk) {
+  zonemaps* zmaps = NULL;
+  int32_t nbytes;
+  uint8_t* buffer;
+
+  if (chunk == NULL) {
+    return;
+  }
+  nbytes = *(int32_t*)(chunk + 4);
+  buffer = malloc(nbytes > 0 ? (size_t)nbytes : 1);
+  if (blosc2_decompress_ctx(schunk->dctx, chunk, buffer,
+                            (size_t)nbytes) == nbytes) {
+    zmaps = zonemaps_deserialize(buffer, (size_t)nbytes);
+  }
+  free(buffer);
+  /* Chunks appended to the packed super-chunk have no zone maps */
+  if ((zmaps != NULL) &&
+      ((zonemaps_nchunks(zmaps) != schunk->nchunks) ||
+       (zonemap_typesize(zonemaps_type(zmaps)) != (int)schunk->typesize))) {
+    zonemaps_free(zmaps);
+    zmaps = NULL;
+  }
+  if (zmaps == NULL) {
+    schunk->metadata_chunk = chunk;
+    return;
+  }
+  schunk->priv->zonemaps = zmaps;
+  schunk->cctx->zonemap_type = zonemaps_type(zmaps);
+  free(chunk);
+}
+
+
 /* Unpack a packed super-chunk */
 blosc2_schunk* blosc2_unpack_schunk(void* packed) {
-  blosc2_schunk* schunk = calloc(1, sizeof(blosc2_schunk));
-  int64_t nbytes = sizeof(blosc2_schunk);
-  int64_t cbytes = sizeof(blosc2_schunk);
+  uint8_t* _packed = (uint8_t*)packed;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  uint8_t* metadata_chunk;
   uint8_t* data_chunk;
   void* new_chunk;
   int64_t* data;
@@ -287,44 +1462,37 @@ blosc2_schunk* blosc2_unpack_schunk(void* packed) {
   int32_t chunk_size;
   int i;
 
+  if (check_packed(_packed) < 0) {
+    return NULL;
+  }
+
   /* Fill the header */
-  memcpy(schunk, packed, 52); /* Copy until cbytes */
+  schunk = blosc2_new_schunk(packed_cparams(_packed), dparams);
+  schunk->flags1 = _packed[1];
+  schunk->flags2 = _packed[2];
+  schunk->flags3 = _packed[3];
+  schunk->chunksize = *(uint32_t*)(_packed + PACKED_CHUNKSIZE);
 
   /* Fill the ancillary chunks info */
-  schunk->filters_chunk = unpack_copy_chunk(
-          packed, 52, schunk, &nbytes, &cbytes);
-  schunk->codec_chunk = unpack_copy_chunk(
-          packed, 52 + 8, schunk, &nbytes, &cbytes);
-  schunk->metadata_chunk = unpack_copy_chunk(
-          packed, 52 + 8 * 2, schunk, &nbytes, &cbytes);
-  schunk->userdata_chunk = unpack_copy_chunk(
-          packed, 52 + 8 * 3, schunk, &nbytes, &cbytes);
+  schunk->filters_chunk = unpack_copy_chunk(_packed, PACKED_FILTERS_CHUNK);
+  schunk->codec_chunk = unpack_copy_chunk(_packed, PACKED_CODEC_CHUNK);
+  metadata_chunk = unpack_copy_chunk(_packed, PACKED_METADATA_CHUNK);
+  schunk->userdata_chunk = unpack_copy_chunk(_packed, PACKED_USERDATA_CHUNK);
 
   /* Finally, fill the data pointers section */
-  data = (int64_t*)(
-          (uint8_t*)packed + *(int64_t*)((uint8_t*)packed + 52 + 8 * 4));
-  nchunks = *(int64_t*)((uint8_t*)packed + 28);
-  schunk->data = malloc(nchunks * sizeof(void*));
-  nbytes += nchunks * sizeof(int64_t);
-  cbytes += nchunks * sizeof(int64_t);
+  data = (int64_t*)(_packed + *(int64_t*)(_packed + PACKED_DATA_OFFSETS));
+  nchunks = *(int64_t*)(_packed + PACKED_NCHUNKS);
 
   /* And create the actual data chunks */
-  if (data != NULL) {
-    for (i = 0; i < nchunks; i++) {
-      data_chunk = (uint8_t*)packed + data[i];
-      chunk_size = *(int32_t*)(data_chunk + 12);
-      new_chunk = malloc((size_t)chunk_size);
-      memcpy(new_chunk, data_chunk, (size_t)chunk_size);
-      schunk->data[i] = new_chunk;
-      cbytes += chunk_size;
-      nbytes += *(int32_t*)(data_chunk + 4);
-    }
+  for (i = 0; i < nchunks; i++) {
+    data_chunk = _packed + data[i];
+    chunk_size = *(int32_t*)(data_chunk + 12);
+    new_chunk = malloc((size_t)chunk_size);
+    memcpy(new_chunk, data_chunk, (size_t)chunk_size);
+    append_chunk(schunk, new_chunk);
   }
-  schunk->nbytes = nbytes;
-  schunk->cbytes = cbytes;
 
-  assert(*(int64_t*)((uint8_t*)packed + 36) == nbytes);
-  assert(*(int64_t*)((uint8_t*)packed + 44) == cbytes);
+  unpack_metadata(schunk, metadata_chunk);
 
   return schunk;
 }
@@ -332,9 +1500,9 @@ blosc2_schunk* blosc2_unpack_schunk(void* packed) {
 
 /* Append an existing chunk into a *packed* super-chunk. */
 void* packed_append_chunk(void* packed, void* chunk) {
-  int64_t nchunks = *(int64_t*)((uint8_t*)packed + 28);
-  int64_t packed_len = *(int64_t*)((uint8_t*)packed + 44);
-  int64_t data_offsets = *(int64_t*)((uint8_t*)packed + 52 + 8 * 4);
+  int64_t nchunks = *(int64_t*)((uint8_t*)packed + PACKED_NCHUNKS);
+  int64_t packed_len = *(int64_t*)((uint8_t*)packed + PACKED_CBYTES);
+  int64_t data_offsets = *(int64_t*)((uint8_t*)packed + PACKED_DATA_OFFSETS);
   uint64_t chunk_offset = packed_len - nchunks * sizeof(int64_t);
   /* The uncompressed and compressed sizes start at byte 4 and 12 */
   int32_t nbytes = *(int32_t*)((uint8_t*)chunk + 4);
@@ -342,9 +1510,15 @@ void* packed_append_chunk(void* packed, void* chunk) {
   /* The current and new data areas */
   uint8_t* data;
   uint8_t* new_data;
+  void* new_packed;
 
   /* Make space for the new chunk and copy it */
-  packed = realloc(packed, packed_len + cbytes + sizeof(int64_t));
+  new_packed = realloc(packed, packed_len + cbytes + sizeof(int64_t));
+  if (new_packed == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+  packed = new_packed;
   data = (uint8_t*)packed + data_offsets;
   new_data = data + cbytes;
   /* Move the data offsets to the end */
@@ -353,10 +1527,10 @@ void* packed_append_chunk(void* packed, void* chunk) {
   /* Copy the chunk */
   memcpy((uint8_t*)packed + chunk_offset, chunk, (size_t)cbytes);
   /* Update counters */
-  *(int64_t*)((uint8_t*)packed + 28) += 1;
-  *(uint64_t*)((uint8_t*)packed + 36) += nbytes + sizeof(uint64_t);
-  *(uint64_t*)((uint8_t*)packed + 44) += cbytes + sizeof(uint64_t);
-  *(uint64_t*)((uint8_t*)packed + 52 + 8 * 3) += cbytes;
+  *(int64_t*)((uint8_t*)packed + PACKED_NCHUNKS) += 1;
+  *(uint64_t*)((uint8_t*)packed + PACKED_NBYTES) += nbytes + sizeof(uint64_t);
+  *(uint64_t*)((uint8_t*)packed + PACKED_CBYTES) += cbytes + sizeof(uint64_t);
+  *(uint64_t*)((uint8_t*)packed + PACKED_DATA_OFFSETS) += cbytes;
   /* printf("Compression chunk #%lld: %d -> %d (%.1fx)\n",
           nchunks, nbytes, cbytes, (1.*nbytes) / cbytes); */
 
@@ -365,46 +1539,31 @@ void* packed_append_chunk(void* packed, void* chunk) {
 
 
 /* Append a data buffer to a *packed* super-chunk. */
-// TODO: Update for the new filter pipeline support
 void* blosc2_packed_append_buffer(void* packed, size_t typesize, size_t nbytes,
                                   void* src) {
-  int cname = *(int16_t*)((uint8_t*)packed + 4);
-  int clevel = *(int16_t*)((uint8_t*)packed + 6);
-  void* filters_chunk = (uint8_t*)packed + *(uint64_t*)((uint8_t*)packed + 52);
-  uint8_t* filters = (uint8_t*)packed + 12;
-  int cbytes;
-  void* chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
-  void* dest = malloc(nbytes);
-  char* compname;
-  int doshuffle, dodelta = 0;
+  blosc2_cparams cparams;
+  blosc2_context* cctx;
+  void* chunk;
   void* new_packed;
+  int cbytes;
 
-  /* Apply filters prior to compress */
-  if (filters[0] == BLOSC_DELTA) {
-    dodelta = 1;
-    doshuffle = filters[1];
-  }
-  else if (filters[0] == BLOSC_TRUNC_PREC) {
-    doshuffle = filters[1];
-  }
-  else {
-    doshuffle = filters[0];
+  if (check_packed((uint8_t*)packed) < 0) {
+    return NULL;
   }
+  cparams = packed_cparams((uint8_t*)packed);
+  chunk = malloc(nbytes + BLOSC_MAX_OVERHEAD);
 
-  /* Compress the src buffer using super-chunk defaults */
-  blosc_compcode_to_compname(cname, &compname);
-  blosc_set_compressor(compname);
-  blosc_set_delta(dodelta);
-  cbytes = blosc_compress(clevel, doshuffle, typesize, nbytes, src, chunk,
-                          nbytes + BLOSC_MAX_OVERHEAD);
+  /* Compress the src buffer using super-chunk params */
+  cparams.typesize = typesize;
+  cctx = blosc2_create_cctx(cparams);
+  cbytes = blosc2_compress_ctx(cctx, nbytes, src, chunk,
+                               nbytes + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
   if (cbytes < 0) {
     free(chunk);
-    free(dest);
     return NULL;
   }
 
-  free(dest);
-
   /* Append the chunk and free it */
   new_packed = packed_append_chunk(packed, chunk);
   free(chunk);
@@ -413,15 +1572,325 @@ void* blosc2_packed_append_buffer(void* packed, size_t typesize, size_t nbytes,
 }
 
 
+/* The zone maps kept in the metadata chunk of a *packed* super-chunk
+   (NULL if there are none, or if they are stale like in
+   unpack_metadata()) */
+static zonemaps* packed_zonemaps(const uint8_t* packed,
+                                 blosc2_context* dctx) {
+  int64_t offset = *(int64_t*)(packed + PACKED_METADATA_CHUNK);
+  zonemaps* zmaps = NULL;
+  const uint8_t* chunk;
+  uint8_t* buffer;
+  int32_t nbytes;
+
+  if (offset == 0) {
+    return NULL;
+  }
+  chunk = packed + offset;
+  nbytes = *(int32_t*)(chunk + 4);
+  buffer = malloc(nbytes > 0 ? (size_t)nbytes : 1);
+  if ((buffer != NULL) &&
+      (blosc2_decompress_ctx(dctx, chunk, buffer, (size_t)nbytes) ==
+       nbytes)) {
+    zmaps = zonemaps_deserialize(buffer, (size_t)nbytes);
+  }
+  free(buffer);
+  if ((zmaps != NULL) &&
+      ((zonemaps_nchunks(zmaps) != *(int64_t*)(packed + PACKED_NCHUNKS)) ||
+       (zonemap_typesize(zonemaps_type(zmaps)) !=
+        *(int32_t*)(packed + PACKED_TYPESIZE)))) {
+    zonemaps_free(zmaps);
+    zmaps = NULL;
+  }
+  return zmaps;
+}
+
+
+/* The metadata chunk of a *packed* super-chunk after putting `chunk` at
+   the `nchunk` position (replacing the chunk there if `replace`), or after
+   deleting the `nchunk` chunk if `chunk` is NULL.  `*metadata` is set to
+   NULL if the packed super-chunk keeps no zone maps.  Returns a negative
+   value if the zone maps cannot be updated. */
+static int packed_update_metadata(const uint8_t* packed, int64_t nchunk,
+                                  const uint8_t* chunk, int replace,
+                                  uint8_t** metadata) {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  zonemaps* zmaps;
+  blosc2_zonemap* blocks;
+  int32_t nblocks;
+
+  *metadata = NULL;
+  dctx = blosc2_create_dctx(dparams);
+  if (dctx == NULL) {
+    return -1;
+  }
+  zmaps = packed_zonemaps(packed, dctx);
+  if (zmaps == NULL) {
+    blosc2_free_ctx(dctx);
+    return 0;
+  }
+  if (chunk == NULL) {
+    zonemaps_delete(zmaps, nchunk);
+  }
+  else {
+    blocks = compute_zonemaps(dctx, zonemaps_type(zmaps), chunk, NULL,
+                              &nblocks);
+    if (blocks == NULL) {
+      zonemaps_free(zmaps);
+      blosc2_free_ctx(dctx);
+      return -1;
+    }
+    if (replace) {
+      zonemaps_update(zmaps, nchunk, blocks, nblocks);
+    }
+    else if (zonemaps_insert(zmaps, nchunk, blocks, nblocks) < 0) {
+      zonemaps_free(zmaps);
+      blosc2_free_ctx(dctx);
+      return -1;
+    }
+  }
+  blosc2_free_ctx(dctx);
+  *metadata = compress_zonemaps(zmaps);
+  zonemaps_free(zmaps);
+  return (*metadata == NULL) ? -1 : 0;
+}
+
+
+/* Check that `nchunk` is in [0, `nchunks` + `extra`) for a *packed*
+   super-chunk */
+static int check_packed_nchunk(const uint8_t* packed, int64_t nchunk,
+                               int extra) {
+  int64_t nchunks = *(int64_t*)(packed + PACKED_NCHUNKS);
+
+  if ((nchunk < 0) || (nchunk >= nchunks + extra)) {
+    fprintf(stderr, "specified nchunk ('%ld') exceeds the number of chunks "
+                    "('%ld') in super-chunk\n", (long)nchunk, (long)nchunks);
+    return -10;
+  }
+  return 0;
+}
+
+
+/* Put a copy of `chunk` at the `nchunk` position of a *packed*
+   super-chunk, replacing the chunk there if `replace`, or moving it and
+   the next ones one position forward if not.  If `chunk` is NULL, the
+   `nchunk` chunk is deleted instead.
+
+   New chunks go after the last one, like in packed_append_chunk(), and
+   only the data offsets are moved, so the bytes of the replaced and
+   deleted chunks are left dead in the packed super-chunk until
+   blosc2_packed_compact().  The same goes for the metadata chunk when the
+   zone maps in it are updated. */
+static void* packed_put_chunk(void* packed, int64_t nchunk, void* chunk,
+                              int replace) {
+  uint8_t* _packed = (uint8_t*)packed;
+  int64_t old_nchunks = *(int64_t*)(_packed + PACKED_NCHUNKS);
+  int64_t nchunks = old_nchunks;
+  int64_t packed_len = *(int64_t*)(_packed + PACKED_CBYTES);
+  int64_t data_offsets = *(int64_t*)(_packed + PACKED_DATA_OFFSETS);
+  int64_t metadata_offset = *(int64_t*)(_packed + PACKED_METADATA_CHUNK);
+  int64_t nbytes = 0;
+  int64_t dead_bytes = 0;
+  int32_t cbytes = 0;
+  int32_t mbytes = 0;
+  int64_t new_len;
+  int64_t* data;
+  uint8_t* metadata;
+  uint8_t* old;
+  uint8_t* new_packed;
+
+  if (packed_update_metadata(_packed, nchunk, chunk, replace,
+                             &metadata) < 0) {
+    fprintf(stderr, "cannot update the zone maps of the packed "
+                    "super-chunk\n");
+    return NULL;
+  }
+  if (chunk != NULL) {
+    nbytes = *(int32_t*)((uint8_t*)chunk + 4);
+    cbytes = *(int32_t*)((uint8_t*)chunk + 12);
+  }
+  if (metadata != NULL) {
+    mbytes = *(int32_t*)(metadata + 12);
+    old = _packed + metadata_offset;
+    nbytes += *(int32_t*)(metadata + 4) - *(int32_t*)(old + 4);
+    dead_bytes += *(int32_t*)(old + 12);
+  }
+  data = (int64_t*)(_packed + data_offsets);
+  if ((chunk == NULL) || replace) {
+    old = _packed + data[nchunk];
+    nbytes -= *(int32_t*)(old + 4);
+    dead_bytes += *(int32_t*)(old + 12);
+  }
+  if (chunk == NULL) {
+    nbytes -= sizeof(int64_t);
+    nchunks--;
+  }
+  else if (!replace) {
+    nbytes += sizeof(int64_t);
+    nchunks++;
+  }
+
+  /* Make space for the new chunks, if needed, at once */
+  new_len = data_offsets + cbytes + mbytes + nchunks * sizeof(int64_t);
+  if (new_len > packed_len) {
+    new_packed = realloc(_packed, (size_t)new_len);
+    if (new_packed == NULL) {
+      fprintf(stderr, "Error allocating memory!\n");
+      free(metadata);
+      return NULL;
+    }
+    _packed = new_packed;
+  }
+
+  /* Move the data offsets after the new chunks, and relink them */
+  data = (int64_t*)(_packed + data_offsets);
+  if (chunk == NULL) {
+    memmove(data + nchunk, data + nchunk + 1,
+            (size_t)(nchunks - nchunk) * sizeof(int64_t));
+  }
+  data = (int64_t*)(_packed + data_offsets + cbytes + mbytes);
+  memmove(data, _packed + data_offsets,
+          (size_t)(chunk == NULL ? nchunks : old_nchunks) * sizeof(int64_t));
+  if (chunk != NULL) {
+    if (!replace) {
+      memmove(data + nchunk + 1, data + nchunk,
+              (size_t)(nchunks - nchunk - 1) * sizeof(int64_t));
+    }
+    memcpy(_packed + data_offsets, chunk, (size_t)cbytes);
+    data[nchunk] = data_offsets;
+  }
+  if (metadata != NULL) {
+    memcpy(_packed + data_offsets + cbytes, metadata, (size_t)mbytes);
+    *(int64_t*)(_packed + PACKED_METADATA_CHUNK) = data_offsets + cbytes;
+    free(metadata);
+  }
+
+  /* Update counters */
+  *(int64_t*)(_packed + PACKED_NCHUNKS) = nchunks;
+  *(int64_t*)(_packed + PACKED_NBYTES) += nbytes;
+  *(int64_t*)(_packed + PACKED_CBYTES) = new_len;
+  *(int64_t*)(_packed + PACKED_DATA_OFFSETS) += cbytes + mbytes;
+  *(int64_t*)(_packed + PACKED_DEAD_BYTES) += dead_bytes;
+
+  if (new_len < packed_len) {
+    /* Shrinking in place is fine too */
+    new_packed = realloc(_packed, (size_t)new_len);
+    if (new_packed != NULL) {
+      _packed = new_packed;
+    }
+  }
+  return _packed;
+}
+
+
+/* Replace the `nchunk` chunk of a *packed* super-chunk. */
+void* blosc2_packed_update_chunk(void* packed, int64_t nchunk, void* chunk) {
+  if ((check_packed((uint8_t*)packed) < 0) ||
+      (check_packed_nchunk((uint8_t*)packed, nchunk, 0) < 0) ||
+      (check_chunk(chunk) < 0)) {
+    return NULL;
+  }
+  return packed_put_chunk(packed, nchunk, chunk, 1);
+}
+
+
+/* Insert a chunk at the `nchunk` position of a *packed* super-chunk. */
+void* blosc2_packed_insert_chunk(void* packed, int64_t nchunk, void* chunk) {
+  if ((check_packed((uint8_t*)packed) < 0) ||
+      (check_packed_nchunk((uint8_t*)packed, nchunk, 1) < 0) ||
+      (check_chunk(chunk) < 0)) {
+    return NULL;
+  }
+  return packed_put_chunk(packed, nchunk, chunk, 0);
+}
+
+
+/* Delete the `nchunk` chunk of a *packed* super-chunk. */
+void* blosc2_packed_delete_chunk(void* packed, int64_t nchunk) {
+  if ((check_packed((uint8_t*)packed) < 0) ||
+      (check_packed_nchunk((uint8_t*)packed, nchunk, 0) < 0)) {
+    return NULL;
+  }
+  return packed_put_chunk(packed, nchunk, NULL, 0);
+}
+
+
+/* Copy a live chunk of `packed` into `new_packed`, relinking its offset
+   at `*offset` */
+static void compact_copy_chunk(const uint8_t* packed, uint8_t* new_packed,
+                               int64_t* offset, int64_t* cbytes) {
+  const uint8_t* chunk;
+  int32_t cbytes_;
+
+  if (*offset == 0) {
+    return;
+  }
+  chunk = packed + *offset;
+  cbytes_ = *(int32_t*)(chunk + 12);
+  memcpy(new_packed + *cbytes, chunk, (size_t)cbytes_);
+  *offset = *cbytes;
+  *cbytes += cbytes_;
+}
+
+
+/* Drop the dead bytes of a *packed* super-chunk. */
+void* blosc2_packed_compact(void* packed) {
+  uint8_t* _packed = (uint8_t*)packed;
+  int ancillary[] = {PACKED_FILTERS_CHUNK, PACKED_CODEC_CHUNK,
+                     PACKED_METADATA_CHUNK, PACKED_USERDATA_CHUNK};
+  int64_t nchunks = *(int64_t*)(_packed + PACKED_NCHUNKS);
+  int64_t dead_bytes = *(int64_t*)(_packed + PACKED_DEAD_BYTES);
+  int64_t packed_len = *(int64_t*)(_packed + PACKED_CBYTES) - dead_bytes;
+  int64_t cbytes = PACKED_HEADER_LENGTH;
+  int64_t* data;
+  uint8_t* new_packed;
+
+  if (check_packed(_packed) < 0) {
+    return NULL;
+  }
+  if (dead_bytes == 0) {
+    return packed;
+  }
+  new_packed = malloc((size_t)packed_len);
+  if (new_packed == NULL) {
+    fprintf(stderr, "Error allocating memory!\n");
+    return NULL;
+  }
+
+  memcpy(new_packed, _packed, PACKED_HEADER_LENGTH);
+  for (int i = 0; i < 4; i++) {
+    compact_copy_chunk(_packed, new_packed,
+                       (int64_t*)(new_packed + ancillary[i]), &cbytes);
+  }
+  data = (int64_t*)(new_packed + packed_len - nchunks * sizeof(int64_t));
+  memcpy(data, _packed + *(int64_t*)(_packed + PACKED_DATA_OFFSETS),
+         (size_t)nchunks * sizeof(int64_t));
+  for (int64_t i = 0; i < nchunks; i++) {
+    compact_copy_chunk(_packed, new_packed, &data[i], &cbytes);
+  }
+  assert(cbytes == (uint8_t*)data - new_packed);
+  *(int64_t*)(new_packed + PACKED_DATA_OFFSETS) = cbytes;
+  *(int64_t*)(new_packed + PACKED_CBYTES) = packed_len;
+  *(int64_t*)(new_packed + PACKED_DEAD_BYTES) = 0;
+
+  free(packed);
+  return new_packed;
+}
+
+
 /* Decompress and return a chunk that is part of a *packed* super-chunk. */
 int blosc2_packed_decompress_chunk(void* packed, size_t nchunk, void** dest) {
-  int64_t nchunks = *(int64_t*)((uint8_t*)packed + 28);
-  int64_t* data = (int64_t*)(
-          (uint8_t*)packed + *(int64_t*)((uint8_t*)packed + 52 + 8 * 4));
+  int64_t nchunks = *(int64_t*)((uint8_t*)packed + PACKED_NCHUNKS);
+  int64_t data_offsets = *(int64_t*)((uint8_t*)packed + PACKED_DATA_OFFSETS);
+  int64_t* data = (int64_t*)((uint8_t*)packed + data_offsets);
   void* src;
   int chunksize;
   int32_t nbytes;
 
+  if (check_packed((uint8_t*)packed) < 0) {
+    return -1;
+  }
   if (nchunk >= nchunks) {
     return -10;
   }
@@ -220,4 +220,23 @@ int pthread_cond_broadcast(pthread_cond_t *cond)
 	return 0;
 }
 
+int pthread_key_create(pthread_key_t *key, void (*destructor)(void*))
+{
+	*key = FlsAlloc((PFLS_CALLBACK_FUNCTION)destructor);
+	return (*key == FLS_OUT_OF_INDEXES) ? EAGAIN : 0;
+}
+
+static BOOL CALLBACK win32_once_routine(PINIT_ONCE once, PVOID param,
+				       PVOID *context)
+{
+	((void (*)(void))param)();
+	return TRUE;
+}
+
+int pthread_once(pthread_once_t *once, void (*init_routine)(void))
+{
+	return InitOnceExecuteOnce(once, win32_once_routine,
+				   (PVOID)init_routine, NULL) ? 0 : EINVAL;
+}
+
 #endif /* PTHREAD_C */
@@ -89,4 +89,24 @@ extern int pthread_create(pthread_t *thread, const void *unused,
 
 extern int win32_pthread_join(pthread_t *thread, void **value_ptr);
 
+/*
+ * Thread-specific data on top of fiber local storage, whose callbacks are
+ * run at thread exit like the pthread destructors.
+ */
+#define pthread_key_t DWORD
+
+extern int pthread_key_create(pthread_key_t *key, void (*destructor)(void*));
+
+#define pthread_key_delete(a) (FlsFree((a)) ? 0 : EINVAL)
+#define pthread_getspecific(a) FlsGetValue((a))
+#define pthread_setspecific(a, b) (FlsSetValue((a), (b)) ? 0 : ENOMEM)
+
+/*
+ * One-time initialization on top of the one-time initialization API.
+ */
+#define pthread_once_t INIT_ONCE
+#define PTHREAD_ONCE_INIT INIT_ONCE_STATIC_INIT
+
+extern int pthread_once(pthread_once_t *once, void (*init_routine)(void));
+
 #endif /* PTHREAD_H */
@@ -0,0 +1,350 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "zonemap.h"
+
+/* The first bytes of serialized zone maps */
+#define ZONEMAPS_MAGIC "BZM1"
+#define ZONEMAPS_HEADER_LENGTH 16
+
+struct zonemaps_s {
+  int type;
+  int64_t nchunks;
+  int64_t capacity;
+  blosc2_zonemap* chunks;   /* the zone map of every chunk */
+  int32_t* nblocks;
+  blosc2_zonemap** blocks;  /* the zone maps of the blocks of every chunk */
+};
+
+
+int zonemap_typesize(int type) {
+  switch (type) {
+    case BLOSC_ZONEMAP_INT8:
+    case BLOSC_ZONEMAP_UINT8:
+      return 1;
+    case BLOSC_ZONEMAP_INT16:
+    case BLOSC_ZONEMAP_UINT16:
+      return 2;
+    case BLOSC_ZONEMAP_INT32:
+    case BLOSC_ZONEMAP_UINT32:
+    case BLOSC_ZONEMAP_FLOAT32:
+      return 4;
+    case BLOSC_ZONEMAP_INT64:
+    case BLOSC_ZONEMAP_UINT64:
+    case BLOSC_ZONEMAP_FLOAT64:
+      return 8;
+    default:
+      return 0;
+  }
+}
+
+
+/* The min and max of integers are computed in their own type, which is
+   faster, and then converted to double.  The conversion keeps the order,
+   so queries with double bounds never miss a chunk. */
+#define ZONEMAP_INTS(T)                                    \
+  do {                                                     \
+    const T* items = (const T*)src;                        \
+    size_t nitems = nbytes / sizeof(T);                    \
+    if (nitems > 0) {                                      \
+      T min = items[0];                                    \
+      T max = items[0];                                    \
+      for (size_t i = 1; i < nitems; i++) {                \
+        if (items[i] < min) min = items[i];                \
+        if (items[i] > max) max = items[i];                \
+      }                                                    \
+      zonemap->min = (double)min;                          \
+      zonemap->max = (double)max;                          \
+    }                                                      \
+  } while (0)
+
+/* NaN values are counted as nulls and do not take part in min and max */
+#define ZONEMAP_FLOATS(T)                                  \
+  do {                                                     \
+    const T* items = (const T*)src;                        \
+    size_t nitems = nbytes / sizeof(T);                    \
+    for (size_t i = 0; i < nitems; i++) {                  \
+      if (items[i] != items[i]) {                          \
+        zonemap->nnulls++;                                 \
+        continue;                                          \
+      }                                                    \
+      if (items[i] < zonemap->min) zonemap->min = items[i];  \
+      if (items[i] > zonemap->max) zonemap->max = items[i];  \
+    }                                                      \
+  } while (0)
+
+
+void zonemap_compute(int type, const uint8_t* src, size_t nbytes,
+                     blosc2_zonemap* zonemap) {
+  /* No values at all */
+  zonemap->min = HUGE_VAL;
+  zonemap->max = -HUGE_VAL;
+  zonemap->nnulls = 0;
+
+  switch (type) {
+    case BLOSC_ZONEMAP_INT8:
+      ZONEMAP_INTS(int8_t);
+      break;
+    case BLOSC_ZONEMAP_INT16:
+      ZONEMAP_INTS(int16_t);
+      break;
+    case BLOSC_ZONEMAP_INT32:
+      ZONEMAP_INTS(int32_t);
+      break;
+    case BLOSC_ZONEMAP_INT64:
+      ZONEMAP_INTS(int64_t);
+      break;
+    case BLOSC_ZONEMAP_UINT8:
+      ZONEMAP_INTS(uint8_t);
+      break;
+    case BLOSC_ZONEMAP_UINT16:
+      ZONEMAP_INTS(uint16_t);
+      break;
+    case BLOSC_ZONEMAP_UINT32:
+      ZONEMAP_INTS(uint32_t);
+      break;
+    case BLOSC_ZONEMAP_UINT64:
+      ZONEMAP_INTS(uint64_t);
+      break;
+    case BLOSC_ZONEMAP_FLOAT32:
+      ZONEMAP_FLOATS(float);
+      break;
+    case BLOSC_ZONEMAP_FLOAT64:
+      ZONEMAP_FLOATS(double);
+      break;
+    default:
+      break;
+  }
+}
+
+
+void zonemap_merge(blosc2_zonemap* dest, const blosc2_zonemap* src) {
+  if (src->min < dest->min) {
+    dest->min = src->min;
+  }
+  if (src->max > dest->max) {
+    dest->max = src->max;
+  }
+  dest->nnulls += src->nnulls;
+}
+
+
+zonemaps* zonemaps_new(int type) {
+  zonemaps* zmaps = calloc(1, sizeof(zonemaps));
+
+  if (zmaps == NULL) {
+    return NULL;
+  }
+  zmaps->type = type;
+  return zmaps;
+}
+
+
+void zonemaps_free(zonemaps* zmaps) {
+  for (int64_t i = 0; i < zmaps->nchunks; i++) {
+    free(zmaps->blocks[i]);
+  }
+  free(zmaps->chunks);
+  free(zmaps->nblocks);
+  free(zmaps->blocks);
+  free(zmaps);
+}
+
+
+int zonemaps_type(const zonemaps* zmaps) {
+  return zmaps->type;
+}
+
+
+int64_t zonemaps_nchunks(const zonemaps* zmaps) {
+  return zmaps->nchunks;
+}
+
+
+/* Set the zone maps of the `nchunk` slot */
+static void set_chunk(zonemaps* zmaps, int64_t nchunk, blosc2_zonemap* blocks,
+                      int32_t nblocks) {
+  blosc2_zonemap* chunk = &zmaps->chunks[nchunk];
+
+  chunk->min = HUGE_VAL;
+  chunk->max = -HUGE_VAL;
+  chunk->nnulls = 0;
+  for (int32_t i = 0; i < nblocks; i++) {
+    zonemap_merge(chunk, &blocks[i]);
+  }
+  zmaps->nblocks[nchunk] = nblocks;
+  zmaps->blocks[nchunk] = blocks;
+}
+
+
+int zonemaps_insert(zonemaps* zmaps, int64_t nchunk, blosc2_zonemap* blocks,
+                    int32_t nblocks) {
+  size_t nafter = (size_t)(zmaps->nchunks - nchunk);
+  int64_t capacity;
+  void* array;
+
+  if (zmaps->nchunks == zmaps->capacity) {
+    /* The capacity only grows once the three arrays have grown */
+    capacity = (zmaps->capacity > 0) ? 2 * zmaps->capacity : 16;
+    array = realloc(zmaps->chunks, capacity * sizeof(blosc2_zonemap));
+    if (array == NULL) {
+      free(blocks);
+      return -1;
+    }
+    zmaps->chunks = array;
+    array = realloc(zmaps->nblocks, capacity * sizeof(int32_t));
+    if (array == NULL) {
+      free(blocks);
+      return -1;
+    }
+    zmaps->nblocks = array;
+    array = realloc(zmaps->blocks, capacity * sizeof(blosc2_zonemap*));
+    if (array == NULL) {
+      free(blocks);
+      return -1;
+    }
+    zmaps->blocks = array;
+    zmaps->capacity = capacity;
+  }
+  memmove(zmaps->chunks + nchunk + 1, zmaps->chunks + nchunk,
+          nafter * sizeof(blosc2_zonemap));
+  memmove(zmaps->nblocks + nchunk + 1, zmaps->nblocks + nchunk,
+          nafter * sizeof(int32_t));
+  memmove(zmaps->blocks + nchunk + 1, zmaps->blocks + nchunk,
+          nafter * sizeof(blosc2_zonemap*));
+  zmaps->nchunks++;
+  set_chunk(zmaps, nchunk, blocks, nblocks);
+  return 0;
+}
+
+
+void zonemaps_update(zonemaps* zmaps, int64_t nchunk, blosc2_zonemap* blocks,
+                     int32_t nblocks) {
+  free(zmaps->blocks[nchunk]);
+  set_chunk(zmaps, nchunk, blocks, nblocks);
+}
+
+
+void zonemaps_delete(zonemaps* zmaps, int64_t nchunk) {
+  size_t nafter = (size_t)(zmaps->nchunks - nchunk - 1);
+
+  free(zmaps->blocks[nchunk]);
+  memmove(zmaps->chunks + nchunk, zmaps->chunks + nchunk + 1,
+          nafter * sizeof(blosc2_zonemap));
+  memmove(zmaps->nblocks + nchunk, zmaps->nblocks + nchunk + 1,
+          nafter * sizeof(int32_t));
+  memmove(zmaps->blocks + nchunk, zmaps->blocks + nchunk + 1,
+          nafter * sizeof(blosc2_zonemap*));
+  zmaps->nchunks--;
+}
+
+
+const blosc2_zonemap* zonemaps_chunk(const zonemaps* zmaps, int64_t nchunk) {
+  return &zmaps->chunks[nchunk];
+}
+
+
+const blosc2_zonemap* zonemaps_blocks(const zonemaps* zmaps, int64_t nchunk,
+                                      int32_t* nblocks) {
+  *nblocks = zmaps->nblocks[nchunk];
+  return zmaps->blocks[nchunk];
+}
+
+
+int64_t zonemaps_query(const zonemaps* zmaps, double low, double high,
+                       int64_t* chunks, int64_t maxchunks) {
+  int64_t nfound = 0;
+
+  for (int64_t i = 0; i < zmaps->nchunks; i++) {
+    const blosc2_zonemap* chunk = &zmaps->chunks[i];
+    /* Chunks without values (but NaNs) have min > max and never match */
+    if ((chunk->min <= chunk->max) && (chunk->max >= low) &&
+        (chunk->min <= high)) {
+      if (nfound < maxchunks) {
+        chunks[nfound] = i;
+      }
+      nfound++;
+    }
+  }
+  return nfound;
+}
+
+
+uint8_t* zonemaps_serialize(const zonemaps* zmaps, size_t* nbytes) {
+  uint8_t* buffer;
+  uint8_t* p;
+  int32_t type = zmaps->type;
+
+  *nbytes = ZONEMAPS_HEADER_LENGTH;
+  for (int64_t i = 0; i < zmaps->nchunks; i++) {
+    *nbytes += sizeof(int32_t) + zmaps->nblocks[i] * sizeof(blosc2_zonemap);
+  }
+  buffer = malloc(*nbytes);
+  if (buffer == NULL) {
+    return NULL;
+  }
+  memcpy(buffer, ZONEMAPS_MAGIC, 4);
+  memcpy(buffer + 4, &type, sizeof(int32_t));
+  memcpy(buffer + 8, &zmaps->nchunks, sizeof(int64_t));
+  p = buffer + ZONEMAPS_HEADER_LENGTH;
+  for (int64_t i = 0; i < zmaps->nchunks; i++) {
+    memcpy(p, &zmaps->nblocks[i], sizeof(int32_t));
+    p += sizeof(int32_t);
+    memcpy(p, zmaps->blocks[i], zmaps->nblocks[i] * sizeof(blosc2_zonemap));
+    p += zmaps->nblocks[i] * sizeof(blosc2_zonemap);
+  }
+  return buffer;
+}
+
+
+zonemaps* zonemaps_deserialize(const uint8_t* buffer, size_t nbytes) {
+  const uint8_t* p = buffer + ZONEMAPS_HEADER_LENGTH;
+  const uint8_t* end = buffer + nbytes;
+  blosc2_zonemap* blocks;
+  zonemaps* zmaps;
+  int32_t type, nblocks;
+  int64_t nchunks;
+
+  if ((nbytes < ZONEMAPS_HEADER_LENGTH) ||
+      (memcmp(buffer, ZONEMAPS_MAGIC, 4) != 0)) {
+    return NULL;
+  }
+  memcpy(&type, buffer + 4, sizeof(int32_t));
+  memcpy(&nchunks, buffer + 8, sizeof(int64_t));
+  zmaps = zonemaps_new(type);
+  if (zmaps == NULL) {
+    return NULL;
+  }
+  for (int64_t i = 0; i < nchunks; i++) {
+    if (p + sizeof(int32_t) > end) {
+      break;
+    }
+    memcpy(&nblocks, p, sizeof(int32_t));
+    p += sizeof(int32_t);
+    if ((nblocks < 0) ||
+        ((size_t)(end - p) < nblocks * sizeof(blosc2_zonemap))) {
+      break;
+    }
+    blocks = malloc((nblocks > 0 ? nblocks : 1) * sizeof(blosc2_zonemap));
+    if (blocks == NULL) {
+      break;
+    }
+    memcpy(blocks, p, nblocks * sizeof(blosc2_zonemap));
+    p += nblocks * sizeof(blosc2_zonemap);
+    if (zonemaps_insert(zmaps, i, blocks, nblocks) < 0) {
+      break;
+    }
+  }
+  if (zmaps->nchunks != nchunks) {
+    /* Truncated buffer, or out of memory */
+    zonemaps_free(zmaps);
+    return NULL;
+  }
+  return zmaps;
+}
@@ -0,0 +1,68 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#ifndef BLOSC_ZONEMAP_H
+#define BLOSC_ZONEMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "blosc.h"
+
+/* The size of the items of a zone map type (0 if not valid) */
+int zonemap_typesize(int type);
+
+/* Compute the zone map of the `nbytes` bytes in `src` */
+void zonemap_compute(int type, const uint8_t* src, size_t nbytes,
+                     blosc2_zonemap* zonemap);
+
+/* Widen `dest` for covering `src` too */
+void zonemap_merge(blosc2_zonemap* dest, const blosc2_zonemap* src);
+
+/* The zone maps of the chunks of a super-chunk, with the ones of their
+   blocks */
+typedef struct zonemaps_s zonemaps;
+
+/* NULL if it cannot be allocated */
+zonemaps* zonemaps_new(int type);
+
+void zonemaps_free(zonemaps* zmaps);
+
+int zonemaps_type(const zonemaps* zmaps);
+
+int64_t zonemaps_nchunks(const zonemaps* zmaps);
+
+/* Insert the zone maps of a new `nchunk` chunk made of `nblocks` blocks.
+   `blocks` is owned by `zmaps` from now on, and it is freed if they cannot
+   grow (then a negative value is returned). */
+int zonemaps_insert(zonemaps* zmaps, int64_t nchunk, blosc2_zonemap* blocks,
+                    int32_t nblocks);
+
+/* Replace the zone maps of the `nchunk` chunk (see zonemaps_insert()) */
+void zonemaps_update(zonemaps* zmaps, int64_t nchunk, blosc2_zonemap* blocks,
+                     int32_t nblocks);
+
+void zonemaps_delete(zonemaps* zmaps, int64_t nchunk);
+
+const blosc2_zonemap* zonemaps_chunk(const zonemaps* zmaps, int64_t nchunk);
+
+/* The zone maps of the blocks of the `nchunk` chunk */
+const blosc2_zonemap* zonemaps_blocks(const zonemaps* zmaps, int64_t nchunk,
+                                      int32_t* nblocks);
+
+/* The chunks that can hold values in [low, high] (see
+   blosc2_schunk_zonemap_query()) */
+int64_t zonemaps_query(const zonemaps* zmaps, double low, double high,
+                       int64_t* chunks, int64_t maxchunks);
+
+/* Serialize the zone maps into a new buffer of `*nbytes` bytes (NULL if it
+   cannot be allocated) */
+uint8_t* zonemaps_serialize(const zonemaps* zmaps, size_t* nbytes);
+
+/* The zone maps in a buffer made by zonemaps_serialize() (NULL if it was
+   not made by it) */
+zonemaps* zonemaps_deserialize(const uint8_t* buffer, size_t nbytes);
+
+#endif  /* BLOSC_ZONEMAP_H */
@@ -85,6 +85,51 @@ static char *test_blocksize() {
   return 0;
 }
 
+static char *test_cache_sizes() {
+  size_t l1, l2, l3;
+
+  blosc_get_cache_sizes(&l1, &l2, &l3);
+  mu_assert("ERROR: L1 size incorrect", l1 >= 8 * KB);
+  mu_assert("ERROR: L2 size incorrect", l2 >= l1);
+  mu_assert("ERROR: L3 size incorrect", (l3 == 0) || (l3 >= l2));
+  return 0;
+}
+
+static char *test_blocksize_info() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_blocksize_info info;
+  blosc2_context* cctx;
+  int cbytes_;
+
+  cparams.typesize = typesize;
+  cparams.clevel = 6;
+  cparams.nthreads = 2;
+  cctx = blosc2_create_cctx(cparams);
+  cbytes_ = blosc2_compress_ctx(cctx, size, src, dest2, size);
+  mu_assert("ERROR: compression failed", cbytes_ > 0);
+  mu_assert("ERROR: blocksize_info failed",
+            blosc2_get_blocksize_info(cctx, &info) == 0);
+  mu_assert("ERROR: blocksize should not be forced", info.forced == 0);
+  mu_assert("ERROR: blocksize does not fit in cache",
+            info.blocksize <= info.blocksize_limit);
+  mu_assert("ERROR: blocksize not a multiple of typesize",
+            info.blocksize % typesize == 0);
+  blosc2_free_ctx(cctx);
+
+  /* Forced blocksizes are kept for every buffer compressed by a context */
+  cparams.blocksize = 4096;
+  cctx = blosc2_create_cctx(cparams);
+  for (int i = 0; i < 2; i++) {
+    cbytes_ = blosc2_compress_ctx(cctx, size / (i + 1), src, dest2, size);
+    mu_assert("ERROR: compression failed", cbytes_ > 0);
+    blosc2_get_blocksize_info(cctx, &info);
+    mu_assert("ERROR: blocksize should be forced", info.forced == 1);
+    mu_assert("ERROR: forced blocksize not used", info.blocksize == 4096);
+  }
+  blosc2_free_ctx(cctx);
+  return 0;
+}
+
 
 static char* all_tests() {
   mu_run_test(test_cbuffer_sizes);
@@ -93,6 +138,8 @@ static char* all_tests() {
   mu_run_test(test_cbuffer_complib);
   mu_run_test(test_nthreads);
   mu_run_test(test_blocksize);
+  mu_run_test(test_cache_sizes);
+  mu_run_test(test_blocksize_info);
   return 0;
 }
 
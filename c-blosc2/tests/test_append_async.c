@@ -0,0 +1,118 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for blosc2_append_buffer_async() and blosc2_schunk_flush().
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (4 * 1024)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 300
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *dest;
+int nthreads;
+int use_delta;
+
+
+static void fill_chunk(int nchunk) {
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    data[i] = i * nchunk + (i % 17);
+  }
+}
+
+
+static char *test_append_async() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  int64_t nchunks;
+  int dsize;
+
+  cparams.typesize = 4;
+  cparams.nthreads = (uint32_t)nthreads;
+  if (use_delta) {
+    cparams.filters[0] = BLOSC_DELTA;
+  }
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    /* The buffer can be reused right after the call */
+    fill_chunk(nchunk);
+    if (nchunk == NCHUNKS / 2) {
+      /* Synchronous appends go after the pending ones */
+      nchunks = (int64_t)blosc2_append_buffer(schunk, CHUNKSIZE, data);
+      mu_assert("ERROR: bad number of chunks after a synchronous append",
+                nchunks == nchunk + 1);
+      continue;
+    }
+    nchunks = blosc2_append_buffer_async(schunk, CHUNKSIZE, data);
+    mu_assert("ERROR: bad number of chunks", nchunks == nchunk + 1);
+  }
+  mu_assert("ERROR: flush failed", blosc2_schunk_flush(schunk) == 0);
+  mu_assert("ERROR: chunks are missing", schunk->nchunks == NCHUNKS);
+
+  /* The chunks are appended in order */
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    dsize = blosc2_decompress_chunk(schunk, (size_t)nchunk, dest, CHUNKSIZE);
+    mu_assert("ERROR: chunk decompression failed", dsize == CHUNKSIZE);
+    fill_chunk(nchunk);
+    mu_assert("ERROR: chunk roundtrip not successful",
+              memcmp(data, dest, CHUNKSIZE) == 0);
+  }
+
+  /* Pending appends are flushed when destroying the super-chunk */
+  for (int nchunk = 0; nchunk < 10; nchunk++) {
+    blosc2_append_buffer_async(schunk, CHUNKSIZE, data);
+  }
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    use_delta = 0;
+    mu_run_test(test_append_async);
+    use_delta = 1;
+    mu_run_test(test_append_async);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,160 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the asynchronous requests (see
+  blosc2_compress_ctx_async()).
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NREQUESTS 16
+#define NITEMS (100 * 1000)
+#define SIZE (NITEMS * 4)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *src, *dest[NREQUESTS], *dest2[NREQUESTS];
+int nthreads;
+int ncallbacks;
+
+
+static void callback(blosc2_request* request, int result, void* data) {
+  /* Callbacks are run by a single thread per context */
+  ncallbacks++;
+  *(int*)data = result;
+}
+
+
+static char *test_async() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context *cctx, *dctx;
+  blosc2_request* requests[NREQUESTS];
+  int results[NREQUESTS];
+  int cbytes;
+
+  cparams.typesize = 4;
+  cparams.compcode = BLOSC_ZSTD;
+  cparams.nthreads = (uint32_t)nthreads;
+  cctx = blosc2_create_cctx(cparams);
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+
+  /* Compression with handles */
+  for (int r = 0; r < NREQUESTS; r++) {
+    requests[r] = blosc2_compress_ctx_async(cctx, SIZE - r * 1000, src,
+                                            dest[r], SIZE + BLOSC_MAX_OVERHEAD,
+                                            NULL, NULL);
+    mu_assert("ERROR: compression request not queued", requests[r] != NULL);
+  }
+  for (int r = 0; r < NREQUESTS; r++) {
+    results[r] = blosc2_request_wait(requests[r]);
+    mu_assert("ERROR: asynchronous compression failed", results[r] > 0);
+  }
+  for (int r = 0; r < NREQUESTS; r++) {
+    /* The same result than the synchronous call */
+    cbytes = blosc2_compress_ctx(cctx, SIZE - r * 1000, src, dest2[r],
+                                 SIZE + BLOSC_MAX_OVERHEAD);
+    mu_assert("ERROR: compressed sizes differ", cbytes == results[r]);
+  }
+
+  /* Decompression with callbacks */
+  ncallbacks = 0;
+  for (int r = 0; r < NREQUESTS; r++) {
+    results[r] = 0;
+    requests[r] = blosc2_decompress_ctx_async(dctx, dest[r], dest2[r], SIZE,
+                                              callback, &results[r]);
+  }
+  for (int r = 0; r < NREQUESTS; r++) {
+    int result = blosc2_request_wait(requests[r]);
+    mu_assert("ERROR: asynchronous decompression failed",
+              result == SIZE - r * 1000);
+    mu_assert("ERROR: callback not called before completion",
+              results[r] == result);
+    mu_assert("ERROR: decompression roundtrip not successful",
+              memcmp(src, dest2[r], (size_t)result) == 0);
+  }
+  mu_assert("ERROR: bad number of callbacks", ncallbacks == NREQUESTS);
+
+  /* Cancellation of the requests that did not start */
+  ncallbacks = 0;
+  for (int r = 0; r < NREQUESTS; r++) {
+    requests[r] = blosc2_compress_ctx_async(cctx, SIZE, src, dest[r],
+                                            SIZE + BLOSC_MAX_OVERHEAD,
+                                            callback, &results[r]);
+  }
+  mu_assert("ERROR: the last request is not cancelled",
+            blosc2_request_cancel(requests[NREQUESTS - 1]) == 1);
+  mu_assert("ERROR: cancelled request is not done",
+            blosc2_request_poll(requests[NREQUESTS - 1]) == 1);
+  for (int r = 0; r < NREQUESTS - 1; r++) {
+    blosc2_request_cancel(requests[r]);
+  }
+  for (int r = 0; r < NREQUESTS; r++) {
+    int result = blosc2_request_wait(requests[r]);
+    mu_assert("ERROR: bad result for a request",
+              (result == BLOSC2_REQUEST_CANCELLED_RESULT) || (result > 0));
+  }
+  mu_assert("ERROR: callback called for cancelled requests",
+            ncallbacks < NREQUESTS);
+
+  mu_assert("ERROR: decompression context compresses",
+            blosc2_compress_ctx_async(dctx, SIZE, src, dest[0], SIZE, NULL,
+                                      NULL) == NULL);
+
+  blosc2_free_ctx(cctx);
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  nthreads = 1;
+  mu_run_test(test_async);
+  nthreads = 4;
+  mu_run_test(test_async);
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  src = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  for (int i = 0; i < NITEMS; i++) {
+    src[i] = i * 3 + (i % 23);
+  }
+  for (int r = 0; r < NREQUESTS; r++) {
+    dest[r] = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BLOSC_MAX_OVERHEAD);
+    dest2[r] = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BLOSC_MAX_OVERHEAD);
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(src);
+  for (int r = 0; r < NREQUESTS; r++) {
+    blosc_test_free(dest[r]);
+    blosc_test_free(dest2[r]);
+  }
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,174 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for blosc2_compress_batch() and blosc2_decompress_batch().
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NBUFFERS 40
+#define MAXITEMS (100 * 1000)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *src[NBUFFERS], *dest[NBUFFERS], *dest2[NBUFFERS], *dest3;
+size_t sizes[NBUFFERS];
+int nthreads;
+int use_delta;
+int chainlen;
+
+
+/* Buffers of many sizes, some of them not compressible at all */
+static void fill_buffers(void) {
+  for (int n = 0; n < NBUFFERS; n++) {
+    size_t nitems = (n % 4 == 0) ? (size_t)(MAXITEMS / (n + 1)) :
+                    (size_t)(n * 257 + 3);
+    sizes[n] = nitems * sizeof(int32_t);
+    for (uint32_t i = 0; i < nitems; i++) {
+      src[n][i] = (n % 5 == 4) ? (int32_t)(i * 2654435761u) :
+                  (int32_t)(i * n + i % 7);
+    }
+  }
+}
+
+
+static blosc2_cparams get_cparams(void) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+
+  cparams.typesize = 4;
+  cparams.compcode = BLOSC_LZ4;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.chainlen = chainlen;
+  cparams.blocksize = 16 * 1024;
+  if (use_delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  return cparams;
+}
+
+
+static char *test_batch() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_batch_item items[NBUFFERS];
+  blosc2_context *cctx, *dctx;
+  int csize, rc;
+
+  fill_buffers();
+  cctx = blosc2_create_cctx(get_cparams());
+  for (int n = 0; n < NBUFFERS; n++) {
+    items[n].src = src[n];
+    items[n].nbytes = sizes[n];
+    items[n].dest = dest[n];
+    items[n].destsize = sizes[n] + BLOSC_MAX_OVERHEAD;
+  }
+  rc = blosc2_compress_batch(cctx, items, NBUFFERS);
+  mu_assert("ERROR: batch compression failed", rc == 0);
+  blosc2_free_ctx(cctx);
+
+  /* The buffers are the same than the ones of blosc2_compress_ctx() */
+  cctx = blosc2_create_cctx(get_cparams());
+  for (int n = 0; n < NBUFFERS; n++) {
+    csize = blosc2_compress_ctx(cctx, sizes[n], src[n], dest3,
+                                sizes[n] + BLOSC_MAX_OVERHEAD);
+    mu_assert("ERROR: compressed sizes differ", csize == items[n].result);
+    mu_assert("ERROR: chunk is not readable",
+              blosc_decompress(dest[n], dest2[n], sizes[n]) == (int)sizes[n]);
+    mu_assert("ERROR: compression roundtrip not successful",
+              memcmp(src[n], dest2[n], sizes[n]) == 0);
+  }
+  blosc2_free_ctx(cctx);
+
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+  for (int n = 0; n < NBUFFERS; n++) {
+    memset(dest2[n], 0, sizes[n]);
+    items[n].src = dest[n];
+    items[n].dest = dest2[n];
+    items[n].destsize = sizes[n];
+  }
+  rc = blosc2_decompress_batch(dctx, items, NBUFFERS);
+  mu_assert("ERROR: batch decompression failed", rc == 0);
+  for (int n = 0; n < NBUFFERS; n++) {
+    mu_assert("ERROR: decompressed size differs",
+              items[n].result == (int)sizes[n]);
+    mu_assert("ERROR: decompression roundtrip not successful",
+              memcmp(src[n], dest2[n], sizes[n]) == 0);
+  }
+
+  /* Errors are reported per buffer */
+  items[1].destsize = sizes[1] - 1;
+  rc = blosc2_decompress_batch(dctx, items, NBUFFERS);
+  mu_assert("ERROR: a short destination is not reported", rc < 0);
+  mu_assert("ERROR: the failing buffer is not reported", items[1].result < 0);
+  mu_assert("ERROR: other buffers are affected",
+            items[2].result == (int)sizes[2]);
+
+  mu_assert("ERROR: a decompression context compresses",
+            blosc2_compress_batch(dctx, items, NBUFFERS) == -10);
+  mu_assert("ERROR: a negative number of items is accepted",
+            blosc2_decompress_batch(dctx, items, -1) == -10);
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  int nthreads_values[] = {1, 4};
+
+  for (int t = 0; t < 2; t++) {
+    nthreads = nthreads_values[t];
+    use_delta = 0;
+    chainlen = 1;
+    mu_run_test(test_batch);
+    use_delta = 1;
+    mu_run_test(test_batch);
+    use_delta = 0;
+    chainlen = 4;
+    mu_run_test(test_batch);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  for (int n = 0; n < NBUFFERS; n++) {
+    src[n] = blosc_test_malloc(BUFFER_ALIGN_SIZE, MAXITEMS * 4);
+    dest[n] = blosc_test_malloc(BUFFER_ALIGN_SIZE,
+                                MAXITEMS * 4 + BLOSC_MAX_OVERHEAD);
+    dest2[n] = blosc_test_malloc(BUFFER_ALIGN_SIZE, MAXITEMS * 4);
+  }
+  dest3 = blosc_test_malloc(BUFFER_ALIGN_SIZE,
+                            MAXITEMS * 4 + BLOSC_MAX_OVERHEAD);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  for (int n = 0; n < NBUFFERS; n++) {
+    blosc_test_free(src[n]);
+    blosc_test_free(dest[n]);
+    blosc_test_free(dest2[n]);
+  }
+  blosc_test_free(dest3);
+
+  blosc_destroy();
+
+  return result != 0;
+}
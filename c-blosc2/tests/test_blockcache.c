@@ -0,0 +1,131 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the cache of blocks of blosc2_getitem_ctx() (see
+  `blockcache` in blosc2_dparams).
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (256 * 1024)
+#define SIZE (NITEMS * 4)
+#define BLOCKSIZE (16 * 1024)
+#define WINDOW 100
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *src, *dest, *dest2;
+size_t budget;
+int use_delta;
+
+
+static int compress_src(int32_t seed) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int cbytes;
+
+  for (int i = 0; i < NITEMS; i++) {
+    src[i] = seed * i + (i % 29);
+  }
+  cparams.typesize = 4;
+  cparams.blocksize = BLOCKSIZE;
+  if (use_delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  cbytes = blosc2_compress_ctx(cctx, SIZE, src, dest, SIZE + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  return cbytes;
+}
+
+
+/* Read the buffer in small windows, back and forth */
+static int check_windows(blosc2_context* dctx) {
+  for (int pass = 0; pass < 2; pass++) {
+    for (int start = 0; start + WINDOW <= NITEMS; start += 997) {
+      int nbytes = blosc2_getitem_ctx(dctx, dest, start, WINDOW, dest2);
+      if ((nbytes != WINDOW * 4) ||
+          (memcmp(src + start, dest2, WINDOW * 4) != 0)) {
+        return 0;
+      }
+    }
+  }
+  return 1;
+}
+
+
+static char *test_blockcache() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+
+  dparams.blockcache = budget;
+  dctx = blosc2_create_dctx(dparams);
+
+  mu_assert("ERROR: compression failed", compress_src(3) > 0);
+  mu_assert("ERROR: windows are not correct", check_windows(dctx));
+
+  /* A different buffer at the same address */
+  mu_assert("ERROR: compression failed", compress_src(5) > 0);
+  blosc2_clear_blockcache(dctx);
+  mu_assert("ERROR: windows of new buffer are not correct",
+            check_windows(dctx));
+
+  /* Which is told apart by its contents too */
+  mu_assert("ERROR: compression failed", compress_src(7) > 0);
+  mu_assert("ERROR: windows of replaced buffer are not correct",
+            check_windows(dctx));
+
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  /* No cache, room for a few blocks, room for the whole buffer */
+  size_t budgets[] = {0, 3 * BLOCKSIZE, 2 * SIZE};
+
+  for (int i = 0; i < 3; i++) {
+    budget = budgets[i];
+    use_delta = 0;
+    mu_run_test(test_blockcache);
+    use_delta = 1;
+    mu_run_test(test_blockcache);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  src = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BLOSC_MAX_OVERHEAD);
+  dest2 = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(src);
+  blosc_test_free(dest);
+  blosc_test_free(dest2);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,111 @@
+/*
+  Copyright (C) 2015  Francesc Alted
+  http://blosc.org
+  License: BSD (see LICENSE.txt)
+
+*/
+
+#include <stdio.h>
+#include "test_common.h"
+
+#define SIZE (100 * 1000)
+#define NCHUNKS 40
+#define NTHREADS 2
+
+
+static int test_btune(blosc2_btune btune) {
+  static int32_t data[SIZE];
+  static int32_t data_dest[SIZE];
+  size_t isize = SIZE * sizeof(int32_t);
+  int dsize;
+  int32_t cbytes_first, cbytes_last, cbytes_prev;
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  size_t nchunks;
+
+  /* Create a super-chunk container with BTune attached */
+  cparams.typesize = sizeof(int32_t);
+  cparams.compcode = BLOSC_BLOSCLZ;
+  cparams.clevel = 5;
+  cparams.nthreads = NTHREADS;
+  dparams.nthreads = NTHREADS;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  if (blosc2_set_btune(schunk, btune) < 0) {
+    fprintf(stderr, "Cannot attach BTune to the super-chunk\n");
+    return EXIT_FAILURE;
+  }
+
+  for (int i = 0; i < SIZE; i++) {
+    data[i] = (i / 7) ^ (i % 13);
+  }
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    nchunks = blosc2_append_buffer(schunk, isize, data);
+    if (nchunks != (nchunk + 1)) return EXIT_FAILURE;
+  }
+
+  /* The first chunk uses the initial params, the last ones the tuned ones */
+  cbytes_first = *(int32_t*)(schunk->data[0] + 12);
+  cbytes_prev = *(int32_t*)(schunk->data[NCHUNKS - 2] + 12);
+  cbytes_last = *(int32_t*)(schunk->data[NCHUNKS - 1] + 12);
+  if (cbytes_last != cbytes_prev) {
+    fprintf(stderr, "BTune has not converged: %d != %d\n",
+            cbytes_last, cbytes_prev);
+    return EXIT_FAILURE;
+  }
+  if ((btune.min_dspeed == 0) && (cbytes_last > cbytes_first)) {
+    fprintf(stderr, "BTune worsened the ratio: %d > %d\n",
+            cbytes_last, cbytes_first);
+    return EXIT_FAILURE;
+  }
+
+  /* Retrieve and decompress the chunks (0-based count) */
+  for (size_t nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    dsize = blosc2_decompress_chunk(schunk, nchunk, (void *) data_dest, isize);
+    if (dsize < 0) {
+      return EXIT_FAILURE;
+    }
+    if (memcmp(data, data_dest, isize) != 0) {
+      fprintf(stderr, "Roundtrip failed for chunk: %zu\n", nchunk);
+      return EXIT_FAILURE;
+    }
+  }
+
+  blosc2_destroy_schunk(schunk);
+  return EXIT_SUCCESS;
+}
+
+
+int main() {
+  blosc2_btune btune = BLOSC_BTUNE_DEFAULTS;
+
+  printf("Blosc version info: %s (%s)\n",
+         BLOSC_VERSION_STRING, BLOSC_VERSION_DATE);
+
+  /* Initialize the Blosc compressor */
+  blosc_init();
+
+  /* Maximize the compression ratio */
+  if (test_btune(btune) != EXIT_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  /* A decompression speed that cannot be reached */
+  btune.min_dspeed = 1e6;
+  if (test_btune(btune) != EXIT_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  /* Maximize the compression speed */
+  btune.objective = BLOSC_BTUNE_CSPEED;
+  btune.min_dspeed = 0;
+  btune.period = 4;
+  if (test_btune(btune) != EXIT_SUCCESS) {
+    return EXIT_FAILURE;
+  }
+
+  /* Destroy the Blosc environment */
+  blosc_destroy();
+
+  return EXIT_SUCCESS;
+}
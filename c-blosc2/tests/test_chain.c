@@ -0,0 +1,167 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for chained blocks (see `chainlen` in blosc2_cparams).
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define BLOCKSIZE (16 * KB)
+#define NBLOCKS 37
+#define LEFTOVER 992
+#define SIZE (NBLOCKS * BLOCKSIZE + LEFTOVER)   /* must be divisible by 4 */
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+uint8_t *src, *srccpy, *dest, *dest2;
+int compcode;
+int nthreads;
+uint8_t filter;
+
+
+/* A pseudo-random block repeated (with small changes) all over the buffer,
+   so that matches mostly live in neighbouring blocks */
+static void fill_buffer(void) {
+  uint32_t seed = 1234567;
+  for (int i = 0; i < BLOCKSIZE; i++) {
+    seed = seed * 1103515245 + 12345;
+    src[i] = (uint8_t)(seed >> 16);
+  }
+  for (int i = BLOCKSIZE; i < SIZE; i++) {
+    src[i] = src[i - BLOCKSIZE];
+  }
+  for (int i = 0; i < SIZE; i += 4093) {
+    src[i] = (uint8_t)i;
+  }
+  memcpy(srccpy, src, SIZE);
+}
+
+
+static int compress_buffer(int chainlen, uint8_t* out) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int csize;
+
+  cparams.typesize = 4;
+  cparams.compcode = compcode;
+  cparams.clevel = 5;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.blocksize = BLOCKSIZE;
+  cparams.filters[BLOSC_MAX_FILTERS - 1] = filter;
+  cparams.chainlen = chainlen;
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, SIZE, src, out, SIZE + BUFFER_ALIGN_SIZE);
+  blosc2_free_ctx(cctx);
+  return csize;
+}
+
+
+static char *test_chain() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  int32_t items[16];
+  int csize, csize_chain, dsize;
+
+  fill_buffer();
+
+  csize = compress_buffer(0, dest2);
+  mu_assert("ERROR: compression without chains failed", csize > 0);
+  csize_chain = compress_buffer(8, dest);
+  mu_assert("ERROR: compression with chains failed", csize_chain > 0);
+  if (filter != BLOSC_BITSHUFFLE) {
+    /* Bitshuffle scrambles bytes too much for history to help much */
+    mu_assert("ERROR: chains do not improve the compression ratio",
+              csize_chain < csize);
+  }
+
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+
+  /* Decompress the whole buffer */
+  memset(src, 0, SIZE);
+  dsize = blosc2_decompress_ctx(dctx, dest, src, SIZE);
+  mu_assert("ERROR: decompression with chains failed", dsize == SIZE);
+  mu_assert("ERROR: roundtrip with chains not successful",
+            memcmp(src, srccpy, SIZE) == 0);
+
+  /* Get items from the middle of a chain, both out of order and in order */
+  for (int n = 0; n < 4; n++) {
+    int start = ((29 - 9 * n) * BLOCKSIZE + 36) / 4;
+    if (n == 3) {
+      start = SIZE / 4 - 16;   /* the leftover block */
+    }
+    dsize = blosc2_getitem_ctx(dctx, dest, start, 16, items);
+    mu_assert("ERROR: getitem with chains failed", dsize == 16 * 4);
+    mu_assert("ERROR: getitem with chains not successful",
+              memcmp(items, srccpy + start * 4, 16 * 4) == 0);
+  }
+  dsize = blosc2_getitem_ctx(dctx, dest, (3 * BLOCKSIZE - 16) / 4, 8, items);
+  mu_assert("ERROR: getitem across blocks failed", dsize == 8 * 4);
+  mu_assert("ERROR: getitem across blocks not successful",
+            memcmp(items, srccpy + 3 * BLOCKSIZE - 16, 8 * 4) == 0);
+
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  const char* compressors = blosc_list_compressors();
+  int compcodes[] = {BLOSC_LZ4, BLOSC_LZ4HC, BLOSC_ZSTD};
+  const char* compnames[] = {"lz4", "lz4hc", "zstd"};
+  uint8_t filters[] = {BLOSC_NOSHUFFLE, BLOSC_SHUFFLE, BLOSC_BITSHUFFLE};
+
+  for (int i = 0; i < 3; i++) {
+    /* Codecs may be deactivated at build time */
+    if (strstr(compressors, compnames[i]) == NULL) {
+      continue;
+    }
+    compcode = compcodes[i];
+    for (int j = 0; j < 3; j++) {
+      filter = filters[j];
+      nthreads = 1;
+      mu_run_test(test_chain);
+      nthreads = 4;
+      mu_run_test(test_chain);
+    }
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  src = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  srccpy = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BUFFER_ALIGN_SIZE);
+  dest2 = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BUFFER_ALIGN_SIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(src);
+  blosc_test_free(srccpy);
+  blosc_test_free(dest);
+  blosc_test_free(dest2);
+
+  blosc_destroy();
+
+  return result != 0;
+}
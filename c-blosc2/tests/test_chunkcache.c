@@ -0,0 +1,194 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the cache of decompressed chunks of super-chunks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <pthread.h>
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (50 * 1000)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 10
+#define NREADERS 4
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *dest;
+blosc2_schunk* schunk;
+
+
+static void fill_schunk(void) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+
+  cparams.typesize = 4;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    for (int i = 0; i < CHUNKITEMS; i++) {
+      data[nchunk * CHUNKITEMS + i] = i * nchunk + (i % 13);
+    }
+    blosc2_append_buffer(schunk, CHUNKSIZE, data + nchunk * CHUNKITEMS);
+  }
+}
+
+
+static int check_chunk(int nchunk, int32_t* buffer) {
+  memset(buffer, 0, CHUNKSIZE);
+  return (blosc2_decompress_chunk(schunk, (size_t)nchunk, buffer,
+                                  CHUNKSIZE) == CHUNKSIZE) &&
+         (memcmp(data + nchunk * CHUNKITEMS, buffer, CHUNKSIZE) == 0);
+}
+
+
+static char *test_lru() {
+  blosc2_chunkcache_stats stats;
+
+  fill_schunk();
+  mu_assert("ERROR: stats of a missing cache",
+            blosc2_schunk_get_chunkcache_stats(schunk, &stats) < 0);
+
+  /* Room for 3 chunks */
+  blosc2_schunk_set_chunkcache(schunk, 3 * CHUNKSIZE + 100);
+  for (int n = 0; n < 3; n++) {
+    mu_assert("ERROR: chunk roundtrip not successful", check_chunk(n, dest));
+  }
+  for (int n = 0; n < 3; n++) {
+    mu_assert("ERROR: cached chunk roundtrip not successful",
+              check_chunk(n, dest));
+  }
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: bad number of misses", stats.misses == 3);
+  mu_assert("ERROR: bad number of hits", stats.hits == 3);
+  mu_assert("ERROR: bad number of cached chunks", stats.nchunks == 3);
+  mu_assert("ERROR: bad cached bytes", stats.nbytes == 3 * CHUNKSIZE);
+
+  /* Chunk 1 is the least recently used after touching 0 and 2 */
+  check_chunk(0, dest);
+  check_chunk(2, dest);
+  check_chunk(5, dest);
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: bad number of evictions", stats.evictions == 1);
+  check_chunk(0, dest);
+  check_chunk(2, dest);
+  check_chunk(1, dest);
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: the LRU chunk was not evicted",
+            (stats.hits == 7) && (stats.misses == 5));
+
+  /* Dropping the cache */
+  blosc2_schunk_set_chunkcache(schunk, 0);
+  mu_assert("ERROR: the cache is not dropped",
+            blosc2_schunk_get_chunkcache_stats(schunk, &stats) < 0);
+  mu_assert("ERROR: chunk roundtrip without cache not successful",
+            check_chunk(4, dest));
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static void* reader(void* arg) {
+  int32_t* buffer = malloc(CHUNKSIZE);
+  intptr_t failed = 0;
+
+  for (int i = 0; i < 200 && !failed; i++) {
+    failed = !check_chunk((int)(((intptr_t)arg + i) % 3), buffer);
+  }
+  free(buffer);
+  return (void*)failed;
+}
+
+
+static char *test_concurrent_readers() {
+  blosc2_chunkcache_stats stats;
+  pthread_t threads[NREADERS];
+  void* failed;
+
+  fill_schunk();
+  blosc2_schunk_set_chunkcache(schunk, (size_t)NCHUNKS * CHUNKSIZE);
+  for (int n = 0; n < 3; n++) {
+    check_chunk(n, dest);
+  }
+
+  /* The chunks are in the cache, so readers never decompress */
+  for (intptr_t t = 0; t < NREADERS; t++) {
+    pthread_create(&threads[t], NULL, reader, (void*)t);
+  }
+  for (int t = 0; t < NREADERS; t++) {
+    pthread_join(threads[t], &failed);
+    mu_assert("ERROR: concurrent reader failed", failed == NULL);
+  }
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: bad number of hits", stats.hits == NREADERS * 200);
+  mu_assert("ERROR: bad number of misses", stats.misses == 3);
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+/* Readers that start with an empty cache decompress concurrently */
+static char *test_concurrent_misses() {
+  blosc2_chunkcache_stats stats;
+  pthread_t threads[NREADERS];
+  void* failed;
+
+  fill_schunk();
+  blosc2_schunk_set_chunkcache(schunk, (size_t)NCHUNKS * CHUNKSIZE);
+  for (intptr_t t = 0; t < NREADERS; t++) {
+    pthread_create(&threads[t], NULL, reader, (void*)t);
+  }
+  for (int t = 0; t < NREADERS; t++) {
+    pthread_join(threads[t], &failed);
+    mu_assert("ERROR: concurrent reader failed", failed == NULL);
+  }
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: bad number of lookups",
+            stats.hits + stats.misses == NREADERS * 200);
+  mu_assert("ERROR: chunks are not cached", stats.misses < NREADERS * 200);
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_lru);
+  mu_run_test(test_concurrent_readers);
+  mu_run_test(test_concurrent_misses);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, (size_t)NCHUNKS * CHUNKSIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
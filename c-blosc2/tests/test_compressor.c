@@ -33,6 +33,7 @@ static char *test_compressor() {
 
   /* Activate the BLOSC_COMPRESSOR variable */
   setenv("BLOSC_COMPRESSOR", "lz4", 0);
+  blosc_reload_env();
 
   /* Get a compressed buffer */
   cbytes = blosc_compress(clevel, doshuffle, typesize, size, src,
@@ -45,6 +46,7 @@ static char *test_compressor() {
 
   /* Reset envvar */
   unsetenv("BLOSC_COMPRESSOR");
+  blosc_reload_env();
   return 0;
 }
 
@@ -55,6 +57,7 @@ static char *test_compress_decompress() {
 
   /* Activate the BLOSC_COMPRESSOR variable */
   setenv("BLOSC_COMPRESSOR", "lz4", 0);
+  blosc_reload_env();
 
   compressor = blosc_get_compressor();
   mu_assert("ERROR: get_compressor incorrect",
@@ -79,6 +82,7 @@ static char *test_compress_decompress() {
 
   /* Reset envvar */
   unsetenv("BLOSC_COMPRESSOR");
+  blosc_reload_env();
   return 0;
 }
 
@@ -94,12 +98,14 @@ static char *test_clevel() {
 
   /* Activate the BLOSC_CLEVEL variable */
   setenv("BLOSC_CLEVEL", "9", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_CLEVEL does not work correctly", cbytes2 < cbytes);
 
   /* Reset envvar */
   unsetenv("BLOSC_CLEVEL");
+  blosc_reload_env();
   return 0;
 }
 
@@ -114,6 +120,7 @@ static char *test_noshuffle() {
 
   /* Activate the BLOSC_SHUFFLE variable */
   setenv("BLOSC_SHUFFLE", "NOSHUFFLE", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_SHUFFLE=NOSHUFFLE does not work correctly",
@@ -121,6 +128,7 @@ static char *test_noshuffle() {
 
   /* Reset env var */
   unsetenv("BLOSC_SHUFFLE");
+  blosc_reload_env();
   return 0;
 }
 
@@ -136,6 +144,7 @@ static char *test_shuffle() {
 
   /* Activate the BLOSC_SHUFFLE variable */
   setenv("BLOSC_SHUFFLE", "SHUFFLE", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_SHUFFLE=SHUFFLE does not work correctly",
@@ -143,6 +152,7 @@ static char *test_shuffle() {
 
   /* Reset env var */
   unsetenv("BLOSC_SHUFFLE");
+  blosc_reload_env();
   return 0;
 }
 
@@ -158,6 +168,7 @@ static char *test_bitshuffle() {
 
   /* Activate the BLOSC_BITSHUFFLE variable */
   setenv("BLOSC_SHUFFLE", "BITSHUFFLE", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_SHUFFLE=BITSHUFFLE does not work correctly",
@@ -165,6 +176,7 @@ static char *test_bitshuffle() {
 
   /* Reset env var */
   unsetenv("BLOSC_SHUFFLE");
+  blosc_reload_env();
   return 0;
 }
 
@@ -182,6 +194,7 @@ static char *test_delta() {
 
   /* Activate the BLOSC_DELTA variable */
   setenv("BLOSC_DELTA", "1", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_DELTA=1 does not work correctly",
@@ -189,6 +202,7 @@ static char *test_delta() {
 
   /* Reset env var */
   unsetenv("BLOSC_DELTA");
+  blosc_reload_env();
   return 0;
 }
 
@@ -204,12 +218,43 @@ static char *test_typesize() {
 
   /* Activate the BLOSC_TYPESIZE variable */
   setenv("BLOSC_TYPESIZE", "9", 0);
+  blosc_reload_env();
   cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
                            dest, size + 16);
   mu_assert("ERROR: BLOSC_TYPESIZE does not work correctly", cbytes2 > cbytes);
 
   /* Reset envvar */
   unsetenv("BLOSC_TYPESIZE");
+  blosc_reload_env();
+  return 0;
+}
+
+
+/* Check that env vars are only read again in blosc_reload_env() */
+static char *test_reload_env() {
+  int cbytes2;
+
+  /* Get a compressed buffer */
+  cbytes = blosc_compress(clevel, doshuffle, typesize, size, src,
+                          dest, size + 16);
+  mu_assert("ERROR: cbytes is not correct", cbytes < size);
+
+  /* The snapshot of the env vars does not see the change yet */
+  setenv("BLOSC_CLEVEL", "0", 0);
+  cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
+                           dest, size + 16);
+  mu_assert("ERROR: BLOSC_CLEVEL is seen before blosc_reload_env()",
+            cbytes2 == cbytes);
+
+  blosc_reload_env();
+  cbytes2 = blosc_compress(clevel, doshuffle, typesize, size, src,
+                           dest, size + 16);
+  mu_assert("ERROR: BLOSC_CLEVEL is not seen after blosc_reload_env()",
+            cbytes2 == size + 16);
+
+  /* Reset env var */
+  unsetenv("BLOSC_CLEVEL");
+  blosc_reload_env();
   return 0;
 }
 
@@ -223,6 +268,7 @@ static char *all_tests() {
   mu_run_test(test_bitshuffle);
   mu_run_test(test_delta);
   mu_run_test(test_typesize);
+  mu_run_test(test_reload_env);
 
   return 0;
 }
@@ -0,0 +1,190 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for compressing streams of data.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKSIZE (100 * 1000)
+#define NBYTES (CHUNKSIZE * 5 / 2)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+uint8_t *data, *data_out;
+int nthreads;
+/* What the emit functions have got */
+int nemitted;
+size_t nout;
+
+
+static blosc2_cparams stream_cparams(void) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+
+  cparams.typesize = 4;
+  cparams.blocksize = 16 * 1024;
+  cparams.nthreads = (uint32_t)nthreads;
+  return cparams;
+}
+
+
+/* Write `nbytes` of data in pieces of odd sizes */
+static int write_pieces(blosc2_cstream* stream, size_t nbytes) {
+  size_t offset = 0;
+  size_t n;
+
+  for (int i = 0; offset < nbytes; i++) {
+    n = (size_t)((i * 7919) % 5003 + 1);
+    n = (n < nbytes - offset) ? n : nbytes - offset;
+    if (blosc2_cstream_write(stream, data + offset, n) < 0) {
+      return -1;
+    }
+    offset += n;
+  }
+  return 0;
+}
+
+
+static int decompress_emitted(const void* chunk, int32_t cbytes,
+                              void* user_data) {
+  int nbytes = blosc_decompress(chunk, data_out + nout, NBYTES - nout);
+
+  if ((nbytes <= 0) || (cbytes != *(int32_t*)((uint8_t*)chunk + 12))) {
+    return -1;
+  }
+  nemitted++;
+  nout += (size_t)nbytes;
+  return 0;
+}
+
+
+static int fail_emitted(const void* chunk, int32_t cbytes, void* user_data) {
+  nemitted++;
+  return (nemitted > 1) ? -1 : 0;
+}
+
+
+static int pass_prefilter(blosc2_prefilter_params* params) {
+  memcpy(params->out, params->in, (size_t)params->out_size);
+  return 0;
+}
+
+
+static char *test_emit() {
+  blosc2_cstream* stream;
+  size_t sizes[] = {NBYTES, 2 * CHUNKSIZE, 1};
+
+  for (int i = 0; i < 3; i++) {
+    nemitted = 0;
+    nout = 0;
+    stream = blosc2_cstream_new(stream_cparams(), CHUNKSIZE,
+                                decompress_emitted, NULL);
+    mu_assert("ERROR: stream not created", stream != NULL);
+    mu_assert("ERROR: stream write failed",
+              write_pieces(stream, sizes[i]) == 0);
+    mu_assert("ERROR: stream flush failed", blosc2_cstream_flush(stream) == 0);
+    mu_assert("ERROR: write after flush is accepted",
+              blosc2_cstream_write(stream, data, 1) < 0);
+    blosc2_cstream_free(stream);
+    mu_assert("ERROR: bad number of chunks",
+              nemitted == (int)((sizes[i] + CHUNKSIZE - 1) / CHUNKSIZE));
+    mu_assert("ERROR: bad stream contents",
+              (nout == sizes[i]) && (memcmp(data, data_out, nout) == 0));
+  }
+  return 0;
+}
+
+
+static char *test_schunk() {
+  blosc2_cparams cparams = stream_cparams();
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk = blosc2_new_schunk(cparams, dparams);
+  blosc2_cstream* stream;
+
+  cparams.schunk = schunk;
+  stream = blosc2_cstream_new(cparams, CHUNKSIZE, NULL, NULL);
+  mu_assert("ERROR: stream write failed", write_pieces(stream, NBYTES) == 0);
+  blosc2_cstream_free(stream);
+  mu_assert("ERROR: bad number of chunks", schunk->nchunks == 3);
+  mu_assert("ERROR: bad super-chunk size", schunk->nbytes == NBYTES);
+  mu_assert("ERROR: bad super-chunk contents",
+            (blosc2_schunk_get_slice(schunk, 0, NBYTES / 4, data_out) ==
+             NBYTES) && (memcmp(data, data_out, NBYTES) == 0));
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_cparams cparams;
+  blosc2_cstream* stream;
+
+  mu_assert("ERROR: stream without destination is accepted",
+            blosc2_cstream_new(stream_cparams(), CHUNKSIZE, NULL, NULL) ==
+            NULL);
+  mu_assert("ERROR: stream without chunksize is accepted",
+            blosc2_cstream_new(stream_cparams(), 0, fail_emitted, NULL) ==
+            NULL);
+  cparams = stream_cparams();
+  cparams.prefilter = pass_prefilter;
+  mu_assert("ERROR: stream with a prefilter is accepted",
+            blosc2_cstream_new(cparams, CHUNKSIZE, fail_emitted, NULL) ==
+            NULL);
+
+  nemitted = 0;
+  stream = blosc2_cstream_new(stream_cparams(), CHUNKSIZE, fail_emitted,
+                              NULL);
+  /* Writes stop some time after the failure */
+  write_pieces(stream, NBYTES);
+  mu_assert("ERROR: emit failure is not reported",
+            blosc2_cstream_flush(stream) < 0);
+  mu_assert("ERROR: chunks emitted after the failure", nemitted == 2);
+  blosc2_cstream_free(stream);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    mu_run_test(test_emit);
+    mu_run_test(test_schunk);
+    mu_run_test(test_errors);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  for (int i = 0; i < NBYTES; i++) {
+    data[i] = (uint8_t)((i / 64) ^ (i % 7));
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -125,6 +125,14 @@ static char *test_delta() {
   }
   mu_assert("ERROR: roundtrip not successful", buf_equal == 0);
 
+  /* Items of blocks other than the first one are decoded with it */
+  nbytes = blosc_getitem(dest, (int)(size / typesize / 3),
+                         (int)(size / typesize / 2), src);
+  mu_assert("ERROR: getitem nbytes incorrect",
+            nbytes == (int)(size / typesize / 2 * typesize));
+  buf_equal = memcmp(src, srccpy + size / typesize / 3 * typesize, nbytes);
+  mu_assert("ERROR: getitem with DELTA not successful", buf_equal == 0);
+
   return 0;
 }
 
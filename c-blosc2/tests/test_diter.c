@@ -0,0 +1,153 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for reading decompressed buffers with iterators.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (300 * 1000 + 17)
+#define NBYTES (NITEMS * 4)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *data_out;
+uint8_t *dest;
+
+
+static int compress(int clevel, int delta, int chainlen) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int csize;
+
+  cparams.typesize = 4;
+  cparams.clevel = clevel;
+  cparams.blocksize = 32 * 1024;
+  cparams.chainlen = chainlen;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, NBYTES, data, dest,
+                              NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  return csize;
+}
+
+
+/* Read the whole buffer in pieces of `piece` bytes */
+static int read_all(int nthreads, int32_t piece) {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_diter* iter;
+  int32_t nread = 0;
+  int rc;
+
+  dparams.nthreads = nthreads;
+  iter = blosc2_diter_new(dparams, dest);
+  if (iter == NULL) {
+    return 0;
+  }
+  memset(data_out, 0, NBYTES);
+  while ((rc = blosc2_diter_next(iter, (uint8_t*)data_out + nread,
+                                 piece)) > 0) {
+    nread += rc;
+  }
+  blosc2_diter_free(iter);
+  return (rc == 0) && (nread == NBYTES) &&
+         (memcmp(data, data_out, NBYTES) == 0);
+}
+
+
+static char *test_read() {
+  int32_t pieces[] = {1000, 32 * 1024, NBYTES};
+
+  for (int nthreads = 1; nthreads <= 4; nthreads += 3) {
+    for (int p = 0; p < 3; p++) {
+      mu_assert("ERROR: compression failed", compress(5, 0, 0) > 0);
+      mu_assert("ERROR: bad buffer read", read_all(nthreads, pieces[p]));
+    }
+    mu_assert("ERROR: compression failed", compress(5, 1, 0) > 0);
+    mu_assert("ERROR: bad delta buffer read", read_all(nthreads, 777));
+    mu_assert("ERROR: compression failed", compress(5, 0, 4) > 0);
+    mu_assert("ERROR: bad chained buffer read", read_all(nthreads, 5000));
+    mu_assert("ERROR: compression failed", compress(0, 0, 0) > 0);
+    mu_assert("ERROR: bad memcpy'ed buffer read", read_all(nthreads, 5000));
+  }
+  return 0;
+}
+
+
+static char *test_stop() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_diter* iter;
+
+  /* Iterators can be dropped before the end */
+  mu_assert("ERROR: compression failed", compress(5, 0, 0) > 0);
+  dparams.nthreads = 4;
+  iter = blosc2_diter_new(dparams, dest);
+  mu_assert("ERROR: iterator not created", iter != NULL);
+  mu_assert("ERROR: bad first read",
+            (blosc2_diter_next(iter, data_out, 100) == 100) &&
+            (memcmp(data, data_out, 100) == 0));
+  blosc2_diter_free(iter);
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+
+  /* NBYTES is not a multiple of 3 */
+  mu_assert("ERROR: compression failed",
+            blosc_compress(5, 1, 3, NBYTES, data, dest,
+                           NBYTES + BLOSC_MAX_OVERHEAD) > 0);
+  mu_assert("ERROR: partial items are accepted",
+            blosc2_diter_new(dparams, dest) == NULL);
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_read);
+  mu_run_test(test_stop);
+  mu_run_test(test_errors);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES + BLOSC_MAX_OVERHEAD);
+  for (int i = 0; i < NITEMS; i++) {
+    data[i] = i / 3 + i % 11;
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,206 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for expressions over super-chunks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (30 * 1000)
+#define CHUNKSIZE (CHUNKITEMS * 8)
+#define NCHUNKS 4
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+double *data, *data_out;
+blosc2_schunk *a, *b, *c;
+int nthreads;
+
+
+static double item(int operand, int64_t i) {
+  return (double)((i * (operand + 3)) % 1001) / (operand + 1) + 1.;
+}
+
+
+static blosc2_schunk* new_schunk(int operand, int nchunks) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+
+  cparams.typesize = 8;
+  cparams.nthreads = (uint32_t)nthreads;
+  /* Blocks do not match the ones of the other operands */
+  cparams.blocksize = (operand == 1) ? 24 * 1024 : 0;
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  for (int n = 0; n < nchunks; n++) {
+    for (int i = 0; i < CHUNKITEMS; i++) {
+      data[i] = item(operand, (int64_t)n * CHUNKITEMS + i);
+    }
+    if (operand < 0) {
+      /* An empty result */
+      break;
+    }
+    blosc2_append_buffer(schunk, CHUNKSIZE, data);
+  }
+  return schunk;
+}
+
+
+/* Evaluate `expression` and check the result against `expected` */
+static int check_expr(const char* expression,
+                      double (*expected)(double, double, double)) {
+  blosc2_schunk* operands[3] = {a, b, c};
+  blosc2_schunk* out = new_schunk(-1, 0);
+  blosc2_expr* expr = blosc2_expr_new(expression, operands, 3);
+  int ok = 1;
+
+  if (expr == NULL) {
+    return 0;
+  }
+  if (blosc2_expr_eval(expr, out) != (int64_t)NCHUNKS * CHUNKSIZE) {
+    ok = 0;
+  }
+  for (int n = 0; ok && (n < NCHUNKS); n++) {
+    if (blosc2_decompress_chunk(out, (size_t)n, data_out, CHUNKSIZE) !=
+        CHUNKSIZE) {
+      ok = 0;
+      break;
+    }
+    for (int i = 0; i < CHUNKITEMS; i++) {
+      int64_t j = (int64_t)n * CHUNKITEMS + i;
+      double value = expected(item(0, j), item(1, j), item(2, j));
+      /* The compiler may fuse the operations of `expected` */
+      if (fabs(data_out[i] - value) > 1e-12 * fabs(value)) {
+        ok = 0;
+        break;
+      }
+    }
+  }
+  blosc2_expr_free(expr);
+  blosc2_destroy_schunk(out);
+  return ok;
+}
+
+
+static double linear(double x, double y, double z) {
+  return x * 2 + y;
+}
+
+static double nested(double x, double y, double z) {
+  return -(x - y) / (z * .5) + 3 * -x;
+}
+
+static double constant(double x, double y, double z) {
+  return 1.5e1;
+}
+
+
+static char *test_eval() {
+  mu_assert("ERROR: 'a * 2 + b' is wrong", check_expr("a * 2 + b", linear));
+  mu_assert("ERROR: nested expression is wrong",
+            check_expr(" -(a-b) / (c * .5) + 3 * -a", nested));
+  mu_assert("ERROR: constant expression is wrong",
+            check_expr("1.5e1", constant));
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_schunk* operands[3] = {a, b, c};
+  const char* wrong[] = {"", "a +", "(a + b", "a b", "d + a", "ab", "a $ b"};
+  char deep[128] = "";
+  char nested[2002];
+  blosc2_schunk* out;
+  blosc2_schunk* shorter;
+  blosc2_expr* expr;
+
+  for (size_t i = 0; i < sizeof(wrong) / sizeof(wrong[0]); i++) {
+    mu_assert("ERROR: wrong expression is accepted",
+              blosc2_expr_new(wrong[i], operands, 3) == NULL);
+  }
+  /* Too many pending results for the stack */
+  for (int i = 0; i < 20; i++) {
+    strcat(deep, "a+(");
+  }
+  strcat(deep, "a))))))))))))))))))))");
+  mu_assert("ERROR: too deep expression is accepted",
+            blosc2_expr_new(deep, operands, 3) == NULL);
+  /* Nesting that could exhaust the stack of the parser */
+  memset(nested, '(', 1000);
+  nested[1000] = 'a';
+  memset(nested + 1001, ')', 1000);
+  nested[2001] = '\0';
+  mu_assert("ERROR: too nested parentheses are accepted",
+            blosc2_expr_new(nested, operands, 3) == NULL);
+  memset(nested, '-', 1000);
+  nested[1001] = '\0';
+  mu_assert("ERROR: too many minus signs are accepted",
+            blosc2_expr_new(nested, operands, 3) == NULL);
+  mu_assert("ERROR: nested parentheses are not accepted",
+            (expr = blosc2_expr_new("((((-(-a))))) * --b", operands, 3)) !=
+            NULL);
+  blosc2_expr_free(expr);
+
+  /* Operands must be alike */
+  shorter = new_schunk(2, NCHUNKS - 1);
+  operands[2] = shorter;
+  expr = blosc2_expr_new("a + c", operands, 3);
+  out = new_schunk(-1, 0);
+  mu_assert("ERROR: operands of different lengths are accepted",
+            (expr != NULL) && (blosc2_expr_eval(expr, out) < 0));
+  mu_assert("ERROR: chunks appended after an error", out->nchunks == 0);
+  blosc2_expr_free(expr);
+  blosc2_destroy_schunk(out);
+  blosc2_destroy_schunk(shorter);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    a = new_schunk(0, NCHUNKS);
+    b = new_schunk(1, NCHUNKS);
+    c = new_schunk(2, NCHUNKS);
+    mu_run_test(test_eval);
+    mu_run_test(test_errors);
+    blosc2_destroy_schunk(a);
+    blosc2_destroy_schunk(b);
+    blosc2_destroy_schunk(c);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,121 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for blosc2_getitem_ctx() on ranges spanning many blocks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (500 * 1000 + 7)
+#define SIZE (NITEMS * 4)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *src, *dest, *dest2;
+int nthreads;
+int use_delta;
+int chainlen;
+
+
+static char *test_ranges() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context *cctx, *dctx;
+  int csize, nbytes;
+  /* Items per block are 4096, so some ranges start or end at blocks */
+  int ranges[][2] = {{0, NITEMS}, {0, 4096 * 5}, {4096 * 3, 4096 * 7},
+                     {1, NITEMS - 1}, {5000, 100000}, {4095, 4097 * 6},
+                     {NITEMS - 30000, 30000}, {70000, 10}, {4096, 4096 * 4}};
+
+  for (int i = 0; i < NITEMS; i++) {
+    src[i] = i * 3 + (i % 13);
+  }
+  cparams.typesize = 4;
+  cparams.compcode = BLOSC_LZ4;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.chainlen = chainlen;
+  cparams.blocksize = 16 * 1024;
+  if (use_delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, SIZE, src, dest, SIZE + BLOSC_MAX_OVERHEAD);
+  mu_assert("ERROR: compression failed", csize > 0);
+  blosc2_free_ctx(cctx);
+
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+  for (int r = 0; r < (int)(sizeof(ranges) / sizeof(ranges[0])); r++) {
+    int start = ranges[r][0];
+    int nitems = ranges[r][1];
+    memset(dest2, 0, SIZE);
+    nbytes = blosc2_getitem_ctx(dctx, dest, start, nitems, dest2);
+    mu_assert("ERROR: getitem failed", nbytes == nitems * 4);
+    mu_assert("ERROR: getitem roundtrip not successful",
+              memcmp(src + start, dest2, (size_t)nbytes) == 0);
+    /* Nothing is written past the range */
+    mu_assert("ERROR: getitem wrote past the range",
+              (nitems == NITEMS) || (dest2[nitems] == 0));
+  }
+
+  /* Out of bounds ranges are still reported */
+  mu_assert("ERROR: range out of bounds not detected",
+            blosc2_getitem_ctx(dctx, dest, NITEMS - 10, 100000, dest2) < 0);
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  int nthreads_values[] = {1, 4};
+
+  for (int t = 0; t < 2; t++) {
+    nthreads = nthreads_values[t];
+    use_delta = 0;
+    chainlen = 1;
+    mu_run_test(test_ranges);
+    use_delta = 1;
+    mu_run_test(test_ranges);
+    chainlen = 4;
+    mu_run_test(test_ranges);
+    use_delta = 0;
+    mu_run_test(test_ranges);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  src = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BLOSC_MAX_OVERHEAD);
+  dest2 = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(src);
+  blosc_test_free(dest);
+  blosc_test_free(dest2);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,224 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the postfilters of decompression contexts.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (200 * 1000)
+#define NBYTES (NITEMS * 4)
+#define NCHUNKS 5
+#define MAX_THREADS 4
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *data_out;
+uint8_t *dest;
+/* The partial sums of every thread */
+int64_t sums[MAX_THREADS];
+
+
+/* Scales the items of the decompressed blocks */
+static int scale(blosc2_postfilter_params* params) {
+  const int32_t* in = (const int32_t*)params->in;
+  int32_t* out = (int32_t*)params->out;
+  int32_t factor = *(int32_t*)params->user_data;
+
+  for (int32_t i = 0; i < params->size / 4; i++) {
+    out[i] = in[i] * factor;
+  }
+  return 0;
+}
+
+
+/* Adds up the items of the decompressed blocks */
+static int sum(blosc2_postfilter_params* params) {
+  const int32_t* in = (const int32_t*)params->in;
+
+  if (params->out != NULL) {
+    return -1;
+  }
+  for (int32_t i = 0; i < params->size / 4; i++) {
+    sums[params->tid] += in[i];
+  }
+  return 0;
+}
+
+
+static int fail(blosc2_postfilter_params* params) {
+  return (params->offset > 0) ? -1 : 0;
+}
+
+
+static int compress(int clevel, int delta) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int csize;
+
+  cparams.typesize = 4;
+  cparams.clevel = clevel;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, NBYTES, data, dest,
+                              NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  return csize;
+}
+
+
+static int64_t total(void) {
+  int64_t result = 0;
+
+  for (int i = 0; i < MAX_THREADS; i++) {
+    result += sums[i];
+    sums[i] = 0;
+  }
+  return result;
+}
+
+
+static char *test_scale() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  int32_t factor = 3;
+  int clevels[] = {0, 5};
+
+  dparams.postfilter = scale;
+  dparams.postfilter_data = &factor;
+  for (int c = 0; c < 2; c++) {
+    for (int delta = 0; delta <= 1; delta++) {
+      mu_assert("ERROR: compression failed", compress(clevels[c], delta) > 0);
+      for (int nthreads = 1; nthreads <= MAX_THREADS; nthreads += 3) {
+        dparams.nthreads = nthreads;
+        dctx = blosc2_create_dctx(dparams);
+        memset(data_out, 0, NBYTES);
+        mu_assert("ERROR: decompression with a postfilter failed",
+                  blosc2_decompress_ctx(dctx, dest, data_out, NBYTES) ==
+                  NBYTES);
+        blosc2_free_ctx(dctx);
+        for (int i = 0; i < NITEMS; i++) {
+          mu_assert("ERROR: postfilter output is wrong",
+                    data_out[i] == data[i] * factor);
+        }
+      }
+    }
+  }
+  return 0;
+}
+
+
+static char *test_reduce() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  blosc2_schunk* schunk;
+  int64_t expected = 0;
+
+  for (int i = 0; i < NITEMS; i++) {
+    expected += data[i];
+  }
+  dparams.postfilter = sum;
+  for (int delta = 0; delta <= 1; delta++) {
+    mu_assert("ERROR: compression failed", compress(5, delta) > 0);
+    for (int nthreads = 1; nthreads <= MAX_THREADS; nthreads += 3) {
+      dparams.nthreads = nthreads;
+      dctx = blosc2_create_dctx(dparams);
+      mu_assert("ERROR: reduction without destination failed",
+                blosc2_decompress_ctx(dctx, dest, NULL, NBYTES) == NBYTES);
+      blosc2_free_ctx(dctx);
+      mu_assert("ERROR: reduction result is wrong", total() == expected);
+    }
+  }
+
+  /* The cache of a super-chunk does not hide chunks from the postfilter */
+  cparams.typesize = 4;
+  cparams.nthreads = MAX_THREADS;
+  dparams.nthreads = MAX_THREADS;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  blosc2_schunk_set_chunkcache(schunk, (size_t)NCHUNKS * NBYTES);
+  for (int n = 0; n < NCHUNKS; n++) {
+    blosc2_append_buffer(schunk, NBYTES, data);
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    for (int n = 0; n < NCHUNKS; n++) {
+      mu_assert("ERROR: chunk reduction failed",
+                blosc2_decompress_chunk(schunk, (size_t)n, NULL, NBYTES) ==
+                NBYTES);
+    }
+    mu_assert("ERROR: super-chunk reduction result is wrong",
+              total() == NCHUNKS * expected);
+  }
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+
+  mu_assert("ERROR: compression failed", compress(5, 0) > 0);
+  dctx = blosc2_create_dctx(dparams);
+  mu_assert("ERROR: no destination buffer nor postfilter is accepted",
+            blosc2_decompress_ctx(dctx, dest, NULL, NBYTES) < 0);
+  blosc2_free_ctx(dctx);
+
+  dparams.postfilter = fail;
+  for (int nthreads = 1; nthreads <= MAX_THREADS; nthreads += 3) {
+    dparams.nthreads = nthreads;
+    dctx = blosc2_create_dctx(dparams);
+    mu_assert("ERROR: postfilter failure is not reported",
+              blosc2_decompress_ctx(dctx, dest, data_out, NBYTES) < 0);
+    blosc2_free_ctx(dctx);
+  }
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_scale);
+  mu_run_test(test_reduce);
+  mu_run_test(test_errors);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES + BLOSC_MAX_OVERHEAD);
+  for (int i = 0; i < NITEMS; i++) {
+    data[i] = i % 1000 - 500 + i / 1000;
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,190 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the prefilters of compression contexts.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (200 * 1000)
+#define NBYTES (NITEMS * 4)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *data_out, *expected;
+uint8_t *dest, *dest2;
+
+
+/* Makes the items from their position */
+static int generate(blosc2_prefilter_params* params) {
+  int32_t* out = (int32_t*)params->out;
+  int32_t first = params->out_offset / 4;
+
+  if (params->in != NULL) {
+    return -1;
+  }
+  for (int32_t i = 0; i < params->out_size / 4; i++) {
+    out[i] = (first + i) * 3 + (first + i) % 7;
+  }
+  return 0;
+}
+
+
+/* Scales the items in the source buffer */
+static int scale(blosc2_prefilter_params* params) {
+  const int32_t* in = (const int32_t*)params->in;
+  int32_t* out = (int32_t*)params->out;
+  int32_t factor = *(int32_t*)params->user_data;
+
+  for (int32_t i = 0; i < params->out_size / 4; i++) {
+    out[i] = in[i] * factor;
+  }
+  return 0;
+}
+
+
+static int fail(blosc2_prefilter_params* params) {
+  return (params->out_offset > 0) ? -1 : generate(params);
+}
+
+
+/* Compress `src` (or nothing) with a prefilter and check that the result
+   is like compressing `expected` without it */
+static int check_prefilter(blosc2_prefilter_fn prefilter, void* user_data,
+                           const void* src, int clevel, int nthreads,
+                           int delta) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int csize, csize2;
+
+  cparams.typesize = 4;
+  cparams.clevel = clevel;
+  cparams.nthreads = (uint32_t)nthreads;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize2 = blosc2_compress_ctx(cctx, NBYTES, expected, dest2,
+                               NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+
+  cparams.prefilter = prefilter;
+  cparams.prefilter_data = user_data;
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, NBYTES, src, dest,
+                              NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  if ((csize <= 0) || (csize != csize2)) {
+    return 0;
+  }
+  /* Threads put the blocks in the order they finish them */
+  if ((nthreads == 1) && (memcmp(dest, dest2, (size_t)csize) != 0)) {
+    return 0;
+  }
+  return (blosc_decompress(dest, data_out, NBYTES) == NBYTES) &&
+         (memcmp(data_out, expected, NBYTES) == 0);
+}
+
+
+static char *test_generate() {
+  for (int i = 0; i < NITEMS; i++) {
+    expected[i] = i * 3 + i % 7;
+  }
+  mu_assert("ERROR: generated buffer not compressed right",
+            check_prefilter(generate, NULL, NULL, 5, 1, 0));
+  mu_assert("ERROR: generated buffer not compressed right with threads",
+            check_prefilter(generate, NULL, NULL, 5, 4, 0));
+  mu_assert("ERROR: generated buffer not compressed right with delta",
+            check_prefilter(generate, NULL, NULL, 5, 4, 1));
+  mu_assert("ERROR: generated buffer not memcpy'ed right",
+            check_prefilter(generate, NULL, NULL, 0, 1, 0));
+  mu_assert("ERROR: generated buffer not memcpy'ed right with threads",
+            check_prefilter(generate, NULL, NULL, 0, 4, 0));
+  return 0;
+}
+
+
+static char *test_scale() {
+  int32_t factor = 5;
+
+  for (int i = 0; i < NITEMS; i++) {
+    data[i] = i % 1000 - 500;
+    expected[i] = data[i] * factor;
+  }
+  mu_assert("ERROR: scaled buffer not compressed right",
+            check_prefilter(scale, &factor, data, 5, 1, 0));
+  mu_assert("ERROR: scaled buffer not compressed right with threads",
+            check_prefilter(scale, &factor, data, 9, 4, 1));
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+
+  cparams.typesize = 4;
+  cctx = blosc2_create_cctx(cparams);
+  mu_assert("ERROR: no source buffer nor prefilter is accepted",
+            blosc2_compress_ctx(cctx, NBYTES, NULL, dest,
+                                NBYTES + BLOSC_MAX_OVERHEAD) < 0);
+  blosc2_free_ctx(cctx);
+
+  cparams.prefilter = fail;
+  for (int nthreads = 1; nthreads <= 4; nthreads += 3) {
+    cparams.nthreads = (uint32_t)nthreads;
+    cctx = blosc2_create_cctx(cparams);
+    mu_assert("ERROR: prefilter failure is not reported",
+              blosc2_compress_ctx(cctx, NBYTES, NULL, dest,
+                                  NBYTES + BLOSC_MAX_OVERHEAD) < 0);
+    blosc2_free_ctx(cctx);
+  }
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_generate);
+  mu_run_test(test_scale);
+  mu_run_test(test_errors);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  expected = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES + BLOSC_MAX_OVERHEAD);
+  dest2 = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES + BLOSC_MAX_OVERHEAD);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+  blosc_test_free(expected);
+  blosc_test_free(dest);
+  blosc_test_free(dest2);
+
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,221 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for decompressing into strided and scattered destinations,
+  and for compressing gathered sources.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (100 * 1000 + 3)
+#define NBYTES (NITEMS * 8)
+#define NCOLS 3
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int64_t *data, *data_out;
+uint8_t *dest;
+int nthreads;
+
+
+static int compress(int clevel, int typesize, int delta) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  int csize;
+
+  cparams.typesize = typesize;
+  cparams.clevel = clevel;
+  cparams.blocksize = 24 * 1024;
+  cparams.nthreads = (uint32_t)nthreads;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, NBYTES, data, dest,
+                              NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  return csize;
+}
+
+
+/* Decompress into a column of a row-major NITEMS x NCOLS array */
+static int check_strided(int column, int reversed) {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  int64_t stride = reversed ? -NCOLS * 8 : NCOLS * 8;
+  int64_t first = reversed ? (int64_t)(NITEMS - 1) * NCOLS + column : column;
+  int64_t j;
+  int rc;
+  int ok = 1;
+
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+  memset(data_out, 0, (size_t)NBYTES * NCOLS);
+  rc = blosc2_decompress_strided_ctx(dctx, dest, data_out + first, stride);
+  blosc2_free_ctx(dctx);
+  if (rc != NBYTES) {
+    return 0;
+  }
+  for (int64_t i = 0; ok && (i < NITEMS); i++) {
+    j = reversed ? (NITEMS - 1 - i) * NCOLS : i * NCOLS;
+    ok = (data_out[j + column] == data[i]);
+    /* The other columns are left alone */
+    ok = ok && (data_out[j + (column + 1) % NCOLS] == 0);
+  }
+  return ok;
+}
+
+
+static char *test_strided() {
+  mu_assert("ERROR: compression failed", compress(5, 8, 0) > 0);
+  mu_assert("ERROR: bad strided buffer", check_strided(1, 0));
+  mu_assert("ERROR: bad reversed buffer", check_strided(2, 1));
+  mu_assert("ERROR: compression failed", compress(5, 8, 1) > 0);
+  mu_assert("ERROR: bad delta strided buffer", check_strided(0, 0));
+  mu_assert("ERROR: compression failed", compress(0, 8, 0) > 0);
+  mu_assert("ERROR: bad memcpy'ed strided buffer", check_strided(1, 0));
+  return 0;
+}
+
+
+static char *test_iov() {
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context* dctx;
+  blosc2_iovec iov[5];
+  uint8_t* out = (uint8_t*)data_out;
+  size_t lens[5] = {1000, 0, 77777, NBYTES - 78777, 100};
+  size_t offset = 0;
+
+  mu_assert("ERROR: compression failed", compress(5, 8, 0) > 0);
+  /* Pieces in the reverse order of memory, with gaps between them */
+  for (int i = 4; i >= 0; i--) {
+    iov[i].base = out + offset;
+    iov[i].len = lens[i];
+    offset += lens[i] + 16;
+  }
+  dparams.nthreads = nthreads;
+  dctx = blosc2_create_dctx(dparams);
+  mu_assert("ERROR: bad iov decompression",
+            blosc2_decompress_iov_ctx(dctx, dest, iov, 5) == NBYTES);
+  offset = 0;
+  for (int i = 0; i < 4; i++) {
+    mu_assert("ERROR: bad iov contents",
+              memcmp(iov[i].base, (uint8_t*)data + offset, lens[i]) == 0);
+    offset += lens[i];
+  }
+
+  mu_assert("ERROR: short iovs are accepted",
+            blosc2_decompress_iov_ctx(dctx, dest, iov, 3) < 0);
+  blosc2_free_ctx(dctx);
+  return 0;
+}
+
+
+/* Compress the data from pieces and check it back */
+static int check_gather(int clevel, int delta) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  blosc2_iovec iov[4];
+  size_t lens[4] = {333, 0, 100000, NBYTES - 100333};
+  size_t offset = 0;
+  int csize;
+
+  for (int i = 0; i < 4; i++) {
+    iov[i].base = (uint8_t*)data + offset;
+    iov[i].len = lens[i];
+    offset += lens[i];
+  }
+  cparams.typesize = 8;
+  cparams.clevel = clevel;
+  cparams.blocksize = 24 * 1024;
+  cparams.nthreads = (uint32_t)nthreads;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_iov_ctx(cctx, iov, 4, dest,
+                                  NBYTES + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  return (csize > 0) &&
+         (blosc_decompress(dest, data_out, NBYTES) == NBYTES) &&
+         (memcmp(data, data_out, NBYTES) == 0);
+}
+
+
+static char *test_gather() {
+  mu_assert("ERROR: bad gathered buffer", check_gather(5, 0));
+  mu_assert("ERROR: bad delta gathered buffer", check_gather(5, 1));
+  mu_assert("ERROR: bad memcpy'ed gathered buffer", check_gather(0, 0));
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_context *cctx, *dctx;
+
+  mu_assert("ERROR: compression failed", compress(5, 8, 0) > 0);
+  dctx = blosc2_create_dctx(dparams);
+  mu_assert("ERROR: overlapping items are accepted",
+            blosc2_decompress_strided_ctx(dctx, dest, data_out, 4) < 0);
+  /* NBYTES is not a multiple of 3 */
+  mu_assert("ERROR: compression failed", compress(5, 3, 0) > 0);
+  mu_assert("ERROR: partial items are accepted",
+            blosc2_decompress_strided_ctx(dctx, dest, data_out, 24) < 0);
+  blosc2_free_ctx(dctx);
+  cctx = blosc2_create_cctx(cparams);
+  mu_assert("ERROR: gathering nothing is accepted",
+            blosc2_compress_iov_ctx(cctx, NULL, 0, dest, NBYTES) < 0);
+  blosc2_free_ctx(cctx);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    mu_run_test(test_strided);
+    mu_run_test(test_iov);
+    mu_run_test(test_gather);
+    mu_run_test(test_errors);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES);
+  data_out = blosc_test_malloc(BUFFER_ALIGN_SIZE, (size_t)NBYTES * NCOLS);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, NBYTES + BLOSC_MAX_OVERHEAD);
+  for (int64_t i = 0; i < NITEMS; i++) {
+    data[i] = i * 7 + (i % 13) * 1000 + 1;
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(data_out);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
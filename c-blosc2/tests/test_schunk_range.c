@@ -0,0 +1,127 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for blosc2_schunk_decompress_range().
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (2 * 1024)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 500
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *dest;
+int nthreads;
+int use_delta;
+int use_async;
+
+
+static char *test_range() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  int64_t nbytes;
+
+  cparams.typesize = 4;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.blocksize = 1024;
+  if (use_delta) {
+    cparams.filters[0] = BLOSC_DELTA;
+  }
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    for (int i = 0; i < CHUNKITEMS; i++) {
+      data[nchunk * CHUNKITEMS + i] = i * nchunk + (i % 13);
+    }
+    if (use_async) {
+      blosc2_append_buffer_async(schunk, CHUNKSIZE,
+                                 data + nchunk * CHUNKITEMS);
+    }
+    else {
+      blosc2_append_buffer(schunk, CHUNKSIZE, data + nchunk * CHUNKITEMS);
+    }
+  }
+
+  /* The whole super-chunk (asynchronous appends are waited for) */
+  memset(dest, 0, (size_t)NCHUNKS * CHUNKSIZE);
+  nbytes = blosc2_schunk_decompress_range(schunk, 0, NCHUNKS, dest,
+                                          (size_t)NCHUNKS * CHUNKSIZE);
+  mu_assert("ERROR: full range not decompressed",
+            nbytes == (int64_t)NCHUNKS * CHUNKSIZE);
+  mu_assert("ERROR: full range roundtrip not successful",
+            memcmp(data, dest, (size_t)NCHUNKS * CHUNKSIZE) == 0);
+
+  /* A range in the middle */
+  memset(dest, 0, (size_t)NCHUNKS * CHUNKSIZE);
+  nbytes = blosc2_schunk_decompress_range(schunk, 7, 42, dest,
+                                          (size_t)NCHUNKS * CHUNKSIZE);
+  mu_assert("ERROR: range not decompressed",
+            nbytes == (int64_t)(42 - 7) * CHUNKSIZE);
+  mu_assert("ERROR: range roundtrip not successful",
+            memcmp(data + 7 * CHUNKITEMS, dest, (size_t)nbytes) == 0);
+
+  /* Empty ranges and errors */
+  mu_assert("ERROR: empty range",
+            blosc2_schunk_decompress_range(schunk, 3, 3, dest, 0) == 0);
+  mu_assert("ERROR: range beyond the super-chunk is accepted",
+            blosc2_schunk_decompress_range(schunk, 0, NCHUNKS + 1, dest,
+                                           (size_t)NCHUNKS * CHUNKSIZE) < 0);
+  mu_assert("ERROR: short destination is accepted",
+            blosc2_schunk_decompress_range(schunk, 0, 2, dest,
+                                           CHUNKSIZE) < 0);
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    use_delta = 0;
+    mu_run_test(test_range);
+    use_delta = 1;
+    mu_run_test(test_range);
+    use_async = 1;
+    mu_run_test(test_range);
+    use_async = 0;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, (size_t)NCHUNKS * CHUNKSIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, (size_t)NCHUNKS * CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
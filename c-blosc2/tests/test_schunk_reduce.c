@@ -0,0 +1,238 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for reducing the contents of super-chunks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (50 * 1000)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 8
+#define NBINS 16
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data;
+int nthreads;
+
+
+static int32_t item(int64_t i) {
+  return (int32_t)((i * 7919) % 100003) - 50000;
+}
+
+
+static blosc2_schunk* new_schunk(int delta) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+
+  cparams.typesize = 4;
+  cparams.blocksize = 16 * 1024;
+  if (delta) {
+    cparams.filters[BLOSC_MAX_FILTERS - 2] = BLOSC_DELTA;
+  }
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  for (int n = 0; n < NCHUNKS; n++) {
+    for (int i = 0; i < CHUNKITEMS; i++) {
+      data[i] = item((int64_t)n * CHUNKITEMS + i);
+    }
+    blosc2_append_buffer(schunk, CHUNKSIZE, data);
+  }
+  return schunk;
+}
+
+
+/* The sum of the items */
+static void sum_init(void* partial, void* user_data) {
+  *(int64_t*)partial = 0;
+}
+
+static int sum_block(void* partial, const uint8_t* block, int32_t size,
+                     int32_t typesize, int64_t offset, void* user_data) {
+  const int32_t* items = (const int32_t*)block;
+
+  for (int32_t i = 0; i < size / typesize; i++) {
+    *(int64_t*)partial += items[i];
+  }
+  return 0;
+}
+
+static void sum_combine(void* result, const void* partial, void* user_data) {
+  *(int64_t*)result += *(const int64_t*)partial;
+}
+
+
+/* The histogram of the items, in NBINS bins of the width in user_data */
+static void hist_init(void* partial, void* user_data) {
+  memset(partial, 0, NBINS * sizeof(int64_t));
+}
+
+static int hist_block(void* partial, const uint8_t* block, int32_t size,
+                      int32_t typesize, int64_t offset, void* user_data) {
+  const int32_t* items = (const int32_t*)block;
+  int32_t width = *(int32_t*)user_data;
+
+  for (int32_t i = 0; i < size / typesize; i++) {
+    ((int64_t*)partial)[(items[i] + 50000) / width]++;
+  }
+  return 0;
+}
+
+static void hist_combine(void* result, const void* partial, void* user_data) {
+  for (int i = 0; i < NBINS; i++) {
+    ((int64_t*)result)[i] += ((const int64_t*)partial)[i];
+  }
+}
+
+
+/* The position of the first minimum, which depends on the offsets */
+typedef struct {
+  int32_t min;
+  int64_t index;
+} argmin;
+
+static void argmin_init(void* partial, void* user_data) {
+  ((argmin*)partial)->min = INT32_MAX;
+  ((argmin*)partial)->index = -1;
+}
+
+static int argmin_block(void* partial, const uint8_t* block, int32_t size,
+                        int32_t typesize, int64_t offset, void* user_data) {
+  const int32_t* items = (const int32_t*)block;
+  argmin* p = (argmin*)partial;
+
+  for (int32_t i = 0; i < size / typesize; i++) {
+    int64_t index = offset / typesize + i;
+    if ((items[i] < p->min) || ((items[i] == p->min) && (index < p->index))) {
+      p->min = items[i];
+      p->index = index;
+    }
+  }
+  return 0;
+}
+
+static void argmin_combine(void* result, const void* partial,
+                           void* user_data) {
+  argmin* r = (argmin*)result;
+  const argmin* p = (const argmin*)partial;
+
+  if ((p->min < r->min) || ((p->min == r->min) && (p->index < r->index))) {
+    *r = *p;
+  }
+}
+
+
+static int fail_block(void* partial, const uint8_t* block, int32_t size,
+                      int32_t typesize, int64_t offset, void* user_data) {
+  return (offset > CHUNKSIZE) ? -1 : 0;
+}
+
+
+static char *test_reductions() {
+  int64_t nitems = (int64_t)NCHUNKS * CHUNKITEMS;
+  int64_t sum = 0, result_sum;
+  int64_t hist[NBINS] = {0}, result_hist[NBINS];
+  int32_t width = 100003 / NBINS + 1;
+  argmin amin = {INT32_MAX, -1}, result_amin;
+  blosc2_schunk* schunk;
+
+  for (int64_t i = 0; i < nitems; i++) {
+    sum += item(i);
+    hist[(item(i) + 50000) / width]++;
+    if (item(i) < amin.min) {
+      amin.min = item(i);
+      amin.index = i;
+    }
+  }
+
+  for (int delta = 0; delta <= 1; delta++) {
+    schunk = new_schunk(delta);
+    mu_assert("ERROR: sum failed",
+              blosc2_schunk_reduce(schunk, sizeof(int64_t), sum_init,
+                                   sum_block, sum_combine, NULL,
+                                   &result_sum) == nitems * 4);
+    mu_assert("ERROR: bad sum", result_sum == sum);
+    mu_assert("ERROR: histogram failed",
+              blosc2_schunk_reduce(schunk, sizeof(hist), hist_init,
+                                   hist_block, hist_combine, &width,
+                                   result_hist) == nitems * 4);
+    mu_assert("ERROR: bad histogram",
+              memcmp(result_hist, hist, sizeof(hist)) == 0);
+    mu_assert("ERROR: argmin failed",
+              blosc2_schunk_reduce(schunk, sizeof(argmin), argmin_init,
+                                   argmin_block, argmin_combine, NULL,
+                                   &result_amin) == nitems * 4);
+    mu_assert("ERROR: bad argmin", (result_amin.min == amin.min) &&
+                                   (result_amin.index == amin.index));
+
+    /* The super-chunk is still usable as usual */
+    mu_assert("ERROR: decompression after a reduction failed",
+              blosc2_decompress_chunk(schunk, 1, data, CHUNKSIZE) ==
+              CHUNKSIZE);
+    mu_assert("ERROR: bad chunk after a reduction",
+              data[0] == item(CHUNKITEMS));
+    blosc2_destroy_schunk(schunk);
+  }
+  return 0;
+}
+
+
+static char *test_errors() {
+  blosc2_schunk* schunk = new_schunk(0);
+  int64_t result;
+
+  mu_assert("ERROR: failed block function is not reported",
+            blosc2_schunk_reduce(schunk, sizeof(int64_t), sum_init,
+                                 fail_block, sum_combine, NULL,
+                                 &result) < 0);
+  mu_assert("ERROR: missing functions are accepted",
+            blosc2_schunk_reduce(schunk, sizeof(int64_t), sum_init,
+                                 sum_block, NULL, NULL, &result) < 0);
+  mu_assert("ERROR: decompression after a failed reduction failed",
+            blosc2_decompress_chunk(schunk, 0, data, CHUNKSIZE) ==
+            CHUNKSIZE);
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    mu_run_test(test_reductions);
+    mu_run_test(test_errors);
+  }
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+
+  blosc_destroy();
+
+  return result != 0;
+}
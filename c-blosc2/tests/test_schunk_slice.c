@@ -0,0 +1,127 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for blosc2_schunk_get_slice().
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (10 * 1000)
+#define NCHUNKS 20
+#define NITEMS (NCHUNKS * CHUNKITEMS)
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int64_t *data, *dest;
+int nthreads;
+int use_delta;
+int chainlen;
+int use_async;
+
+
+static char *test_slice() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  int64_t slices[][2] = {{0, 1}, {5, 5}, {CHUNKITEMS - 50, CHUNKITEMS + 50},
+                         {1234, 3 * CHUNKITEMS + 4321},
+                         {2 * CHUNKITEMS, 5 * CHUNKITEMS},
+                         {NITEMS - 777, NITEMS}, {0, NITEMS}};
+  int64_t nbytes;
+
+  cparams.typesize = sizeof(int64_t);
+  cparams.compcode = BLOSC_LZ4;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.blocksize = 4 * 1024;
+  cparams.chainlen = chainlen;
+  if (use_delta) {
+    cparams.filters[0] = BLOSC_DELTA;
+  }
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    if (use_async) {
+      blosc2_append_buffer_async(schunk, CHUNKITEMS * sizeof(int64_t),
+                                 data + nchunk * CHUNKITEMS);
+    }
+    else {
+      blosc2_append_buffer(schunk, CHUNKITEMS * sizeof(int64_t),
+                           data + nchunk * CHUNKITEMS);
+    }
+  }
+
+  for (int i = 0; i < (int)(sizeof(slices) / sizeof(slices[0])); i++) {
+    int64_t start = slices[i][0];
+    int64_t stop = slices[i][1];
+    memset(dest, 0, NITEMS * sizeof(int64_t));
+    nbytes = blosc2_schunk_get_slice(schunk, start, stop, dest);
+    mu_assert("ERROR: bad size of slice",
+              nbytes == (stop - start) * (int64_t)sizeof(int64_t));
+    mu_assert("ERROR: slice is not correct",
+              memcmp(data + start, dest, (size_t)nbytes) == 0);
+  }
+
+  mu_assert("ERROR: slice beyond the super-chunk is accepted",
+            blosc2_schunk_get_slice(schunk, 0, NITEMS + 1, dest) < 0);
+  mu_assert("ERROR: reversed slice is accepted",
+            blosc2_schunk_get_slice(schunk, 10, 5, dest) < 0);
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  for (nthreads = 1; nthreads <= 4; nthreads += 3) {
+    use_delta = 0;
+    chainlen = 1;
+    mu_run_test(test_slice);
+    use_delta = 1;
+    mu_run_test(test_slice);
+    chainlen = 4;
+    mu_run_test(test_slice);
+    /* Asynchronous appends are waited for */
+    use_async = 1;
+    mu_run_test(test_slice);
+    use_async = 0;
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, NITEMS * sizeof(int64_t));
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, NITEMS * sizeof(int64_t));
+  for (int64_t i = 0; i < NITEMS; i++) {
+    data[i] = i * 7 + (i % 3) * (i / CHUNKITEMS);
+  }
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
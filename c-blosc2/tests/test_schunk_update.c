@@ -0,0 +1,347 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for updating, inserting and deleting chunks of super-chunks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (20 * 1000)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 10
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *dest;
+blosc2_schunk* schunk;
+/* The seed of the contents of every chunk */
+int seeds[NCHUNKS + 10];
+int nseeds;
+
+
+static void fill_chunk(int32_t* buffer, int seed) {
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    buffer[i] = (int32_t)((uint32_t)i * (uint32_t)seed + (uint32_t)(i % 13));
+  }
+}
+
+
+/* The chunks hold the expected contents and the counters add up */
+static int check_schunk(void) {
+  int64_t nbytes = 0;
+  int64_t cbytes = sizeof(blosc2_schunk);
+
+  if (schunk->nchunks != nseeds) {
+    return 0;
+  }
+  for (int n = 0; n < nseeds; n++) {
+    fill_chunk(data, seeds[n]);
+    if ((blosc2_decompress_chunk(schunk, (size_t)n, dest, CHUNKSIZE) !=
+         CHUNKSIZE) || (memcmp(data, dest, CHUNKSIZE) != 0)) {
+      return 0;
+    }
+    nbytes += *(int32_t*)(schunk->data[n] + 4);
+    cbytes += *(int32_t*)(schunk->data[n] + 12) + sizeof(void*);
+  }
+  return (schunk->nbytes == nbytes) && (schunk->cbytes == cbytes);
+}
+
+
+static void new_schunk(void) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+
+  cparams.typesize = 4;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  for (nseeds = 0; nseeds < NCHUNKS; nseeds++) {
+    seeds[nseeds] = nseeds + 1;
+    fill_chunk(data, seeds[nseeds]);
+    blosc2_append_buffer(schunk, CHUNKSIZE, data);
+  }
+}
+
+
+static char *test_update() {
+  void* chunk;
+  int cbytes;
+
+  new_schunk();
+  mu_assert("ERROR: bad initial super-chunk", check_schunk());
+
+  /* Less compressible data changes the compressed size */
+  seeds[3] = 1000003;
+  fill_chunk(data, seeds[3]);
+  mu_assert("ERROR: buffer update failed",
+            blosc2_schunk_update_buffer(schunk, 3, CHUNKSIZE, data) ==
+            NCHUNKS);
+  mu_assert("ERROR: bad super-chunk after a buffer update", check_schunk());
+
+  /* Chunks can be copied or handed over */
+  seeds[0] = 77;
+  fill_chunk(data, seeds[0]);
+  chunk = malloc(CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  cbytes = blosc_compress(5, BLOSC_SHUFFLE, 4, CHUNKSIZE, data, chunk,
+                          CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  mu_assert("ERROR: compression failed", cbytes > 0);
+  mu_assert("ERROR: chunk update (copy) failed",
+            blosc2_schunk_update_chunk(schunk, 0, chunk, 1) == NCHUNKS);
+  seeds[NCHUNKS - 1] = 77;
+  mu_assert("ERROR: chunk update failed",
+            blosc2_schunk_update_chunk(schunk, NCHUNKS - 1, chunk, 0) ==
+            NCHUNKS);
+  mu_assert("ERROR: bad super-chunk after chunk updates", check_schunk());
+
+  /* Errors */
+  mu_assert("ERROR: update beyond the super-chunk is accepted",
+            blosc2_schunk_update_buffer(schunk, NCHUNKS, CHUNKSIZE, data) < 0);
+  mu_assert("ERROR: update with a NULL chunk is accepted",
+            blosc2_schunk_update_chunk(schunk, 0, NULL, 1) < 0);
+  mu_assert("ERROR: bad super-chunk after errors", check_schunk());
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *test_insert_delete() {
+  new_schunk();
+
+  /* At the start, in the middle and at the end */
+  int positions[] = {0, 5, NCHUNKS + 2};
+  for (int p = 0; p < 3; p++) {
+    int pos = positions[p];
+    memmove(seeds + pos + 1, seeds + pos, (nseeds - pos) * sizeof(int));
+    seeds[pos] = 500 + p;
+    nseeds++;
+    fill_chunk(data, seeds[pos]);
+    mu_assert("ERROR: insert failed",
+              blosc2_schunk_insert_buffer(schunk, pos, CHUNKSIZE, data) ==
+              nseeds);
+    mu_assert("ERROR: bad super-chunk after an insert", check_schunk());
+  }
+  mu_assert("ERROR: insert beyond the super-chunk is accepted",
+            blosc2_schunk_insert_buffer(schunk, nseeds + 1, CHUNKSIZE,
+                                        data) < 0);
+
+  int deletions[] = {0, 4, NCHUNKS};
+  for (int p = 0; p < 3; p++) {
+    int pos = deletions[p];
+    memmove(seeds + pos, seeds + pos + 1, (nseeds - pos - 1) * sizeof(int));
+    nseeds--;
+    mu_assert("ERROR: delete failed",
+              blosc2_schunk_delete_chunk(schunk, pos) == nseeds);
+    mu_assert("ERROR: bad super-chunk after a delete", check_schunk());
+  }
+  mu_assert("ERROR: delete beyond the super-chunk is accepted",
+            blosc2_schunk_delete_chunk(schunk, nseeds) < 0);
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+/* Inserts and deletes wait for the pending asynchronous appends */
+static char *test_pending_appends() {
+  new_schunk();
+
+  for (int i = 0; i < 3; i++) {
+    seeds[nseeds] = 700 + i;
+    fill_chunk(data, seeds[nseeds]);
+    nseeds++;
+    mu_assert("ERROR: async append failed",
+              blosc2_append_buffer_async(schunk, CHUNKSIZE, data) == nseeds);
+  }
+  memmove(seeds + 1, seeds, nseeds * sizeof(int));
+  seeds[0] = 800;
+  nseeds++;
+  fill_chunk(data, seeds[0]);
+  mu_assert("ERROR: insert after async appends failed",
+            blosc2_schunk_insert_buffer(schunk, 0, CHUNKSIZE, data) == nseeds);
+  mu_assert("ERROR: bad super-chunk after an insert", check_schunk());
+
+  seeds[nseeds] = 801;
+  fill_chunk(data, seeds[nseeds]);
+  nseeds++;
+  mu_assert("ERROR: async append failed",
+            blosc2_append_buffer_async(schunk, CHUNKSIZE, data) == nseeds);
+  nseeds--;
+  mu_assert("ERROR: delete after async appends failed",
+            blosc2_schunk_delete_chunk(schunk, nseeds) == nseeds);
+  mu_assert("ERROR: bad super-chunk after a delete", check_schunk());
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+/* Compress a chunk with the contents for `seed` */
+static void* make_chunk(int seed) {
+  void* chunk = malloc(CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+
+  fill_chunk(data, seed);
+  if (blosc_compress(5, BLOSC_SHUFFLE, 4, CHUNKSIZE, data, chunk,
+                     CHUNKSIZE + BLOSC_MAX_OVERHEAD) <= 0) {
+    free(chunk);
+    return NULL;
+  }
+  return chunk;
+}
+
+
+static char *test_packed() {
+  int64_t packed_len;
+  void* packed;
+  void* new_packed;
+  void* chunk;
+  void* buffer;
+
+  new_schunk();
+  packed = blosc2_pack_schunk(schunk);
+  blosc2_destroy_schunk(schunk);
+
+  seeds[4] = 600;
+  chunk = make_chunk(seeds[4]);
+  packed = blosc2_packed_update_chunk(packed, 4, chunk);
+  mu_assert("ERROR: packed update failed", packed != NULL);
+  free(chunk);
+
+  int positions[] = {0, 5, NCHUNKS + 1};
+  for (int p = 0; p < 3; p++) {
+    int pos = positions[p];
+    memmove(seeds + pos + 1, seeds + pos, (nseeds - pos) * sizeof(int));
+    seeds[pos] = 610 + p;
+    nseeds++;
+    chunk = make_chunk(seeds[pos]);
+    packed = blosc2_packed_insert_chunk(packed, pos, chunk);
+    mu_assert("ERROR: packed insert failed", packed != NULL);
+    free(chunk);
+  }
+
+  int deletions[] = {0, 6, NCHUNKS};
+  for (int p = 0; p < 3; p++) {
+    int pos = deletions[p];
+    memmove(seeds + pos, seeds + pos + 1, (nseeds - pos - 1) * sizeof(int));
+    nseeds--;
+    packed = blosc2_packed_delete_chunk(packed, pos);
+    mu_assert("ERROR: packed delete failed", packed != NULL);
+  }
+
+  /* Errors leave the packed super-chunk alone */
+  chunk = make_chunk(1);
+  new_packed = blosc2_packed_insert_chunk(packed, nseeds + 1, chunk);
+  mu_assert("ERROR: packed insert beyond the end is accepted",
+            new_packed == NULL);
+  new_packed = blosc2_packed_update_chunk(packed, nseeds, chunk);
+  mu_assert("ERROR: packed update beyond the end is accepted",
+            new_packed == NULL);
+  free(chunk);
+  mu_assert("ERROR: packed delete beyond the end is accepted",
+            blosc2_packed_delete_chunk(packed, nseeds) == NULL);
+  /* Packed super-chunks with the older layout are rejected */
+  ((uint8_t*)packed)[0] = 0;
+  mu_assert("ERROR: an old packed super-chunk is unpacked",
+            blosc2_unpack_schunk(packed) == NULL);
+  mu_assert("ERROR: an old packed super-chunk is changed",
+            blosc2_packed_delete_chunk(packed, 0) == NULL);
+  ((uint8_t*)packed)[0] = 1;
+
+  for (int n = 0; n < nseeds; n++) {
+    fill_chunk(data, seeds[n]);
+    mu_assert("ERROR: bad packed chunk",
+              (blosc2_packed_decompress_chunk(packed, (size_t)n, &buffer) ==
+               CHUNKSIZE) && (memcmp(data, buffer, CHUNKSIZE) == 0));
+    free(buffer);
+  }
+
+  /* Compaction drops the bytes of the replaced and deleted chunks */
+  packed_len = *(int64_t*)((uint8_t*)packed + 32);
+  packed = blosc2_packed_compact(packed);
+  mu_assert("ERROR: packed compaction failed",
+            (packed != NULL) &&
+            (*(int64_t*)((uint8_t*)packed + 32) < packed_len));
+  mu_assert("ERROR: compacting twice moves the packed super-chunk",
+            blosc2_packed_compact(packed) == packed);
+  schunk = blosc2_unpack_schunk(packed);
+  mu_assert("ERROR: bad unpacked super-chunk", check_schunk());
+
+  blosc2_destroy_schunk(schunk);
+  free(packed);
+  return 0;
+}
+
+
+static char *test_cached_chunks() {
+  blosc2_chunkcache_stats stats;
+
+  new_schunk();
+  blosc2_schunk_set_chunkcache(schunk, (size_t)NCHUNKS * CHUNKSIZE);
+  mu_assert("ERROR: bad super-chunk with a cache", check_schunk());
+
+  /* A rolling window rewrites the last chunk over and over */
+  for (int i = 0; i < 5; i++) {
+    seeds[NCHUNKS - 1] = 900 + i;
+    fill_chunk(data, seeds[NCHUNKS - 1]);
+    blosc2_schunk_update_buffer(schunk, NCHUNKS - 1, CHUNKSIZE, data);
+    mu_assert("ERROR: stale chunk after an update", check_schunk());
+  }
+  blosc2_schunk_get_chunkcache_stats(schunk, &stats);
+  mu_assert("ERROR: cached chunks are not used", stats.hits > 0);
+
+  /* Chunks move on inserts and deletes */
+  memmove(seeds + 1, seeds, nseeds * sizeof(int));
+  seeds[0] = 999;
+  nseeds++;
+  fill_chunk(data, seeds[0]);
+  blosc2_schunk_insert_buffer(schunk, 0, CHUNKSIZE, data);
+  mu_assert("ERROR: stale chunks after an insert", check_schunk());
+  memmove(seeds + 2, seeds + 3, (nseeds - 3) * sizeof(int));
+  nseeds--;
+  blosc2_schunk_delete_chunk(schunk, 2);
+  mu_assert("ERROR: stale chunks after a delete", check_schunk());
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_update);
+  mu_run_test(test_insert_delete);
+  mu_run_test(test_pending_appends);
+  mu_run_test(test_packed);
+  mu_run_test(test_cached_chunks);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}
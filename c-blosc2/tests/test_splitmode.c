@@ -0,0 +1,192 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the split modes (see `splitmode` in blosc2_cparams).
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NITEMS (64 * 1024)
+#define SIZE (NITEMS * 4)
+#define NCHUNKS 10
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *src, *dest, *dest2;
+int compcode;
+int nthreads;
+
+
+/* Runs of a ramp interleaved with runs of noisy values */
+static void fill_buffer(void) {
+  for (uint32_t i = 0; i < NITEMS; i++) {
+    src[i] = ((i % 64) < 32) ? (int32_t)(i * 13) :
+             (int32_t)((i * 2654435761u) >> 20);
+  }
+}
+
+
+static int compress_buffer(int splitmode, int* split) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  size_t typesize;
+  int flags;
+  int csize;
+
+  cparams.typesize = 4;
+  cparams.compcode = compcode;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.splitmode = splitmode;
+  cctx = blosc2_create_cctx(cparams);
+  csize = blosc2_compress_ctx(cctx, SIZE, src, dest, SIZE + BLOSC_MAX_OVERHEAD);
+  blosc2_free_ctx(cctx);
+  blosc_cbuffer_metainfo(dest, &typesize, &flags);
+  *split = !(flags & 0x10);
+  return csize;
+}
+
+
+static char *test_auto_split() {
+  int split_always, split_never, split_auto;
+  int csize_always, csize_never, csize_auto;
+  int dsize;
+
+  fill_buffer();
+  csize_always = compress_buffer(BLOSC_ALWAYS_SPLIT, &split_always);
+  mu_assert("ERROR: BLOSC_ALWAYS_SPLIT does not split", split_always);
+  csize_never = compress_buffer(BLOSC_NEVER_SPLIT, &split_never);
+  mu_assert("ERROR: BLOSC_NEVER_SPLIT splits", !split_never);
+  csize_auto = compress_buffer(BLOSC_AUTO_SPLIT, &split_auto);
+  mu_assert("ERROR: BLOSC_AUTO_SPLIT does not choose the best ratio",
+            csize_auto == ((csize_always < csize_never) ?
+                           csize_always : csize_never));
+
+  dsize = blosc_decompress(dest, dest2, SIZE);
+  mu_assert("ERROR: decompression failed", dsize == SIZE);
+  mu_assert("ERROR: roundtrip not successful",
+            memcmp(src, dest2, SIZE) == 0);
+  return 0;
+}
+
+
+static char *test_auto_split_schunk() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk;
+  uint8_t split_flag;
+  int dsize;
+
+  cparams.typesize = 4;
+  cparams.compcode = compcode;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.splitmode = BLOSC_AUTO_SPLIT;
+  dparams.nthreads = nthreads;
+  schunk = blosc2_new_schunk(cparams, dparams);
+
+  fill_buffer();
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    src[0] = nchunk;
+    blosc2_append_buffer(schunk, SIZE, src);
+  }
+
+  /* The decision for the first chunk is kept for the next ones */
+  split_flag = (uint8_t)(schunk->data[0][2] & 0x10);
+  for (int nchunk = 0; nchunk < NCHUNKS; nchunk++) {
+    mu_assert("ERROR: split decision changed between chunks",
+              (schunk->data[nchunk][2] & 0x10) == split_flag);
+    dsize = blosc2_decompress_chunk(schunk, (size_t)nchunk, dest2, SIZE);
+    mu_assert("ERROR: chunk decompression failed", dsize == SIZE);
+    src[0] = nchunk;
+    mu_assert("ERROR: chunk roundtrip not successful",
+              memcmp(src, dest2, SIZE) == 0);
+  }
+
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+/* The ratio profile splits shuffled streams only */
+static char *test_ratio_split() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_context* cctx;
+  size_t typesize;
+  int flags;
+
+  fill_buffer();
+  cparams.typesize = 4;
+  cparams.compcode = compcode;
+  cparams.nthreads = (uint32_t)nthreads;
+  cparams.tuning = BLOSC_TUNE_RATIO;
+  for (int shuffle = 0; shuffle <= 1; shuffle++) {
+    cparams.filters[BLOSC_MAX_FILTERS - 1] = (uint8_t)shuffle;
+    cctx = blosc2_create_cctx(cparams);
+    mu_assert("ERROR: compression failed",
+              blosc2_compress_ctx(cctx, SIZE, src, dest,
+                                  SIZE + BLOSC_MAX_OVERHEAD) > 0);
+    blosc2_free_ctx(cctx);
+    blosc_cbuffer_metainfo(dest, &typesize, &flags);
+    mu_assert("ERROR: BLOSC_TUNE_RATIO splits by the shuffle",
+              !(flags & 0x10) == shuffle);
+  }
+  return 0;
+}
+
+
+static char *all_tests() {
+  const char* compressors = blosc_list_compressors();
+  int compcodes[] = {BLOSC_BLOSCLZ, BLOSC_LZ4, BLOSC_ZSTD};
+  const char* compnames[] = {"blosclz", "lz4", "zstd"};
+
+  for (int i = 0; i < 3; i++) {
+    /* Codecs may be deactivated at build time */
+    if (strstr(compressors, compnames[i]) == NULL) {
+      continue;
+    }
+    compcode = compcodes[i];
+    nthreads = 1;
+    mu_run_test(test_auto_split);
+    mu_run_test(test_auto_split_schunk);
+    mu_run_test(test_ratio_split);
+    nthreads = 4;
+    mu_run_test(test_auto_split);
+    mu_run_test(test_auto_split_schunk);
+  }
+
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  src = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE + BLOSC_MAX_OVERHEAD);
+  dest2 = blosc_test_malloc(BUFFER_ALIGN_SIZE, SIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(src);
+  blosc_test_free(dest);
+  blosc_test_free(dest2);
+
+  blosc_destroy();
+
+  return result != 0;
+}
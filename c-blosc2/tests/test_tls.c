@@ -0,0 +1,132 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the per-thread contexts behind blosc_compress() and
+  blosc_decompress().
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <pthread.h>
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define NCALLERS 8
+#define NITER 20
+#define NITEMS (200 * 1000)
+#define SIZE (NITEMS * 4)
+
+/* Global vars */
+int nthreads;
+
+
+/* Compress and decompress a buffer of its own with the Blosc1 API */
+static void* caller(void* arg) {
+  int32_t seed = (int32_t)(intptr_t)arg;
+  int32_t* src = malloc(SIZE);
+  int32_t* dest = malloc(SIZE + BLOSC_MAX_OVERHEAD);
+  int32_t* dest2 = malloc(SIZE);
+  intptr_t failed = 0;
+
+  for (int i = 0; i < NITEMS; i++) {
+    src[i] = seed * i + (i % 11);
+  }
+  for (int n = 0; n < NITER && !failed; n++) {
+    int cbytes = blosc_compress(5, BLOSC_SHUFFLE, 4, SIZE, src, dest,
+                                SIZE + BLOSC_MAX_OVERHEAD);
+    int nbytes = blosc_decompress(dest, dest2, SIZE);
+    failed = (cbytes <= 0) || (nbytes != SIZE) ||
+             (memcmp(src, dest2, SIZE) != 0);
+  }
+
+  free(src);
+  free(dest);
+  free(dest2);
+  return (void*)failed;
+}
+
+
+static char *test_callers() {
+  pthread_t threads[NCALLERS];
+  void* failed;
+
+  blosc_set_nthreads(nthreads);
+  for (intptr_t t = 0; t < NCALLERS; t++) {
+    pthread_create(&threads[t], NULL, caller, (void*)(t + 1));
+  }
+  for (int t = 0; t < NCALLERS; t++) {
+    pthread_join(threads[t], &failed);
+    mu_assert("ERROR: concurrent roundtrip not successful", failed == NULL);
+  }
+
+  /* The calling thread has a context of its own too */
+  failed = caller((void*)(intptr_t)NCALLERS);
+  mu_assert("ERROR: roundtrip in main thread not successful", failed == NULL);
+  return 0;
+}
+
+
+/* The environment variables can be read again while other threads are
+   compressing */
+static char *test_reloads() {
+  pthread_t threads[NCALLERS];
+  void* failed;
+
+  blosc_set_nthreads(nthreads);
+  for (intptr_t t = 0; t < NCALLERS; t++) {
+    pthread_create(&threads[t], NULL, caller, (void*)(t + 1));
+  }
+  for (int n = 0; n < 1000; n++) {
+    blosc_reload_env();
+  }
+  for (int t = 0; t < NCALLERS; t++) {
+    pthread_join(threads[t], &failed);
+    mu_assert("ERROR: roundtrip while reloading not successful",
+              failed == NULL);
+  }
+  return 0;
+}
+
+
+static char *all_tests() {
+  nthreads = 1;
+  mu_run_test(test_callers);
+  nthreads = 2;
+  mu_run_test(test_callers);
+  /* Contexts shrink their pools of threads on the next call */
+  nthreads = 1;
+  mu_run_test(test_callers);
+  mu_run_test(test_reloads);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_destroy();
+
+  /* Contexts are created again after a new initialization */
+  blosc_init();
+  if (caller((void*)1) != NULL) {
+    printf("ERROR: roundtrip after re-initialization not successful\n");
+    return 1;
+  }
+  blosc_destroy();
+
+  return result != 0;
+}
@@ -0,0 +1,355 @@
+/*********************************************************************
+  Blosc - Blocked Shuffling and Compression Library
+
+  Unit tests for the zone maps of super-chunks.
+
+  See LICENSES/BLOSC.txt for details about copyright and rights to use.
+**********************************************************************/
+
+#include <math.h>
+#include "test_common.h"
+
+int tests_run = 0;
+
+#define CHUNKITEMS (20 * 1000)
+#define CHUNKSIZE (CHUNKITEMS * 4)
+#define NCHUNKS 10
+#define BUFFER_ALIGN_SIZE   32
+
+/* Global vars */
+int32_t *data, *dest;
+blosc2_schunk* schunk;
+
+
+/* The chunk `n` holds values in [n * 1000, n * 1000 + 999] */
+static void fill_chunk(int32_t* buffer, int n) {
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    buffer[i] = n * 1000 + (i * 7) % 1000;
+  }
+}
+
+
+static blosc2_schunk* new_schunk(int clevel, int zonemap_type, int async) {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  blosc2_schunk* schunk_;
+
+  cparams.typesize = 4;
+  cparams.clevel = clevel;
+  schunk_ = blosc2_new_schunk(cparams, dparams);
+  if (zonemap_type != BLOSC_ZONEMAP_NONE) {
+    blosc2_schunk_set_zonemaps(schunk_, zonemap_type);
+  }
+  for (int n = 0; n < NCHUNKS; n++) {
+    fill_chunk(data, n);
+    if (async) {
+      blosc2_append_buffer_async(schunk_, CHUNKSIZE, data);
+    }
+    else {
+      blosc2_append_buffer(schunk_, CHUNKSIZE, data);
+    }
+  }
+  return schunk_;
+}
+
+
+/* The zone maps of the chunks are the ones of `fill_chunk()` for `ns` */
+static int check_zonemaps(blosc2_schunk* schunk_, const int* ns, int nchunks) {
+  blosc2_zonemap zonemap, blocks[64], merged;
+  int nblocks;
+
+  for (int n = 0; n < nchunks; n++) {
+    if ((blosc2_schunk_get_zonemap(schunk_, n, &zonemap) < 0) ||
+        (zonemap.min != ns[n] * 1000) || (zonemap.max != ns[n] * 1000 + 999) ||
+        (zonemap.nnulls != 0)) {
+      return 0;
+    }
+    /* The blocks add up to the chunk */
+    nblocks = blosc2_schunk_get_block_zonemaps(schunk_, n, blocks, 64);
+    if ((nblocks < 1) || (nblocks > 64)) {
+      return 0;
+    }
+    merged = blocks[0];
+    for (int i = 1; i < nblocks; i++) {
+      merged.min = (blocks[i].min < merged.min) ? blocks[i].min : merged.min;
+      merged.max = (blocks[i].max > merged.max) ? blocks[i].max : merged.max;
+    }
+    if ((merged.min != zonemap.min) || (merged.max != zonemap.max)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+static char *test_query() {
+  int ns[NCHUNKS];
+  int64_t chunks[NCHUNKS];
+  blosc2_schunk* schunks[4];
+
+  for (int n = 0; n < NCHUNKS; n++) {
+    ns[n] = n;
+  }
+  /* Computed while compressing, after compressing, in batches and for
+     memcpy'ed chunks */
+  schunks[0] = new_schunk(5, BLOSC_ZONEMAP_INT32, 0);
+  schunks[1] = new_schunk(5, BLOSC_ZONEMAP_NONE, 0);
+  mu_assert("ERROR: query without zone maps is accepted",
+            blosc2_schunk_zonemap_query(schunks[1], 0, 1, chunks,
+                                        NCHUNKS) < 0);
+  blosc2_schunk_set_zonemaps(schunks[1], BLOSC_ZONEMAP_INT32);
+  schunks[2] = new_schunk(5, BLOSC_ZONEMAP_INT32, 1);
+  schunks[3] = new_schunk(0, BLOSC_ZONEMAP_INT32, 0);
+
+  for (int s = 0; s < 4; s++) {
+    schunk = schunks[s];
+    mu_assert("ERROR: bad zone maps", check_zonemaps(schunk, ns, NCHUNKS));
+    mu_assert("ERROR: bad number of matching chunks",
+              blosc2_schunk_zonemap_query(schunk, 2500, 4200, chunks,
+                                          NCHUNKS) == 3);
+    mu_assert("ERROR: bad matching chunks",
+              (chunks[0] == 2) && (chunks[1] == 3) && (chunks[2] == 4));
+    mu_assert("ERROR: the bounds do not match",
+              (blosc2_schunk_zonemap_query(schunk, 999, 1000, chunks,
+                                           NCHUNKS) == 2));
+    mu_assert("ERROR: chunks match values out of range",
+              blosc2_schunk_zonemap_query(schunk, 10000, 20000, chunks,
+                                          NCHUNKS) == 0);
+    blosc2_destroy_schunk(schunk);
+  }
+  return 0;
+}
+
+
+static char *test_changes() {
+  int ns[NCHUNKS + 1];
+  int64_t chunks[NCHUNKS + 1];
+  blosc2_zonemap zonemap;
+
+  for (int n = 0; n < NCHUNKS; n++) {
+    ns[n] = n;
+  }
+  /* The appends are still pending on the first update */
+  schunk = new_schunk(5, BLOSC_ZONEMAP_INT32, 1);
+  mu_assert("ERROR: wrong type is accepted",
+            blosc2_schunk_set_zonemaps(schunk, BLOSC_ZONEMAP_INT64) < 0);
+
+  /* Updates, inserts and deletes move the zone maps along */
+  ns[3] = 50;
+  fill_chunk(data, ns[3]);
+  blosc2_schunk_update_buffer(schunk, 3, CHUNKSIZE, data);
+  mu_assert("ERROR: bad zone maps after an update",
+            check_zonemaps(schunk, ns, NCHUNKS));
+  mu_assert("ERROR: updated chunk does not match",
+            (blosc2_schunk_zonemap_query(schunk, 50500, 50600, chunks,
+                                         NCHUNKS) == 1) && (chunks[0] == 3));
+
+  memmove(ns + 1, ns, NCHUNKS * sizeof(int));
+  ns[0] = 70;
+  fill_chunk(data, ns[0]);
+  blosc2_schunk_insert_buffer(schunk, 0, CHUNKSIZE, data);
+  mu_assert("ERROR: bad zone maps after an insert",
+            check_zonemaps(schunk, ns, NCHUNKS + 1));
+  mu_assert("ERROR: chunks do not move after an insert",
+            (blosc2_schunk_zonemap_query(schunk, 50500, 50600, chunks,
+                                         NCHUNKS) == 1) && (chunks[0] == 4));
+
+  memmove(ns + 2, ns + 3, (NCHUNKS - 2) * sizeof(int));
+  blosc2_schunk_delete_chunk(schunk, 2);
+  mu_assert("ERROR: bad zone maps after a delete",
+            check_zonemaps(schunk, ns, NCHUNKS));
+  mu_assert("ERROR: deleted chunk still has zone maps",
+            blosc2_schunk_get_zonemap(schunk, NCHUNKS, &zonemap) < 0);
+
+  /* Chunks made elsewhere are looked at */
+  void* chunk = malloc(CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  ns[5] = 60;
+  fill_chunk(data, ns[5]);
+  blosc_compress(5, BLOSC_SHUFFLE, 4, CHUNKSIZE, data, chunk,
+                 CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  blosc2_schunk_update_chunk(schunk, 5, chunk, 0);
+  mu_assert("ERROR: bad zone maps after a chunk update",
+            check_zonemaps(schunk, ns, NCHUNKS));
+
+  /* Dropping the zone maps */
+  blosc2_schunk_set_zonemaps(schunk, BLOSC_ZONEMAP_NONE);
+  mu_assert("ERROR: zone maps are not dropped",
+            blosc2_schunk_get_zonemap(schunk, 0, &zonemap) < 0);
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *test_nans() {
+  blosc2_cparams cparams = BLOSC_CPARAMS_DEFAULTS;
+  blosc2_dparams dparams = BLOSC_DPARAMS_DEFAULTS;
+  float* fdata = (float*)data;
+  blosc2_zonemap zonemap;
+  int64_t chunks[3];
+
+  cparams.typesize = 4;
+  schunk = blosc2_new_schunk(cparams, dparams);
+  blosc2_schunk_set_zonemaps(schunk, BLOSC_ZONEMAP_FLOAT32);
+  /* Values with some NaNs, only NaNs and negative values */
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    fdata[i] = (i % 100 == 0) ? NAN : (float)i / 4;
+  }
+  blosc2_append_buffer(schunk, CHUNKSIZE, data);
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    fdata[i] = NAN;
+  }
+  blosc2_append_buffer(schunk, CHUNKSIZE, data);
+  for (int i = 0; i < CHUNKITEMS; i++) {
+    fdata[i] = -1.5f - (float)(i % 10);
+  }
+  blosc2_append_buffer(schunk, CHUNKSIZE, data);
+
+  blosc2_schunk_get_zonemap(schunk, 0, &zonemap);
+  mu_assert("ERROR: bad zone map with NaNs",
+            (zonemap.min == 0.25) && (zonemap.max == (CHUNKITEMS - 1) / 4.) &&
+            (zonemap.nnulls == CHUNKITEMS / 100));
+  blosc2_schunk_get_zonemap(schunk, 1, &zonemap);
+  mu_assert("ERROR: bad zone map with only NaNs",
+            (zonemap.nnulls == CHUNKITEMS) && (zonemap.min > zonemap.max));
+  mu_assert("ERROR: bad float query",
+            (blosc2_schunk_zonemap_query(schunk, -HUGE_VAL, 0, chunks,
+                                         3) == 1) && (chunks[0] == 2));
+  mu_assert("ERROR: chunks with only NaNs match",
+            blosc2_schunk_zonemap_query(schunk, -HUGE_VAL, HUGE_VAL, chunks,
+                                        3) == 2);
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *test_pack() {
+  int ns[NCHUNKS + 1];
+  int64_t chunks[NCHUNKS + 1];
+  blosc2_schunk* unpacked;
+  void* packed;
+  void* chunk;
+
+  for (int n = 0; n < NCHUNKS; n++) {
+    ns[n] = n;
+  }
+  schunk = new_schunk(5, BLOSC_ZONEMAP_INT32, 0);
+  packed = blosc2_pack_schunk(schunk);
+  unpacked = blosc2_unpack_schunk(packed);
+  mu_assert("ERROR: bad number of unpacked chunks",
+            unpacked->nchunks == NCHUNKS);
+  mu_assert("ERROR: bad unpacked zone maps",
+            check_zonemaps(unpacked, ns, NCHUNKS));
+  mu_assert("ERROR: bad unpacked query",
+            blosc2_schunk_zonemap_query(unpacked, 2500, 4200, chunks,
+                                        NCHUNKS) == 3);
+  for (int n = 0; n < NCHUNKS; n++) {
+    fill_chunk(data, n);
+    mu_assert("ERROR: bad unpacked chunk",
+              (blosc2_decompress_chunk(unpacked, (size_t)n, dest,
+                                       CHUNKSIZE) == CHUNKSIZE) &&
+              (memcmp(data, dest, CHUNKSIZE) == 0));
+  }
+  /* New chunks get zone maps */
+  ns[NCHUNKS] = 20;
+  fill_chunk(data, ns[NCHUNKS]);
+  blosc2_append_buffer(unpacked, CHUNKSIZE, data);
+  mu_assert("ERROR: bad zone maps after appending to an unpacked "
+            "super-chunk", check_zonemaps(unpacked, ns, NCHUNKS + 1));
+  blosc2_destroy_schunk(unpacked);
+
+  /* Chunks appended to the packed super-chunk have no zone maps */
+  packed = blosc2_packed_append_buffer(packed, 4, CHUNKSIZE, data);
+  mu_assert("ERROR: packed append failed", packed != NULL);
+  mu_assert("ERROR: packed chunk roundtrip not successful",
+            (blosc2_packed_decompress_chunk(packed, NCHUNKS, &chunk) ==
+             CHUNKSIZE) && (memcmp(data, chunk, CHUNKSIZE) == 0));
+  free(chunk);
+  unpacked = blosc2_unpack_schunk(packed);
+  mu_assert("ERROR: stale zone maps are unpacked",
+            blosc2_schunk_zonemap_query(unpacked, 0, 1, chunks,
+                                        NCHUNKS) < 0);
+  mu_assert("ERROR: bad appended chunk",
+            (blosc2_decompress_chunk(unpacked, NCHUNKS, dest,
+                                     CHUNKSIZE) == CHUNKSIZE) &&
+            (memcmp(data, dest, CHUNKSIZE) == 0));
+  blosc2_destroy_schunk(unpacked);
+
+  /* Changing the chunks of a packed super-chunk updates its zone maps */
+  free(packed);
+  packed = blosc2_pack_schunk(schunk);
+  chunk = malloc(CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  ns[3] = 20;
+  fill_chunk(data, ns[3]);
+  blosc_compress(5, BLOSC_SHUFFLE, 4, CHUNKSIZE, data, chunk,
+                 CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  packed = blosc2_packed_update_chunk(packed, 3, chunk);
+  mu_assert("ERROR: packed update failed", packed != NULL);
+  memmove(ns + 1, ns, NCHUNKS * sizeof(int));
+  ns[0] = 30;
+  fill_chunk(data, ns[0]);
+  blosc_compress(5, BLOSC_SHUFFLE, 4, CHUNKSIZE, data, chunk,
+                 CHUNKSIZE + BLOSC_MAX_OVERHEAD);
+  packed = blosc2_packed_insert_chunk(packed, 0, chunk);
+  mu_assert("ERROR: packed insert failed", packed != NULL);
+  free(chunk);
+  memmove(ns + 5, ns + 6, (NCHUNKS - 5) * sizeof(int));
+  packed = blosc2_packed_delete_chunk(packed, 5);
+  mu_assert("ERROR: packed delete failed", packed != NULL);
+  packed = blosc2_packed_compact(packed);
+  mu_assert("ERROR: packed compaction failed", packed != NULL);
+  unpacked = blosc2_unpack_schunk(packed);
+  mu_assert("ERROR: bad zone maps after changing a packed super-chunk",
+            check_zonemaps(unpacked, ns, NCHUNKS));
+  mu_assert("ERROR: bad query after changing a packed super-chunk",
+            (blosc2_schunk_zonemap_query(unpacked, 20000, 30999, chunks,
+                                         NCHUNKS) == 2) &&
+            (chunks[0] == 0) && (chunks[1] == 4));
+  fill_chunk(data, ns[4]);
+  mu_assert("ERROR: bad updated chunk",
+            (blosc2_decompress_chunk(unpacked, 4, dest,
+                                     CHUNKSIZE) == CHUNKSIZE) &&
+            (memcmp(data, dest, CHUNKSIZE) == 0));
+  blosc2_destroy_schunk(unpacked);
+
+  free(packed);
+  blosc2_destroy_schunk(schunk);
+  return 0;
+}
+
+
+static char *all_tests() {
+  mu_run_test(test_query);
+  mu_run_test(test_changes);
+  mu_run_test(test_nans);
+  mu_run_test(test_pack);
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  char *result;
+
+  printf("STARTING TESTS for %s", argv[0]);
+
+  blosc_init();
+
+  /* Initialize buffers */
+  data = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+  dest = blosc_test_malloc(BUFFER_ALIGN_SIZE, CHUNKSIZE);
+
+  /* Run all the suite */
+  result = all_tests();
+  if (result != 0) {
+    printf(" (%s)\n", result);
+  }
+  else {
+    printf(" ALL TESTS PASSED");
+  }
+  printf("\tTests run: %d\n", tests_run);
+
+  blosc_test_free(data);
+  blosc_test_free(dest);
+
+  blosc_destroy();
+
+  return result != 0;
+}